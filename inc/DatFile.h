@@ -0,0 +1,53 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#ifndef DATFILE_H
+#define DATFILE_H
+
+//
+// CustomizeToolbar.dat reader and writer - for all historical formats
+// (see format description at top of PluginDefinition.cpp)
+//
+// No Windows dependencies, so that it is shared by the plugin and by the offline DatTool (tools\DatTool.cpp)
+//
+
+#include <stddef.h>
+
+#define DATFORMAT_UNKNOWN 0
+#define DATFORMAT_V12 1  /* versions 1.2-1.9 - no menu item states */
+#define DATFORMAT_V20 2  /* version 2.0 - wrap toolbar menu item state at end */
+#define DATFORMAT_V30 3  /* versions 3.0-3.9 and 4.3-5.3 - menu item states at start (current format) */
+#define DATFORMAT_V310 4  /* versions 3.10-4.2 - margin button states at end */
+
+#define DATMAXBUTTONS 300
+#define DATMAXSIZE ((4+DATMAXBUTTONS+DATMAXBUTTONS+3)*4)  /* largest .dat file in bytes */
+
+typedef struct
+{
+    int format;  /* DATFORMAT_... detected when parsed */
+    int customButtonsState;  /* custom buttons menu item state (0 or non-zero) */
+    int wrapToolbarState;  /* wrap toolbar menu item state (0 or non-zero) */
+    int buttonsOnToolbar;
+    int buttonsAvailable;
+    unsigned int toolbar[DATMAXBUTTONS];  /* each button on toolbar (cmdid or menuhash) */
+    unsigned int available[DATMAXBUTTONS];  /* each button available (cmdid or menuhash) */
+    int marginStates[3];  /* line number, bookmark and folder margin button states (3.10-4.2 only) */
+} DATLAYOUT;
+
+//
+// Detect format and decode .dat file contents - returns DATFORMAT_UNKNOWN (and empty layout) if not recognised
+//
+int parseDatLayout(const unsigned char *data, size_t size, DATLAYOUT *layout);
+
+//
+// Encode layout in current format - returns number of bytes written to data (at most DATMAXSIZE)
+//
+size_t formatDatLayout(const DATLAYOUT *layout, unsigned char *data);
+
+//
+// Name of format for display
+//
+const char *datFormatName(int format);
+
+#endif //DATFILE_H
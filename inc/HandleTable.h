@@ -0,0 +1,52 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#ifndef HANDLETABLE_H
+#define HANDLETABLE_H
+
+//
+// Table of bitmap and icon handles owned by the plugin, with live and peak counts (shown in Resource Usage)
+//
+// No Windows dependencies - the plugin guards the table with a critical section and frees each handle
+// taken from it (DeleteObject or DestroyIcon by kind)
+//
+
+#define HANDLEKIND_BITMAP 0  /* HBITMAP - freed with DeleteObject */
+#define HANDLEKIND_ICON 1  /* HICON - freed with DestroyIcon */
+#define HANDLEKINDS 2
+#define TRACKEDMAX 1024  /* handles owned by plugin at once - 27 additional buttons and 100 custom buttons need about 400 */
+
+typedef struct
+{
+    void *handle;
+    int kind;  /* HANDLEKIND_... */
+} TRACKEDHANDLE;
+
+typedef struct
+{
+    TRACKEDHANDLE handles[TRACKEDMAX];
+    int count;
+    int live[HANDLEKINDS];
+    int peak[HANDLEKINDS];
+    int created;
+    int freed;
+    int untracked;  /* added when table full (never freed by plugin) */
+} HANDLETABLE;
+
+//
+// Add handle - returns false (and counts it untracked) if table is full
+//
+bool addTrackedHandle(HANDLETABLE *table, void *handle, int kind);
+
+//
+// Remove handle - returns its kind (to be freed by caller), or -1 if not in table
+//
+int removeTrackedHandle(HANDLETABLE *table, void *handle);
+
+//
+// Remove most recently added handle - returns its kind (to be freed by caller), or -1 if table is empty
+//
+int popTrackedHandle(HANDLETABLE *table, void **handle);
+
+#endif //HANDLETABLE_H
@@ -0,0 +1,115 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#ifndef ICONIMAGE_H
+#define ICONIMAGE_H
+
+//
+// Decoded custom button images and CustomizeToolbar.atlas reader and writer
+// (see format description at top of PluginDefinition.cpp)
+//
+// No Windows dependencies - the plugin converts images to and from bitmaps and icons
+//
+
+#include <stddef.h>
+
+#define ICONTYPE_BITMAP 1  /* standard .bmp image */
+#define ICONTYPE_ICON 2  /* fluent light or dark .ico image */
+
+#define ICONMAXSIZE 256  /* largest width or height of decoded image */
+#define ICONATLASMAX 300  /* 100 custom buttons, 3 images per button */
+#define ICONSOURCEMAX 128  /* largest icon frame kept as source (fluent icons up to 400%) - larger frames are reduced */
+
+#define QUICKCODEMAXLABEL 2  /* characters of quick code label shown on button */
+
+typedef struct
+{
+    int width;
+    int height;
+    const unsigned int *pixels;  /* BGRA with straight alpha (0xAARRGGBB), top row first - not premultiplied, as CreateIconIndirect and image lists take it */
+} ICONIMAGE;
+
+typedef struct
+{
+    unsigned int keyHash;  /* hash of file name (see calcIconKeyHash) */
+    unsigned int type;  /* ICONTYPE_... */
+    unsigned long long fileTime;  /* last write time of file when decoded */
+    unsigned long long fileSize;
+    ICONIMAGE image;
+} ICONATLASENTRY;
+
+//
+// Hash of file name (case-insensitive, so that any spelling of the same file matches)
+//
+unsigned int calcIconKeyHash(const wchar_t *fileName);
+
+//
+// Hash of image contents (size and pixels) - identical images have the same hash, so images decoded from
+// different files (or rendered from different quick codes) are found to share one handle (different images can
+// have the same hash, so confirmed by sameIconImage)
+//
+unsigned long long calcIconContentHash(const ICONIMAGE *image);
+
+//
+// Same size and pixels
+//
+bool sameIconImage(const ICONIMAGE *image, const ICONIMAGE *other);
+
+//
+// Decode atlas file contents - returns number of entries (pixels point into data), or zero if not recognised or stamp differs
+//
+int parseIconAtlas(const unsigned char *data, size_t size, unsigned int stamp, ICONATLASENTRY *entries, int maxEntries);
+
+//
+// Find entry decoded from same file (unchanged since) - returns index, or -1 if none
+//
+int findIconAtlasEntry(const ICONATLASENTRY *entries, int count, unsigned int keyHash, unsigned int type, unsigned long long fileTime, unsigned long long fileSize);
+
+//
+// Size of atlas file for entries in bytes
+//
+size_t iconAtlasSize(const ICONATLASENTRY *entries, int count);
+
+//
+// Encode entries - returns number of bytes written to data (as iconAtlasSize)
+//
+size_t formatIconAtlas(const ICONATLASENTRY *entries, int count, unsigned int stamp, unsigned char *data);
+
+//
+// Decode quick code (*color:label) - color is 0xRRGGBB (grey if missing or not recognised), label is at most two characters
+//
+void parseQuickCode(const wchar_t *text, unsigned int *color, wchar_t label[QUICKCODEMAXLABEL+1]);
+
+//
+// Render quick code image - tile of color with white label (bitmap font) on background (0 for transparent)
+// into size*size pixels, size 16 (bitmap) or 32 (icon) or any size from 16 up to ICONMAXSIZE (font scaled by size/16)
+//
+void renderQuickCode(unsigned int color, const wchar_t *label, int size, unsigned int background, unsigned int *pixels);
+
+//
+// Size of largest frame listed in .ico file contents (icon directory only) - returns zero if not recognised
+//
+int findLargestIconFrame(const unsigned char *data, size_t size);
+
+//
+// Resample image into width*height pixels - triangle filter on premultiplied alpha (linear when enlarging,
+// wide enough to cover every source pixel when reducing), SSE2 when available
+//
+void resampleIconImage(const ICONIMAGE *source, int width, int height, unsigned int *pixels);
+
+//
+// Disabled look of image - grey of same brightness, and half as opaque (unless opaque, for bitmaps without alpha)
+//
+void makeDisabledIconImage(unsigned int *pixels, int count, bool opaque);
+
+//
+// Decode .bmp file contents (8, 24 or 32 bits per pixel, uncompressed) into image with pixels allocated by new[] -
+// for 8 bits per pixel (palette) key color (bottom-left pixel) is replaced by background (0 for transparent), and if shades
+// is not NULL greys 0x808080, 0xC0C0C0 and 0xDFDFDF are replaced by shades[0..2] (as LR_LOADTRANSPARENT and LR_LOADMAP3DCOLORS,
+// which only change color table) - alpha of 32 bits per pixel is kept (straight) only if background is transparent -
+// returns false if not recognised
+//
+bool decodeBitmapImage(const unsigned char *data, size_t size, unsigned int background, const unsigned int *shades, ICONIMAGE *image);
+
+#endif //ICONIMAGE_H
@@ -0,0 +1,109 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#ifndef LAYOUTSYNC_H
+#define LAYOUTSYNC_H
+
+//
+// Toolbar layout deltas (for CustomizeToolbar.jnl and undo/redo) and the channel shared between instances
+// of Notepad++ (see format descriptions at top of PluginDefinition.cpp)
+//
+// No Windows dependencies - the plugin maps the channel into shared memory, guards it with a named mutex,
+// and applies deltas to the toolbar; tests use an ordinary struct and mutex as stand-in
+//
+
+#define JOURNALOP_MARKER 0
+#define JOURNALOP_INSERT 1
+#define JOURNALOP_DELETE 2
+#define JOURNALOP_MOVE 3
+#define JOURNALFLAG_GROUPEND 0x0004  /* last delta of one layout change */
+
+#define LAYOUTMAXBUTTONS 300
+
+#define SYNCSIGNATURE 0x314E5953  /* "SYN1" */
+#define SYNCMAXDELTAS 1024  /* deltas in shared ring */
+#define SYNCMAXINSTANCES 32  /* instances of Notepad++ attached to shared channel */
+
+#define MAKEDELTACODE(op, toIndex, groupEnd) ((unsigned short) ((op) | ((groupEnd) ? JOURNALFLAG_GROUPEND : 0) | ((toIndex) << 3)))
+#define DELTAOP(delta) ((delta).code & 0x0003)
+#define DELTATOINDEX(delta) ((delta).code >> 3)
+#define DELTAGROUPEND(delta) ((delta).code & JOURNALFLAG_GROUPEND)
+
+#ifdef _WIN32
+typedef unsigned long LAYOUTID;  /* DWORD - so plugin layouts are passed as they are */
+#else
+typedef unsigned int LAYOUTID;  /* 32 bits, as DWORD */
+#endif
+
+typedef struct
+{
+    unsigned short code;  /* op, end of change flag and to index (move) */
+    unsigned short index;  /* toolbar index (insert/delete/move) or marker type */
+    LAYOUTID identity;  /* identity of button (cmdid or menuhash) */
+} JOURNALDELTA;
+
+typedef struct
+{
+    unsigned int signature;  /* SYNCSIGNATURE when channel initialised */
+    unsigned int version;  /* incremented for each published change */
+    unsigned int deltaTotal;  /* deltas published since channel created - delta n is in ring[n % SYNCMAXDELTAS] */
+    unsigned int resetPos;  /* deltas before this position cannot be applied incrementally (full layout published) */
+    int customButtonsState;
+    int wrapToolbarState;
+    int layoutCount;
+    LAYOUTID layout[LAYOUTMAXBUTTONS];  /* latest layout - identities of buttons on toolbar */
+    unsigned int instances[SYNCMAXINSTANCES];  /* process identifier of each attached instance (0 = free) */
+    JOURNALDELTA ring[SYNCMAXDELTAS];
+} SYNCCHANNEL;
+
+typedef struct
+{
+    unsigned int version;  /* version of channel last synchronized with */
+    unsigned int deltaPos;  /* position in ring last synchronized with */
+} SYNCPOSITION;
+
+typedef struct
+{
+    SYNCPOSITION position;  /* position once change is applied */
+    int customButtonsState;
+    int wrapToolbarState;
+    int deltaCount;  /* deltas since last synchronized, or -1 if no longer in ring (full layout must be applied) */
+    JOURNALDELTA deltas[SYNCMAXDELTAS];
+    int layoutCount;
+    LAYOUTID layout[LAYOUTMAXBUTTONS];
+} SYNCCHANGE;
+
+//
+// Deltas that change old layout into new layout (deletes, then moves and inserts in toolbar order) - returns number of deltas
+// (at most oldCount+newCount), with end of change flag on last
+//
+int calcLayoutDeltas(const LAYOUTID oldLayout[], int oldCount, const LAYOUTID newLayout[], int newCount, JOURNALDELTA deltas[]);
+
+//
+// Apply one delta to layout - returns false (and leaves layout unchanged) if it does not fit layout
+//
+bool applyLayoutDelta(LAYOUTID layout[], int *count, int op, int index, int toIndex, LAYOUTID identity);
+
+//
+// Attach to channel (caller holds channel lock) - first instance publishes its own layout and returns true,
+// otherwise position is set so that next change read is the full layout of the channel
+//
+bool attachSyncChannel(SYNCCHANNEL *channel, SYNCPOSITION *position, const LAYOUTID layout[], int layoutCount,
+                       int customButtonsState, int wrapToolbarState);
+
+//
+// Publish change (caller holds channel lock) - deltas are relative to layout at position, and if changes by other instances
+// have not been read since (or too many deltas) only the full layout is published, so other instances do not apply earlier
+// deltas incrementally - without deltas only menu item states are published
+//
+void publishSyncChange(SYNCCHANNEL *channel, SYNCPOSITION *position, const JOURNALDELTA deltas[], int deltaCount,
+                       const LAYOUTID layout[], int layoutCount, int customButtonsState, int wrapToolbarState);
+
+//
+// Copy change published since position (caller holds channel lock, and applies copy after releasing it) - returns false
+// if nothing published since
+//
+bool readSyncChange(const SYNCCHANNEL *channel, const SYNCPOSITION *position, SYNCCHANGE *change);
+
+#endif //LAYOUTSYNC_H
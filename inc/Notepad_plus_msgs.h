@@ -295,17 +295,29 @@ enum winVer{WV_UNKNOWN, WV_WIN32S, WV_95, WV_98, WV_ME, WV_NT, WV_W2K, WV_XP, WV
 	// fullPathName2Open indicates the full file path name to be opened.
 	// The return value is TRUE (1) if the operation is successful, otherwise FALSE (0).
 
-    #define NPPM_ADDTOOLBARICON_FORDARKMODE (NPPMSG + 101)
-    // VOID NPPM_ADDTOOLBARICON_FORDARKMODE(UINT funcItem[X]._cmdID, toolbarIconsWithDarkMode iconHandles)
-    // Use NPPM_ADDTOOLBARICON_FORDARKMODE instead obsolete NPPM_ADDTOOLBARICON which doesn't support the dark mode
-    // 2 formats / 3 icons are needed:  1 * BMP + 2 * ICO 
-    // All 3 handles below should be set so the icon will be displayed correctly if toolbar icon sets are changed by users, also in dark mode
-
-struct toolbarIconsWithDarkMode {
-    HBITMAP	hToolbarBmp;
-    HICON	hToolbarIcon;
-    HICON	hToolbarIconDarkMode;
-};
+	#define NPPM_ADDTOOLBARICON_FORDARKMODE (NPPMSG + 101)
+	// VOID NPPM_ADDTOOLBARICON_FORDARKMODE(UINT funcItem[X]._cmdID, toolbarIconsWithDarkMode iconHandles)
+	// Use NPPM_ADDTOOLBARICON_FORDARKMODE instead obsolete NPPM_ADDTOOLBARICON which doesn't support the dark mode
+	// 2 formats / 3 icons are needed:  1 * BMP + 2 * ICO 
+	// All 3 handles below should be set so the icon will be displayed correctly if toolbar icon sets are changed by users, also in dark mode
+		struct toolbarIconsWithDarkMode {
+			HBITMAP	hToolbarBmp;
+			HICON	hToolbarIcon;
+			HICON	hToolbarIconDarkMode;
+		};
+
+	#define NPPM_ISDARKMODEENABLED (NPPMSG + 107)
+	// bool NPPM_ISDARKMODEENABLED(0, 0)
+	// Returns true when Notepad++ Dark Mode is enable, false when it is not.
+
+	#define NPPM_GETTOOLBARICONSETCHOICE (NPPMSG + 118)
+	// int NPPM_GETTOOLBARICONSETCHOICE(0, 0)
+	// Get Notepad++ toolbar icon set choice (Fluent UI small, Fluent UI large, Filled Fluent UI small, Filled Fluent UI large and Standard icons small.)
+	// Return value: 0: Fluent UI small
+	//               1: Fluent UI large
+	//               2: Filled Fluent UI small
+	//               3: Filled Fluent UI large
+	//               4: Standard icons small
 
 #define	RUNCOMMAND_USER    (WM_USER + 3000)
 	#define NPPM_GETFULLCURRENTPATH		(RUNCOMMAND_USER + FULL_CURRENT_PATH)
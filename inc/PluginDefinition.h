@@ -26,7 +26,7 @@ const TCHAR NPP_PLUGIN_NAME[] = TEXT("Customize Toolbar");
 //
 // Here define the number of your plugin commands
 //
-const int nbFunc = 9;
+const int nbFunc = 14;
 
 
 //
@@ -64,10 +64,15 @@ void addMenuCommands();
 void addToolbarButtons();
 void afterNppReady();
 void bufferActivated();
+void documentStateChanged(UINT notification);
 void beforeNppShutdown();
 void customizeToolbar();
 void customButtons();
 void wrapToolbar();
+void undoLayoutChange();
+void redoLayoutChange();
+void exportLayout();
+void importLayout();
 void helpOverview();
 void helpCustomButtons();
 void resourceUsage();
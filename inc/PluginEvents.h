@@ -0,0 +1,87 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#ifndef PLUGINEVENTS_H
+#define PLUGINEVENTS_H
+
+//
+// Sequencing of plugin events - lifecycle stages (see sequence of events in CustomizeToolbar.cpp), generations
+// of layout passes, and writes deferred while state is read
+//
+// No Windows dependencies - the plugin drives these from Notepad++ notifications and its window procedures,
+// tests drive them with simulated sequences of events
+//
+
+#define LIFECYCLE_LOADED 0  /* plugin loaded - before setInfo */
+#define LIFECYCLE_MENUS 1  /* setInfo - menu commands added */
+#define LIFECYCLE_TOOLBAR 2  /* NPPN_TBMODIFICATION - additional and custom buttons added */
+#define LIFECYCLE_READY 3  /* NPPN_READY - window subclassed, waiting for startup readiness */
+#define LIFECYCLE_STARTED 4  /* toolbar restored - UI events, layout changes and synchronization handled */
+#define LIFECYCLE_SHUTDOWN 5  /* NPPN_SHUTDOWN - layout saved (if started) */
+#define LIFECYCLESTAGES 6
+
+typedef struct
+{
+    int stage;  /* LIFECYCLE_... - each stage entered once, in order */
+    int rejected;  /* notifications ignored because repeated or out of order */
+} LIFECYCLE;
+
+typedef struct
+{
+    unsigned int generation;  /* incremented by each resize or changed icons event */
+    unsigned int passGeneration;  /* generation of layout pass in progress */
+    bool active;  /* layout pass in progress */
+    bool stale;  /* layout pass in progress overtaken by newer geometry */
+    int started;
+    int aborted;  /* stopped at checkpoint - remaining work left to pass for newer event */
+} LAYOUTPASSES;
+
+typedef struct
+{
+    int readers;  /* customize dialog box or overflow menu open - reading preserved buttons and toolbar */
+    unsigned int deferred;  /* writes (bit per kind, assigned by caller) to be made when last reader finishes */
+    int writesDeferred;
+} STATEREADERS;
+
+//
+// Enter stage - only from the stage before it, shutdown from any stage - returns false (and counts rejection)
+// if repeated or out of order, so each startup pass runs exactly once
+//
+bool advanceLifecycle(LIFECYCLE *lifecycle, int stage);
+
+//
+// Layout pass (wrap/overflow and ideal size after resize or changed icons) - newer geometry makes pass in progress stale,
+// and its remaining work is left to the pass for the newer event
+//
+void newLayoutGeneration(LAYOUTPASSES *passes);
+void beginLayoutPass(LAYOUTPASSES *passes);
+
+//
+// Checkpoint - returns true if newer geometry received since pass began (and from then on, until pass ends)
+// Always false outside layout passes (menu commands are not aborted)
+//
+bool layoutPassStale(LAYOUTPASSES *passes);
+
+//
+// Returns false if pass was stale (so it is repeated for latest geometry)
+//
+bool endLayoutPass(LAYOUTPASSES *passes);
+
+//
+// Readers of preserved buttons and toolbar (modal loops, which dispatch timers and posted messages) - writes which
+// would rebuild them are deferred while any reader is open, and each is made once when the last reader finishes
+//
+void enterStateRead(STATEREADERS *readers);
+
+//
+// Returns true if write was deferred (caller skips it)
+//
+bool deferStateWrite(STATEREADERS *readers, unsigned int write);
+
+//
+// Returns deferred writes if last reader finished (each returned once), otherwise 0
+//
+unsigned int leaveStateRead(STATEREADERS *readers);
+
+#endif //PLUGINEVENTS_H
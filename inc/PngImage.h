@@ -0,0 +1,21 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#ifndef PNGIMAGE_H
+#define PNGIMAGE_H
+
+//
+// PNG decoder for custom button images (with its own inflate - no zlib or Windows dependencies)
+//
+
+#include "IconImage.h"
+
+//
+// Decode .png file contents (any color type and bit depth, interlaced or not, at most ICONMAXSIZE wide and high)
+// into image with pixels allocated by new[] - composited on background if it is opaque (0xFF......), otherwise
+// straight alpha - returns false if not recognised or damaged
+//
+bool decodePngImage(const unsigned char *data, size_t size, unsigned int background, ICONIMAGE *image);
+
+#endif //PNGIMAGE_H
@@ -3,63 +3,9 @@
 // Used by Resources.rc
 //
 
-#define IDB_AUTO_WORDCOMPLETE           101 // auto_wordcomplete.bmp
-#define IDB_BLANK_SPACETOTAB            102 // blank_spacetotab.bmp
-#define IDB_BLANK_TABTOSPACE            103 // blank_tabtospace.bmp
-#define IDB_BLANK_TRIMTRAILING          104 // blank_trimtrailing.bmp
-#define IDB_BOOKMARK_CLEAR              105 // bookmark_clear.bmp
-#define IDB_BOOKMARK_NEXT               106 // bookmark_next.bmp
-#define IDB_BOOKMARK_PREV               107 // bookmark_prev.bmp
-#define IDB_CLONE_CLONETOOTHER          108 // clone_clonetoother.bmp
-#define IDB_COMMENT_CLEAR               109 // comment_clear.bmp
-#define IDB_COMMENT_SET                 110 // comment_set.bmp
-#define IDB_CUSTOMIZE_TOOLBAR           111 // customize_toolbar.bmp
-#define IDB_CUSTOM_BACKGROUND16         112 // custom_background16.bmp
-#define IDB_CUSTOM_BACKGROUND32         113 // custom_background32.bmp
+#define IDB_ADDITIONAL_BUTTONS          112 // additional_buttons.bmp (strip generated by tools\StripTool.cpp)
+#define IDB_ADDITIONAL_ICONS            113 // additional_icons.bmp (strip generated by tools\StripTool.cpp)
 #define IDB_CUSTOM_MISSINGFILE          114 // custom_missingfile.bmp
-#define IDB_EDIT_DELETE                 115 // edit_delete.bmp
-#define IDB_FILE_CLOSEALLBUT            116 // file_closeallbut.bmp
-#define IDB_INDENT_DECREASE             117 // indent_decrease.bmp
-#define IDB_INDENT_INCREASE             118 // indent_increase.bmp
-#define IDB_LINE_DUPLICATE              119 // line_duplicate.bmp
-#define IDB_MOVE_MOVETOOTHER            120 // move_movetoother.bmp
-#define IDB_SEARCH_FINDINFILES          121 // search_findinfiles.bmp
-#define IDB_SEARCH_FINDNEXT             122 // search_findnext.bmp
-#define IDB_SEARCH_FINDPREV             123 // search_findprev.bmp
-#define IDB_SEARCH_GOTO                 124 // search_goto.bmp
-#define IDB_SEARCH_INCREMENTAL          125 // search_incremental.bmp
-#define IDB_SEARCH_RESULTS              126 // search_results.bmp
-#define IDB_VIEW_FOLDALL                127 // view_foldall.bmp
-#define IDB_VIEW_HIDELINES              128 // view_hidelines.bmp
-#define IDB_VIEW_UNFOLDALL              129 // view_unfoldall.bmp
-#define IDB_ZOOM_RESTORE                130 // zoom_restore.bmp
 
-#define IDI_AUTO_WORDCOMPLETE           132 // auto_wordcomplete.ico
-#define IDI_BLANK_SPACETOTAB            133 // blank_spacetotab.ico
-#define IDI_BLANK_TABTOSPACE            134 // blank_tabtospace.ico
-#define IDI_BLANK_TRIMTRAILING          135 // blank_trimtrailing.ico
-#define IDI_BOOKMARK_CLEAR              136 // bookmark_clear.ico
-#define IDI_BOOKMARK_NEXT               137 // bookmark_next.ico
-#define IDI_BOOKMARK_PREV               138 // bookmark_prev.ico
-#define IDI_CLONE_CLONETOOTHER          139 // clone_clonetoother.ico
-#define IDI_COMMENT_CLEAR               140 // comment_clear.ico
-#define IDI_COMMENT_SET                 141 // comment_set.ico
-#define IDI_CUSTOMIZE_TOOLBAR           142 // customize_toolbar.ico
 #define IDI_CUSTOM_FAILEDMATCH          143 // custom_failedmatch.ico
 #define IDI_CUSTOM_MISSINGFILE          144 // custom_missingfile.ico
-#define IDI_EDIT_DELETE                 145 // edit_delete.ico
-#define IDI_FILE_CLOSEALLBUT            146 // file_closeallbut.ico
-#define IDI_INDENT_DECREASE             147 // indent_decrease.ico
-#define IDI_INDENT_INCREASE             148 // indent_increase.ico
-#define IDI_LINE_DUPLICATE              149 // line_duplicate.ico
-#define IDI_MOVE_MOVETOOTHER            150 // move_movetoother.ico
-#define IDI_SEARCH_FINDINFILES          151 // search_findinfiles.ico
-#define IDI_SEARCH_FINDNEXT             152 // search_findnext.ico
-#define IDI_SEARCH_FINDPREV             153 // search_findprev.ico
-#define IDI_SEARCH_GOTO                 154 // search_goto.ico
-#define IDI_SEARCH_INCREMENTAL          155 // search_incremental.ico
-#define IDI_SEARCH_RESULTS              156 // search_results.ico
-#define IDI_VIEW_FOLDALL                157 // view_foldall.ico
-#define IDI_VIEW_HIDELINES              158 // view_hidelines.ico
-#define IDI_VIEW_UNFOLDALL              159 // view_unfoldall.ico
-#define IDI_ZOOM_RESTORE                160 // zoom_restore.ico
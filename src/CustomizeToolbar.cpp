@@ -20,9 +20,17 @@ HANDLE		g_hModule;
 //      setInfo()                               >>  commandMenuInit()       addMenuCommands()
 //      beNotified()    NPPN_TBMODIFICATION     >>                          addToolbarButtons()
 //      beNotified()    NPPN_READY              >>                          afterNppReady()
+//      WM_TIMER        startup ready           >>                          afterNppReadyDelayed()
 //      beNotified()    NPPN_BUFFERACTIVATED    >>                          bufferActivated()
+//      beNotified()    NPPN_READONLYCHANGED    >>                          documentStateChanged()
+//      beNotified()    NPPN_FILESAVED          >>                          documentStateChanged()
+//      beNotified()    SCN_SAVEPOINTREACHED    >>                          documentStateChanged()
+//      beNotified()    SCN_SAVEPOINTLEFT       >>                          documentStateChanged()
+//      beNotified()    SCN_UPDATEUI            >>                          documentStateChanged()
 //      beNotified()    NPPN_SHUTDOWN           >>  commandMenuCleanUp()    beforeNppShutdown()
 //      DllMain()       DLL_PROCESS_DETACH      >>  pluginCleanUp()
+//
+// Each stage is entered once, in this order (see enterLifecycleStage) - UI events are handled only once afterNppReadyDelayed() completes
 
 /* functions */
 
@@ -88,6 +96,19 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification *notifyCode)
             }
             break;
 
+            case NPPN_BUFFERACTIVATED:
+            {
+                bufferActivated();
+            }
+            break;
+
+            case NPPN_READONLYCHANGED:
+            case NPPN_FILESAVED:
+            {
+                documentStateChanged(notifyCode->nmhdr.code);
+            }
+            break;
+
             case NPPN_SHUTDOWN:
             {
                 commandMenuCleanUp();
@@ -95,6 +116,22 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification *notifyCode)
             }
             break;
 
+            default:
+            return;
+        }
+    }
+    else if (notifyCode->nmhdr.hwndFrom == nppData._scintillaMainHandle || notifyCode->nmhdr.hwndFrom == nppData._scintillaSecondHandle)
+    {
+        switch (notifyCode->nmhdr.code)
+        {
+            case SCN_SAVEPOINTREACHED:
+            case SCN_SAVEPOINTLEFT:
+            case SCN_UPDATEUI:
+            {
+                documentStateChanged(notifyCode->nmhdr.code);
+            }
+            break;
+
             default:
             return;
         }
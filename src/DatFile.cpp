@@ -0,0 +1,150 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Format detection:
+//
+//  - .dat file is a sequence of little-endian 32-bit values
+//  - versions 3.0+ start with two menu item states (0, 1 or -1) followed by the two button counts,
+//    and the file length must match the counts exactly, or with three margin button states (3.10-4.2)
+//  - versions 1.2-2.0 start with the two button counts, and the file length must match the counts
+//    exactly, or with one wrap toolbar menu item state (2.0)
+//  - current format is tried first, so a file is only taken as an older format if it cannot be current
+
+#include "DatFile.h"
+#include <string.h>
+
+// Local functions
+
+static unsigned int readValue(const unsigned char *data, size_t index);
+static void writeValue(unsigned char *data, size_t index, unsigned int value);
+static bool isMenuState(unsigned int value);
+static void readButtons(const unsigned char *data, size_t first, DATLAYOUT *layout);
+
+int parseDatLayout(const unsigned char *data, size_t size, DATLAYOUT *layout)
+{
+    size_t count;
+    unsigned int onToolbar, available;
+    int i;
+    
+    memset(layout, 0, sizeof(DATLAYOUT));
+    
+    if (size % 4 != 0 || size > DATMAXSIZE) return DATFORMAT_UNKNOWN;
+    count = size/4;
+    
+    // Versions 3.0-5.3
+    
+    if (count >= 4 && isMenuState(readValue(data, 0)) && isMenuState(readValue(data, 1)))
+    {
+        onToolbar = readValue(data, 2);
+        available = readValue(data, 3);
+        
+        if (onToolbar <= DATMAXBUTTONS && available <= DATMAXBUTTONS)
+        {
+            if (count == 4+onToolbar+available) layout->format = DATFORMAT_V30;
+            else if (count == 4+onToolbar+available+3 && isMenuState(readValue(data, count-3)) &&
+                     isMenuState(readValue(data, count-2)) && isMenuState(readValue(data, count-1))) layout->format = DATFORMAT_V310;
+            
+            if (layout->format != DATFORMAT_UNKNOWN)
+            {
+                layout->customButtonsState = (int) readValue(data, 0);
+                layout->wrapToolbarState = (int) readValue(data, 1);
+                layout->buttonsOnToolbar = (int) onToolbar;
+                layout->buttonsAvailable = (int) available;
+                readButtons(data, 4, layout);
+                
+                if (layout->format == DATFORMAT_V310)
+                {
+                    for (i = 0; i < 3; i++) layout->marginStates[i] = (int) readValue(data, count-3+i);
+                }
+                
+                return layout->format;
+            }
+        }
+    }
+    
+    // Versions 1.2-2.0
+    
+    if (count >= 2)
+    {
+        onToolbar = readValue(data, 0);
+        available = readValue(data, 1);
+        
+        if (onToolbar <= DATMAXBUTTONS && available <= DATMAXBUTTONS)
+        {
+            if (count == 2+onToolbar+available) layout->format = DATFORMAT_V12;
+            else if (count == 2+onToolbar+available+1 && isMenuState(readValue(data, count-1))) layout->format = DATFORMAT_V20;
+            
+            if (layout->format != DATFORMAT_UNKNOWN)
+            {
+                layout->wrapToolbarState = (layout->format == DATFORMAT_V20) ? (int) readValue(data, count-1) : 0;
+                layout->buttonsOnToolbar = (int) onToolbar;
+                layout->buttonsAvailable = (int) available;
+                readButtons(data, 2, layout);
+                
+                return layout->format;
+            }
+        }
+    }
+    
+    return DATFORMAT_UNKNOWN;
+}
+
+size_t formatDatLayout(const DATLAYOUT *layout, unsigned char *data)
+{
+    size_t index;
+    int i;
+    
+    index = 0;
+    
+    writeValue(data, index++, (unsigned int) layout->customButtonsState);
+    writeValue(data, index++, (unsigned int) layout->wrapToolbarState);
+    writeValue(data, index++, (unsigned int) layout->buttonsOnToolbar);
+    writeValue(data, index++, (unsigned int) layout->buttonsAvailable);
+    
+    for (i = 0; i < layout->buttonsOnToolbar; i++) writeValue(data, index++, layout->toolbar[i]);
+    for (i = 0; i < layout->buttonsAvailable; i++) writeValue(data, index++, layout->available[i]);
+    
+    return index*4;
+}
+
+const char *datFormatName(int format)
+{
+    switch (format)
+    {
+        case DATFORMAT_V12: return "1.2-1.9";
+        case DATFORMAT_V20: return "2.0";
+        case DATFORMAT_V30: return "3.0-5.3";
+        case DATFORMAT_V310: return "3.10-4.2";
+    }
+    
+    return "unknown";
+}
+
+static unsigned int readValue(const unsigned char *data, size_t index)
+{
+    data += index*4;
+    return (unsigned int) data[0] | ((unsigned int) data[1] << 8) | ((unsigned int) data[2] << 16) | ((unsigned int) data[3] << 24);
+}
+
+static void writeValue(unsigned char *data, size_t index, unsigned int value)
+{
+    data += index*4;
+    data[0] = (unsigned char) value;
+    data[1] = (unsigned char) (value >> 8);
+    data[2] = (unsigned char) (value >> 16);
+    data[3] = (unsigned char) (value >> 24);
+}
+
+static bool isMenuState(unsigned int value)
+{
+    return value == 0 || value == 1 || value == 0xFFFFFFFF;  /* older versions saved 1, newer versions save ~0 */
+}
+
+static void readButtons(const unsigned char *data, size_t first, DATLAYOUT *layout)
+{
+    int i;
+    
+    for (i = 0; i < layout->buttonsOnToolbar; i++) layout->toolbar[i] = readValue(data, first+i);
+    for (i = 0; i < layout->buttonsAvailable; i++) layout->available[i] = readValue(data, first+layout->buttonsOnToolbar+i);
+}
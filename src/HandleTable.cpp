@@ -0,0 +1,58 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#include "HandleTable.h"
+
+bool addTrackedHandle(HANDLETABLE *table, void *handle, int kind)
+{
+    if (table->count >= TRACKEDMAX)
+    {
+        table->untracked++;
+        return false;
+    }
+    
+    table->handles[table->count].handle = handle;
+    table->handles[table->count].kind = kind;
+    table->count++;
+    
+    table->created++;
+    table->live[kind]++;
+    if (table->live[kind] > table->peak[kind]) table->peak[kind] = table->live[kind];
+    
+    return true;
+}
+
+int removeTrackedHandle(HANDLETABLE *table, void *handle)
+{
+    int i, kind;
+    
+    for (i = table->count-1; i >= 0; i--)  /* most recently added first (temporary bitmaps) */
+    {
+        if (table->handles[i].handle == handle)
+        {
+            kind = table->handles[i].kind;
+            table->handles[i] = table->handles[--table->count];
+            table->live[kind]--;
+            table->freed++;
+            return kind;
+        }
+    }
+    
+    return -1;
+}
+
+int popTrackedHandle(HANDLETABLE *table, void **handle)
+{
+    int kind;
+    
+    if (table->count == 0) return -1;
+    
+    table->count--;
+    *handle = table->handles[table->count].handle;
+    kind = table->handles[table->count].kind;
+    table->live[kind]--;
+    table->freed++;
+    
+    return kind;
+}
@@ -0,0 +1,719 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Atlas validation:
+//
+//  - .atlas file is a header followed by entries, each a fixed-size entry header and its pixels
+//  - header stamp must match current stamp (system colors and icon size used when decoded),
+//    otherwise every image would have to be decoded again anyway, so the atlas is not recognised
+//  - every entry must lie entirely within the file, so a truncated atlas is never read past its end
+//  - entry headers and pixels are multiples of 4 bytes, so pixels of a mapped atlas are aligned
+
+// Quick code rendering:
+//
+//  - tile fills all rows except the top and bottom row (two rows at 32x32), background elsewhere
+//  - label uses a 5x7 bitmap font scaled by size/16, centered on tile with one column (scaled) between characters
+//  - characters outside printable ASCII are drawn as '?'
+
+// Resampling:
+//
+//  - separable, horizontal pass into intermediate rows then vertical pass, each with weights computed once per output column or row
+//  - pixels are converted to premultiplied floats, so transparent pixels do not darken edges
+//  - each pixel is four floats, accumulated as one SSE2 vector (or four scalar floats without SSE2)
+//
+// Bitmap decoding:
+//
+//  - uncompressed .bmp with 8, 24 or 32 bits per pixel (BI_BITFIELDS only with standard masks), bottom-up or top-down
+//  - every row must lie entirely within the file, otherwise the bitmap is not recognised (plugin falls back to LoadImage)
+//  - key color (bottom-left pixel) and greys are replaced only for 8 bits per pixel - LR_LOADTRANSPARENT and
+//    LR_LOADMAP3DCOLORS only rewrite the color table, so 24 and 32 bit images are left as LoadImage leaves them
+//  - colors are replaced in the palette before pixels are expanded (4 palette entries per step with SSE2, else one)
+//  - replaced pixels are background, so a transparent key is 0 (premultiplied and straight alpha are the same)
+
+#include "IconImage.h"
+#include <string.h>
+
+#if !defined(IMAGENOSSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))  /* IMAGENOSSE2 for scalar paths (see test_resample) */
+#define IMAGESSE2
+#include <emmintrin.h>
+#endif
+
+#define ATLASSIGNATURE 0x31415443  /* "CTA1" */
+#define ATLASHEADERSIZE 16
+#define ATLASENTRYSIZE 32
+
+#define BITMAPFILEHEADERSIZE 14
+#define BITMAPINFOHEADERSIZE 40
+#define BITMAPKEYCOLORS 4  /* key and three shades of grey */
+
+#define FONTWIDTH 5
+#define FONTHEIGHT 7
+
+typedef struct
+{
+    int first;  /* first source pixel */
+    int count;  /* source pixels contributing */
+    int weights;  /* index of first weight */
+} RESAMPLESPAN;
+
+// Bitmap font - one byte per row (top row first), bit 4 is left column
+
+static const unsigned char g_font[95][FONTHEIGHT] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  /* space */
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },  /* ! */
+    { 0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00 },  /* " */
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A },  /* # */
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 },  /* $ */
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },  /* % */
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D },  /* & */
+    { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 },  /* ' */
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },  /* ( */
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },  /* ) */
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 },  /* * */
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },  /* + */
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 },  /* , */
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },  /* - */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },  /* . */
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },  /* / */
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },  /* 0 */
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },  /* 1 */
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },  /* 2 */
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },  /* 3 */
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },  /* 4 */
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },  /* 5 */
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },  /* 6 */
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },  /* 7 */
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },  /* 8 */
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },  /* 9 */
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },  /* : */
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 },  /* ; */
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },  /* < */
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },  /* = */
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },  /* > */
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },  /* ? */
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E },  /* @ */
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },  /* A */
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },  /* B */
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },  /* C */
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },  /* D */
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },  /* E */
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },  /* F */
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },  /* G */
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },  /* H */
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },  /* I */
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },  /* J */
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },  /* K */
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },  /* L */
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },  /* M */
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },  /* N */
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },  /* O */
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },  /* P */
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },  /* Q */
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },  /* R */
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },  /* S */
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  /* T */
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },  /* U */
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },  /* V */
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },  /* W */
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },  /* X */
+    { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },  /* Y */
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },  /* Z */
+    { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E },  /* [ */
+    { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },  /* backslash */
+    { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E },  /* ] */
+    { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 },  /* ^ */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F },  /* _ */
+    { 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 },  /* ` */
+    { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F },  /* a */
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E },  /* b */
+    { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E },  /* c */
+    { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F },  /* d */
+    { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E },  /* e */
+    { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 },  /* f */
+    { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E },  /* g */
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },  /* h */
+    { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E },  /* i */
+    { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C },  /* j */
+    { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 },  /* k */
+    { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },  /* l */
+    { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11 },  /* m */
+    { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },  /* n */
+    { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E },  /* o */
+    { 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10 },  /* p */
+    { 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01 },  /* q */
+    { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },  /* r */
+    { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E },  /* s */
+    { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 },  /* t */
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D },  /* u */
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04 },  /* v */
+    { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A },  /* w */
+    { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11 },  /* x */
+    { 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E },  /* y */
+    { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F },  /* z */
+    { 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 },  /* { */
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  /* | */
+    { 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 },  /* } */
+    { 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 }   /* ~ */
+};
+
+// Local functions
+
+static unsigned int readValue(const unsigned char *data);
+static void writeValue(unsigned char *data, unsigned int value);
+static unsigned int hexDigit(wchar_t c);
+static void calcResampleSpans(int sourceSize, int size, RESAMPLESPAN *spans, float *weights);
+static void resamplePass(const float *source, int lines, int sourceLineStep, int sourcePixelStep, float *dest, int size, int destLineStep, int destPixelStep, const RESAMPLESPAN *spans, const float *weights);
+static void replaceColors(unsigned int *pixels, int count, const unsigned int *from, const unsigned int *to, int colors);
+
+unsigned int calcIconKeyHash(const wchar_t *fileName)
+{
+    unsigned int hash;
+    wchar_t c;
+    
+    hash = 2166136261u;  /* FNV-1a */
+    
+    for (; *fileName; fileName++)
+    {
+        c = *fileName;
+        if (c >= L'A' && c <= L'Z') c = (wchar_t) (c - L'A' + L'a');
+        if (c == L'/') c = L'\\';
+        hash = (hash ^ (unsigned int) c) * 16777619u;
+    }
+    
+    return hash;
+}
+
+unsigned long long calcIconContentHash(const ICONIMAGE *image)
+{
+    unsigned long long hash;
+    int i, count;
+    
+    hash = 14695981039346656037ull;  /* FNV-1a (64-bit, a pixel at a time) */
+    
+    hash = (hash ^ (unsigned int) image->width) * 1099511628211ull;
+    hash = (hash ^ (unsigned int) image->height) * 1099511628211ull;
+    
+    count = image->width*image->height;
+    for (i = 0; i < count; i++) hash = (hash ^ image->pixels[i]) * 1099511628211ull;
+    
+    return hash;
+}
+
+bool sameIconImage(const ICONIMAGE *image, const ICONIMAGE *other)
+{
+    if (image->width != other->width || image->height != other->height) return false;
+    
+    return memcmp(image->pixels, other->pixels, (size_t) image->width*image->height*4) == 0;
+}
+
+int parseIconAtlas(const unsigned char *data, size_t size, unsigned int stamp, ICONATLASENTRY *entries, int maxEntries)
+{
+    size_t offset, pixelSize;
+    unsigned int count, width, height;
+    int i;
+    
+    if (size < ATLASHEADERSIZE || readValue(data) != ATLASSIGNATURE || readValue(data+4) != stamp) return 0;
+    
+    count = readValue(data+8);
+    if (count > (unsigned int) maxEntries) return 0;
+    
+    offset = ATLASHEADERSIZE;
+    
+    for (i = 0; i < (int) count; i++)
+    {
+        if (size - offset < ATLASENTRYSIZE) return 0;
+        
+        width = readValue(data+offset+24);
+        height = readValue(data+offset+28);
+        if (width == 0 || height == 0 || width > ICONMAXSIZE || height > ICONMAXSIZE) return 0;
+        
+        pixelSize = (size_t) width*height*4;
+        if (size - offset - ATLASENTRYSIZE < pixelSize) return 0;
+        
+        entries[i].keyHash = readValue(data+offset);
+        entries[i].type = readValue(data+offset+4);
+        entries[i].fileTime = readValue(data+offset+8) | ((unsigned long long) readValue(data+offset+12) << 32);
+        entries[i].fileSize = readValue(data+offset+16) | ((unsigned long long) readValue(data+offset+20) << 32);
+        entries[i].image.width = (int) width;
+        entries[i].image.height = (int) height;
+        entries[i].image.pixels = (const unsigned int *) (data+offset+ATLASENTRYSIZE);
+        
+        offset += ATLASENTRYSIZE + pixelSize;
+    }
+    
+    return (int) count;
+}
+
+int findIconAtlasEntry(const ICONATLASENTRY *entries, int count, unsigned int keyHash, unsigned int type, unsigned long long fileTime, unsigned long long fileSize)
+{
+    int i;
+    
+    for (i = 0; i < count; i++)
+    {
+        if (entries[i].keyHash == keyHash && entries[i].type == type && entries[i].fileTime == fileTime && entries[i].fileSize == fileSize) return i;
+    }
+    
+    return -1;
+}
+
+size_t iconAtlasSize(const ICONATLASENTRY *entries, int count)
+{
+    size_t size;
+    int i;
+    
+    size = ATLASHEADERSIZE;
+    for (i = 0; i < count; i++) size += ATLASENTRYSIZE + (size_t) entries[i].image.width*entries[i].image.height*4;
+    
+    return size;
+}
+
+size_t formatIconAtlas(const ICONATLASENTRY *entries, int count, unsigned int stamp, unsigned char *data)
+{
+    size_t offset, pixelSize;
+    int i;
+    
+    writeValue(data, ATLASSIGNATURE);
+    writeValue(data+4, stamp);
+    writeValue(data+8, (unsigned int) count);
+    writeValue(data+12, 0);
+    
+    offset = ATLASHEADERSIZE;
+    
+    for (i = 0; i < count; i++)
+    {
+        pixelSize = (size_t) entries[i].image.width*entries[i].image.height*4;
+        
+        writeValue(data+offset, entries[i].keyHash);
+        writeValue(data+offset+4, entries[i].type);
+        writeValue(data+offset+8, (unsigned int) entries[i].fileTime);
+        writeValue(data+offset+12, (unsigned int) (entries[i].fileTime >> 32));
+        writeValue(data+offset+16, (unsigned int) entries[i].fileSize);
+        writeValue(data+offset+20, (unsigned int) (entries[i].fileSize >> 32));
+        writeValue(data+offset+24, (unsigned int) entries[i].image.width);
+        writeValue(data+offset+28, (unsigned int) entries[i].image.height);
+        memcpy(data+offset+ATLASENTRYSIZE, entries[i].image.pixels, pixelSize);  /* pixels in native (little-endian) order */
+        
+        offset += ATLASENTRYSIZE + pixelSize;
+    }
+    
+    return offset;
+}
+
+void parseQuickCode(const wchar_t *text, unsigned int *color, wchar_t label[QUICKCODEMAXLABEL+1])
+{
+    static const wchar_t letters[] = L"SRGBCMY";  /* standard, red, green, blue, cyan, magenta, yellow */
+    static const unsigned int letterColors[] = { 0x808080, 0xB03030, 0x309030, 0x0050C0, 0x00A0A0, 0xA040A0, 0xB09000 };
+    const wchar_t *p;
+    unsigned int value, digit;
+    int i;
+    
+    *color = 0x808080;
+    
+    if (text[1] == 0 || text[1] == L':')  /* missing color code */
+    {
+    }
+    else if (text[2] == 0 || text[2] == L':')  /* letter color code */
+    {
+        for (i = 0; letters[i] != 0; i++) if (text[1] == letters[i]) *color = letterColors[i];
+    }
+    else if (text[1] == L'#')  /* hex color code */
+    {
+        value = 0;
+        for (i = 2; i < 8 && (digit = hexDigit(text[i])) < 16; i++) value = value*16 + digit;
+        if (i == 8) *color = value;
+    }
+    
+    // Label follows first colon
+    
+    for (p = text; *p != 0 && *p != L':'; p++);
+    if (*p == L':') p++;
+    
+    for (i = 0; i < QUICKCODEMAXLABEL && p[i] != 0; i++) label[i] = p[i];
+    label[i] = 0;
+}
+
+void renderQuickCode(unsigned int color, const wchar_t *label, int size, unsigned int background, unsigned int *pixels)
+{
+    const unsigned char *glyph;
+    unsigned int tile, text;
+    int scale, length, left, top, x, y, i;
+    
+    scale = size/16;
+    tile = 0xFF000000 | (color & 0x00FFFFFF);
+    text = 0xFFFFFFFF;
+    
+    for (y = 0; y < size; y++)
+    {
+        for (x = 0; x < size; x++) pixels[y*size+x] = (y >= scale && y < size-scale) ? tile : background;
+    }
+    
+    for (length = 0; length < QUICKCODEMAXLABEL && label[length] != 0; length++);
+    if (length == 0) return;
+    
+    left = (size - scale*(length*(FONTWIDTH+1)-1))/2;
+    top = (size - scale*FONTHEIGHT)/2;
+    
+    for (i = 0; i < length; i++)
+    {
+        glyph = g_font[(label[i] >= 32 && label[i] < 127) ? label[i]-32 : '?'-32];
+        
+        for (y = 0; y < FONTHEIGHT*scale; y++)
+        {
+            for (x = 0; x < FONTWIDTH*scale; x++)
+            {
+                if (glyph[y/scale] & (0x10 >> (x/scale))) pixels[(top+y)*size + left + i*(FONTWIDTH+1)*scale + x] = text;
+            }
+        }
+    }
+}
+
+int findLargestIconFrame(const unsigned char *data, size_t size)
+{
+    unsigned int count, i;
+    int frame, largest;
+    
+    if (size < 6 || data[0] != 0 || data[1] != 0 || data[2] != 1 || data[3] != 0) return 0;  /* reserved, type 1 (icon) */
+    
+    count = (unsigned int) data[4] | ((unsigned int) data[5] << 8);
+    
+    largest = 0;
+    for (i = 0; i < count && 6 + (i+1)*16 <= size; i++)
+    {
+        frame = data[6+i*16] ? data[6+i*16] : 256;  /* width 0 is 256 */
+        if (frame > largest) largest = frame;
+    }
+    
+    return largest;
+}
+
+void resampleIconImage(const ICONIMAGE *source, int width, int height, unsigned int *pixels)
+{
+    RESAMPLESPAN *spansX, *spansY;
+    float *weightsX, *weightsY, *premultiplied, *rows, *result, alpha, scale;
+    unsigned int pixel;
+    int i, c, count, radiusX, radiusY;
+    
+    // Weights - each output pixel covers at most 2*radius+3 source pixels
+    
+    radiusX = source->width/width + 1;
+    radiusY = source->height/height + 1;
+    
+    spansX = new RESAMPLESPAN[width];
+    spansY = new RESAMPLESPAN[height];
+    weightsX = new float[width*(2*radiusX+3)];
+    weightsY = new float[height*(2*radiusY+3)];
+    
+    calcResampleSpans(source->width, width, spansX, weightsX);
+    calcResampleSpans(source->height, height, spansY, weightsY);
+    
+    // Premultiply source
+    
+    count = source->width*source->height;
+    premultiplied = new float[count*4];
+    
+    for (i = 0; i < count; i++)
+    {
+        pixel = source->pixels[i];
+        alpha = (float) (pixel >> 24);
+        scale = alpha/255.0f;
+        premultiplied[i*4] = (float) (pixel & 0xFF)*scale;
+        premultiplied[i*4+1] = (float) ((pixel >> 8) & 0xFF)*scale;
+        premultiplied[i*4+2] = (float) ((pixel >> 16) & 0xFF)*scale;
+        premultiplied[i*4+3] = alpha;
+    }
+    
+    // Horizontal pass (source rows into intermediate rows of output width), then vertical pass (intermediate columns)
+    
+    rows = new float[source->height*width*4];
+    result = new float[width*height*4];
+    
+    resamplePass(premultiplied, source->height, source->width*4, 4, rows, width, width*4, 4, spansX, weightsX);
+    resamplePass(rows, width, 4, width*4, result, height, 4, width*4, spansY, weightsY);
+    
+    // Unpremultiply and round
+    
+    for (i = 0; i < width*height; i++)
+    {
+        alpha = result[i*4+3];
+        if (alpha < 0.5f)
+        {
+            pixels[i] = 0;
+            continue;
+        }
+        
+        pixel = (alpha > 254.5f) ? 255 : (unsigned int) (alpha + 0.5f);
+        for (c = 2; c >= 0; c--)
+        {
+            scale = result[i*4+c]*255.0f/alpha;
+            pixel = (pixel << 8) | ((scale > 254.5f) ? 255 : (scale < 0.0f) ? 0 : (unsigned int) (scale + 0.5f));
+        }
+        pixels[i] = pixel;
+    }
+    
+    delete[] spansX;
+    delete[] spansY;
+    delete[] weightsX;
+    delete[] weightsY;
+    delete[] premultiplied;
+    delete[] rows;
+    delete[] result;
+}
+
+void makeDisabledIconImage(unsigned int *pixels, int count, bool opaque)
+{
+    unsigned int pixel, grey, alpha;
+    int i;
+    
+    for (i = 0; i < count; i++)
+    {
+        pixel = pixels[i];
+        grey = (((pixel >> 16) & 0xFF)*77 + ((pixel >> 8) & 0xFF)*150 + (pixel & 0xFF)*29) >> 8;  /* luma weights (sum 256) */
+        alpha = opaque ? (pixel >> 24) : ((pixel >> 24)/2);
+        pixels[i] = (alpha << 24) | (grey << 16) | (grey << 8) | grey;
+    }
+}
+
+bool decodeBitmapImage(const unsigned char *data, size_t size, unsigned int background, const unsigned int *shades, ICONIMAGE *image)
+{
+    const unsigned char *row, *keyRow;
+    unsigned int palette[256], from[BITMAPKEYCOLORS], to[BITMAPKEYCOLORS], *pixels, *dest, headerSize, offset, compression, colorsUsed;
+    int width, height, bits, stride, x, y, i, colors, keyColors;
+    bool topDown, alpha;
+    
+    // Headers
+    
+    if (size < BITMAPFILEHEADERSIZE+BITMAPINFOHEADERSIZE || data[0] != 'B' || data[1] != 'M') return false;
+    
+    offset = readValue(data+10);
+    headerSize = readValue(data+14);
+    if (headerSize < BITMAPINFOHEADERSIZE || headerSize > size-BITMAPFILEHEADERSIZE) return false;  /* BITMAPCOREHEADER not recognised */
+    
+    width = (int) readValue(data+18);
+    height = (int) readValue(data+22);
+    bits = data[28] | (data[29] << 8);
+    compression = readValue(data+30);
+    colorsUsed = readValue(data+46);
+    
+    if (height < -ICONMAXSIZE) return false;  /* before negated (INT_MIN has no positive) */
+    
+    topDown = (height < 0);
+    if (topDown) height = -height;
+    
+    if (width <= 0 || height <= 0 || width > ICONMAXSIZE || height > ICONMAXSIZE) return false;
+    if (bits != 8 && bits != 24 && bits != 32) return false;
+    
+    if (compression == 3 && bits == 32)  /* BI_BITFIELDS - masks follow BITMAPINFOHEADER (or are its extension in later headers) */
+    {
+        if (size < BITMAPFILEHEADERSIZE+BITMAPINFOHEADERSIZE+12) return false;
+        if (readValue(data+54) != 0x00FF0000 || readValue(data+58) != 0x0000FF00 || readValue(data+62) != 0x000000FF) return false;
+    }
+    else if (compression != 0) return false;  /* BI_RGB only */
+    
+    stride = ((width*bits+31)/32)*4;
+    if (offset > size || (size_t) stride*height > size-offset) return false;
+    
+    // Palette
+    
+    if (bits == 8)
+    {
+        colors = (colorsUsed > 0 && colorsUsed <= 256) ? (int) colorsUsed : 256;
+        if ((size_t) BITMAPFILEHEADERSIZE+headerSize+colors*4 > size) return false;
+        
+        for (i = 0; i < 256; i++) palette[i] = 0xFF000000 | ((i < colors) ? (readValue(data+BITMAPFILEHEADERSIZE+headerSize+i*4) & 0x00FFFFFF) : 0);
+    }
+    
+    // Key color (bottom-left pixel) and shades of grey replaced in palette - key last, so that it wins if it is also a shade
+    
+    if (bits == 8)
+    {
+        keyRow = data+offset+(topDown ? (height-1)*stride : 0);
+        
+        keyColors = 0;
+        if (shades)
+        {
+            from[0] = 0xFF808080;
+            from[1] = 0xFFC0C0C0;
+            from[2] = 0xFFDFDFDF;
+            for (i = 0; i < 3; i++) to[i] = shades[i];
+            keyColors = 3;
+        }
+        from[keyColors] = palette[keyRow[0]];
+        to[keyColors++] = background;
+        
+        replaceColors(palette, 256, from, to, keyColors);
+    }
+    
+    // Expand rows (top row first)
+    
+    pixels = new unsigned int[width*height];
+    
+    for (y = 0; y < height; y++)
+    {
+        row = data+offset+(topDown ? y : height-1-y)*stride;
+        dest = pixels+y*width;
+        
+        if (bits == 8) for (x = 0; x < width; x++) dest[x] = palette[row[x]];
+        else if (bits == 24) for (x = 0; x < width; x++, row += 3) dest[x] = 0xFF000000 | row[0] | (row[1] << 8) | (row[2] << 16);
+        else memcpy(dest, row, width*4);
+    }
+    
+    // Alpha channel of 32 bits per pixel kept only for transparent background (icons) and only if used, otherwise opaque
+    
+    alpha = false;
+    if (bits == 32 && (background & 0xFF000000) == 0) for (i = 0; i < width*height && !alpha; i++) alpha = (pixels[i] & 0xFF000000) != 0;
+    
+    if (bits == 32 && !alpha) for (i = 0; i < width*height; i++) pixels[i] |= 0xFF000000;
+    
+    image->width = width;
+    image->height = height;
+    image->pixels = pixels;
+    
+    return true;
+}
+
+static void calcResampleSpans(int sourceSize, int size, RESAMPLESPAN *spans, float *weights)
+{
+    float ratio, radius, center, weight, total;
+    int i, j, first, last, next;
+    
+    ratio = (float) sourceSize/(float) size;
+    radius = (ratio > 1.0f) ? ratio : 1.0f;  /* linear when enlarging, widened by ratio when reducing */
+    
+    next = 0;
+    
+    for (i = 0; i < size; i++)
+    {
+        center = ((float) i + 0.5f)*ratio - 0.5f;  /* pixel centers aligned */
+        
+        first = (int) (center - radius);
+        last = (int) (center + radius) + 1;
+        if (first < 0) first = 0;
+        if (last > sourceSize-1) last = sourceSize-1;
+        
+        spans[i].first = first;
+        spans[i].count = 0;
+        spans[i].weights = next;
+        
+        total = 0.0f;
+        for (j = first; j <= last; j++)
+        {
+            weight = 1.0f - ((float) j > center ? (float) j - center : center - (float) j)/radius;
+            if (weight < 0.0f) weight = 0.0f;
+            weights[next+j-first] = weight;
+            total += weight;
+        }
+        
+        spans[i].count = last-first+1;
+        
+        // Normalize (weights outside image dropped at edges)
+        
+        if (total > 0.0f)
+        {
+            for (j = 0; j < spans[i].count; j++) weights[next+j] /= total;
+        }
+        else
+        {
+            spans[i].first = (center < 0.0f) ? 0 : (center > (float) (sourceSize-1)) ? sourceSize-1 : (int) (center + 0.5f);
+            spans[i].count = 1;
+            weights[next] = 1.0f;
+        }
+        
+        next += spans[i].count;
+    }
+}
+
+static void resamplePass(const float *source, int lines, int sourceLineStep, int sourcePixelStep, float *dest, int size, int destLineStep, int destPixelStep, const RESAMPLESPAN *spans, const float *weights)
+{
+    const float *line, *pixel, *weight;
+#ifdef IMAGESSE2
+    __m128 sum;
+#else
+    float sum[4];
+#endif
+    int l, i, j;
+    
+    for (l = 0; l < lines; l++)
+    {
+        line = source + l*sourceLineStep;
+        
+        for (i = 0; i < size; i++)
+        {
+            pixel = line + spans[i].first*sourcePixelStep;
+            weight = weights + spans[i].weights;
+            
+#ifdef IMAGESSE2
+            sum = _mm_setzero_ps();
+            for (j = 0; j < spans[i].count; j++, pixel += sourcePixelStep) sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pixel), _mm_set1_ps(weight[j])));
+            _mm_storeu_ps(dest + l*destLineStep + i*destPixelStep, sum);
+#else
+            sum[0] = sum[1] = sum[2] = sum[3] = 0.0f;
+            for (j = 0; j < spans[i].count; j++, pixel += sourcePixelStep)
+            {
+                sum[0] += pixel[0]*weight[j];
+                sum[1] += pixel[1]*weight[j];
+                sum[2] += pixel[2]*weight[j];
+                sum[3] += pixel[3]*weight[j];
+            }
+            memcpy(dest + l*destLineStep + i*destPixelStep, sum, sizeof(sum));
+#endif
+        }
+    }
+}
+
+static void replaceColors(unsigned int *pixels, int count, const unsigned int *from, const unsigned int *to, int colors)
+{
+    unsigned int pixel, result;
+#ifdef IMAGESSE2
+    __m128i vector, match, replaced;
+#endif
+    int i, k;
+    
+    i = 0;
+    
+    // Each pixel compared with original colors (so a replacement is never replaced again)
+    
+#ifdef IMAGESSE2
+    for (; i+4 <= count; i += 4)
+    {
+        vector = _mm_loadu_si128((const __m128i *) (pixels+i));
+        replaced = vector;
+        for (k = 0; k < colors; k++)
+        {
+            match = _mm_cmpeq_epi32(vector, _mm_set1_epi32((int) from[k]));
+            replaced = _mm_or_si128(_mm_andnot_si128(match, replaced), _mm_and_si128(match, _mm_set1_epi32((int) to[k])));
+        }
+        _mm_storeu_si128((__m128i *) (pixels+i), replaced);
+    }
+#endif
+    
+    for (; i < count; i++)
+    {
+        pixel = result = pixels[i];
+        for (k = 0; k < colors; k++) if (pixel == from[k]) result = to[k];
+        pixels[i] = result;
+    }
+}
+
+static unsigned int readValue(const unsigned char *data)
+{
+    return (unsigned int) data[0] | ((unsigned int) data[1] << 8) | ((unsigned int) data[2] << 16) | ((unsigned int) data[3] << 24);
+}
+
+static void writeValue(unsigned char *data, unsigned int value)
+{
+    data[0] = (unsigned char) value;
+    data[1] = (unsigned char) (value >> 8);
+    data[2] = (unsigned char) (value >> 16);
+    data[3] = (unsigned char) (value >> 24);
+}
+
+static unsigned int hexDigit(wchar_t c)
+{
+    if (c >= L'0' && c <= L'9') return c - L'0';
+    if (c >= L'A' && c <= L'F') return c - L'A' + 10;
+    if (c >= L'a' && c <= L'f') return c - L'a' + 10;
+    
+    return 16;  /* not a hex digit */
+}
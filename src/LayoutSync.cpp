@@ -0,0 +1,202 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Shared channel:
+//
+//  - each published change increments version, and its deltas (if any) are appended to ring at deltaTotal
+//  - an instance that is up to date (has read every delta) publishes its deltas, otherwise only its full layout
+//    (resetPos is moved past it, so no instance applies deltas across it) - the last change published wins
+//  - an instance reading deltas that have been overwritten in ring (or across resetPos) applies the full layout instead
+
+#include "LayoutSync.h"
+#include <string.h>
+
+int calcLayoutDeltas(const LAYOUTID oldLayout[], int oldCount, const LAYOUTID newLayout[], int newCount, JOURNALDELTA deltas[])
+{
+    LAYOUTID layout[LAYOUTMAXBUTTONS];
+    int i, j, k, count, deltaCount, have, need;
+    
+    memcpy(layout, oldLayout, oldCount*sizeof(LAYOUTID));
+    count = oldCount;
+    deltaCount = 0;
+    
+    // Delete buttons (from end) that occur more often in old layout than in new layout (separators can occur many times)
+    
+    for (i = count-1; i >= 0; i--)
+    {
+        for (have = 0, k = 0; k < count; k++) if (layout[k] == layout[i]) have++;
+        for (need = 0, k = 0; k < newCount; k++) if (newLayout[k] == layout[i]) need++;
+        if (have > need)
+        {
+            deltas[deltaCount].code = MAKEDELTACODE(JOURNALOP_DELETE, 0, false);
+            deltas[deltaCount].index = (unsigned short) i;
+            deltas[deltaCount].identity = layout[i];
+            deltaCount++;
+            memmove(&layout[i], &layout[i+1], (count-i-1)*sizeof(LAYOUTID));
+            count--;
+        }
+    }
+    
+    // Move or insert buttons so that each position matches new layout
+    
+    for (i = 0; i < newCount; i++)
+    {
+        if (i < count && layout[i] == newLayout[i]) continue;
+        
+        for (j = i+1; j < count && layout[j] != newLayout[i]; j++);
+        
+        if (j < count)  /* button is further along toolbar */
+        {
+            deltas[deltaCount].code = MAKEDELTACODE(JOURNALOP_MOVE, i, false);
+            deltas[deltaCount].index = (unsigned short) j;
+            deltas[deltaCount].identity = newLayout[i];
+            memmove(&layout[i+1], &layout[i], (j-i)*sizeof(LAYOUTID));
+            layout[i] = newLayout[i];
+        }
+        else  /* button is not on toolbar */
+        {
+            deltas[deltaCount].code = MAKEDELTACODE(JOURNALOP_INSERT, 0, false);
+            deltas[deltaCount].index = (unsigned short) i;
+            deltas[deltaCount].identity = newLayout[i];
+            memmove(&layout[i+1], &layout[i], (count-i)*sizeof(LAYOUTID));
+            layout[i] = newLayout[i];
+            count++;
+        }
+        deltaCount++;
+    }
+    
+    if (deltaCount > 0) deltas[deltaCount-1].code |= JOURNALFLAG_GROUPEND;
+    
+    return deltaCount;
+}
+
+bool applyLayoutDelta(LAYOUTID layout[], int *count, int op, int index, int toIndex, LAYOUTID identity)
+{
+    LAYOUTID moved;
+    
+    switch (op)
+    {
+        case JOURNALOP_INSERT:
+            
+            if (index > *count || *count >= LAYOUTMAXBUTTONS) return false;
+            memmove(&layout[index+1], &layout[index], (*count-index)*sizeof(LAYOUTID));
+            layout[index] = identity;
+            (*count)++;
+            return true;
+            
+        case JOURNALOP_DELETE:
+            
+            if (index >= *count || layout[index] != identity) return false;
+            memmove(&layout[index], &layout[index+1], (*count-index-1)*sizeof(LAYOUTID));
+            (*count)--;
+            return true;
+            
+        case JOURNALOP_MOVE:
+            
+            if (index >= *count || toIndex >= *count || layout[index] != identity) return false;
+            moved = layout[index];
+            memmove(&layout[index], &layout[index+1], (*count-index-1)*sizeof(LAYOUTID));
+            memmove(&layout[toIndex+1], &layout[toIndex], (*count-1-toIndex)*sizeof(LAYOUTID));
+            layout[toIndex] = moved;
+            return true;
+    }
+    
+    return false;
+}
+
+bool attachSyncChannel(SYNCCHANNEL *channel, SYNCPOSITION *position, const LAYOUTID layout[], int layoutCount,
+                       int customButtonsState, int wrapToolbarState)
+{
+    if (channel->signature != SYNCSIGNATURE)  /* channel just created (zero filled) - publish layout of this instance */
+    {
+        channel->signature = SYNCSIGNATURE;
+        channel->customButtonsState = customButtonsState;
+        channel->wrapToolbarState = wrapToolbarState;
+        channel->layoutCount = layoutCount;
+        memcpy(channel->layout, layout, layoutCount*sizeof(LAYOUTID));
+        position->version = channel->version;
+        position->deltaPos = channel->deltaTotal;
+        return true;
+    }
+    
+    // Other instances attached - force full layout to be taken from channel
+    
+    position->version = channel->version-1;
+    position->deltaPos = channel->deltaTotal-SYNCMAXDELTAS-1;
+    return false;
+}
+
+void publishSyncChange(SYNCCHANNEL *channel, SYNCPOSITION *position, const JOURNALDELTA deltas[], int deltaCount,
+                       const LAYOUTID layout[], int layoutCount, int customButtonsState, int wrapToolbarState)
+{
+    bool upToDate;
+    int i;
+    
+    upToDate = (position->deltaPos == channel->deltaTotal);
+    
+    if (deltaCount > 0)
+    {
+        if (upToDate && deltaCount <= SYNCMAXDELTAS)
+        {
+            for (i = 0; i < deltaCount; i++)
+            {
+                channel->ring[(channel->deltaTotal+i) % SYNCMAXDELTAS] = deltas[i];
+            }
+            channel->deltaTotal += deltaCount;
+        }
+        else
+        {
+            channel->deltaTotal++;
+            channel->resetPos = channel->deltaTotal;
+            upToDate = true;
+        }
+        
+        channel->layoutCount = layoutCount;
+        memcpy(channel->layout, layout, layoutCount*sizeof(LAYOUTID));
+    }
+    
+    channel->customButtonsState = customButtonsState;
+    channel->wrapToolbarState = wrapToolbarState;
+    channel->version++;
+    
+    // Menu item states only - if changes by other instances not yet read, leave them to be read
+    
+    if (upToDate)
+    {
+        position->version = channel->version;
+        position->deltaPos = channel->deltaTotal;
+    }
+}
+
+bool readSyncChange(const SYNCCHANNEL *channel, const SYNCPOSITION *position, SYNCCHANGE *change)
+{
+    unsigned int pending;
+    int i;
+    
+    if (channel->version == position->version) return false;  /* nothing published since */
+    
+    change->position.version = channel->version;
+    change->position.deltaPos = channel->deltaTotal;
+    change->customButtonsState = channel->customButtonsState;
+    change->wrapToolbarState = channel->wrapToolbarState;
+    
+    // Deltas published since - if still in ring
+    
+    pending = channel->deltaTotal-position->deltaPos;
+    
+    if (pending <= SYNCMAXDELTAS && position->deltaPos >= channel->resetPos)
+    {
+        for (i = 0; i < (int) pending; i++)
+        {
+            change->deltas[i] = channel->ring[(position->deltaPos+i) % SYNCMAXDELTAS];
+        }
+        change->deltaCount = (int) pending;
+    }
+    else change->deltaCount = -1;
+    
+    change->layoutCount = (channel->layoutCount <= LAYOUTMAXBUTTONS) ? channel->layoutCount : LAYOUTMAXBUTTONS;
+    memcpy(change->layout, channel->layout, change->layoutCount*sizeof(LAYOUTID));
+    
+    return true;
+}
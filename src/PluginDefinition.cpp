@@ -8,15 +8,23 @@
 //  - assumes that required rebar is first rebar in window
 //  - assumes that required toolbar is first toolbar in rebar
 //  - subclasses window and rebar
+//  - caches rebar and toolbar window handles (revalidated with IsWindow and parent before each use)
 //  - derives button string from menu string
 //  - workaround for Spell-Checker plugin
 //  - workaround for WebEdit plugin
 //  - workaround for Python Script plugin
+//  - creates custom button images on thread pool workers, but adds them to toolbar in order on calling thread
+//  - creates custom icons for DPI of Notepad++ window, and replaces them in toolbar image lists when Notepad++ recreates toolbar after DPI change
+//  - shares one handle between custom button images with identical contents (same file, or different files or quick codes)
+//  - keeps bitmaps and icons given to Notepad++ until plugin unloaded (tracked with all other bitmaps and icons it creates)
 //  - assigns temporary command identifiers to custom buttons until NPPN_READY received
 //  - traps RB_SETBANDINFO message (fMask == 0x0270) to detect icons changed by Notepad++
 //  - updates button states from menu states
+//  - re-evaluates states of dependent buttons on Notepad++ and Scintilla notifications, and after menu or shortcut commands
+//  - disables additional editing buttons in read-only documents (evaluated after SCN_UPDATEUI, coalesced)
 //  - sends TB_SETMAXTEXTROWS message to force toolbar to refresh and display buttons
 //  - hashes menu string and parent menu string to uniquely identify button
+//  - defers rebuilding preserved buttons and applying synchronized changes while customize dialog box or overflow menu is open
 
 // CustomizeToolbar.dat File Format - for toolbar layout
 //
@@ -41,12 +49,85 @@
 // line number margin button state (3.10-4.2)       00000000 or 01000000
 // bookmark margin button state (3.10-4.2)          00000000 or 01000000
 // folder margin button state (3.10-4.2)            00000000 or 01000000
+//
+// Version is detected from file length and counts (see DatFile.cpp), so any version is read,
+// and is rewritten in current format when saved - tools\DatTool.cpp inspects and converts offline
+
+// CustomizeToolbar.cache File Format - startup snapshot of preserved toolbar buttons
+//
+// snapshot signature                               43545332 ("CTS2")
+// fingerprint of menus and startup toolbar buttons XXXXXXXX
+// number of buttons preserved                      XX000000
+// fingerprint of plugins menu when startup ready   XXXXXXXX
+// first button command identifier                  XXXX0000
+// first button identity (cmdid or menuhash)        XXXX0000 or XXXXXXXX
+// first button string length (characters)          XX000000
+// first button string (without null)               ........
+// repeat for each button preserved                 ........
+
+// CustomizeToolbar.jnl File Format - append-only journal of toolbar layout changes (for undo/redo)
+//
+// each record is a layout delta or an undo/redo marker XXXX XXXX XXXXXXXX
+//   op (bits 0-1), end of change (bit 2), to index (bits 3-15) XXXX
+//   toolbar index (or 1 = undo marker, 2 = redo marker)    XXXX
+//   identity of button inserted, deleted or moved          XXXXXXXX
+// op is insert (1), delete (2), move (3) or marker (0)
+// journal is compacted (rewritten from memory) when it exceeds its size limit
+
+// Toolbar Layout Text File Format - for export and import of toolbar layouts (shared between machines)
+//
+// Unicode UTF-16 Little Endian with BOM and CR-LF line breaks (ANSI in non-Unicode build), as .btn file
+// Each line is either a semi-colon followed by a comment, a setting, a section header or a button entry:
+// Custom Buttons=0 or 1
+// Wrap Toolbar=0 or 1
+// [Toolbar] followed by an entry for each button on toolbar
+// [Available] followed by an entry for each button available
+// Each button entry is one of:
+// menustring1,menustring2,menustring3,menustring4  - menu path of command (two to four menu strings)
+// menustring1,menustring2,...,#cmdid                - menu path of built-in command, then its command identifier
+//                                                     (used if menu path not found, e.g. Notepad++ in other language)
+// -                                                 - separator
+// @buttonstring                                     - plugin command without menu item (or custom command with menu strings not found)
+// #cmdid                                            - built-in command without menu item
+// Buttons available that are not listed in [Available] (e.g. newly installed plugin) are added to end of toolbar on import
+
+// CustomizeToolbar.atlas File Format - decoded images of custom buttons (for warm startup)
+//
+// atlas signature                                  43544131 ("CTA1")
+// stamp of system colors and icon size             XXXXXXXX
+// number of images                                 XX000000
+// reserved                                         00000000
+// first image file name hash                       XXXXXXXX
+// first image type (bitmap or icon)                01000000 or 02000000
+// first image file last write time                 XXXXXXXX XXXXXXXX
+// first image file size                            XXXXXXXX XXXXXXXX
+// first image width and height                     XX000000 XX000000
+// first image pixels (BGRA, top row first)         ........
+// repeat for each image                            ........
+//
+// Atlas is mapped at startup - an image file is decoded only if its entry is missing or its time or size differs,
+// and atlas is rewritten (see IconImage.cpp) only if an image was decoded or an entry is no longer used
+// Icon entries are largest frame of icon (reduced to 128x128 if larger), resampled for each DPI -
+// so atlas does not depend on DPI, and is kept mapped until unloaded for DPI changes (unless rewritten -
+// a mapped file cannot be replaced, so reused entries are then copied out of it and it is unmapped first)
+// Entries decoded from different files with identical contents share one pixel buffer while loaded
+// (each is still written to atlas, so an entry never depends on another file)
+
+// Layout Synchronization Channel - shared memory between instances of Notepad++ (-multiInst)
+//
+// Named file mapping (Local\\CustomizeToolbarSync) guarded by named mutex (Local\\CustomizeToolbarSyncMutex)
+// holds latest full layout, menu item states and a ring of layout deltas (as journal records)
+// Each layout change is published as deltas with a new version, and other instances are notified
+// by setting their named auto-reset events (Local\\CustomizeToolbarSync<process id>)
+// An instance applies the deltas published since it last synchronized, or the full layout if they are
+// no longer in the ring - so all instances have the same layout, and any shutdown save writes it
 
 // CustomizeToolbar.btn File Format - for custom buttons
 // 
 // Each line is either a semi-colon followed by a comment or a custom button definition:
 // menustring1,menustring2,menustring3,menustring4,standard.bmp,fluentlight.ico,fluentdark.ico
 // The standard.bmp, fluentlight.ico and fluentdark.ico image file names are optional
+// Any of the image files can instead be a .png file (decoded by the plugin, by contents not by extension)
 // With Notepad++ 7.9.5 or earlier, the fluent light and fluent dark fields are ignored
 // With Notepad++ 8.0 or later, the fluent dark field if omitted defaults to the fluent light field
 
@@ -56,6 +137,12 @@
 
 // Include files
 #include "PluginDefinition.h"
+#include "DatFile.h"
+#include "HandleTable.h"
+#include "IconImage.h"
+#include "LayoutSync.h"
+#include "PluginEvents.h"
+#include "PngImage.h"
 #include "menuCmdID.h"
 #include "resource.h"
 #include <commctrl.h>
@@ -83,6 +170,120 @@
 
 #define HASHFLAG 0x80000000
 
+#define SNAPSHOTSIGNATURE 0x32535443  /* "CTS2" */
+#define SNAPSHOTHEADERSIZE (4*sizeof(DWORD))
+
+#define JOURNALMARKER_UNDO 1
+#define JOURNALMARKER_REDO 2
+#define JOURNALMAXDELTAS 2048  /* memory budget - 2048 deltas (16 KB) */
+#define JOURNALMAXGROUP 600  /* largest layout change - delete 300 buttons and insert 300 buttons */
+#define JOURNALMAXFILESIZE 32768  /* journal file is compacted when larger than this */
+
+#define MENUINDEXMAX 4000  /* menu items in menu index (for export and import of layouts) */
+#define LAYOUTBUFFERSIZE 1024  /* characters buffered when streaming layout text file */
+#define USAGEBUFFERSIZE 4096  /* characters in resource usage report (about 2300 with every value at its widest) */
+#define LOOKUPSAMPLES 1000  /* window lookups timed for resource usage report */
+
+#define UIEVENT_RESIZE 0  /* Notepad++ window resized */
+#define UIEVENT_CHANGEDICONS 1  /* toolbar reset and icons changed by Notepad++ */
+#define UIEVENT_BUTTONSTATES 2  /* toolbar clicked or menu closed */
+#define UIEVENT_EDITORSTATE 3  /* Scintilla UI updated (text, selection or caret) or document read-only state changed */
+#define UIEVENT_STARTUP 4  /* Notepad++ ready - complete startup when other plugins have finished adding menu items */
+#define UIEVENTKINDS 5
+#define DEFERRED_SYNC (1 << UIEVENTKINDS)  /* deferred state write - after bit per kind of UI event */
+#define UIEVENTPHASE_IDLE 0
+#define UIEVENTPHASE_WAIT 1  /* waiting for state to settle before handling */
+#define UIEVENTPHASE_VERIFY 2  /* handled - checking state does not change again */
+#define UITIMER_BASE 0x43540000  /* timer identifier of each kind of UI event (not used by Notepad++) */
+#define UIEVENTINITDELAY 10.0  /* ms - initial delay (as previously fixed) */
+#define UIEVENTMAXDELAY 50.0  /* ms - UI event handled (and verifying stops) this long after first event, even if state still changing */
+#define UIEVENTPOLLDELAY USER_TIMER_MINIMUM  /* ms - interval between checks while state still changing */
+#define STARTUPSTABLEPOLLS 3  /* menus unchanged for this many consecutive polls - startup ready (if plugins menu not as expected) */
+#define STARTUPMAXWAIT 2000.0  /* ms - startup completed this long after NPPN_READY, even if menus still changing */
+
+#define EDITPREDICATE_WRITABLE 0x0001  /* current document not read-only */
+
+#define IMAGEJOB_BITMAP 0  /* standard bitmap (missing file image if not found) */
+#define IMAGEJOB_ICON 1  /* fluent light icon (missing file image if not found) */
+#define IMAGEJOB_DARKICON 2  /* fluent dark icon (NULL if not found - light icon used) */
+#define IMAGEJOBKINDS 3
+#define IMAGEMAXWORKERS 8  /* pool workers decoding images (as well as calling thread) */
+#define QUICKCODEMAX 300  /* quick code images rendered and cached */
+#define ICONBASESIZE 32  /* fluent icon size at 96 DPI (100%) */
+#define IMAGEVARIANTMAX 1200  /* custom button images created for other DPI (after DPI change) - normal and disabled */
+#define SHAREDIMAGEMAX 1200  /* distinct custom button image handles (startup and other DPI) */
+#define IMAGEFILEMAX (ICONMAXSIZE*ICONMAXSIZE*4+4096)  /* bytes of image file read (largest .bmp or .png decoded, or directory of .ico) */
+#define ADDITIONALBUTTONS 26  /* additional buttons for Notepad++ built-in commands (customize toolbar button is next frame of strips) */
+#define ADDITIONALBITMAPSIZE 16  /* frame size of standard strip */
+#define ADDITIONALICONSIZE 32  /* frame size of fluent strip */
+
+
+// Type definitions
+
+typedef struct
+{
+    UINT idCommand;
+    DWORD pathHash;  /* hash of menu strings along menu path (separated by commas) */
+    HMENU hMenu[4];  /* menu containing each menu string along menu path */
+    int position[4];  /* position of each menu string along menu path */
+    int depth;  /* number of menu strings along menu path */
+} MENUINDEXENTRY;
+
+typedef struct
+{
+    HANDLE file;
+    TCHAR buffer[LAYOUTBUFFERSIZE];
+    int length;  /* characters in buffer */
+    int position;  /* next character in buffer (read only) */
+} LAYOUTSTREAM;
+
+typedef struct
+{
+    int idCommand;
+    UINT notification;  /* NPPN_* or SCN_* notification after which menu state of command may have changed */
+} STATEDEPENDENCY;
+
+typedef struct
+{
+    TCHAR fileName[MAXSIZE];  /* image file name (relative to plugins config directory) or quick code (*) */
+    int kind;  /* IMAGEJOB_... */
+    HANDLE hImage;  /* bitmap or icon created by job */
+    volatile LONG done;
+} IMAGEJOB;
+
+typedef struct
+{
+    int job;  /* index of image job (button and kind) */
+    int size;
+    bool disabled;  /* disabled look (for disabled image list) */
+    HANDLE hImage;
+} IMAGEVARIANT;
+
+typedef struct
+{
+    unsigned long long contentHash;  /* calcIconContentHash */
+    UINT type;
+    ICONIMAGE image;  /* copy of pixels (allocated by new[]) - compared before handle is given again */
+    HANDLE hImage;
+    int uses;
+} SHAREDIMAGE;
+
+typedef UINT (WINAPI *GETDPIFORWINDOWPROC)(HWND hwnd);
+
+typedef struct
+{
+    unsigned int color;  /* 0xRRGGBB */
+    unsigned int background;  /* window color (bitmap) or transparent (icon) */
+    wchar_t label[QUICKCODEMAXLABEL+1];
+    ICONIMAGE image;  /* size of image is size of quick code */
+} QUICKCODEIMAGE;
+
+typedef struct
+{
+    int idCommand;
+    DWORD predicates;  /* EDITPREDICATE_* - all must be true for button to be enabled */
+} EDITPREDICATE;
+
 // Data declarations
 
 TCHAR g_debugBuffer[200];
@@ -96,7 +297,94 @@ int g_rebarBandInfoSize;
 
 WNDPROC g_origWindowProc, g_origRebarProc;
 
+HWND g_rbWindow, g_tbWindow;  /* cached by findToolbarWindows */
+int g_windowLookups;  /* FindWindowEx lookups made (cache empty or invalid) */
+ULONGLONG g_windowMessages;  /* messages received by subclassed window procedure (64-bit, as a long session can exceed 2^31) */
+ULONGLONG g_fastMessages;  /* messages passed straight to Notepad++ (not handled) */
+LONGLONG g_fastMessageTicks;  /* performance counter ticks spent in subclassed window procedure (excluding Notepad++) */
+LONGLONG g_handledMessageTicks;
+
+int g_stateUpdates;  /* updateToolbarState passes */
+int g_stateButtonsChecked;  /* buttons compared with menu states */
+int g_stateChanges;  /* TB_SETSTATE messages sent (buttons whose state actually changed) */
+int g_stateNotifications;  /* notifications and commands which re-evaluated dependent buttons */
+
+STATEDEPENDENCY g_stateDependencies[] =  /* commands whose checked or enabled state is changed other than by the command itself */
+{
+    { IDM_VIEW_WRAP, NPPN_BUFFERACTIVATED },  /* per view */
+    { IDM_VIEW_ALL_CHARACTERS, NPPN_BUFFERACTIVATED },
+    { IDM_VIEW_TAB_SPACE, NPPN_BUFFERACTIVATED },
+    { IDM_VIEW_EOL, NPPN_BUFFERACTIVATED },
+    { IDM_VIEW_INDENT_GUIDE, NPPN_BUFFERACTIVATED },
+    { IDM_VIEW_SYNSCROLLV, NPPN_BUFFERACTIVATED },  /* enabled when both views visible */
+    { IDM_VIEW_SYNSCROLLH, NPPN_BUFFERACTIVATED },
+    { IDM_VIEW_SWITCHTO_OTHER_VIEW, NPPN_BUFFERACTIVATED },
+    { IDM_VIEW_GOTO_ANOTHER_VIEW, NPPN_BUFFERACTIVATED },
+    { IDM_VIEW_CLONE_TO_ANOTHER_VIEW, NPPN_BUFFERACTIVATED },
+    { IDM_EDIT_SETREADONLY, NPPN_BUFFERACTIVATED },  /* per document */
+    { IDM_EDIT_SETREADONLY, NPPN_READONLYCHANGED },
+    { IDM_FILE_SAVE, NPPN_BUFFERACTIVATED },  /* enabled when document modified */
+    { IDM_FILE_SAVE, NPPN_FILESAVED },
+    { IDM_FILE_SAVE, SCN_SAVEPOINTREACHED },
+    { IDM_FILE_SAVE, SCN_SAVEPOINTLEFT },
+    { IDM_FILE_SAVEALL, NPPN_FILESAVED },
+    { IDM_FILE_SAVEALL, SCN_SAVEPOINTREACHED },
+    { IDM_FILE_SAVEALL, SCN_SAVEPOINTLEFT }
+};
+
+EDITPREDICATE g_editPredicates[] =  /* additional buttons which Notepad++ does not disable itself (menu items remain enabled) */
+{
+    { IDM_EDIT_DELETE, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_RMV_TAB, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_INS_TAB, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_DUP_LINE, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_BLOCK_COMMENT_SET, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_BLOCK_UNCOMMENT, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_AUTOCOMPLETE_CURRENTFILE, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_TRIMTRAILING, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_TAB2SW, EDITPREDICATE_WRITABLE },
+    { IDM_EDIT_SW2TAB_ALL, EDITPREDICATE_WRITABLE }
+};
+DWORD g_editorState;  /* EDITPREDICATE_* true for current document (as last applied to buttons) */
+int g_editorStateChanges;
+
+int g_additionalButtons[ADDITIONALBUTTONS] =  /* same order as frames of strips (res\additional_buttons.txt) */
+{
+    IDM_FILE_CLOSEALL_BUT_CURRENT,
+    IDM_EDIT_DELETE,
+    IDM_EDIT_RMV_TAB,
+    IDM_EDIT_INS_TAB,
+    IDM_EDIT_DUP_LINE,
+    IDM_EDIT_BLOCK_COMMENT_SET,
+    IDM_EDIT_BLOCK_UNCOMMENT,
+    IDM_EDIT_AUTOCOMPLETE_CURRENTFILE,
+    IDM_EDIT_TRIMTRAILING,
+    IDM_EDIT_TAB2SW,
+    IDM_EDIT_SW2TAB_ALL,
+    IDM_SEARCH_FINDINFILES,
+    IDM_SEARCH_FINDPREV,
+    IDM_SEARCH_FINDNEXT,
+    IDM_SEARCH_FINDINCREMENT,
+    IDM_FOCUS_ON_FOUND_RESULTS,
+    IDM_SEARCH_GOTOLINE,
+    IDM_SEARCH_PREV_BOOKMARK,
+    IDM_SEARCH_NEXT_BOOKMARK,
+    IDM_SEARCH_CLEAR_BOOKMARKS,
+    IDM_VIEW_ZOOMRESTORE,
+    IDM_VIEW_GOTO_ANOTHER_VIEW,
+    IDM_VIEW_CLONE_TO_ANOTHER_VIEW,
+    IDM_VIEW_HIDELINES,
+    IDM_VIEW_TOGGLE_FOLDALL,
+    IDM_VIEW_TOGGLE_UNFOLDALL
+};
+int g_additionalImages;  /* images sliced from strips */
+double g_additionalTime;  /* ms to load strips and add additional buttons */
+
+LIFECYCLE g_lifecycle;  /* each stage entered once, in order (see enterLifecycleStage) */
+LARGE_INTEGER g_lifecycleTime[LIFECYCLESTAGES];  /* when each stage was entered */
+
 TBBUTTON g_tbButtons[300];  /* 300 buttons in total - built-in buttons, plugin buttons, dynamic plugin buttons and custom buttons */
+DWORD g_tbIdentities[300];  /* identity of each preserved button (cmdid or menuhash) - as written to .dat file */
 int g_buttonsAvailable;
 int g_customButtonsState;
 int g_wrapToolbarState;
@@ -104,33 +392,208 @@ int g_wrapToolbarState;
 TCHAR g_customMenuStrings[100][4][MAXSIZE];  /* 100 custom buttons, 4 menu strings per button */
 int g_customButtonsCount;
 
+LARGE_INTEGER g_readyTime;  /* when NPPN_READY was received */
+double g_startupTime;  /* milliseconds from NPPN_READY to final toolbar */
+bool g_snapshotUsed;  /* preserved buttons were loaded from startup snapshot */
+DWORD g_expectedPluginMenus;  /* fingerprint of plugins menu when startup was ready last session (zero if unknown) */
+int g_readyPolls;  /* readiness checks made before startup completed */
+int g_readyStablePolls;  /* consecutive readiness checks with menus unchanged */
+double g_readyWait;  /* milliseconds from NPPN_READY to startup ready */
+const TCHAR *g_readyReason;  /* how startup readiness was detected */
+
+DWORD g_layoutIdentities[300];  /* identities of buttons on toolbar after last recorded layout change */
+int g_layoutCount;
+
+JOURNALDELTA g_journal[JOURNALMAXDELTAS];  /* layout changes - deltas before g_journalPos can be undone, deltas after can be redone */
+int g_journalCount;
+int g_journalPos;
+
+UINT g_uiEventMessage;  /* registered message posted to Notepad++ window for delay shorter than timer resolution (wParam = kind) */
+int g_uiEventPhase[UIEVENTKINDS];  /* repeated events of same kind coalesce while waiting */
+LARGE_INTEGER g_uiEventStart[UIEVENTKINDS];  /* when first event of burst was queued */
+DWORD g_uiEventFingerprint[UIEVENTKINDS];  /* state (which Notepad++ changes) when last checked */
+double g_uiEventChecked[UIEVENTKINDS];  /* ms after first event when state last checked */
+double g_uiEventSettle[UIEVENTKINDS];  /* ms after first event when state last changed (estimate) */
+bool g_uiEventForced[UIEVENTKINDS];  /* state still changing when handled or verified (not learned) */
+double g_uiEventDelay[UIEVENTKINDS];  /* ms - learned delay from first event to handling */
+double g_uiEventLatency[UIEVENTKINDS];  /* ms - total delay added by handling UI events */
+int g_uiEventsReceived[UIEVENTKINDS];  /* UI events queued (by kind) */
+int g_uiEventPasses[UIEVENTKINDS];  /* UI event handler passes executed (by kind) */
+int g_uiEventsLate[UIEVENTKINDS];  /* state changed after UI event handled (delay too short) */
+int g_uiEventsCovered;  /* UI events received before startup completed (covered by startup pass, not handled) */
+
+LAYOUTPASSES g_layoutPasses;  /* newer geometry (resize or changed icons event) makes layout pass in progress stale */
+bool g_changedIconsPending;  /* toolbar reset by Notepad++ - preserved and restored once by changed icons pass */
+
+STATEREADERS g_stateReaders;  /* customize dialog box or overflow menu open (modal loop dispatches timers) - UI events which rebuild preserved buttons (bit per kind) and layout changes of other instance deferred */
+
+HANDLE g_syncMapping, g_syncMutex, g_syncEvent;
+SYNCCHANNEL *g_syncChannel;  /* NULL if channel could not be opened */
+SYNCPOSITION g_syncPosition;  /* version of shared channel and position in its ring last synchronized with */
+UINT g_syncMessage;  /* registered message posted to Notepad++ window when other instance published change */
+HANDLE g_syncThread;  /* waits for notification event - owned (and joined) by Notepad++ window thread */
+volatile LONG g_syncClosing;
+
+HANDLE g_atlasMapping;
+const BYTE *g_atlasView;  /* mapped atlas file (until unloaded, or until atlas rewritten) */
+DWORD g_atlasSize;
+DWORD g_atlasStamp;
+ICONATLASENTRY g_atlasEntries[ICONATLASMAX];  /* images in mapped atlas */
+int g_atlasCount;
+ICONATLASENTRY g_atlasUsed[ICONATLASMAX];  /* images used by custom buttons this session - written to atlas */
+bool g_atlasOwned[ICONATLASMAX];  /* pixels allocated (decoded this session, or copied from mapped atlas before rewritten) */
+int g_atlasUsedCount;
+bool g_atlasChanged;
+CRITICAL_SECTION g_atlasLock;  /* images used and counts (updated by image jobs) */
+LONG g_atlasHits;  /* images created from atlas (file not decoded) */
+LONG g_atlasDecodes;  /* images decoded from file (new or changed) */
+LONG g_bitmapDecodes;  /* of which .bmp contents decoded by plugin (not LoadImage) */
+LONG g_pngDecodes;  /* of which .png contents decoded by plugin */
+bool g_atlasOpen;  /* sources kept until unloaded (resampled after DPI change) */
+
+IMAGEJOB g_imageJobs[300];  /* 100 custom buttons, 3 images per button - created in parallel, added to toolbar in order */
+int g_imageJobCount;
+volatile LONG g_imageJobNext;  /* next job to be taken by worker or calling thread */
+HANDLE g_imageJobEvent;  /* set when any job done, and when any worker finishes */
+volatile LONG g_imageWorkersRunning;  /* pool workers queued and not yet finished - drained before atlas saved and before unload */
+TCHAR g_imageConfigPath[MAX_PATH];
+int g_imageWorkers;  /* pool workers queued */
+double g_imageTime;  /* ms from first job queued to last custom button added */
+UINT g_imageDpi;  /* DPI of Notepad++ window when custom button images created */
+int g_iconSize;  /* size of custom icons for g_imageDpi */
+LONG g_imageResamples;
+
+bool g_dpiChanged;  /* WM_DPICHANGED received (Notepad++ per-monitor DPI aware) */
+IMAGEVARIANT g_imageVariants[IMAGEVARIANTMAX];  /* images for other DPI - kept until unloaded, so returning to a DPI reuses them */
+int g_imageVariantCount;
+int g_imageVariantSwaps;  /* toolbar recreations after which images were replaced */
+
+QUICKCODEIMAGE g_quickCodes[QUICKCODEMAX];  /* rendered quick code images - same color, label and size reuse image */
+int g_quickCodeCount;
+CRITICAL_SECTION g_quickCodeLock;
+LONG g_quickCodeRenders;
+LONG g_quickCodeHits;
+
+SHAREDIMAGE g_sharedImages[SHAREDIMAGEMAX];  /* handles by image contents - kept until unloaded */
+int g_sharedImageCount;
+CRITICAL_SECTION g_sharedLock;
+int g_sharedHandleUses;  /* images given an existing handle */
+double g_sharedHandleBytes;  /* pixels of bitmaps not created */
+int g_sharedBuffers;  /* atlas entries sharing another entry's pixels */
+double g_sharedBufferBytes;
+int g_duplicateSlots;  /* image list slots holding same handle as another custom button */
+
+HANDLETABLE g_trackedHandles;  /* every bitmap and icon owned by plugin (images given to Notepad++ are kept until unloaded) */
+CRITICAL_SECTION g_trackedLock;  /* handles are created by image jobs */
+
+MENUINDEXENTRY g_menuIndex[MENUINDEXMAX];  /* every command in main menu with its menu path - rebuilt for each export or import */
+int g_menuIndexCount;
+
 // Function declarations
 
-void addAdditionalButton(int bitmapName, int iconName, int idCmd);
-DWORD WINAPI afterNppReadyDelayed(LPVOID lpParam);
+void addAdditionalButton(const ICONIMAGE *bitmapStrip, const ICONIMAGE *iconStrip, int frame, int idCmd);
+bool loadImageStrip(int resourceName, UINT flags, int frameSize, ICONIMAGE *strip);
+HANDLE createStripFrame(UINT type, const ICONIMAGE *strip, int frame);
+void afterNppReadyDelayed();
+bool enterLifecycleStage(int stage);
 LRESULT APIENTRY subclassRebarProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 LRESULT APIENTRY subclassWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
-DWORD WINAPI handleWindowResize(LPVOID lpParam);
-DWORD WINAPI handleChangedIcons(LPVOID lpParam);
-DWORD WINAPI handleButtonStates(LPVOID lpParam);
+LRESULT handleWindowMessage(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+bool isHandledWindowMessage(UINT uMsg);
+void queueUiEvent(int kind);
+void scheduleUiEventCheck(int kind, double delay);
+void checkUiEvent(int kind);
+void checkStartupReady();
+DWORD calcSettleFingerprint(int kind);
+bool handleUiEvent(int kind);
+void beginStateRead();
+void endStateRead();
+void handleWindowResize();
+void handleChangedIcons();
+void handleButtonStates();
 void replaceTemporaryCmdIDs();
 void preserveToolbarButtons();
+DWORD calcStartupFingerprint();
+DWORD calcMenuFingerprint(HMENU hMenu, DWORD hash);
+bool loadStartupSnapshot(DWORD fingerprint);
+void saveStartupSnapshot(DWORD fingerprint);
+DWORD loadExpectedPluginMenus();
 void updateToolbarState();
+int calcButtonState(int idCommand);
+void updateButtonState(HWND tbWindow, int idCommand);
+void updateDependentButtons(UINT notification);
+DWORD calcEditorState();
+void handleEditorState();
 void resetToolbarLayout();
 void saveToolbarLayout();
 void restoreToolbarLayout(bool menuStates);
+bool readDatLayout(DATLAYOUT *layout);
 void makeToolbarWrap();
 void makeToolbarOverflow();
 void adjustIdealSize();
 void displayOverflowMenu(NMREBARCHEVRON *lpNmRebarChevron);
-HBITMAP createBitmapForCustomButton(TCHAR text[]);
-HICON createIconForCustomButton(TCHAR text[]);
+int captureToolbarLayout(DWORD layout[]);
+bool applyToolbarDelta(HWND tbWindow, DWORD layout[], int *count, int op, int index, int toIndex, DWORD identity);
+bool applyJournalGroup(int start, int end, bool undo);
+void recordLayoutChange();
+void resetLayoutBaseline();
+void addJournalGroup(JOURNALDELTA deltas[], int deltaCount);
+void appendLayoutJournal(JOURNALDELTA deltas[], int deltaCount);
+void loadLayoutJournal();
+void compactLayoutJournal();
+void openSyncChannel();
+void closeSyncChannel();
+void publishLayoutChange(JOURNALDELTA deltas[], int deltaCount);
+void syncLayoutChanges();
+bool applySyncDeltas(JOURNALDELTA deltas[], int deltaCount);
+DWORD WINAPI handleSyncEvents(LPVOID lpParam);
+bool getLayoutFilePath(LPTSTR filePath, bool save);
+void buildMenuIndex(HMENU hMenu, MENUINDEXENTRY *path);
+int getMenuIndexPath(MENUINDEXENTRY *entry, LPTSTR lpString, int maxCount);
+int findMenuIndexCommand(UINT idCommand);
+int findMenuIndexPath(LPTSTR lpString);
+void writeLayoutEntry(LAYOUTSTREAM *stream, TBBUTTON tbButton);
+int resolveLayoutEntry(LPTSTR lpString);
+void writeLayoutText(LAYOUTSTREAM *stream, LPCTSTR lpString);
+void flushLayoutText(LAYOUTSTREAM *stream);
+bool readLayoutLine(LAYOUTSTREAM *stream, LPTSTR lpString, int maxCount);
+DWORD calcStringHash(LPCTSTR lpString);
+void startImageJobs();
+DWORD WINAPI runImageJobs(LPVOID lpParam);
+bool runNextImageJob();
+void waitImageJob(int index);
+void finishImageJobs();
+HANDLE createJobImage(const IMAGEJOB *job, int size);
+void applyImageVariants();
+HANDLE findImageVariant(int job, int size, bool disabled);
+void loadIconAtlas();
+void saveIconAtlas();
+void releaseIconAtlas();
+DWORD calcIconAtlasStamp();
+HANDLE loadCustomImage(LPCTSTR configPath, LPCTSTR fileName, UINT type, int size);
+BYTE *readImageFile(LPCTSTR filePath, DWORD *size);
+bool captureCustomImage(HANDLE hImage, UINT type, ICONIMAGE *image);
+HANDLE createCustomImage(UINT type, const ICONIMAGE *image);
+HANDLE createSharedImage(UINT type, const ICONIMAGE *image);
+int findSharedImage(unsigned long long contentHash, UINT type, const ICONIMAGE *image);
+int countDuplicateSlots();
+HANDLE createImageVariant(UINT type, const ICONIMAGE *source, int size);
+HANDLE createQuickCodeImage(LPCTSTR text, UINT type, int size);
+DWORD calcButtonIdentity(TBBUTTON tbButton);
+DWORD findButtonIdentity(TBBUTTON tbButton);
 DWORD calcButtonStringHash(TBBUTTON tbButton);
 DWORD calcPluginButtonMenuHash(TBBUTTON tbButton);
 int findPluginParentMenuString(HMENU hMenu, UINT idCommand, LPTSTR lpString, int maxCount);
 int findCmdIDForMenuStrings(HMENU hMenu0, LPTSTR menuString0, LPTSTR menuString1, LPTSTR menuString2, LPTSTR menuString3);
 void stripMenuString(LPTSTR lpString);
+void findToolbarWindows(HWND *rbWindow, HWND *tbWindow);
+double timeWindowLookups(bool cached);
+HANDLE trackHandle(HANDLE handle, int kind);
+void releaseHandle(HANDLE handle);
+void releaseAllHandles();
 int getCommCtrlMajorVersion();
+UINT getWindowDpi(HWND hwnd);
+double elapsedMilliseconds(LARGE_INTEGER startTime);
 
 //
 // The plugin data that Notepad++ needs
@@ -151,6 +614,9 @@ NppData nppData;
 
 void pluginInit(HANDLE hModule)
 {
+    InitializeCriticalSection(&g_quickCodeLock);
+    InitializeCriticalSection(&g_sharedLock);
+    InitializeCriticalSection(&g_trackedLock);
 }
 
 //
@@ -159,6 +625,25 @@ void pluginInit(HANDLE hModule)
 
 void pluginCleanUp()
 {
+    int i;
+    
+    // Image workers drained before anything they use is freed
+    
+    finishImageJobs();  /* already drained after custom buttons added - nothing is waited for here (loader lock held) */
+    if (g_imageJobEvent) CloseHandle(g_imageJobEvent);
+    g_imageJobEvent = NULL;
+    
+    for (i = 0; i < g_quickCodeCount; i++) delete[] (unsigned int *) g_quickCodes[i].image.pixels;
+    g_quickCodeCount = 0;
+    DeleteCriticalSection(&g_quickCodeLock);
+    
+    for (i = 0; i < g_sharedImageCount; i++) delete[] (unsigned int *) g_sharedImages[i].image.pixels;
+    g_sharedImageCount = 0;  /* handles released with all tracked handles */
+    DeleteCriticalSection(&g_sharedLock);
+    
+    releaseIconAtlas();
+    releaseAllHandles();
+    DeleteCriticalSection(&g_trackedLock);
 }
 
 //
@@ -185,10 +670,15 @@ void commandMenuInit()
     setCommand(2, (TCHAR*)TEXT("Custom Buttons"), customButtons, NULL, false);
     setCommand(3, (TCHAR*)TEXT("Wrap Toolbar"), wrapToolbar, NULL, false);
     setCommand(4, (TCHAR*)TEXT("----------"), NULL, NULL, false);
-    setCommand(5, (TCHAR*)TEXT("Help - Overview"), helpOverview, NULL, false);
-    setCommand(6, (TCHAR*)TEXT("Help - Custom Buttons"), helpCustomButtons, NULL, false);
-    setCommand(7, (TCHAR*)TEXT("----------"), NULL, NULL, false);
-    setCommand(8, (TCHAR*)TEXT("Resource Usage"), resourceUsage, NULL, false);
+    setCommand(5, (TCHAR*)TEXT("Undo Layout Change"), undoLayoutChange, NULL, false);
+    setCommand(6, (TCHAR*)TEXT("Redo Layout Change"), redoLayoutChange, NULL, false);
+    setCommand(7, (TCHAR*)TEXT("Export Layout..."), exportLayout, NULL, false);
+    setCommand(8, (TCHAR*)TEXT("Import Layout..."), importLayout, NULL, false);
+    setCommand(9, (TCHAR*)TEXT("----------"), NULL, NULL, false);
+    setCommand(10, (TCHAR*)TEXT("Help - Overview"), helpOverview, NULL, false);
+    setCommand(11, (TCHAR*)TEXT("Help - Custom Buttons"), helpCustomButtons, NULL, false);
+    setCommand(12, (TCHAR*)TEXT("----------"), NULL, NULL, false);
+    setCommand(13, (TCHAR*)TEXT("Resource Usage"), resourceUsage, NULL, false);
 }
 
 //
@@ -229,12 +719,11 @@ bool setCommand(size_t index, TCHAR *cmdName, PFUNCPLUGINCMD pFunc, ShortcutKey
 
 void addMenuCommands()
 {
-    TCHAR configPath[MAX_PATH];
-    TCHAR datFilePath[MAX_PATH];
-    HANDLE datFile;
-    DWORD bytesRead;
+    DATLAYOUT layout;
     int menuHidden;
     
+    if (!enterLifecycleStage(LIFECYCLE_MENUS)) return;
+    
     // Initialize Notepad++ version number
     
     g_nppVersion = (int) SendMessage(nppData._nppHandle, NPPM_GETNPPVERSION, 0, 0);
@@ -254,69 +743,50 @@ void addMenuCommands()
     
     g_customButtonsState = g_wrapToolbarState = 0;
     
-    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
-    
-    lstrcpy(datFilePath, configPath);
-    lstrcat(datFilePath, TEXT("\\CustomizeToolbar.dat"));
-    
-    datFile = CreateFile(datFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (datFile != INVALID_HANDLE_VALUE)
+    if (readDatLayout(&layout))
     {
-        ReadFile(datFile, &g_customButtonsState, sizeof(int), &bytesRead, NULL);
-        ReadFile(datFile, &g_wrapToolbarState, sizeof(int), &bytesRead, NULL);
+        g_customButtonsState = layout.customButtonsState;
+        g_wrapToolbarState = layout.wrapToolbarState;
     }
-    
-    CloseHandle(datFile);
 }
 
 void addToolbarButtons()
 {
     TCHAR configPath[MAX_PATH];
     TCHAR btnFilePath[MAX_PATH];
-    TCHAR bmpFilePath[MAX_PATH], icoFilePath[MAX_PATH], icodarkFilePath[MAX_PATH];
-    HANDLE btnFile, bmpFile, icoFile, icodarkFile;
+    HANDLE btnFile;
     TCHAR nextChar;
     DWORD bytesRead;
     TCHAR buffer[MAXSIZE*7+10];  /* custom button definition - 4 menu strings, 3 file names, plus added commas */
-    TCHAR bmpFileName[MAXSIZE], icoFileName[MAXSIZE], icodarkFileName[MAXSIZE];
+    IMAGEJOB *jobs;
+    ICONIMAGE bitmapStrip, iconStrip;
+    LARGE_INTEGER startTime;
     HBITMAP hToolbarBmp;
     HICON hToolbarIcon, hToolbarIconDarkMode;
     toolbarIcons buttonIcon;
     toolbarIconsWithDarkMode buttonIconDM;
-    bool bmpError, icoError, icodarkError;
-    int i, j;
+    int i, j, k;
+    
+    if (!enterLifecycleStage(LIFECYCLE_TOOLBAR)) return;  /* buttons added once only */
 
     // Add twenty-six additional buttons onto toolbar for Notepad++ built-in commands
+    // Images are sliced from one strip per icon style (packed by tools\StripTool.cpp), so each strip is loaded once
+    
+    QueryPerformanceCounter(&startTime);
+    
+    loadImageStrip(IDB_ADDITIONAL_BUTTONS, (LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS), ADDITIONALBITMAPSIZE, &bitmapStrip);
+    loadImageStrip(IDB_ADDITIONAL_ICONS, LR_CREATEDIBSECTION, ADDITIONALICONSIZE, &iconStrip);  /* keep alpha channel */
+    
+    for (i = 0; i < ADDITIONALBUTTONS; i++) addAdditionalButton(&bitmapStrip, &iconStrip, i, g_additionalButtons[i]);
     
-    addAdditionalButton(IDB_FILE_CLOSEALLBUT, IDI_FILE_CLOSEALLBUT, IDM_FILE_CLOSEALL_BUT_CURRENT);
-    addAdditionalButton(IDB_EDIT_DELETE, IDI_EDIT_DELETE, IDM_EDIT_DELETE);
-    addAdditionalButton(IDB_INDENT_DECREASE, IDI_INDENT_DECREASE, IDM_EDIT_RMV_TAB);
-    addAdditionalButton(IDB_INDENT_INCREASE, IDI_INDENT_INCREASE, IDM_EDIT_INS_TAB);
-    addAdditionalButton(IDB_LINE_DUPLICATE, IDI_LINE_DUPLICATE, IDM_EDIT_DUP_LINE);
-    addAdditionalButton(IDB_COMMENT_SET, IDI_COMMENT_SET, IDM_EDIT_BLOCK_COMMENT_SET);
-    addAdditionalButton(IDB_COMMENT_CLEAR, IDI_COMMENT_CLEAR, IDM_EDIT_BLOCK_UNCOMMENT);
-    addAdditionalButton(IDB_AUTO_WORDCOMPLETE, IDI_AUTO_WORDCOMPLETE, IDM_EDIT_AUTOCOMPLETE_CURRENTFILE);
-    addAdditionalButton(IDB_BLANK_TRIMTRAILING, IDI_BLANK_TRIMTRAILING, IDM_EDIT_TRIMTRAILING);
-    addAdditionalButton(IDB_BLANK_TABTOSPACE, IDI_BLANK_TABTOSPACE, IDM_EDIT_TAB2SW);
-    addAdditionalButton(IDB_BLANK_SPACETOTAB, IDI_BLANK_SPACETOTAB, IDM_EDIT_SW2TAB_ALL);
-    addAdditionalButton(IDB_SEARCH_FINDINFILES, IDI_SEARCH_FINDINFILES, IDM_SEARCH_FINDINFILES);
-    addAdditionalButton(IDB_SEARCH_FINDPREV, IDI_SEARCH_FINDPREV, IDM_SEARCH_FINDPREV);
-    addAdditionalButton(IDB_SEARCH_FINDNEXT, IDI_SEARCH_FINDNEXT, IDM_SEARCH_FINDNEXT);
-    addAdditionalButton(IDB_SEARCH_INCREMENTAL, IDI_SEARCH_INCREMENTAL, IDM_SEARCH_FINDINCREMENT);
-    addAdditionalButton(IDB_SEARCH_RESULTS, IDI_SEARCH_RESULTS, IDM_FOCUS_ON_FOUND_RESULTS);
-    addAdditionalButton(IDB_SEARCH_GOTO, IDI_SEARCH_GOTO, IDM_SEARCH_GOTOLINE);
-    addAdditionalButton(IDB_BOOKMARK_PREV, IDI_BOOKMARK_PREV, IDM_SEARCH_PREV_BOOKMARK);
-    addAdditionalButton(IDB_BOOKMARK_NEXT, IDI_BOOKMARK_NEXT, IDM_SEARCH_NEXT_BOOKMARK);
-    addAdditionalButton(IDB_BOOKMARK_CLEAR, IDI_BOOKMARK_CLEAR, IDM_SEARCH_CLEAR_BOOKMARKS);
-    addAdditionalButton(IDB_ZOOM_RESTORE, IDI_ZOOM_RESTORE, IDM_VIEW_ZOOMRESTORE);
-    addAdditionalButton(IDB_MOVE_MOVETOOTHER, IDI_MOVE_MOVETOOTHER, IDM_VIEW_GOTO_ANOTHER_VIEW);
-    addAdditionalButton(IDB_CLONE_CLONETOOTHER, IDI_CLONE_CLONETOOTHER, IDM_VIEW_CLONE_TO_ANOTHER_VIEW);
-    addAdditionalButton(IDB_VIEW_HIDELINES, IDI_VIEW_HIDELINES, IDM_VIEW_HIDELINES);
-    addAdditionalButton(IDB_VIEW_FOLDALL, IDI_VIEW_FOLDALL, IDM_VIEW_TOGGLE_FOLDALL);
-    addAdditionalButton(IDB_VIEW_UNFOLDALL, IDI_VIEW_UNFOLDALL, IDM_VIEW_TOGGLE_UNFOLDALL);
     // Add customize toolbar button onto toolbar
     
-    addAdditionalButton(IDB_CUSTOMIZE_TOOLBAR, IDI_CUSTOMIZE_TOOLBAR, funcItem[0]._cmdID);
+    addAdditionalButton(&bitmapStrip, &iconStrip, ADDITIONALBUTTONS, funcItem[0]._cmdID);
+    
+    delete[] (unsigned int *) bitmapStrip.pixels;
+    delete[] (unsigned int *) iconStrip.pixels;
+    
+    g_additionalTime = elapsedMilliseconds(startTime);
 
     if (!g_customButtonsState) return;
     // Add custom buttons onto toolbar for Notepad++ built-in commands or plugin commands (with temporary custom command identifiers)
@@ -360,7 +830,7 @@ void addToolbarButtons()
 
         //DEBUG: MessageBox(nppData._nppHandle, buffer, TEXT("Debug: Line Read"), MB_OK);
 
-        if (i > 0 && buffer[0] != (TCHAR) ';')  /* buffer is not empty and does not contain comment */
+        if (i > 0 && buffer[0] != (TCHAR) ';' && g_customButtonsCount < 100)  /* buffer is not empty and does not contain comment */
         {
             for (i = 0, j = 0; j < MAXSIZE-1 && buffer[i] != (TCHAR) ','; i++, j++) g_customMenuStrings[g_customButtonsCount][0][j] = buffer[i];
             g_customMenuStrings[g_customButtonsCount][0][j] = 0;
@@ -386,77 +856,23 @@ void addToolbarButtons()
             //DEBUG: MessageBox(nppData._nppHandle, g_customMenuStrings[g_customButtonsCount][3], TEXT("Parsed Menu String 4"), MB_OK);
             // Debug
 
-            for (i++, j = 0; j < MAXSIZE-1 && buffer[i] != (TCHAR) ','; i++, j++) bmpFileName[j] = buffer[i];
-            bmpFileName[j] = 0;
-            for (i++, j = 0; j < MAXSIZE-1 && buffer[i] != (TCHAR) ','; i++, j++) icoFileName[j] = buffer[i];
-            icoFileName[j] = 0;
-            for (i++, j = 0; j < MAXSIZE-1 && buffer[i] != (TCHAR) ','; i++, j++) icodarkFileName[j] = buffer[i];
-            icodarkFileName[j] = 0;
+            // Image file names (or quick codes) - images created by image jobs once all definitions are read
             
-            //DEBUG: MessageBox(nppData._nppHandle, buffer, TEXT("Debug: Parsed Button Definition"), MB_OK);
-            //DEBUG: MessageBox(NULL, bmpFileName, TEXT("Debug: Parsed Bitmap Filename"), MB_OK);
-            //DEBUG: MessageBox(NULL, icoFileName, TEXT("Debug: Parsed Icon Filename"), MB_OK);
-            //DEBUG: MessageBox(NULL, icodarkFileName, TEXT("Debug: Parsed Dark Icon Filename"), MB_OK);
-
-            bmpError = icoError = icodarkError = false;
-            
-            if (bmpFileName[0] == (TCHAR) '*') hToolbarBmp = createBitmapForCustomButton(bmpFileName);
-            else
-            {
-                lstrcpy(bmpFilePath, configPath);
-                lstrcat(bmpFilePath, TEXT("\\"));
-                lstrcat(bmpFilePath, bmpFileName);
-                bmpFile = CreateFile(bmpFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-                CloseHandle(bmpFile);
-                bmpError = (bmpFile == INVALID_HANDLE_VALUE || GetLastError() == ERROR_FILE_NOT_FOUND);
-                if (!bmpError) hToolbarBmp = (HBITMAP) LoadImage(NULL, bmpFilePath, IMAGE_BITMAP, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS | LR_LOADFROMFILE));
-                else hToolbarBmp = (HBITMAP) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDB_CUSTOM_MISSINGFILE), IMAGE_BITMAP, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
-            }
-            
-            if (icoFileName[0] == (TCHAR) '*') hToolbarIcon = createIconForCustomButton(icoFileName);
-            else
-            {
-                lstrcpy(icoFilePath, configPath);
-                lstrcat(icoFilePath, TEXT("\\"));
-                lstrcat(icoFilePath, icoFileName);
-                icoFile = CreateFile(icoFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-                CloseHandle(icoFile);
-                icoError = (icoFile == INVALID_HANDLE_VALUE || GetLastError() == ERROR_FILE_NOT_FOUND);
-                if (!icoError) hToolbarIcon = (HICON) LoadImage(NULL, icoFilePath, IMAGE_ICON, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS | LR_LOADFROMFILE));
-                else hToolbarIcon = (HICON) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDI_CUSTOM_MISSINGFILE), IMAGE_ICON, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
-            }
+            jobs = &g_imageJobs[g_customButtonsCount*IMAGEJOBKINDS];
             
-            if (icodarkFileName[0] == (TCHAR) '*') hToolbarIconDarkMode = createIconForCustomButton(icodarkFileName);
-            else
+            for (k = 0; k < IMAGEJOBKINDS; k++)
             {
-                lstrcpy(icodarkFilePath, configPath);
-                lstrcat(icodarkFilePath, TEXT("\\"));
-                lstrcat(icodarkFilePath, icodarkFileName);
-                icodarkFile = CreateFile(icodarkFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-                CloseHandle(icodarkFile);
-                icodarkError = (icodarkFile == INVALID_HANDLE_VALUE || GetLastError() == ERROR_FILE_NOT_FOUND);
-                if (!icodarkError) hToolbarIconDarkMode = (HICON) LoadImage(NULL, icodarkFilePath, IMAGE_ICON, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS | LR_LOADFROMFILE));
-                else
-                {
-                    if (!icoError) hToolbarIconDarkMode = hToolbarIcon;
-                    else hToolbarIconDarkMode = (HICON) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDI_CUSTOM_MISSINGFILE), IMAGE_ICON, 0, 0,(LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
-                }
+                for (i++, j = 0; j < MAXSIZE-1 && buffer[i] != (TCHAR) ','; i++, j++) jobs[k].fileName[j] = buffer[i];
+                jobs[k].fileName[j] = 0;
+                jobs[k].kind = k;
+                jobs[k].hImage = NULL;
+                jobs[k].done = 0;
             }
             
-            if (HIWORD(g_nppVersion) < 8)  /* Notepad++ <= 7.9.5 */
-            {
-                buttonIcon.hToolbarBmp = hToolbarBmp;
-                buttonIcon.hToolbarIcon = hToolbarIcon;
-                /* Note: buttonIcon.hToolbarIcon is ignored by Notepad++ <= 7.9.5 */
-                SendMessage(nppData._nppHandle, NPPM_ADDTOOLBARICON_DEPRECATED, (WPARAM) (ID_CMD_CUSTOM+g_customButtonsCount), (LPARAM) &buttonIcon);
-            }
-            else  /* Notepad++ >= 8.0 */
-            {
-                buttonIconDM.hToolbarBmp = hToolbarBmp;
-                buttonIconDM.hToolbarIcon = hToolbarIcon;
-                buttonIconDM.hToolbarIconDarkMode = hToolbarIconDarkMode;
-                SendMessage(nppData._nppHandle, NPPM_ADDTOOLBARICON_FORDARKMODE, (WPARAM) (ID_CMD_CUSTOM+g_customButtonsCount), (LPARAM) &buttonIconDM);
-            }
+            //DEBUG: MessageBox(nppData._nppHandle, buffer, TEXT("Debug: Parsed Button Definition"), MB_OK);
+            //DEBUG: MessageBox(NULL, jobs[IMAGEJOB_BITMAP].fileName, TEXT("Debug: Parsed Bitmap Filename"), MB_OK);
+            //DEBUG: MessageBox(NULL, jobs[IMAGEJOB_ICON].fileName, TEXT("Debug: Parsed Icon Filename"), MB_OK);
+            //DEBUG: MessageBox(NULL, jobs[IMAGEJOB_DARKICON].fileName, TEXT("Debug: Parsed Dark Icon Filename"), MB_OK);
             
             g_customButtonsCount++;
         }
@@ -465,45 +881,90 @@ void addToolbarButtons()
     }
     
     CloseHandle(btnFile);
+    
+    // Create images in parallel, and add each custom button in order as soon as its images are ready
+    
+    QueryPerformanceCounter(&startTime);
+    
+    lstrcpy(g_imageConfigPath, configPath);
+    g_imageJobCount = g_customButtonsCount*IMAGEJOBKINDS;
+    
+    g_imageDpi = getWindowDpi(nppData._nppHandle);
+    g_iconSize = MulDiv(ICONBASESIZE, g_imageDpi, 96);  /* bitmaps stay 16x16 (as loaded) */
+    
+    loadIconAtlas();
+    startImageJobs();
+    
+    for (i = 0; i < g_customButtonsCount; i++)
+    {
+        jobs = &g_imageJobs[i*IMAGEJOBKINDS];
+        for (k = 0; k < IMAGEJOBKINDS; k++) waitImageJob(i*IMAGEJOBKINDS+k);
+        
+        hToolbarBmp = (HBITMAP) jobs[IMAGEJOB_BITMAP].hImage;
+        hToolbarIcon = (HICON) jobs[IMAGEJOB_ICON].hImage;
+        hToolbarIconDarkMode = jobs[IMAGEJOB_DARKICON].hImage ? (HICON) jobs[IMAGEJOB_DARKICON].hImage : hToolbarIcon;
+        
+        if (HIWORD(g_nppVersion) < 8)  /* Notepad++ <= 7.9.5 */
+        {
+            buttonIcon.hToolbarBmp = hToolbarBmp;
+            buttonIcon.hToolbarIcon = hToolbarIcon;
+            /* Note: buttonIcon.hToolbarIcon is ignored by Notepad++ <= 7.9.5 */
+            SendMessage(nppData._nppHandle, NPPM_ADDTOOLBARICON_DEPRECATED, (WPARAM) (ID_CMD_CUSTOM+i), (LPARAM) &buttonIcon);
+        }
+        else  /* Notepad++ >= 8.0 */
+        {
+            buttonIconDM.hToolbarBmp = hToolbarBmp;
+            buttonIconDM.hToolbarIcon = hToolbarIcon;
+            buttonIconDM.hToolbarIconDarkMode = hToolbarIconDarkMode;
+            SendMessage(nppData._nppHandle, NPPM_ADDTOOLBARICON_FORDARKMODE, (WPARAM) (ID_CMD_CUSTOM+i), (LPARAM) &buttonIconDM);
+        }
+    }
+    
+    finishImageJobs();  /* no worker still reads atlas, or runs after unload */
+    saveIconAtlas();
+    
+    g_duplicateSlots = countDuplicateSlots();
+    g_imageTime = elapsedMilliseconds(startTime);
 }
 
-void addAdditionalButton(int bitmapName, int iconName, int idCmd)
+void addAdditionalButton(const ICONIMAGE *bitmapStrip, const ICONIMAGE *iconStrip, int frame, int idCmd)
 {
     toolbarIcons buttonIcon;
     toolbarIconsWithDarkMode buttonIconDM;
     
     if (HIWORD(g_nppVersion) < 8)  /* Notepad++ <= 7.9.5 */
     {
-        buttonIcon.hToolbarBmp = (HBITMAP) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(bitmapName), IMAGE_BITMAP, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
-        buttonIcon.hToolbarIcon = (HICON) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(iconName), IMAGE_ICON, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
+        buttonIcon.hToolbarBmp = (HBITMAP) createStripFrame(ICONTYPE_BITMAP, bitmapStrip, frame);
+        buttonIcon.hToolbarIcon = (HICON) createStripFrame(ICONTYPE_ICON, iconStrip, frame);
         /* Note: buttonIcon.hToolbarIcon is ignored by Notepad++ <= 7.9.5 */
         SendMessage(nppData._nppHandle, NPPM_ADDTOOLBARICON_DEPRECATED, (WPARAM) idCmd, (LPARAM) &buttonIcon);
     }
     else  /* Notepad++ >= 8.0 */
     {
-        buttonIconDM.hToolbarBmp = (HBITMAP) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(bitmapName), IMAGE_BITMAP, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
-        buttonIconDM.hToolbarIcon = (HICON) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(iconName), IMAGE_ICON, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
+        buttonIconDM.hToolbarBmp = (HBITMAP) createStripFrame(ICONTYPE_BITMAP, bitmapStrip, frame);
+        buttonIconDM.hToolbarIcon = (HICON) createStripFrame(ICONTYPE_ICON, iconStrip, frame);
         buttonIconDM.hToolbarIconDarkMode = buttonIconDM.hToolbarIcon;
         SendMessage(nppData._nppHandle, NPPM_ADDTOOLBARICON_FORDARKMODE, (WPARAM) idCmd, (LPARAM) &buttonIconDM);
     }
 }
 
 void afterNppReady()
-{
-    CreateThread(NULL, 0, afterNppReadyDelayed, NULL, 0, NULL);
-}
-
-DWORD WINAPI afterNppReadyDelayed(LPVOID lpParam)
 {
     HWND rbWindow,tbWindow;
-    TCHAR configPath[MAX_PATH];
-    TCHAR datFilePath[MAX_PATH];
-    HANDLE datFile;
+    int i;
+    
+    if (!enterLifecycleStage(LIFECYCLE_READY)) return;
     
-    Sleep(10);  /* allow time for other plugins to create additional menu items */
+    QueryPerformanceCounter(&g_readyTime);
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // Initialize UI event delays (before subclassing, which queues UI events)
+    // UI events are delayed with timers on this thread, so all toolbar changes are made on this thread
+    
+    g_uiEventMessage = RegisterWindowMessage(TEXT("CustomizeToolbarUiEvents"));
+    for (i = 0; i < UIEVENTKINDS; i++) g_uiEventDelay[i] = UIEVENTINITDELAY;
+    g_uiEventDelay[UIEVENT_STARTUP] = 0.0;  /* first readiness check as soon as other plugins have handled NPPN_READY */
     
     // Initialize REBARBANDINFO structure size - taking account of Windows and Common Controls versions
     // Constant REBARBANDINFO_V6_SIZE specifies structure size for Common Controls 4.x & 5.x (not 6.x) !
@@ -519,6 +980,20 @@ DWORD WINAPI afterNppReadyDelayed(LPVOID lpParam)
     
     g_origRebarProc = (WNDPROC) (LONG_PTR) SetWindowLongPtr(rbWindow, GWLP_WNDPROC, (LONG_PTR) subclassRebarProc);
     
+    // Complete startup when ready - when plugins menu is as last session, or menus have stopped changing
+    // (allows time for other plugins to create additional menu items, without fixed delay)
+    
+    g_expectedPluginMenus = loadExpectedPluginMenus();
+    queueUiEvent(UIEVENT_STARTUP);
+}
+
+void afterNppReadyDelayed()
+{
+    HWND rbWindow,tbWindow;
+    DATLAYOUT layout;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
     // Replace temporary custom command identifiers with actual command identifiers
     // This cannot be done when NPPN_TBMODIFICATION received or immediately after NPPN_READY received,
     // because other plugins may receive these notifications afterwards and create additional menu items
@@ -529,23 +1004,9 @@ DWORD WINAPI afterNppReadyDelayed(LPVOID lpParam)
     
     preserveToolbarButtons();
     
-    // Get plugins config directory
-    
-    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
-    
-    // Initialise .dat file path
-    
-    lstrcpy(datFilePath, configPath);
-    lstrcat(datFilePath, TEXT("\\CustomizeToolbar.dat"));
-    
-    // Try to open .dat file
-    
-    datFile = CreateFile(datFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    CloseHandle(datFile);
-    
-    // Reset and save toolbar layout if .dat file does not exist
+    // Reset and save toolbar layout if .dat file does not exist (or is not a recognised version)
     
-    if (datFile == INVALID_HANDLE_VALUE)
+    if (!readDatLayout(&layout))
     {
         resetToolbarLayout();
         saveToolbarLayout();
@@ -554,20 +1015,91 @@ DWORD WINAPI afterNppReadyDelayed(LPVOID lpParam)
     // Restore toolbar layout
     
     restoreToolbarLayout(true);
+    g_editorState = calcEditorState();
     updateToolbarState();
     adjustIdealSize();
     
+    // Load undo/redo history of layout changes (recorded relative to restored layout)
+    
+    resetLayoutBaseline();
+    loadLayoutJournal();
+    
+    // Attach to layout synchronization channel (takes layout from other instances if already running)
+    
+    openSyncChannel();
+    
     // Restore toolbar wrap state and display styles
     
     if (g_wrapToolbarState) makeToolbarWrap();
     else makeToolbarOverflow();
     
-    return 0;
+    // Record time from NPPN_READY to final toolbar - UI events are handled from now on
+    
+    g_startupTime = elapsedMilliseconds(g_readyTime);
+    enterLifecycleStage(LIFECYCLE_STARTED);
+}
+
+void bufferActivated()
+{
+    if (g_lifecycle.stage != LIFECYCLE_STARTED) return;  /* startup updates all button states */
+    
+    handleEditorState();
+    updateDependentButtons(NPPN_BUFFERACTIVATED);
+}
+
+void documentStateChanged(UINT notification)
+{
+    if (g_lifecycle.stage != LIFECYCLE_STARTED) return;
+    
+    // Scintilla UI updated for every keystroke - coalesced, and buttons only updated if editor state changed
+    
+    if (notification == SCN_UPDATEUI)
+    {
+        queueUiEvent(UIEVENT_EDITORSTATE);
+        return;
+    }
+    
+    if (notification == NPPN_READONLYCHANGED) handleEditorState();
+    updateDependentButtons(notification);
 }
 
 void beforeNppShutdown()
 {
-    saveToolbarLayout();
+    bool started;
+    int i;
+    
+    started = (g_lifecycle.stage == LIFECYCLE_STARTED);
+    if (!enterLifecycleStage(LIFECYCLE_SHUTDOWN)) return;
+    
+    // Apply any changes published by other instances, so saved layout includes them (rather than overwriting them)
+    // Not saved if Notepad++ closed before startup completed (toolbar not yet restored from .dat file)
+    
+    if (started)
+    {
+        syncLayoutChanges();
+        saveToolbarLayout();
+        closeSyncChannel();
+    }
+    
+    // Stop UI event timers (including startup readiness check, if Notepad++ closed before ready)
+    
+    for (i = 0; i < UIEVENTKINDS; i++) KillTimer(nppData._nppHandle, UITIMER_BASE+i);
+}
+
+//
+// Lifecycle functions
+//
+
+bool enterLifecycleStage(int stage)
+{
+    // Each stage is entered only from the stage before it, shutdown from any stage
+    // Repeated or out of order notifications are ignored, so each startup pass runs exactly once
+    
+    if (!advanceLifecycle(&g_lifecycle, stage)) return false;
+    
+    QueryPerformanceCounter(&g_lifecycleTime[stage]);
+    
+    return true;
 }
 
 //
@@ -578,8 +1110,7 @@ void customizeToolbar()
 {
     HWND rbWindow, tbWindow;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
     
     SendMessage(tbWindow, TB_CUSTOMIZE, (WPARAM) 0, (LPARAM) 0);
 }
@@ -636,6 +1167,7 @@ void customButtons()
                                        TEXT("Customize Toolbar - Custom Buttons - Disabled"), MB_OK | MB_APPLMODAL);
     }
     
+    publishLayoutChange(NULL, 0);
     saveToolbarLayout();
 }
 
@@ -650,89 +1182,461 @@ void wrapToolbar()
     if (g_wrapToolbarState) makeToolbarWrap();
     else makeToolbarOverflow();
     
+    publishLayoutChange(NULL, 0);
     saveToolbarLayout();
 }
 
-void helpOverview()
-{
-    MessageBox(nppData._nppHandle, TEXT("Customize Toolbar Plugin\n\n")
-                                   TEXT("Version: 5.3    -     2011-2021 DW-dev    -    E-mail: dw-dev@gmx.com\n\n")
-                                   TEXT("Version: 5.3.1    -     2024+   QGtKMlLz    -    E-mail: 3m33dkojb@mozmail.com\n\n")
-                                   TEXT("This plugin allows the Notepad++ toolbar to be fully customised by the user, and includes twenty-six additional buttons for frequently used menu commands.\n\n")
-                                   TEXT("All buttons on the toolbar can be customized, whether Notepad++ built-in buttons, the additional buttons, or buttons belonging to other plugins.\n\n")
-                                   TEXT("When this plugin is first installed, the additional buttons are not shown on the toolbar, but are available in the Customize Toolbar dialog box.\n\n")
-                                   TEXT("The toolbar is customized using the Customize Toolbar dialog box, which can be opened by clicking on the Customize Toolbar... menu item, or ")
-                                   TEXT("by clicking on the Customize Toolbar... toolbar button, or by double-clicking on empty space on the toolbar.\n\n")
-                                   TEXT("Alternatively, the toolbar can be customized by holding down the Shift key and dragging a button along the toolbar or off the toolbar.\n\n")
-                                   TEXT("It is recommended to customize the toolbar when Standard Icons are selected in Notepad++ preferences, so that buttons belonging to other plugins are visible.\n\n")
-                                   TEXT("Custom buttons for Notepad++ or plugin menu commands can be defined using a configuration file, and there is a menu option to enable/disable this feature.\n\n")
-                                   TEXT("An overflow chevron is shown if there are too many buttons to fit on the toolbar. Alternatively, there is a menu option to wrap the toolbar over several rows.\n\n")
-                                   TEXT("There is a menu option to show the resources (toolbar buttons and plugin menu commands) that are currently being used.\n\n"),
-                                   TEXT("Customize Toolbar - Help - Overview"), MB_OK | MB_APPLMODAL);
-}
-
-void helpCustomButtons()
-{
-    MessageBox(nppData._nppHandle, TEXT("Custom buttons are defined using a configuration file (CustomizeToolbar.btn) located in the Notepad++ configuration sub-folder (...\\plugins\\config).\n\n")
-                                   TEXT("When the Custom Buttons feature is enabled, if the .btn configuration file did not previously exist, it is created and contains examples of custom button definitions.\n\n")
-#ifdef _UNICODE
-                                   TEXT("The .btn configuration file must employ Unicode UTF-16 Little Endian encoding, with an optional Byte Order Mark (BOM) at the start of file, and CR-LF line breaks.  ")
-                                   TEXT("When creating this file with Notepad++, set Encoding to UCS-2 Little Endian.\n\n")
-#else
-                                   TEXT("The .btn configuration file must employ ANSI encoding and CR-LF line breaks.  ")
-                                   TEXT("When creating this file with Notepad++, set Encoding to ANSI.\n\n")
-#endif
-                                   TEXT("Each line in the .btn configuration file can be either a custom button definition or a comment starting with a semicolon.\n\n")
-                                   TEXT("Each custom button definition comprises seven comma separated fields (four menu strings, an optional .bmp file name for Standard icons, ")
-                                   TEXT("and two optional .ico file names for Fluent icons in light and dark modes).\n\n")
-                                   TEXT("If the menu strings correspond to a Notepad++ built-in button or plugin button, the custom button will replace the Notepad++ built-in button or plugin button.\n\n")
-                                   TEXT("If the menu strings do not correspond to a Notepad++ built-in button or plugin button, then an error symbol (exclamation mark) is displayed.\n\n")
-                                   TEXT("If the .bmp or .ico file names are present, the files must be located in the Notepad++ configuration sub-folder (...\\plugins\\config).\n\n")
-                                   TEXT("If the .bmp or light mode .ico file name is omitted, or if the file does not exist, then a warning symbol (question mark) is displayed.\n\n")
-                                   TEXT("If the dark mode .ico file name is omitted, or if the file does not exist, then if present the light mode .ico file name is used instead.\n\n")
-                                   TEXT("Each .bmp file must be an image of 16x16 pixels with a bit depth of 8-bits. Any pixels with the same colour as the bottom left pixel will appear transparent.\n\n")
-                                   TEXT("Each .ico file must be an icon containing an image of 32x32 pixels with a bit depth of 32-bits (RGB+alpha).\n\n")
-                                   TEXT("Quick codes can be used instead of file names. A quick code comprises:\nan asterisk, followed by either a color code letter (S: slate grey, R: red,\n")
-                                   TEXT("G: green, B: blue, C: cyan, M: magenta, Y: yellow) or a hex color value\n(e.g. #4488CC), followed by a colon, followed by a label (1 or 2 letters).\n\n")
-                                   TEXT("To create a red button with label 'LA', use: *R:LA or *#FF0000:LA.\n\n"),
-                                   TEXT("Customize Toolbar - Help - Custom Buttons"), MB_OK | MB_APPLMODAL);
-}
-
-void resourceUsage()
+void undoLayoutChange()
 {
-    TCHAR buffer[100];
-    int commands, maxcommands;
+    JOURNALDELTA marker = { MAKEDELTACODE(JOURNALOP_MARKER, 0, true), JOURNALMARKER_UNDO, 0 };
+    int start;
     
-    commands = funcItem[8]._cmdID-ID_PLUGINS_CMD+1;
-    maxcommands = g_id_plugins_cmd_limit-ID_PLUGINS_CMD+1;
+    // Make sure any unrecorded layout change is recorded first (so it is the change undone)
     
-    _stprintf_s(buffer, 100, TEXT("Total Buttons:  %i / 300\n\nCustom Buttons:  %i / 100\n\nPlugin Menu Commands:  %i / %i\n"), g_buttonsAvailable, g_customButtonsCount, commands, maxcommands);
+    recordLayoutChange();
     
-    MessageBox(nppData._nppHandle, buffer, TEXT("Customize Toolbar - Resource Usage"), MB_OK | MB_APPLMODAL);
+    if (g_journalPos == 0) return;  /* nothing to undo */
+    
+    // Find start of most recent layout change
+    
+    for (start = g_journalPos-1; start > 0 && !DELTAGROUPEND(g_journal[start-1]); start--);
+    
+    if (!applyJournalGroup(start, g_journalPos-1, true))
+    {
+        MessageBox(nppData._nppHandle, TEXT("Layout change cannot be undone, as the toolbar buttons have changed since it was made.\n\n"),
+                                       TEXT("Customize Toolbar - Undo Layout Change"), MB_OK | MB_APPLMODAL);
+        return;
+    }
+    
+    g_journalPos = start;
+    
+    appendLayoutJournal(&marker, 1);
 }
 
-//
-// Subclass window procedure and rebar procedure
-//
-
-LRESULT APIENTRY subclassWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+void redoLayoutChange()
 {
-    HWND rbWindow,tbWindow;
-    NMTOOLBAR *lpNmToolbar = (LPNMTOOLBAR) lParam;
-    NMREBARCHEVRON *lpNmRebarChevron = (LPNMREBARCHEVRON) lParam;
+    JOURNALDELTA marker = { MAKEDELTACODE(JOURNALOP_MARKER, 0, true), JOURNALMARKER_REDO, 0 };
+    int end;
     
-    rbWindow = FindWindowEx(nppData._nppHandle,NULL,REBARCLASSNAME,NULL);
-    tbWindow = FindWindowEx(rbWindow,NULL,TOOLBARCLASSNAME,NULL);
+    // Make sure toolbar is as recorded (any unrecorded layout change discards redo history)
     
-    if (uMsg == WM_GETDLGCODE)
-        return DLGC_WANTALLKEYS;
+    recordLayoutChange();
     
-    // Handle toolbar customization
+    if (g_journalPos == g_journalCount) return;  /* nothing to redo */
     
-    if (uMsg == WM_NOTIFY)
+    // Find end of next layout change
+    
+    for (end = g_journalPos; end < g_journalCount-1 && !DELTAGROUPEND(g_journal[end]); end++);
+    
+    if (!applyJournalGroup(g_journalPos, end, false))
     {
-        switch (lpNmToolbar->hdr.code)
-        {
+        MessageBox(nppData._nppHandle, TEXT("Layout change cannot be redone, as the toolbar buttons have changed since it was undone.\n\n"),
+                                       TEXT("Customize Toolbar - Redo Layout Change"), MB_OK | MB_APPLMODAL);
+        return;
+    }
+    
+    g_journalPos = end+1;
+    
+    appendLayoutJournal(&marker, 1);
+}
+
+void exportLayout()
+{
+    HWND rbWindow, tbWindow;
+    TCHAR filePath[MAX_PATH];
+    TBBUTTON tbButton;
+    LAYOUTSTREAM stream;
+    MENUINDEXENTRY path;
+    int i, buttonsOnToolbar;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    if (!getLayoutFilePath(filePath, true)) return;
+    
+    stream.file = CreateFile(filePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (stream.file == INVALID_HANDLE_VALUE)
+    {
+        MessageBox(nppData._nppHandle, TEXT("Layout file cannot be created.\n\n"),
+                                       TEXT("Customize Toolbar - Export Layout"), MB_OK | MB_APPLMODAL);
+        return;
+    }
+    stream.length = 0;
+    
+    // Index menu paths of all commands (one pass over main menu)
+    
+    g_menuIndexCount = 0;
+    path.depth = 0;
+    path.pathHash = 0;
+    buildMenuIndex(g_hMainMenu, &path);
+    
+    // Write settings - each line is streamed to file buffer (no intermediate copy of layout text)
+    
+#ifdef _UNICODE
+    writeLayoutText(&stream, TEXT("\xFEFF"));  /* BOM */
+#endif
+    writeLayoutText(&stream, TEXT(";Customize Toolbar layout\r\n"));
+    writeLayoutText(&stream, g_customButtonsState ? TEXT("Custom Buttons=1\r\n") : TEXT("Custom Buttons=0\r\n"));
+    writeLayoutText(&stream, g_wrapToolbarState ? TEXT("Wrap Toolbar=1\r\n") : TEXT("Wrap Toolbar=0\r\n"));
+    
+    // Write entry for each button on toolbar
+    
+    writeLayoutText(&stream, TEXT("[Toolbar]\r\n"));
+    
+    buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    for (i = 0; i < buttonsOnToolbar; i++)
+    {
+        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
+        writeLayoutEntry(&stream, tbButton);
+    }
+    
+    // Write entry for each button available
+    
+    writeLayoutText(&stream, TEXT("[Available]\r\n"));
+    
+    for (i = 0; i < g_buttonsAvailable; i++)
+    {
+        writeLayoutEntry(&stream, g_tbButtons[i]);
+    }
+    
+    flushLayoutText(&stream);
+    CloseHandle(stream.file);
+}
+
+void importLayout()
+{
+    HWND rbWindow, tbWindow;
+    TCHAR filePath[MAX_PATH];
+    TCHAR line[MAXSIZE*4+10];
+    TCHAR buffer[100];
+    TBBUTTON tbButtons[300];
+    LAYOUTSTREAM stream;
+    MENUINDEXENTRY path;
+    bool used[300], listed[300];
+    bool availableSection, toolbarSection;
+    int i, j, count, unresolved, customState, wrapState;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    if (!getLayoutFilePath(filePath, false)) return;
+    
+    stream.file = CreateFile(filePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (stream.file == INVALID_HANDLE_VALUE)
+    {
+        MessageBox(nppData._nppHandle, TEXT("Layout file cannot be opened.\n\n"),
+                                       TEXT("Customize Toolbar - Import Layout"), MB_OK | MB_APPLMODAL);
+        return;
+    }
+    stream.length = stream.position = 0;
+    
+    // Index menu paths of all commands (one pass over main menu) - each entry is then resolved against index
+    
+    g_menuIndexCount = 0;
+    path.depth = 0;
+    path.pathHash = 0;
+    buildMenuIndex(g_hMainMenu, &path);
+    
+    // Read layout text file line by line (streamed through file buffer)
+    
+    for (j = 0; j < g_buttonsAvailable; j++) used[j] = listed[j] = false;
+    customState = g_customButtonsState;
+    wrapState = g_wrapToolbarState;
+    availableSection = toolbarSection = false;
+    count = unresolved = 0;
+    
+    while (readLayoutLine(&stream, line, MAXSIZE*4+10))
+    {
+        if (line[0] == 0 || line[0] == ';') continue;
+        
+        if (lstrcmpi(line, TEXT("[Toolbar]")) == 0) { toolbarSection = true; continue; }
+        if (lstrcmpi(line, TEXT("[Available]")) == 0) { toolbarSection = false; availableSection = true; continue; }
+        if (_tcsnicmp(line, TEXT("Custom Buttons="), 15) == 0) { customState = (line[15] == '1') ? ~0 : 0; continue; }
+        if (_tcsnicmp(line, TEXT("Wrap Toolbar="), 13) == 0) { wrapState = (line[13] == '1') ? ~0 : 0; continue; }
+        
+        j = resolveLayoutEntry(line);
+        if (j < 0)
+        {
+            unresolved++;
+            continue;
+        }
+        
+        listed[j] = true;
+        
+        if (toolbarSection && count < 300 && (!used[j] || g_tbButtons[j].idCommand == 0))  /* separators can occur many times */
+        {
+            used[j] = true;
+            tbButtons[count++] = g_tbButtons[j];
+        }
+    }
+    
+    CloseHandle(stream.file);
+    
+    // Add buttons that were not available when layout was exported (e.g. newly installed plugin)
+    
+    if (availableSection)
+    {
+        for (j = 0; j < g_buttonsAvailable; j++)
+        {
+            if (!listed[j] && !used[j] && g_tbButtons[j].idCommand != 0 && count < 300) tbButtons[count++] = g_tbButtons[j];
+        }
+    }
+    
+    // Make sure any unrecorded layout change is recorded first (so import can be undone on its own)
+    
+    recordLayoutChange();
+    
+    // Replace all buttons on toolbar with a single batched update
+    
+    SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) FALSE, (LPARAM) 0);
+    
+    i = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    for (i = i - 1; i >= 0; i--)
+    {
+        SendMessage(tbWindow, TB_DELETEBUTTON, (WPARAM) i, (LPARAM) 0);
+    }
+    
+    SendMessage(tbWindow, TB_ADDBUTTONS, (WPARAM)(UINT) count, (LPARAM)(LPTBBUTTON) tbButtons);
+    
+    SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) TRUE, (LPARAM) 0);
+    
+    // Without this added buttons are not displayed !!
+    
+    SendMessage(tbWindow, TB_SETMAXTEXTROWS, (WPARAM) 0, (LPARAM) 0);
+    InvalidateRect(tbWindow, NULL, TRUE);
+    
+    // Restore custom buttons and wrap toolbar menu item states
+    
+    g_customButtonsState = customState;
+    SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[2]._cmdID, (LPARAM) g_customButtonsState);
+    
+    g_wrapToolbarState = wrapState;
+    SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[3]._cmdID, (LPARAM) g_wrapToolbarState);
+    
+    // Restore toolbar wrap state and display styles, record layout change (for undo) and save toolbar layout
+    
+    if (g_wrapToolbarState) makeToolbarWrap();
+    else makeToolbarOverflow();
+    
+    updateToolbarState();
+    adjustIdealSize();
+    recordLayoutChange();
+    publishLayoutChange(NULL, 0);  /* menu item states */
+    saveToolbarLayout();
+    
+    if (unresolved > 0)
+    {
+        _stprintf_s(buffer, 100, TEXT("%i button entries could not be found in menus or on toolbar, and were ignored.\n\n"), unresolved);
+        MessageBox(nppData._nppHandle, buffer, TEXT("Customize Toolbar - Import Layout"), MB_OK | MB_APPLMODAL);
+    }
+}
+
+void helpOverview()
+{
+    MessageBox(nppData._nppHandle, TEXT("Customize Toolbar Plugin\n\n")
+                                   TEXT("Version: 5.3    -     2011-2021 DW-dev    -    E-mail: dw-dev@gmx.com\n\n")
+                                   TEXT("Version: 5.3.1    -     2024+   QGtKMlLz    -    E-mail: 3m33dkojb@mozmail.com\n\n")
+                                   TEXT("This plugin allows the Notepad++ toolbar to be fully customised by the user, and includes twenty-six additional buttons for frequently used menu commands.\n\n")
+                                   TEXT("All buttons on the toolbar can be customized, whether Notepad++ built-in buttons, the additional buttons, or buttons belonging to other plugins.\n\n")
+                                   TEXT("When this plugin is first installed, the additional buttons are not shown on the toolbar, but are available in the Customize Toolbar dialog box.\n\n")
+                                   TEXT("The toolbar is customized using the Customize Toolbar dialog box, which can be opened by clicking on the Customize Toolbar... menu item, or ")
+                                   TEXT("by clicking on the Customize Toolbar... toolbar button, or by double-clicking on empty space on the toolbar.\n\n")
+                                   TEXT("Alternatively, the toolbar can be customized by holding down the Shift key and dragging a button along the toolbar or off the toolbar.\n\n")
+                                   TEXT("Changes to the toolbar layout can be undone and redone using the Undo Layout Change and Redo Layout Change menu items, even after Notepad++ is restarted.\n\n")
+                                   TEXT("The toolbar layout can be exported to a text file using the Export Layout... menu item, and imported on another machine using the Import Layout... menu item. ")
+                                   TEXT("Buttons are identified by their menu paths (e.g. Edit,Select All), so the text file can be shared and compared.\n\n")
+                                   TEXT("It is recommended to customize the toolbar when Standard Icons are selected in Notepad++ preferences, so that buttons belonging to other plugins are visible.\n\n")
+                                   TEXT("Custom buttons for Notepad++ or plugin menu commands can be defined using a configuration file, and there is a menu option to enable/disable this feature.\n\n")
+                                   TEXT("An overflow chevron is shown if there are too many buttons to fit on the toolbar. Alternatively, there is a menu option to wrap the toolbar over several rows.\n\n")
+                                   TEXT("There is a menu option to show the resources (toolbar buttons and plugin menu commands) that are currently being used.\n\n"),
+                                   TEXT("Customize Toolbar - Help - Overview"), MB_OK | MB_APPLMODAL);
+}
+
+void helpCustomButtons()
+{
+    MessageBox(nppData._nppHandle, TEXT("Custom buttons are defined using a configuration file (CustomizeToolbar.btn) located in the Notepad++ configuration sub-folder (...\\plugins\\config).\n\n")
+                                   TEXT("When the Custom Buttons feature is enabled, if the .btn configuration file did not previously exist, it is created and contains examples of custom button definitions.\n\n")
+#ifdef _UNICODE
+                                   TEXT("The .btn configuration file must employ Unicode UTF-16 Little Endian encoding, with an optional Byte Order Mark (BOM) at the start of file, and CR-LF line breaks.  ")
+                                   TEXT("When creating this file with Notepad++, set Encoding to UCS-2 Little Endian.\n\n")
+#else
+                                   TEXT("The .btn configuration file must employ ANSI encoding and CR-LF line breaks.  ")
+                                   TEXT("When creating this file with Notepad++, set Encoding to ANSI.\n\n")
+#endif
+                                   TEXT("Each line in the .btn configuration file can be either a custom button definition or a comment starting with a semicolon.\n\n")
+                                   TEXT("Each custom button definition comprises seven comma separated fields (four menu strings, an optional .bmp or .png file name for Standard icons, ")
+                                   TEXT("and two optional .ico or .png file names for Fluent icons in light and dark modes).\n\n")
+                                   TEXT("If the menu strings correspond to a Notepad++ built-in button or plugin button, the custom button will replace the Notepad++ built-in button or plugin button.\n\n")
+                                   TEXT("If the menu strings do not correspond to a Notepad++ built-in button or plugin button, then an error symbol (exclamation mark) is displayed.\n\n")
+                                   TEXT("If the .bmp or .ico file names are present, the files must be located in the Notepad++ configuration sub-folder (...\\plugins\\config).\n\n")
+                                   TEXT("If the .bmp or light mode .ico file name is omitted, or if the file does not exist, then a warning symbol (question mark) is displayed.\n\n")
+                                   TEXT("If the dark mode .ico file name is omitted, or if the file does not exist, then if present the light mode .ico file name is used instead.\n\n")
+                                   TEXT("Each .bmp file should be an image of 16x16 pixels with a bit depth of 8, 24 or 32-bits. Any pixels with the same colour as the bottom left pixel will appear transparent.\n\n")
+                                   TEXT("Each .ico file should be an icon containing an image of 32x32 pixels (or larger) with a bit depth of 32-bits (RGB+alpha).\n\n")
+                                   TEXT("Each .png file should be an image of 16x16 pixels (Standard icons) or 32x32 pixels or larger (Fluent icons), with transparency if required.\n\n")
+                                   TEXT("Quick codes can be used instead of file names. A quick code comprises:\nan asterisk, followed by either a color code letter (S: slate grey, R: red,\n")
+                                   TEXT("G: green, B: blue, C: cyan, M: magenta, Y: yellow) or a hex color value\n(e.g. #4488CC), followed by a colon, followed by a label (1 or 2 letters).\n\n")
+                                   TEXT("To create a red button with label 'LA', use: *R:LA or *#FF0000:LA.\n\n"),
+                                   TEXT("Customize Toolbar - Help - Custom Buttons"), MB_OK | MB_APPLMODAL);
+}
+
+void resourceUsage()
+{
+    TCHAR buffer[USAGEBUFFERSIZE];
+    const TCHAR *eventNames[UIEVENT_STARTUP] = { TEXT("Resize"), TEXT("Changed Icons"), TEXT("Button States"), TEXT("Editor State") };
+    TCHAR modulePath[MAX_PATH];
+    WIN32_FILE_ATTRIBUTE_DATA moduleData;
+    LARGE_INTEGER frequency;
+    int i, length, written, commands, maxcommands, moduleSize;
+    
+    QueryPerformanceFrequency(&frequency);
+    
+    moduleSize = 0;
+    if (GetModuleFileName((HMODULE) g_hModule, modulePath, MAX_PATH) && GetFileAttributesEx(modulePath, GetFileExInfoStandard, &moduleData)) moduleSize = (int) moduleData.nFileSizeLow;
+    
+    commands = funcItem[nbFunc-1]._cmdID-ID_PLUGINS_CMD+1;
+    maxcommands = g_id_plugins_cmd_limit-ID_PLUGINS_CMD+1;
+    
+    length = _sntprintf_s(buffer, USAGEBUFFERSIZE, _TRUNCATE, TEXT("Total Buttons:  %i / 300\n\nCustom Buttons:  %i / 100\n\nPlugin Menu Commands:  %i / %i\n\nPlugin DLL:  %.1f KB\n\n")
+                                      TEXT("Image Handles:  %i bitmaps (peak %i),  %i icons (peak %i),  %i created,  %i freed,  %i untracked\n")
+                                      TEXT("Process Handles:  %i GDI,  %i USER\n\n")
+                                      TEXT("Additional Button Images:  %i from 2 strips,  %.1f ms\n")
+                                      TEXT("Custom Button Images:  %i from atlas,  %i decoded (%i .bmp, %i .png by plugin),  %i quick codes rendered,  %i reused,  %.1f ms  (%i workers)\n")
+                                      TEXT("Custom Image DPI:  %i  (%i px icons),  %i resampled,  %i variants for other DPI,  %i replaced\n")
+                                      TEXT("Shared Images:  %i handles,  %i reused (%.1f KB),  %i shared buffers (%.1f KB),  %i duplicate image list slots\n\n")
+                                      TEXT("Startup Time:  %.1f ms  (%s)\n")
+                                      TEXT("Startup Ready:  %.1f ms  (%s, %i polls)\n")
+                                      TEXT("Startup Lifecycle:  %.1f ms from menus to ready,  %i covered,  %i rejected\n\n")
+                                      TEXT("Layout Passes:  %i started,  %i aborted (stale)\n")
+                                      TEXT("Deferred Writes:  %i  (while customize dialog box or overflow menu open)\n\n")
+                                      TEXT("Window Messages:  %llu  (%llu fast path, %.2f us average;  %llu handled, %.2f us average)\n")
+                                      TEXT("Window Lookups:  %i  (%.2f us per message before fast path, as two FindWindowEx calls;  %.2f us cached)\n\n")
+                                      TEXT("Button State Updates:  %i passes, %i notifications, %i editor state changes  (%i buttons checked, %i TB_SETSTATE sent)\n\n")
+                                      TEXT("UI Events (received / handled / late, delay, average latency):\n"),
+                                      g_buttonsAvailable, g_customButtonsCount, commands, maxcommands, moduleSize/1024.0,
+                                      g_trackedHandles.live[HANDLEKIND_BITMAP], g_trackedHandles.peak[HANDLEKIND_BITMAP], g_trackedHandles.live[HANDLEKIND_ICON], g_trackedHandles.peak[HANDLEKIND_ICON],
+                                      g_trackedHandles.created, g_trackedHandles.freed, g_trackedHandles.untracked,
+                                      (int) GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS), (int) GetGuiResources(GetCurrentProcess(), GR_USEROBJECTS),
+                                      g_additionalImages, g_additionalTime,
+                                      (int) g_atlasHits, (int) g_atlasDecodes, (int) g_bitmapDecodes, (int) g_pngDecodes, (int) g_quickCodeRenders, (int) g_quickCodeHits, g_imageTime, g_imageWorkers,
+                                      (int) g_imageDpi, g_iconSize, (int) g_imageResamples, g_imageVariantCount, g_imageVariantSwaps,
+                                      g_sharedImageCount, g_sharedHandleUses, g_sharedHandleBytes/1024.0, g_sharedBuffers, g_sharedBufferBytes/1024.0, g_duplicateSlots,
+                                      g_startupTime, g_snapshotUsed ? TEXT("snapshot") : TEXT("rebuilt"),
+                                      g_readyWait, g_readyReason ? g_readyReason : TEXT("not ready"), g_readyPolls,
+                                      (g_lifecycleTime[LIFECYCLE_READY].QuadPart != 0) ? elapsedMilliseconds(g_lifecycleTime[LIFECYCLE_MENUS])-elapsedMilliseconds(g_lifecycleTime[LIFECYCLE_READY]) : 0.0,
+                                      g_uiEventsCovered, g_lifecycle.rejected,
+                                      g_layoutPasses.started, g_layoutPasses.aborted, g_stateReaders.writesDeferred,
+                                      g_windowMessages, g_fastMessages, g_fastMessages ? (double) g_fastMessageTicks*1000000.0/(double) frequency.QuadPart/g_fastMessages : 0.0,
+                                      g_windowMessages-g_fastMessages, (g_windowMessages > g_fastMessages) ? (double) g_handledMessageTicks*1000000.0/(double) frequency.QuadPart/(g_windowMessages-g_fastMessages) : 0.0,
+                                      g_windowLookups, timeWindowLookups(false), timeWindowLookups(true),
+                                      g_stateUpdates, g_stateNotifications, g_editorStateChanges, g_stateButtonsChecked, g_stateChanges);
+    
+    for (i = 0; i < UIEVENT_STARTUP && length >= 0; i++)
+    {
+        written = _sntprintf_s(&buffer[length], USAGEBUFFERSIZE-length, _TRUNCATE, TEXT("    %s:  %i / %i / %i,  %.1f ms,  %.1f ms\n"),
+                                                         eventNames[i], g_uiEventsReceived[i], g_uiEventPasses[i], g_uiEventsLate[i],
+                                                         g_uiEventDelay[i], g_uiEventPasses[i] ? g_uiEventLatency[i]/g_uiEventPasses[i] : 0.0);
+        length = (written < 0) ? -1 : length+written;  /* -1 if truncated (report cut short, but terminated) */
+    }
+    
+    MessageBox(nppData._nppHandle, buffer, TEXT("Customize Toolbar - Resource Usage"), MB_OK | MB_APPLMODAL);
+}
+
+//
+// Subclass window procedure and rebar procedure
+//
+
+LRESULT APIENTRY subclassWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    LARGE_INTEGER startTime, endTime;
+    LRESULT result;
+    
+    QueryPerformanceCounter(&startTime);
+    g_windowMessages++;
+    
+    // Fast path - messages not handled by plugin are passed straight to Notepad++
+    
+    if (!isHandledWindowMessage(uMsg))
+    {
+        g_fastMessages++;
+        QueryPerformanceCounter(&endTime);
+        g_fastMessageTicks += endTime.QuadPart-startTime.QuadPart;
+        
+        return CallWindowProc(g_origWindowProc, hwnd, uMsg, wParam, lParam);
+    }
+    
+    result = handleWindowMessage(hwnd, uMsg, wParam, lParam);
+    
+    QueryPerformanceCounter(&endTime);
+    g_handledMessageTicks += endTime.QuadPart-startTime.QuadPart;  /* includes Notepad++ for messages also passed on */
+    
+    return result;
+}
+
+bool isHandledWindowMessage(UINT uMsg)
+{
+    // Dispatch table of messages handled by handleWindowMessage (registered messages are assigned at run time)
+    
+    switch (uMsg)
+    {
+        case WM_GETDLGCODE:
+        case WM_TIMER:
+        case WM_NOTIFY:
+        case WM_SIZE:
+        case WM_DPICHANGED:
+        case WM_UNINITMENUPOPUP:
+        case WM_COMMAND:
+            return true;
+    }
+    
+    return (uMsg != 0 && (uMsg == g_uiEventMessage || uMsg == g_syncMessage));
+}
+
+LRESULT handleWindowMessage(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    HWND rbWindow, tbWindow;
+    NMTOOLBAR *lpNmToolbar = (LPNMTOOLBAR) lParam;
+    NMREBARCHEVRON *lpNmRebarChevron = (LPNMREBARCHEVRON) lParam;
+    LRESULT result;
+    
+    if (uMsg == WM_GETDLGCODE)
+        return DLGC_WANTALLKEYS;
+    
+    // Handle UI events after delay (timer, or posted message if delay is shorter than timer resolution)
+    
+    if (uMsg == WM_TIMER && wParam >= UITIMER_BASE && wParam < UITIMER_BASE+UIEVENTKINDS)
+    {
+        KillTimer(hwnd, wParam);
+        checkUiEvent((int) (wParam-UITIMER_BASE));
+        return 0;
+    }
+    
+    if (uMsg == g_uiEventMessage && g_uiEventMessage != 0)
+    {
+        checkUiEvent((int) wParam);
+        return 0;
+    }
+    
+    // Handle layout change published by other instance (posted by synchronization thread)
+    
+    if (uMsg == g_syncMessage && g_syncMessage != 0)
+    {
+        if (!deferStateWrite(&g_stateReaders, DEFERRED_SYNC)) syncLayoutChanges();  /* else applied when customize dialog box or overflow menu closed */
+        return 0;
+    }
+    
+    // Handle toolbar customization
+    
+    if (uMsg == WM_NOTIFY)
+    {
+        switch (lpNmToolbar->hdr.code)
+        {
+            case TBN_BEGINADJUST:
+                
+                // Customize dialog box reads preserved buttons until closed
+                
+                beginStateRead();
+                
+                break;
+                
             case TBN_INITCUSTOMIZE:
                 
                 // Hide help button
@@ -792,15 +1696,26 @@ LRESULT APIENTRY subclassWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
                 if (g_wrapToolbarState) makeToolbarWrap();
                 else makeToolbarOverflow();
                 
-                // Save customized toolbar
+                // Record layout change (for undo/redo) and save customized toolbar
                 
+                recordLayoutChange();
                 updateToolbarState();
                 adjustIdealSize();
                 saveToolbarLayout();
                 
+                endStateRead();
+                
                 return 0;  /* not used */
                 break;
                 
+            case TBN_TOOLBARCHANGE:
+                
+                // Record layout change (for undo/redo) - toolbar changed by customize dialog box or by Shift-dragging button
+                
+                recordLayoutChange();
+                
+                break;
+                
             case RBN_ENDDRAG:
                 
                 // Restore toolbar wrap state and display styles
@@ -827,6 +1742,8 @@ LRESULT APIENTRY subclassWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
                 
             case NM_CLICK:
                 
+                if (g_lifecycle.stage != LIFECYCLE_STARTED) break;  /* toolbar not yet restored */
+                
                 // Restore toolbar wrap state and display styles
                 
                 if (g_wrapToolbarState) makeToolbarWrap();
@@ -834,7 +1751,7 @@ LRESULT APIENTRY subclassWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
                 
                 // Update toolbar button states after toolbar clicked
                 
-                CreateThread(NULL, 0, handleButtonStates, NULL, 0, NULL);
+                queueUiEvent(UIEVENT_BUTTONSTATES);
                 
                 break;
         }
@@ -844,14 +1761,34 @@ LRESULT APIENTRY subclassWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
     
     if (uMsg == WM_SIZE)
     {
-        CreateThread(NULL, 0, handleWindowResize, NULL, 0, NULL);
+        queueUiEvent(UIEVENT_RESIZE);
+    }
+    
+    // Handle DPI change (Notepad++ recreates toolbar images, and then sends NPPN_TOOLBARICONSETCHANGED)
+    
+    if (uMsg == WM_DPICHANGED)
+    {
+        g_dpiChanged = true;
     }
     
     // Handle update of button states after menu command selected
     
     if (uMsg == WM_UNINITMENUPOPUP)
     {
-        CreateThread(NULL, 0, handleButtonStates, NULL, 0, NULL);
+        queueUiEvent(UIEVENT_BUTTONSTATES);
+    }
+    
+    // Update state of button for command executed by menu or keyboard shortcut (or sent by other plugin) - once executed
+    
+    if (uMsg == WM_COMMAND && lParam == 0 && g_lifecycle.stage == LIFECYCLE_STARTED)
+    {
+        result = CallWindowProc(g_origWindowProc, hwnd, uMsg, wParam, lParam);
+        
+        findToolbarWindows(&rbWindow, &tbWindow);
+        updateButtonState(tbWindow, LOWORD(wParam));
+        g_stateNotifications++;
+        
+        return result;
     }
     
     return CallWindowProc(g_origWindowProc, hwnd, uMsg, wParam, lParam);
@@ -866,63 +1803,325 @@ LRESULT APIENTRY subclassRebarProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM l
     
     if (uMsg == RB_SETBANDINFO && lpRebarBandInfo->fMask == 0x0270)  /* toolbar has been reset and icons changed by Notepad++ */
     {
-        CreateThread(NULL, 0, handleChangedIcons, NULL, 0, NULL);
+        queueUiEvent(UIEVENT_CHANGEDICONS);
     }
     
     return CallWindowProc(g_origRebarProc, hwnd, uMsg, wParam, lParam);
 }
 
 //
-// Handle window resize, changed icons and button states thread delay functions
+// UI event functions - delay until state has settled (adaptive), then handle window resize, changed icons and button states
+// Startup waits for readiness instead (plugins menu as expected, or menus stable for several polls)
 //
 
-DWORD WINAPI handleWindowResize(LPVOID lpParam)
-{
-    Sleep(10);
-    
-    // Restore toolbar wrap state and display styles
-    
-    if (g_wrapToolbarState) makeToolbarWrap();
-    else makeToolbarOverflow();
-    
-    return 0;
-}
-
-DWORD WINAPI handleChangedIcons(LPVOID lpParam)
+void queueUiEvent(int kind)
 {
-    Sleep(10);
-    
-    // Replace temporary custom command identifiers with actual command identifiers
-    
-    replaceTemporaryCmdIDs();
+    g_uiEventsReceived[kind]++;
     
-    // Preserve initial toolbar buttons
+    // Events before startup completed are covered by startup pass (which preserves, restores, updates states and wraps)
     
-    preserveToolbarButtons();
+    if (kind != UIEVENT_STARTUP && g_lifecycle.stage != LIFECYCLE_STARTED)
+    {
+        g_uiEventsCovered++;
+        return;
+    }
     
-    // Restore toolbar layout
+    if (kind == UIEVENT_RESIZE || kind == UIEVENT_CHANGEDICONS) newLayoutGeneration(&g_layoutPasses);
+    if (kind == UIEVENT_CHANGEDICONS) g_changedIconsPending = true;
     
-    restoreToolbarLayout(false);
-    updateToolbarState();
-    adjustIdealSize();
+    // Any number of events of one kind while waiting are handled by a single pass
     
-    // Restore toolbar wrap state and display styles
+    if (g_uiEventPhase[kind] == UIEVENTPHASE_WAIT) return;
     
-    if (g_wrapToolbarState) makeToolbarWrap();
-    else makeToolbarOverflow();
+    g_uiEventPhase[kind] = UIEVENTPHASE_WAIT;
+    QueryPerformanceCounter(&g_uiEventStart[kind]);
+    g_uiEventFingerprint[kind] = calcSettleFingerprint(kind);
+    g_uiEventChecked[kind] = g_uiEventSettle[kind] = 0.0;
+    g_uiEventForced[kind] = false;
     
-    return 0;
+    scheduleUiEventCheck(kind, g_uiEventDelay[kind]);
+}
+
+void scheduleUiEventCheck(int kind, double delay)
+{
+    if (delay < USER_TIMER_MINIMUM) PostMessage(nppData._nppHandle, g_uiEventMessage, (WPARAM) kind, (LPARAM) 0);  /* after Notepad++ has finished handling current messages */
+    else SetTimer(nppData._nppHandle, UITIMER_BASE+kind, (UINT) delay, NULL);
 }
 
-DWORD WINAPI handleButtonStates(LPVOID lpParam)
+void checkUiEvent(int kind)
 {
-    Sleep(10);
+    DWORD fingerprint;
+    double elapsed;
+    bool changed;
     
-    // Update toolbar button states after toolbar is clicked or menu item is seleceted
+    if (g_uiEventPhase[kind] == UIEVENTPHASE_IDLE) return;
     
-    updateToolbarState();
+    // Preserved buttons being read by customize dialog box or overflow menu - rebuild them when reader finishes
     
-    return 0;
+    if (g_uiEventPhase[kind] == UIEVENTPHASE_WAIT && (kind == UIEVENT_CHANGEDICONS || kind == UIEVENT_STARTUP) && deferStateWrite(&g_stateReaders, 1 << kind)) return;
+    
+    if (kind == UIEVENT_STARTUP)  /* waits for readiness, rather than adaptive delay */
+    {
+        checkStartupReady();
+        return;
+    }
+    
+    elapsed = elapsedMilliseconds(g_uiEventStart[kind]);
+    fingerprint = calcSettleFingerprint(kind);
+    changed = (fingerprint != g_uiEventFingerprint[kind]);
+    
+    if (changed)  /* changed some time since last check */
+    {
+        g_uiEventSettle[kind] = (g_uiEventChecked[kind]+elapsed)/2;
+        g_uiEventFingerprint[kind] = fingerprint;
+    }
+    g_uiEventChecked[kind] = elapsed;
+    
+    if (g_uiEventPhase[kind] == UIEVENTPHASE_WAIT)
+    {
+        // State still changing - check again shortly (unless delayed too long already)
+        
+        if (changed && elapsed < UIEVENTMAXDELAY)
+        {
+            scheduleUiEventCheck(kind, UIEVENTPOLLDELAY);
+            return;
+        }
+        
+        g_uiEventForced[kind] = changed;
+        g_uiEventPasses[kind]++;
+        g_uiEventLatency[kind] += elapsed;
+        
+        // Layout pass aborted by newer event (coalesced while handling) - keep waiting for state to settle
+        
+        if (!handleUiEvent(kind))
+        {
+            scheduleUiEventCheck(kind, UIEVENTPOLLDELAY);
+            return;
+        }
+        
+        // Verify state does not change again after handling
+        
+        g_uiEventPhase[kind] = UIEVENTPHASE_VERIFY;
+        scheduleUiEventCheck(kind, UIEVENTPOLLDELAY);
+        return;
+    }
+    
+    // Verifying - state changed after handling (delay too short), so handle again if that is safe
+    
+    if (changed)
+    {
+        g_uiEventsLate[kind]++;
+        if (kind != UIEVENT_CHANGEDICONS)  /* changed icons cannot be repeated once toolbar restored */
+        {
+            g_uiEventPasses[kind]++;
+            handleUiEvent(kind);
+        }
+        
+        if (elapsed < UIEVENTMAXDELAY)
+        {
+            scheduleUiEventCheck(kind, UIEVENTPOLLDELAY);
+            return;
+        }
+        g_uiEventForced[kind] = true;
+    }
+    
+    // Learn delay from settle time - moving towards time when state last changed (zero if it did not change)
+    
+    if (!g_uiEventForced[kind])  /* not learned from continuous changes (e.g. dragging window edge) */
+    {
+        g_uiEventDelay[kind] += (g_uiEventSettle[kind]-g_uiEventDelay[kind])/4;
+    }
+    
+    g_uiEventPhase[kind] = UIEVENTPHASE_IDLE;
+}
+
+void checkStartupReady()
+{
+    HMENU hPluginMenu;
+    DWORD fingerprint;
+    double elapsed;
+    
+    elapsed = elapsedMilliseconds(g_uiEventStart[UIEVENT_STARTUP]);
+    g_readyPolls++;
+    
+    // Ready if plugins menu is exactly as when startup was ready last session (all expected plugin submenus present)
+    
+    hPluginMenu = (HMENU) SendMessage(nppData._nppHandle, NPPM_GETMENUHANDLE, (WPARAM) NPPPLUGINMENU, (LPARAM) 0);
+    
+    if (g_expectedPluginMenus != 0 && calcMenuFingerprint(hPluginMenu, 0) == g_expectedPluginMenus)
+    {
+        g_readyReason = TEXT("expected menus");
+    }
+    else
+    {
+        // Otherwise ready when menus unchanged for several consecutive polls (plugins added, removed or updated)
+        
+        fingerprint = calcSettleFingerprint(UIEVENT_STARTUP);
+        if (fingerprint == g_uiEventFingerprint[UIEVENT_STARTUP]) g_readyStablePolls++;
+        else
+        {
+            g_uiEventFingerprint[UIEVENT_STARTUP] = fingerprint;
+            g_readyStablePolls = 0;
+        }
+        
+        if (g_readyStablePolls >= STARTUPSTABLEPOLLS) g_readyReason = TEXT("stable menus");
+        else if (elapsed >= STARTUPMAXWAIT) g_readyReason = TEXT("timeout");
+        else
+        {
+            scheduleUiEventCheck(UIEVENT_STARTUP, UIEVENTPOLLDELAY);
+            return;
+        }
+    }
+    
+    g_readyWait = elapsed;
+    g_uiEventPhase[UIEVENT_STARTUP] = UIEVENTPHASE_IDLE;
+    g_uiEventPasses[UIEVENT_STARTUP]++;
+    g_uiEventLatency[UIEVENT_STARTUP] += elapsed;
+    
+    handleUiEvent(UIEVENT_STARTUP);
+}
+
+DWORD calcSettleFingerprint(int kind)
+{
+    HWND rbWindow, tbWindow;
+    RECT rect;
+    TBBUTTON tbButton;
+    DWORD hash;
+    int i, buttonsOnToolbar;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    hash = 0;
+    
+    // State changed by Notepad++ (not by handling UI event) for each kind of UI event
+    
+    switch (kind)
+    {
+        case UIEVENT_RESIZE:
+            
+            GetClientRect(nppData._nppHandle, &rect);
+            hash = ((hash << 5) - hash) + rect.right;
+            hash = ((hash << 5) - hash) + rect.bottom;
+            break;
+            
+        case UIEVENT_CHANGEDICONS:
+            
+            hash = ((hash << 5) - hash) + (DWORD) (ULONG_PTR) SendMessage(tbWindow, TB_GETIMAGELIST, (WPARAM) 0, (LPARAM) 0);
+            hash = ((hash << 5) - hash) + (DWORD) (ULONG_PTR) SendMessage(tbWindow, TB_GETDISABLEDIMAGELIST, (WPARAM) 0, (LPARAM) 0);
+            hash = ((hash << 5) - hash) + (DWORD) (ULONG_PTR) SendMessage(tbWindow, TB_GETHOTIMAGELIST, (WPARAM) 0, (LPARAM) 0);
+            break;
+            
+        case UIEVENT_BUTTONSTATES:
+            
+            buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+            for (i = 0; i < buttonsOnToolbar; i++)
+            {
+                SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
+                hash = ((hash << 5) - hash) + GetMenuState(g_hMainMenu, tbButton.idCommand, MF_BYCOMMAND);
+            }
+            break;
+            
+        case UIEVENT_EDITORSTATE:
+            
+            hash = calcEditorState();
+            break;
+            
+        case UIEVENT_STARTUP:
+            
+            hash = calcMenuFingerprint(g_hMainMenu, hash);
+            break;
+    }
+    
+    return hash;
+}
+
+bool handleUiEvent(int kind)
+{
+    switch (kind)
+    {
+        case UIEVENT_RESIZE: beginLayoutPass(&g_layoutPasses); handleWindowResize(); return endLayoutPass(&g_layoutPasses);
+        case UIEVENT_CHANGEDICONS: beginLayoutPass(&g_layoutPasses); handleChangedIcons(); return endLayoutPass(&g_layoutPasses);
+        case UIEVENT_BUTTONSTATES: handleButtonStates(); break;
+        case UIEVENT_EDITORSTATE: handleEditorState(); break;
+        case UIEVENT_STARTUP: afterNppReadyDelayed(); break;
+    }
+    
+    return true;
+}
+
+void beginStateRead()
+{
+    enterStateRead(&g_stateReaders);
+}
+
+void endStateRead()
+{
+    unsigned int deferred;
+    int kind;
+    
+    deferred = leaveStateRead(&g_stateReaders);
+    
+    // Last reader finished - handle deferred changes (posted, so reader completes first)
+    
+    for (kind = 0; kind < UIEVENTKINDS; kind++)
+    {
+        if (deferred & (1 << kind)) scheduleUiEventCheck(kind, 0.0);
+    }
+    
+    if (deferred & DEFERRED_SYNC) PostMessage(nppData._nppHandle, g_syncMessage, (WPARAM) 0, (LPARAM) 0);
+}
+
+void handleWindowResize()
+{
+    // Restore toolbar wrap state and display styles
+    
+    if (g_wrapToolbarState) makeToolbarWrap();
+    else makeToolbarOverflow();
+}
+
+void handleChangedIcons()
+{
+    // Toolbar preserved and restored once for each toolbar reset - when pass is repeated because it became stale
+    // (e.g. rebar resized re-entrantly while restoring), only ideal size and wrap state are redone
+    
+    if (g_changedIconsPending)
+    {
+        g_changedIconsPending = false;
+        
+        // Replace images made for previous DPI with images for current DPI (before buttons are preserved)
+        
+        applyImageVariants();
+        
+        // Replace temporary custom command identifiers with actual command identifiers
+        
+        replaceTemporaryCmdIDs();
+        
+        // Preserve initial toolbar buttons
+        
+        preserveToolbarButtons();
+        
+        // Restore toolbar layout
+        
+        restoreToolbarLayout(false);
+        updateToolbarState();
+        resetLayoutBaseline();
+    }
+    
+    adjustIdealSize();
+    
+    // Restore toolbar wrap state and display styles (unless newer event received)
+    
+    if (layoutPassStale(&g_layoutPasses)) return;
+    
+    if (g_wrapToolbarState) makeToolbarWrap();
+    else makeToolbarOverflow();
+}
+
+void handleButtonStates()
+{
+    // Update toolbar button states after toolbar is clicked or menu item is seleceted
+    
+    updateToolbarState();
 }
 
 //
@@ -934,8 +2133,7 @@ void replaceTemporaryCmdIDs()
     HWND rbWindow, tbWindow;
     int i, j, btn, idCmd;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
     
     for (btn = 0; btn < g_customButtonsCount; btn++)
     {
@@ -967,38 +2165,54 @@ void preserveToolbarButtons()
     HIMAGELIST hImageList;
     HICON hIcon;
     MENUITEMINFO menuItemInfo;
+    DWORD fingerprint;
     int i,scriptCount;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
     
     // Preserve startup toolbar button count (for reset and save/restore)
     
     g_buttonsAvailable = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
     
+    for (i = 0; i < g_buttonsAvailable; i++)
+    {
+        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &g_tbButtons[i]);
+    }
+    
+    // Load button strings and identities from startup snapshot if menus and startup toolbar are unchanged since last session
+    
+    fingerprint = calcStartupFingerprint();
+    g_snapshotUsed = loadStartupSnapshot(fingerprint);
+    
     // Preserve startup toolbar button information (for reset and save/restore)
     
     for (i = 0; i < g_buttonsAvailable; i++)
     {
-        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &g_tbButtons[i]);
+        g_tbButtons[i].fsState = TBSTATE_ENABLED;
         
         if (g_tbButtons[i].idCommand < ID_CMD_CUSTOM || g_tbButtons[i].idCommand > ID_CMD_CUSTOM_LIMIT)
         {
+            if (g_snapshotUsed) continue;
+            
             GetMenuString(g_hMainMenu, g_tbButtons[i].idCommand, buffer, MAXSIZE, MF_BYCOMMAND);
             stripMenuString(buffer);
         }
         else
         {
+            hIcon = (HICON) trackHandle(LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDI_CUSTOM_FAILEDMATCH), IMAGE_ICON, 0, 0,(LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS)), HANDLEKIND_ICON);
+            
             hImageList = (HIMAGELIST) SendMessage(tbWindow, TB_GETIMAGELIST, (WPARAM) 0, (LPARAM) 0);
-            hIcon = (HICON) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDI_CUSTOM_FAILEDMATCH), IMAGE_ICON, 0, 0,(LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
             ImageList_ReplaceIcon(hImageList, g_tbButtons[i].iBitmap, hIcon);
             SendMessage(tbWindow, TB_SETIMAGELIST, (WPARAM) 0, (LPARAM) hImageList);
 
             hImageList = (HIMAGELIST) SendMessage(tbWindow, TB_GETDISABLEDIMAGELIST, (WPARAM) 0, (LPARAM) 0);
-            hIcon = (HICON) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDI_CUSTOM_FAILEDMATCH), IMAGE_ICON, 0, 0,(LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
             ImageList_ReplaceIcon(hImageList, g_tbButtons[i].iBitmap, hIcon);
             SendMessage(tbWindow, TB_SETDISABLEDIMAGELIST, (WPARAM) 0, (LPARAM) hImageList);
             
+            releaseHandle(hIcon);  /* image lists keep copies */
+            
+            if (g_snapshotUsed) continue;
+            
             lstrcpy(buffer, TEXT("Custom Button Error: "));
             lstrcat(buffer, g_customMenuStrings[g_tbButtons[i].idCommand-ID_CMD_CUSTOM][0]);
             lstrcat(buffer, TEXT(","));
@@ -1012,8 +2226,6 @@ void preserveToolbarButtons()
         buffer[_tcslen(buffer)+1] = 0;  /* TB_ADDSTRING requires two null characters */
         
         g_tbButtons[i].iString = SendMessage(tbWindow, TB_ADDSTRING, 0, (LPARAM) buffer);
-        
-        g_tbButtons[i].fsState = TBSTATE_ENABLED;
     }
     
     // WebEdit Workaround - remove "WebEdit - " from menu strings - as WebEdit will do when it initialises
@@ -1033,6 +2245,8 @@ void preserveToolbarButtons()
         }
     }
     
+    if (g_snapshotUsed) return;  /* button strings (including Python Script) and identities already loaded */
+    
     // Python Script Workaround - add button strings - since Python Script button commands are not on menu
     
     scriptCount = 1;
@@ -1053,191 +2267,492 @@ void preserveToolbarButtons()
             }
         }
     }
-}
-
-void updateToolbarState()
-{
-    HWND rbWindow, tbWindow;
-    TBBUTTON tbButton;
-    int i, buttonsOnToolbar, menuState, tbState;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
-    
-    buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    // Preserve button identities (for save/restore) and save startup snapshot for next session
     
-    for (i = 0; i < buttonsOnToolbar; i++)
+    for (i = 0; i < g_buttonsAvailable; i++)
     {
-        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
-        menuState = GetMenuState(g_hMainMenu, tbButton.idCommand, MF_BYCOMMAND);
-        if (menuState == -1) menuState = 0;  /* no menu associated with button (e.g. Python Script command button) */
-        tbState = 0;
-        if (tbButton.idCommand < ID_CMD_CUSTOM || tbButton.idCommand > ID_CMD_CUSTOM_LIMIT)
-        {
-            if (menuState & MF_CHECKED) tbState |= TBSTATE_CHECKED;
-            if (!(menuState & (MF_DISABLED | MF_GRAYED))) tbState |= TBSTATE_ENABLED;
-        }
-        SendMessage(tbWindow, TB_SETSTATE, (WPARAM) tbButton.idCommand, (LPARAM) MAKELPARAM(tbState, 0));
+        g_tbIdentities[i] = calcButtonIdentity(g_tbButtons[i]);
     }
+    
+    saveStartupSnapshot(fingerprint);
 }
 
 //
-// Reset, save and restore toolbar layout functions
+// Startup snapshot functions
 //
 
-void resetToolbarLayout()
+DWORD calcStartupFingerprint()
 {
-    HWND rbWindow, tbWindow;
-    int i, idCmd;
+    DWORD hash;
+    int i, j, k;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    hash = (DWORD) g_nppVersion;
     
-    // Remove all buttons from toolbar
+    // Hash in custom button menu strings (which appear in error button strings)
     
-    i = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
-    for (i = i - 1; i >= 0; i--)
+    hash = ((hash << 5) - hash) + g_customButtonsCount;
+    for (i = 0; i < g_customButtonsCount; i++)
     {
-        SendMessage(tbWindow, TB_DELETEBUTTON, (WPARAM) i, (LPARAM) 0);
+        for (j = 0; j < 4; j++)
+        {
+            for (k = 0; g_customMenuStrings[i][j][k] != 0; k++) hash = ((hash << 5) - hash) + g_customMenuStrings[i][j][k];
+            hash = ((hash << 5) - hash) + ',';
+        }
     }
     
-    // Add the buttons that were preserved
+    // Hash in menu tree strings (which change with localization), command IDs and structure
+    
+    hash = calcMenuFingerprint(g_hMainMenu, hash);
+    
+    // Hash in startup toolbar buttons
     
+    hash = ((hash << 5) - hash) + g_buttonsAvailable;
     for (i = 0; i < g_buttonsAvailable; i++)
     {
-        idCmd = g_tbButtons[i].idCommand;
-        
-        if (idCmd == IDM_FILE_CLOSEALL_BUT_CURRENT ||
-            idCmd == IDM_EDIT_DELETE || idCmd == IDM_EDIT_RMV_TAB || idCmd == IDM_EDIT_INS_TAB || idCmd == IDM_EDIT_DUP_LINE ||
-            idCmd == IDM_EDIT_BLOCK_COMMENT_SET || idCmd == IDM_EDIT_BLOCK_UNCOMMENT || idCmd == IDM_EDIT_AUTOCOMPLETE_CURRENTFILE ||
-            idCmd == IDM_EDIT_TRIMTRAILING || idCmd == IDM_EDIT_TAB2SW || idCmd == IDM_EDIT_SW2TAB_ALL ||
-            idCmd == IDM_SEARCH_FINDINFILES || idCmd == IDM_SEARCH_FINDPREV || idCmd == IDM_SEARCH_FINDNEXT ||
-            idCmd == IDM_SEARCH_FINDINCREMENT || idCmd == IDM_FOCUS_ON_FOUND_RESULTS || idCmd == IDM_SEARCH_GOTOLINE ||
-            idCmd == IDM_SEARCH_PREV_BOOKMARK || idCmd == IDM_SEARCH_NEXT_BOOKMARK || idCmd == IDM_SEARCH_CLEAR_BOOKMARKS ||
-            idCmd == IDM_VIEW_ZOOMRESTORE || idCmd == IDM_VIEW_GOTO_ANOTHER_VIEW || idCmd == IDM_VIEW_CLONE_TO_ANOTHER_VIEW ||
-            idCmd == IDM_VIEW_HIDELINES || idCmd == IDM_VIEW_TOGGLE_FOLDALL || idCmd == IDM_VIEW_TOGGLE_UNFOLDALL) ;  /* do nothing */
-        else SendMessage(tbWindow, TB_ADDBUTTONS, (WPARAM)(UINT) 1, (LPARAM)(LPTBBUTTON) &g_tbButtons[i]);
+        hash = ((hash << 5) - hash) + g_tbButtons[i].idCommand;
+        hash = ((hash << 5) - hash) + g_tbButtons[i].iBitmap;
+        hash = ((hash << 5) - hash) + g_tbButtons[i].fsStyle;
     }
     
-    // Without this added buttons are not displayed !!
+    return hash;
+}
+
+DWORD calcMenuFingerprint(HMENU hMenu, DWORD hash)
+{
+    TCHAR buffer[MAXSIZE];
+    HMENU hSubMenu;
+    int i, k, count;
     
-    SendMessage(tbWindow, TB_SETMAXTEXTROWS, (WPARAM) 0, (LPARAM) 0);
+    count = GetMenuItemCount(hMenu);
+    hash = ((hash << 5) - hash) + count;
+    
+    for (i = 0; i < count; i++)
+    {
+        buffer[0] = 0;
+        GetMenuString(hMenu, i, buffer, MAXSIZE, MF_BYPOSITION);
+        for (k = 0; buffer[k] != 0; k++) hash = ((hash << 5) - hash) + buffer[k];
+        hash = ((hash << 5) - hash) + ',';
+        
+        hSubMenu = GetSubMenu(hMenu, i);
+        if (hSubMenu == NULL) hash = ((hash << 5) - hash) + GetMenuItemID(hMenu, i);
+        else hash = calcMenuFingerprint(hSubMenu, hash);
+    }
+    
+    return hash;
 }
 
-void saveToolbarLayout()
+bool loadStartupSnapshot(DWORD fingerprint)
 {
     HWND rbWindow, tbWindow;
     TCHAR configPath[MAX_PATH];
-    TCHAR datFilePath[MAX_PATH];
-    HANDLE datFile;
-    DWORD bytesWritten;
-    DWORD dword;
-    TBBUTTON tbButton;
-    int i, j, buttonsOnToolbar;
-    
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
-    
-    // Get plugins config directory
+    TCHAR snpFilePath[MAX_PATH];
+    HANDLE snpFile;
+    DWORD bytesRead, fileSize;
+    BYTE *snapshot;
+    DWORD *header, *entry;
+    TCHAR *strings, *string;
+    TCHAR empty[2];
+    INT_PTR firstString;
+    int i, pos, length, stringsLength, stringCount;
+    bool valid;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
     
     SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
     
-    // Initialise .dat file path
-    
-    lstrcpy(datFilePath, configPath);
-    lstrcat(datFilePath, TEXT("\\CustomizeToolbar.dat"));
+    lstrcpy(snpFilePath, configPath);
+    lstrcat(snpFilePath, TEXT("\\CustomizeToolbar.cache"));
     
-    // Create and open .dat file
-    
-    datFile = CreateFile(datFilePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    // Read whole snapshot file in one go
     
-    // Write custom buttons menu item state
+    snpFile = CreateFile(snpFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (snpFile == INVALID_HANDLE_VALUE) return false;
     
-    WriteFile(datFile, &g_customButtonsState, sizeof(int), &bytesWritten, NULL);
+    fileSize = GetFileSize(snpFile, NULL);
+    if (fileSize == INVALID_FILE_SIZE || fileSize < SNAPSHOTHEADERSIZE || fileSize > 300*(3*sizeof(DWORD)+MAXSIZE*sizeof(TCHAR))+SNAPSHOTHEADERSIZE)
+    {
+        CloseHandle(snpFile);
+        return false;
+    }
     
-    // Write wrap toolbar menu item state
+    snapshot = new BYTE[fileSize];
+    ReadFile(snpFile, snapshot, fileSize, &bytesRead, NULL);
+    CloseHandle(snpFile);
     
-    WriteFile(datFile, &g_wrapToolbarState, sizeof(int), &bytesWritten, NULL);
+    // Validate signature, fingerprint and command identifiers of all buttons before using any of it
     
-    // Write count of buttons on toolbar (currently)
+    header = (DWORD *) snapshot;
+    valid = (bytesRead == fileSize && header[0] == SNAPSHOTSIGNATURE && header[1] == fingerprint && (int) header[2] == g_buttonsAvailable);
     
-    buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
-    WriteFile(datFile, &buttonsOnToolbar, sizeof(int), &bytesWritten, NULL);
+    pos = SNAPSHOTHEADERSIZE;
+    stringsLength = 0;
+    for (i = 0; valid && i < g_buttonsAvailable; i++)
+    {
+        if (pos+3*sizeof(DWORD) > fileSize) { valid = false; break; }
+        entry = (DWORD *) (snapshot+pos);
+        length = (int) entry[2];
+        if ((int) entry[0] != g_tbButtons[i].idCommand || length >= MAXSIZE) { valid = false; break; }
+        pos += 3*sizeof(DWORD)+length*sizeof(TCHAR);
+        if ((DWORD) pos > fileSize) { valid = false; break; }
+        stringsLength += length+1;
+    }
+    if ((DWORD) pos != fileSize) valid = false;
     
-    // Write count of all buttons available (at startup)
+    if (!valid)
+    {
+        delete[] snapshot;
+        return false;
+    }
     
-    WriteFile(datFile, &g_buttonsAvailable, sizeof(int), &bytesWritten, NULL);
+    // Add all non-empty button strings to toolbar with a single TB_ADDSTRING (strings receive consecutive indexes)
     
-    // Write entry for each button on toolbar (currently)
+    strings = new TCHAR[stringsLength+1];
+    string = strings;
+    stringCount = 0;
     
-    for (i = 0; i < buttonsOnToolbar; i++)
+    pos = SNAPSHOTHEADERSIZE;
+    for (i = 0; i < g_buttonsAvailable; i++)
     {
-        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
-        if (tbButton.idCommand >= ID_PLUGINS_CMD && tbButton.idCommand <= g_id_plugins_cmd_limit)  /* plugin command (with menu item) */
-        {
-            dword = calcPluginButtonMenuHash(tbButton);
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
-        }
-        else if (tbButton.idCommand >= ID_PLUGINS_CMD_DYNAMIC && tbButton.idCommand <= ID_PLUGINS_CMD_DYNAMIC_LIMIT)  /* plugin command (without menu item) (from NPPM_ALLOCATECMDID) */
-        {
-            dword = calcButtonStringHash(tbButton);
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
-        }
-        else if (tbButton.idCommand >= ID_CMD_CUSTOM && tbButton.idCommand <= ID_CMD_CUSTOM_LIMIT)  /* custom command (menu strings not found) */
+        entry = (DWORD *) (snapshot+pos);
+        length = (int) entry[2];
+        g_tbIdentities[i] = entry[1];
+        if (length > 0)
         {
-            dword = calcButtonStringHash(tbButton);
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
-        }
-        else  /* built-in command or separator */
-        {
-            dword = tbButton.idCommand;
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
+            memcpy(string, entry+3, length*sizeof(TCHAR));
+            string[length] = 0;
+            string += length+1;
+            stringCount++;
         }
+        pos += 3*sizeof(DWORD)+length*sizeof(TCHAR);
     }
+    *string = 0;  /* TB_ADDSTRING requires two null characters */
     
-    // Write entry for each button available (at startup)
+    firstString = (stringCount > 0) ? SendMessage(tbWindow, TB_ADDSTRING, 0, (LPARAM) strings) : 0;
     
-    for (j = 0; j < g_buttonsAvailable; j++)
+    pos = SNAPSHOTHEADERSIZE;
+    for (i = 0; i < g_buttonsAvailable; i++)
     {
-        if (g_tbButtons[j].idCommand >= ID_PLUGINS_CMD && g_tbButtons[j].idCommand <= g_id_plugins_cmd_limit)  /* plugin command (with menu item) */
-        {
-            dword = calcPluginButtonMenuHash(g_tbButtons[j]);
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
-        }
-        else if (g_tbButtons[j].idCommand >= ID_PLUGINS_CMD_DYNAMIC && g_tbButtons[j].idCommand <= ID_PLUGINS_CMD_DYNAMIC_LIMIT)  /* plugin command (without menu item) (from NPPM_ALLOCATECMDID) */
-        {
-            dword = calcButtonStringHash(g_tbButtons[j]);
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
-        }
-        else if (g_tbButtons[j].idCommand >= ID_CMD_CUSTOM && g_tbButtons[j].idCommand <= ID_CMD_CUSTOM_LIMIT)  /* custom command (menu strings not found) */
-        {
-            dword = calcButtonStringHash(g_tbButtons[j]);
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
-        }
-        else  /* built-in command or separator */
+        entry = (DWORD *) (snapshot+pos);
+        length = (int) entry[2];
+        if (length > 0) g_tbButtons[i].iString = firstString++;
+        else
         {
-            dword = g_tbButtons[j].idCommand;
-            WriteFile(datFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
+            empty[0] = empty[1] = 0;
+            g_tbButtons[i].iString = SendMessage(tbWindow, TB_ADDSTRING, 0, (LPARAM) empty);
         }
+        pos += 3*sizeof(DWORD)+length*sizeof(TCHAR);
     }
     
-    // Close .dat file
+    delete[] strings;
+    delete[] snapshot;
     
-    CloseHandle(datFile);
+    return true;
 }
 
-void restoreToolbarLayout(bool menuStates)
+void saveStartupSnapshot(DWORD fingerprint)
+{
+    HWND rbWindow, tbWindow;
+    TCHAR configPath[MAX_PATH];
+    TCHAR snpFilePath[MAX_PATH];
+    HANDLE snpFile;
+    DWORD bytesWritten;
+    DWORD dword;
+    HMENU hPluginMenu;
+    TCHAR buffer[MAXSIZE];
+    int i, length;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(snpFilePath, configPath);
+    lstrcat(snpFilePath, TEXT("\\CustomizeToolbar.cache"));
+    
+    snpFile = CreateFile(snpFilePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (snpFile == INVALID_HANDLE_VALUE) return;
+    
+    // Write signature, fingerprint, count of buttons preserved and plugins menu fingerprint (expected when ready next session)
+    
+    dword = SNAPSHOTSIGNATURE;
+    WriteFile(snpFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
+    WriteFile(snpFile, &fingerprint, sizeof(DWORD), &bytesWritten, NULL);
+    WriteFile(snpFile, &g_buttonsAvailable, sizeof(int), &bytesWritten, NULL);
+    
+    hPluginMenu = (HMENU) SendMessage(nppData._nppHandle, NPPM_GETMENUHANDLE, (WPARAM) NPPPLUGINMENU, (LPARAM) 0);
+    dword = calcMenuFingerprint(hPluginMenu, 0);
+    WriteFile(snpFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
+    
+    // Write command identifier, identity and string for each button preserved
+    
+    for (i = 0; i < g_buttonsAvailable; i++)
+    {
+        length = (int) SendMessage(tbWindow, TB_GETSTRING, (WPARAM) MAKEWPARAM(MAXSIZE,g_tbButtons[i].iString), (LPARAM) buffer);
+        if (length < 0 || length >= MAXSIZE) length = 0;
+        
+        dword = (DWORD) g_tbButtons[i].idCommand;
+        WriteFile(snpFile, &dword, sizeof(DWORD), &bytesWritten, NULL);
+        WriteFile(snpFile, &g_tbIdentities[i], sizeof(DWORD), &bytesWritten, NULL);
+        WriteFile(snpFile, &length, sizeof(int), &bytesWritten, NULL);
+        WriteFile(snpFile, buffer, length*sizeof(TCHAR), &bytesWritten, NULL);
+    }
+    
+    CloseHandle(snpFile);
+}
+
+DWORD loadExpectedPluginMenus()
+{
+    TCHAR configPath[MAX_PATH];
+    TCHAR snpFilePath[MAX_PATH];
+    HANDLE snpFile;
+    DWORD bytesRead;
+    DWORD header[4];
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(snpFilePath, configPath);
+    lstrcat(snpFilePath, TEXT("\\CustomizeToolbar.cache"));
+    
+    // Read snapshot header only (snapshot itself is validated after startup ready)
+    
+    snpFile = CreateFile(snpFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (snpFile == INVALID_HANDLE_VALUE) return 0;
+    
+    if (!ReadFile(snpFile, header, SNAPSHOTHEADERSIZE, &bytesRead, NULL) || bytesRead != SNAPSHOTHEADERSIZE) bytesRead = 0;
+    CloseHandle(snpFile);
+    
+    if (bytesRead == 0 || header[0] != SNAPSHOTSIGNATURE) return 0;
+    
+    return header[3];
+}
+
+void updateToolbarState()
+{
+    HWND rbWindow, tbWindow;
+    TBBUTTON tbButton;
+    int changedCommands[300], changedStates[300];
+    int i, buttonsOnToolbar, tbState, changeCount;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    g_stateUpdates++;
+    
+    // Compare state of each button with its menu state - current button state (fsState) is cache of last state set
+    // (read from toolbar, rather than kept separately, as Notepad++ also sets states of its own buttons)
+    
+    changeCount = 0;
+    buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    
+    for (i = 0; i < buttonsOnToolbar && changeCount < 300; i++)
+    {
+        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
+        if (tbButton.fsStyle & BTNS_SEP) continue;
+        
+        tbState = calcButtonState(tbButton.idCommand);
+        g_stateButtonsChecked++;
+        
+        if ((tbButton.fsState & ~TBSTATE_WRAP) == tbState) continue;  /* wrap state is set by toolbar itself */
+        
+        changedCommands[changeCount] = tbButton.idCommand;
+        changedStates[changeCount] = tbState;
+        changeCount++;
+    }
+    
+    // Set changed states only - with a single redraw if more than one button changed
+    
+    if (changeCount > 1) SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) FALSE, (LPARAM) 0);
+    
+    for (i = 0; i < changeCount; i++)
+    {
+        SendMessage(tbWindow, TB_SETSTATE, (WPARAM) changedCommands[i], (LPARAM) MAKELPARAM(changedStates[i], 0));
+    }
+    g_stateChanges += changeCount;
+    
+    if (changeCount > 1)
+    {
+        SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) TRUE, (LPARAM) 0);
+        InvalidateRect(tbWindow, NULL, TRUE);
+    }
+}
+
+int calcButtonState(int idCommand)
+{
+    int i, menuState, tbState;
+    
+    menuState = GetMenuState(g_hMainMenu, idCommand, MF_BYCOMMAND);
+    if (menuState == -1) menuState = 0;  /* no menu associated with button (e.g. Python Script command button) */
+    
+    tbState = 0;
+    if (idCommand < ID_CMD_CUSTOM || idCommand > ID_CMD_CUSTOM_LIMIT)
+    {
+        if (menuState & MF_CHECKED) tbState |= TBSTATE_CHECKED;
+        if (!(menuState & (MF_DISABLED | MF_GRAYED))) tbState |= TBSTATE_ENABLED;
+    }
+    
+    // Disable button if any of its editor predicates is false
+    
+    for (i = 0; i < (int) (sizeof(g_editPredicates)/sizeof(EDITPREDICATE)); i++)
+    {
+        if (g_editPredicates[i].idCommand == idCommand && (g_editPredicates[i].predicates & ~g_editorState)) tbState &= ~TBSTATE_ENABLED;
+    }
+    
+    return tbState;
+}
+
+void updateButtonState(HWND tbWindow, int idCommand)
+{
+    int fsState, tbState;
+    
+    if (idCommand == 0) return;
+    
+    fsState = (int) SendMessage(tbWindow, TB_GETSTATE, (WPARAM) idCommand, (LPARAM) 0);
+    if (fsState == -1) return;  /* button not on toolbar */
+    
+    tbState = calcButtonState(idCommand);
+    g_stateButtonsChecked++;
+    
+    if ((fsState & ~TBSTATE_WRAP) == tbState) return;
+    
+    SendMessage(tbWindow, TB_SETSTATE, (WPARAM) idCommand, (LPARAM) MAKELPARAM(tbState, 0));
+    g_stateChanges++;
+}
+
+DWORD calcEditorState()
+{
+    HWND hScintilla;
+    int which;
+    DWORD state;
+    
+    which = 0;
+    SendMessage(nppData._nppHandle, NPPM_GETCURRENTSCINTILLA, (WPARAM) 0, (LPARAM) &which);
+    hScintilla = (which == 1) ? nppData._scintillaSecondHandle : nppData._scintillaMainHandle;
+    
+    state = 0;
+    if (!SendMessage(hScintilla, SCI_GETREADONLY, (WPARAM) 0, (LPARAM) 0)) state |= EDITPREDICATE_WRITABLE;
+    
+    return state;
+}
+
+void handleEditorState()
+{
+    HWND rbWindow, tbWindow;
+    DWORD state;
+    int i;
+    
+    // Update buttons with editor predicates only if editor state has changed (not for each keystroke)
+    
+    state = calcEditorState();
+    if (state == g_editorState) return;
+    
+    g_editorState = state;
+    g_editorStateChanges++;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    for (i = 0; i < (int) (sizeof(g_editPredicates)/sizeof(EDITPREDICATE)); i++)
+    {
+        updateButtonState(tbWindow, g_editPredicates[i].idCommand);
+    }
+}
+
+void updateDependentButtons(UINT notification)
+{
+    HWND rbWindow, tbWindow;
+    int i;
+    
+    if (g_lifecycle.stage != LIFECYCLE_STARTED) return;  /* startup updates all button states */
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // Re-evaluate only buttons whose state depends on notification
+    
+    for (i = 0; i < (int) (sizeof(g_stateDependencies)/sizeof(STATEDEPENDENCY)); i++)
+    {
+        if (g_stateDependencies[i].notification == notification) updateButtonState(tbWindow, g_stateDependencies[i].idCommand);
+    }
+    g_stateNotifications++;
+}
+
+//
+// Reset, save and restore toolbar layout functions
+//
+
+void resetToolbarLayout()
+{
+    HWND rbWindow, tbWindow;
+    int i, idCmd;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // Remove all buttons from toolbar
+    
+    i = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    for (i = i - 1; i >= 0; i--)
+    {
+        SendMessage(tbWindow, TB_DELETEBUTTON, (WPARAM) i, (LPARAM) 0);
+    }
+    
+    // Add the buttons that were preserved
+    
+    for (i = 0; i < g_buttonsAvailable; i++)
+    {
+        idCmd = g_tbButtons[i].idCommand;
+        
+        if (idCmd == IDM_FILE_CLOSEALL_BUT_CURRENT ||
+            idCmd == IDM_EDIT_DELETE || idCmd == IDM_EDIT_RMV_TAB || idCmd == IDM_EDIT_INS_TAB || idCmd == IDM_EDIT_DUP_LINE ||
+            idCmd == IDM_EDIT_BLOCK_COMMENT_SET || idCmd == IDM_EDIT_BLOCK_UNCOMMENT || idCmd == IDM_EDIT_AUTOCOMPLETE_CURRENTFILE ||
+            idCmd == IDM_EDIT_TRIMTRAILING || idCmd == IDM_EDIT_TAB2SW || idCmd == IDM_EDIT_SW2TAB_ALL ||
+            idCmd == IDM_SEARCH_FINDINFILES || idCmd == IDM_SEARCH_FINDPREV || idCmd == IDM_SEARCH_FINDNEXT ||
+            idCmd == IDM_SEARCH_FINDINCREMENT || idCmd == IDM_FOCUS_ON_FOUND_RESULTS || idCmd == IDM_SEARCH_GOTOLINE ||
+            idCmd == IDM_SEARCH_PREV_BOOKMARK || idCmd == IDM_SEARCH_NEXT_BOOKMARK || idCmd == IDM_SEARCH_CLEAR_BOOKMARKS ||
+            idCmd == IDM_VIEW_ZOOMRESTORE || idCmd == IDM_VIEW_GOTO_ANOTHER_VIEW || idCmd == IDM_VIEW_CLONE_TO_ANOTHER_VIEW ||
+            idCmd == IDM_VIEW_HIDELINES || idCmd == IDM_VIEW_TOGGLE_FOLDALL || idCmd == IDM_VIEW_TOGGLE_UNFOLDALL) ;  /* do nothing */
+        else SendMessage(tbWindow, TB_ADDBUTTONS, (WPARAM)(UINT) 1, (LPARAM)(LPTBBUTTON) &g_tbButtons[i]);
+    }
+    
+    // Without this added buttons are not displayed !!
+    
+    SendMessage(tbWindow, TB_SETMAXTEXTROWS, (WPARAM) 0, (LPARAM) 0);
+}
+
+void saveToolbarLayout()
 {
     HWND rbWindow, tbWindow;
     TCHAR configPath[MAX_PATH];
     TCHAR datFilePath[MAX_PATH];
     HANDLE datFile;
-    DWORD bytesRead;
-    DWORD dword;
-    int i, j, buttonsAvailable, buttonsOnToolbar;
+    DWORD bytesWritten;
+    TBBUTTON tbButton;
+    DATLAYOUT layout;
+    BYTE data[DATMAXSIZE];
+    int i, j;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // Menu item states
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    layout.customButtonsState = g_customButtonsState;
+    layout.wrapToolbarState = g_wrapToolbarState;
+    
+    // Entry for each button on toolbar (currently)
+    
+    layout.buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    if (layout.buttonsOnToolbar > DATMAXBUTTONS) layout.buttonsOnToolbar = DATMAXBUTTONS;
+    
+    for (i = 0; i < layout.buttonsOnToolbar; i++)
+    {
+        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
+        layout.toolbar[i] = findButtonIdentity(tbButton);
+    }
+    
+    // Entry for each button available (at startup)
+    
+    layout.buttonsAvailable = g_buttonsAvailable;
+    
+    for (j = 0; j < g_buttonsAvailable; j++)
+    {
+        layout.available[j] = g_tbIdentities[j];
+    }
     
     // Get plugins config directory
     
@@ -1248,25 +2763,36 @@ void restoreToolbarLayout(bool menuStates)
     lstrcpy(datFilePath, configPath);
     lstrcat(datFilePath, TEXT("\\CustomizeToolbar.dat"));
     
-    // Open .dat file
+    // Create .dat file and write layout (in current format)
     
-    datFile = CreateFile(datFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    datFile = CreateFile(datFilePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     
-    // Read custom buttons menu item state
+    WriteFile(datFile, data, (DWORD) formatDatLayout(&layout, data), &bytesWritten, NULL);
     
-    ReadFile(datFile, &i, sizeof(int), &bytesRead, NULL);
-    if (menuStates)
-    {
-        g_customButtonsState = i;
-        SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[2]._cmdID, (LPARAM) g_customButtonsState);
-    }
+    CloseHandle(datFile);
+}
+
+void restoreToolbarLayout(bool menuStates)
+{
+    HWND rbWindow, tbWindow;
+    DATLAYOUT layout;
+    DWORD dword;
+    int i, j;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // Read .dat file (any version)
     
-    // Read wrap toolbar menu item state
+    readDatLayout(&layout);
+    
+    // Restore custom buttons and wrap toolbar menu item states
     
-    ReadFile(datFile, &i, sizeof(int), &bytesRead, NULL);
     if (menuStates)
     {
-        g_wrapToolbarState = i;
+        g_customButtonsState = layout.customButtonsState;
+        SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[2]._cmdID, (LPARAM) g_customButtonsState);
+        
+        g_wrapToolbarState = layout.wrapToolbarState;
         SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[3]._cmdID, (LPARAM) g_wrapToolbarState);
     }
     
@@ -1278,46 +2804,19 @@ void restoreToolbarLayout(bool menuStates)
         SendMessage(tbWindow, TB_DELETEBUTTON, (WPARAM) i, (LPARAM) 0);
     }
     
-    // Read count of buttons on toolbar (in last session)
-    
-    ReadFile(datFile, &buttonsOnToolbar, sizeof(int), &bytesRead, NULL);
+    // Entry for each button on toolbar (in last session)
     
-    // Read count of all buttons available (in last session)
-    
-    ReadFile(datFile, &buttonsAvailable, sizeof(int), &bytesRead, NULL);
-    
-    // Read entry for each button on toolbar (in last session)
-    
-    for (i = 0; i < buttonsOnToolbar; i++)
+    for (i = 0; i < layout.buttonsOnToolbar; i++)
     {
-        ReadFile(datFile, &dword, sizeof(DWORD), &bytesRead, NULL);
+        dword = layout.toolbar[i];
         if (dword & HASHFLAG)  /* plugin command */
         {
             for (j = 0; j < g_buttonsAvailable; j++)
             {
-                if (g_tbButtons[j].idCommand >= ID_PLUGINS_CMD && g_tbButtons[j].idCommand <= g_id_plugins_cmd_limit)  /* plugin command (with menu item) */
-                {
-                    if (dword == calcPluginButtonMenuHash(g_tbButtons[j]))
-                    {
-                        SendMessage(tbWindow, TB_ADDBUTTONS, (WPARAM)(UINT) 1, (LPARAM)(LPTBBUTTON) &g_tbButtons[j]);
-                        break;
-                    }
-                }
-                else if (g_tbButtons[j].idCommand >= ID_PLUGINS_CMD_DYNAMIC && g_tbButtons[j].idCommand <= ID_PLUGINS_CMD_DYNAMIC_LIMIT)  /* plugin command (without menu item) (from NPPM_ALLOCATECMDID) */
+                if (dword == g_tbIdentities[j])  /* plugin command (with or without menu item) or custom command (menu strings not found) */
                 {
-                    if (dword == calcButtonStringHash(g_tbButtons[j]))
-                    {
-                        SendMessage(tbWindow, TB_ADDBUTTONS, (WPARAM)(UINT) 1, (LPARAM)(LPTBBUTTON) &g_tbButtons[j]);
-                        break;
-                    }
-                }
-                else if (g_tbButtons[j].idCommand >= ID_CMD_CUSTOM && g_tbButtons[j].idCommand <= ID_CMD_CUSTOM_LIMIT)  /* plugin command (menu strings not found) */
-                {
-                    if (dword == calcButtonStringHash(g_tbButtons[j]))
-                    {
-                        SendMessage(tbWindow, TB_ADDBUTTONS, (WPARAM)(UINT) 1, (LPARAM)(LPTBBUTTON) &g_tbButtons[j]);
-                        break;
-                    }
+                    SendMessage(tbWindow, TB_ADDBUTTONS, (WPARAM)(UINT) 1, (LPARAM)(LPTBBUTTON) &g_tbButtons[j]);
+                    break;
                 }
             }
         }
@@ -1334,43 +2833,24 @@ void restoreToolbarLayout(bool menuStates)
         }
     }
     
-    // Read entry for each button available (in last session)
+    // Entry for each button available (in last session)
     
     for (j = 0; j < g_buttonsAvailable; j++)
     {
         g_tbButtons[j].dwData = 1;
     }
     
-    for (i = 0; i < buttonsAvailable; i++)
+    for (i = 0; i < layout.buttonsAvailable; i++)
     {
-        ReadFile(datFile, &dword, sizeof(DWORD), &bytesRead, NULL);
+        dword = layout.available[i];
         if (dword & HASHFLAG)  /* plugin command */
         {
             for (j = 0; j < g_buttonsAvailable; j++)
             {
-                if (g_tbButtons[j].idCommand >= ID_PLUGINS_CMD && g_tbButtons[j].idCommand <= g_id_plugins_cmd_limit)  /* plugin command (with menu item) */
-                {
-                    if (dword == calcPluginButtonMenuHash(g_tbButtons[j]))
-                    {
-                        g_tbButtons[j].dwData = 0;
-                        break;
-                    }
-                }
-                else if (g_tbButtons[j].idCommand >= ID_PLUGINS_CMD_DYNAMIC && g_tbButtons[j].idCommand <= ID_PLUGINS_CMD_DYNAMIC_LIMIT)  /* plugin command (without menu item) (from NPPM_ALLOCATECMDID) */
-                {
-                    if (dword == calcButtonStringHash(g_tbButtons[j]))
-                    {
-                        g_tbButtons[j].dwData = 0;
-                        break;
-                    }
-                }
-                else if (g_tbButtons[j].idCommand >= ID_CMD_CUSTOM && g_tbButtons[j].idCommand <= ID_CMD_CUSTOM_LIMIT)  /* plugin command (menu strings not found) */
+                if (dword == g_tbIdentities[j])  /* plugin command (with or without menu item) or custom command (menu strings not found) */
                 {
-                    if (dword == calcButtonStringHash(g_tbButtons[j]))
-                    {
-                        g_tbButtons[j].dwData = 0;
-                        break;
-                    }
+                    g_tbButtons[j].dwData = 0;
+                    break;
                 }
             }
         }
@@ -1387,6 +2867,8 @@ void restoreToolbarLayout(bool menuStates)
         }
     }
     
+    // Add buttons that were not available in last session (e.g. newly installed plugin)
+    
     for (j = 0; j < g_buttonsAvailable; j++)
     {
         if (g_tbButtons[j].dwData == 1)
@@ -1399,10 +2881,36 @@ void restoreToolbarLayout(bool menuStates)
     // Without this added buttons are not displayed !!
     
     SendMessage(tbWindow, TB_SETMAXTEXTROWS, (WPARAM) 0, (LPARAM) 0);
+}
+
+bool readDatLayout(DATLAYOUT *layout)
+{
+    TCHAR configPath[MAX_PATH];
+    TCHAR datFilePath[MAX_PATH];
+    HANDLE datFile;
+    DWORD bytesRead;
+    BYTE data[DATMAXSIZE+1];
     
-    // Close .dat file
+    // Get plugins config directory
     
-    CloseHandle(datFile);
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    // Initialise .dat file path
+    
+    lstrcpy(datFilePath, configPath);
+    lstrcat(datFilePath, TEXT("\\CustomizeToolbar.dat"));
+    
+    // Read whole .dat file and detect its version from its contents (one byte extra, so oversized file is rejected)
+    
+    bytesRead = 0;
+    datFile = CreateFile(datFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (datFile != INVALID_HANDLE_VALUE)
+    {
+        ReadFile(datFile, data, DATMAXSIZE+1, &bytesRead, NULL);
+        CloseHandle(datFile);
+    }
+    
+    return parseDatLayout(data, bytesRead, layout) != DATFORMAT_UNKNOWN;
 }
 
 //
@@ -1418,8 +2926,7 @@ void makeToolbarWrap()
     DWORD padding;
     int buttonsOnToolbar;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
     
     style = GetWindowLongPtr(tbWindow, GWL_STYLE);
     style |= TBSTYLE_WRAPABLE;
@@ -1442,6 +2949,7 @@ void makeToolbarWrap()
     rebarBandInfo.cyMinChild = buttonRect.bottom+(HIWORD(padding)/2)+1;
     rebarBandInfo.cyMaxChild = buttonRect.bottom+(HIWORD(padding)/2)+1;
     rebarBandInfo.cxHeader = 6;
+    if (layoutPassStale(&g_layoutPasses)) return;  /* band height from obsolete geometry */
     SendMessage(rbWindow, RB_SETBANDINFO, (WPARAM) 0, (LPARAM) &rebarBandInfo);
 }
 
@@ -1452,8 +2960,7 @@ void makeToolbarOverflow()
     REBARBANDINFO rebarBandInfo;
     DWORD size, padding;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
     
     style = GetWindowLongPtr(tbWindow, GWL_STYLE);
     style &= ~TBSTYLE_WRAPABLE;
@@ -1474,6 +2981,7 @@ void makeToolbarOverflow()
     rebarBandInfo.cyMinChild = HIWORD(size)+HIWORD(padding);
     rebarBandInfo.cyMaxChild = HIWORD(size)+HIWORD(padding);
     rebarBandInfo.cxHeader = 26;
+    if (layoutPassStale(&g_layoutPasses)) return;  /* band height from obsolete geometry */
     SendMessage(rbWindow, RB_SETBANDINFO, (WPARAM) 0, (LPARAM) &rebarBandInfo);
 }
 
@@ -1483,8 +2991,9 @@ void adjustIdealSize()
     SIZE tbMaxSize;
     REBARBANDINFO rebarBandInfo;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    if (layoutPassStale(&g_layoutPasses)) return;  /* newer resize or changed icons event received (e.g. re-entrantly while rebar is resized) */
     
     SendMessage(tbWindow, TB_GETMAXSIZE, (WPARAM) 0, (LPARAM) &tbMaxSize);
     
@@ -1506,163 +3015,1892 @@ void displayOverflowMenu(NMREBARCHEVRON *lpNmRebarChevron)
     UINT menuStyle;
     int i, itemCount, buttonsOnToolbar;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // Create popup menu to show overflow buttons
+    
+    popupMenu = CreatePopupMenu();
+    
+    // Screen co-ordinates for Menu to be displayed - align with left of chevron (-12)
+    
+    popupPoint.x = lpNmRebarChevron->rc.left-11;
+    popupPoint.y = lpNmRebarChevron->rc.bottom;
+    ClientToScreen(tbWindow, &popupPoint);
+    
+    // Get band rectangle - subtract chevron width (-16)
+    
+    SendMessage(rbWindow, RB_GETRECT, (WPARAM) 0, (LPARAM) (LPPOINT) &rbBandRect);
+    rbBandRect.right -= 16;
+    
+    // Add items to popup menu
+    
+    itemCount = 0;
+    buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    
+    for (i = 0; i < buttonsOnToolbar; i++)
+    {
+        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
+        
+        if (tbButton.fsStyle & BTNS_SEP)
+        {
+            // Add separator menu item
+            
+            if (itemCount > 0) AppendMenu(popupMenu, MF_SEPARATOR, 0, 0);
+        }
+        else
+        {
+            // Get button rectangle - offset by band gripper width (+12)
+            
+            SendMessage(tbWindow, TB_GETITEMRECT, (WPARAM) i, (LPARAM)(LPRECT) &tbButtonRect);
+            tbButtonRect.left += 12;
+            tbButtonRect.right += 12;
+            
+            // Check intersection of button and band rectangles
+            
+            IntersectRect(&intersectRect, &tbButtonRect, &rbBandRect);
+            
+            if (intersectRect.left != tbButtonRect.left || intersectRect.right != tbButtonRect.right ||
+                intersectRect.top != tbButtonRect.top || intersectRect.bottom != tbButtonRect.bottom)
+            {
+                menuStyle = MF_STRING;
+                menuStyle |= SendMessage(tbWindow, TB_ISBUTTONENABLED, (WPARAM) tbButton.idCommand, (LPARAM) 0) ? MF_ENABLED : MF_DISABLED|MF_GRAYED;
+                menuStyle |= SendMessage(tbWindow, TB_ISBUTTONCHECKED, (WPARAM) tbButton.idCommand, (LPARAM) 0) ? MF_CHECKED : MF_UNCHECKED;
+                
+                SendMessage(tbWindow, TB_GETSTRING, (WPARAM) MAKEWPARAM(MAXSIZE,tbButton.iString), (LPARAM) buffer);
+                
+                AppendMenu(popupMenu, menuStyle, tbButton.idCommand, buffer);
+                
+                itemCount++;
+            }
+        }
+    }
+    
+    // Display popup menu if at least one item has been added
+    
+    if (itemCount > 0)
+    {
+        beginStateRead();
+        TrackPopupMenu(popupMenu, TPM_LEFTALIGN|TPM_TOPALIGN, popupPoint.x, popupPoint.y, 0, rbWindow, NULL);
+        endStateRead();
+    }
+    
+    // Destroy popup menu
+    
+    DestroyMenu(popupMenu);
+}
+
+//
+// Layout journal (undo/redo) functions
+//
+
+int captureToolbarLayout(DWORD layout[])
+{
+    HWND rbWindow, tbWindow;
+    TBBUTTON tbButton;
+    int i, buttonsOnToolbar;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    if (buttonsOnToolbar > 300) buttonsOnToolbar = 300;
+    
+    for (i = 0; i < buttonsOnToolbar; i++)
+    {
+        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
+        layout[i] = findButtonIdentity(tbButton);
+    }
+    
+    return buttonsOnToolbar;
+}
+
+bool applyToolbarDelta(HWND tbWindow, DWORD layout[], int *count, int op, int index, int toIndex, DWORD identity)
+{
+    int j;
+    
+    // Apply delta to layout - and to toolbar unless only checking delta can be applied (tbWindow is NULL)
+    
+    if (op == JOURNALOP_INSERT)
+    {
+        for (j = 0; j < g_buttonsAvailable && g_tbIdentities[j] != identity; j++);
+        if (j == g_buttonsAvailable) return false;  /* button no longer exists */
+    }
+    
+    if (!applyLayoutDelta(layout, count, op, index, toIndex, identity)) return false;
+    if (tbWindow == NULL) return true;
+    
+    switch (op)
+    {
+        case JOURNALOP_INSERT: SendMessage(tbWindow, TB_INSERTBUTTON, (WPARAM) index, (LPARAM)(LPTBBUTTON) &g_tbButtons[j]); break;
+        case JOURNALOP_DELETE: SendMessage(tbWindow, TB_DELETEBUTTON, (WPARAM) index, (LPARAM) 0); break;
+        case JOURNALOP_MOVE: SendMessage(tbWindow, TB_MOVEBUTTON, (WPARAM) index, (LPARAM) toIndex); break;
+    }
+    
+    return true;
+}
+
+bool applyJournalGroup(int start, int end, bool undo)
+{
+    HWND rbWindow, tbWindow;
+    DWORD layout[300];
+    JOURNALDELTA deltas[JOURNALMAXGROUP];
+    JOURNALDELTA *delta;
+    int i, pass, count, op, index, toIndex, deltaCount;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // First pass checks that the whole change can be applied, second pass applies it to toolbar
+    
+    for (pass = 0; pass < 2; pass++)
+    {
+        memcpy(layout, g_layoutIdentities, g_layoutCount*sizeof(DWORD));
+        count = g_layoutCount;
+        
+        if (pass == 1) SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) FALSE, (LPARAM) 0);
+        
+        for (i = 0; i <= end-start; i++)
+        {
+            delta = &g_journal[undo ? end-i : start+i];
+            
+            // Undo inverts each delta - insert and delete swap, and move goes back to where it came from
+            
+            op = DELTAOP(*delta);
+            index = delta->index;
+            toIndex = DELTATOINDEX(*delta);
+            if (undo)
+            {
+                if (op == JOURNALOP_INSERT) op = JOURNALOP_DELETE;
+                else if (op == JOURNALOP_DELETE) op = JOURNALOP_INSERT;
+                else if (op == JOURNALOP_MOVE) { index = toIndex; toIndex = delta->index; }
+            }
+            
+            if (!applyToolbarDelta(pass == 1 ? tbWindow : NULL, layout, &count, op, index, toIndex, delta->identity)) return false;
+        }
+    }
+    
+    SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) TRUE, (LPARAM) 0);
+    
+    // Without this added buttons are not displayed !!
+    
+    SendMessage(tbWindow, TB_SETMAXTEXTROWS, (WPARAM) 0, (LPARAM) 0);
+    InvalidateRect(tbWindow, NULL, TRUE);
+    
+    // Publish change to other instances (as forward deltas from previous layout)
+    
+    deltaCount = calcLayoutDeltas(g_layoutIdentities, g_layoutCount, layout, count, deltas);
+    
+    memcpy(g_layoutIdentities, layout, count*sizeof(DWORD));
+    g_layoutCount = count;
+    
+    if (deltaCount > 0) publishLayoutChange(deltas, deltaCount);
+    
+    // Restore toolbar wrap state and display styles, and save toolbar layout
+    
+    if (g_wrapToolbarState) makeToolbarWrap();
+    else makeToolbarOverflow();
+    
+    updateToolbarState();
+    adjustIdealSize();
+    saveToolbarLayout();
+    
+    return true;
+}
+
+void recordLayoutChange()
+{
+    DWORD layout[300];
+    JOURNALDELTA deltas[JOURNALMAXGROUP];
+    int count, deltaCount;
+    
+    count = captureToolbarLayout(layout);
+    deltaCount = calcLayoutDeltas(g_layoutIdentities, g_layoutCount, layout, count, deltas);
+    
+    memcpy(g_layoutIdentities, layout, count*sizeof(DWORD));
+    g_layoutCount = count;
+    
+    if (deltaCount > 0)
+    {
+        addJournalGroup(deltas, deltaCount);
+        appendLayoutJournal(deltas, deltaCount);
+        publishLayoutChange(deltas, deltaCount);
+    }
+}
+
+void resetLayoutBaseline()
+{
+    // Layout changed by plugin itself (restore) - not recorded as a layout change
+    
+    g_layoutCount = captureToolbarLayout(g_layoutIdentities);
+}
+
+void addJournalGroup(JOURNALDELTA deltas[], int deltaCount)
+{
+    int drop;
+    
+    // Discard changes that were undone (no longer redoable)
+    
+    g_journalCount = g_journalPos;
+    
+    // Discard oldest changes to keep within memory budget
+    
+    while (g_journalCount+deltaCount > JOURNALMAXDELTAS)
+    {
+        for (drop = 0; drop < g_journalCount && !DELTAGROUPEND(g_journal[drop]); drop++);
+        drop++;
+        memmove(&g_journal[0], &g_journal[drop], (g_journalCount-drop)*sizeof(JOURNALDELTA));
+        g_journalCount -= drop;
+    }
+    
+    memcpy(&g_journal[g_journalCount], deltas, deltaCount*sizeof(JOURNALDELTA));
+    g_journalCount += deltaCount;
+    g_journalPos = g_journalCount;
+}
+
+void appendLayoutJournal(JOURNALDELTA deltas[], int deltaCount)
+{
+    TCHAR configPath[MAX_PATH];
+    TCHAR jnlFilePath[MAX_PATH];
+    HANDLE jnlFile;
+    DWORD bytesWritten, fileSize;
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(jnlFilePath, configPath);
+    lstrcat(jnlFilePath, TEXT("\\CustomizeToolbar.jnl"));
+    
+    jnlFile = CreateFile(jnlFilePath, GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (jnlFile == INVALID_HANDLE_VALUE) return;
+    
+    fileSize = SetFilePointer(jnlFile, 0, NULL, FILE_END);
+    WriteFile(jnlFile, deltas, deltaCount*sizeof(JOURNALDELTA), &bytesWritten, NULL);
+    
+    CloseHandle(jnlFile);
+    
+    if (fileSize+bytesWritten > JOURNALMAXFILESIZE) compactLayoutJournal();
+}
+
+void loadLayoutJournal()
+{
+    TCHAR configPath[MAX_PATH];
+    TCHAR jnlFilePath[MAX_PATH];
+    HANDLE jnlFile;
+    DWORD bytesRead;
+    JOURNALDELTA deltas[JOURNALMAXGROUP];
+    JOURNALDELTA delta;
+    int deltaCount, start, end;
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(jnlFilePath, configPath);
+    lstrcat(jnlFilePath, TEXT("\\CustomizeToolbar.jnl"));
+    
+    g_journalCount = g_journalPos = 0;
+    
+    jnlFile = CreateFile(jnlFilePath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (jnlFile == INVALID_HANDLE_VALUE) return;
+    
+    // Replay journal - collecting deltas of each change, and moving undo position for each undo/redo marker
+    
+    deltaCount = 0;
+    while (ReadFile(jnlFile, &delta, sizeof(JOURNALDELTA), &bytesRead, NULL) && bytesRead == sizeof(JOURNALDELTA))
+    {
+        if (DELTAOP(delta) == JOURNALOP_MARKER)
+        {
+            deltaCount = 0;
+            if (delta.index == JOURNALMARKER_UNDO && g_journalPos > 0)
+            {
+                for (start = g_journalPos-1; start > 0 && !DELTAGROUPEND(g_journal[start-1]); start--);
+                g_journalPos = start;
+            }
+            else if (delta.index == JOURNALMARKER_REDO && g_journalPos < g_journalCount)
+            {
+                for (end = g_journalPos; end < g_journalCount-1 && !DELTAGROUPEND(g_journal[end]); end++);
+                g_journalPos = end+1;
+            }
+        }
+        else if (deltaCount < JOURNALMAXGROUP)
+        {
+            deltas[deltaCount++] = delta;
+            if (DELTAGROUPEND(delta))
+            {
+                addJournalGroup(deltas, deltaCount);
+                deltaCount = 0;
+            }
+        }
+    }
+    
+    CloseHandle(jnlFile);
+}
+
+void compactLayoutJournal()
+{
+    TCHAR configPath[MAX_PATH];
+    TCHAR jnlFilePath[MAX_PATH];
+    HANDLE jnlFile;
+    DWORD bytesWritten;
+    JOURNALDELTA marker = { MAKEDELTACODE(JOURNALOP_MARKER, 0, true), JOURNALMARKER_UNDO, 0 };
+    int i;
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(jnlFilePath, configPath);
+    lstrcat(jnlFilePath, TEXT("\\CustomizeToolbar.jnl"));
+    
+    // Rewrite journal with changes held in memory, followed by an undo marker for each change that has been undone
+    
+    jnlFile = CreateFile(jnlFilePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (jnlFile == INVALID_HANDLE_VALUE) return;
+    
+    WriteFile(jnlFile, g_journal, g_journalCount*sizeof(JOURNALDELTA), &bytesWritten, NULL);
+    
+    for (i = g_journalPos; i < g_journalCount; i++)
+    {
+        if (DELTAGROUPEND(g_journal[i])) WriteFile(jnlFile, &marker, sizeof(JOURNALDELTA), &bytesWritten, NULL);
+    }
+    
+    CloseHandle(jnlFile);
+}
+
+//
+// Multi-instance layout synchronization functions
+//
+
+void openSyncChannel()
+{
+    TCHAR eventName[100];
+    DWORD processId;
+    bool firstInstance;
+    int i;
+    
+    g_syncMessage = RegisterWindowMessage(TEXT("CustomizeToolbarSync"));
+    
+    // Open (or create) shared channel and its mutex
+    
+    g_syncMutex = CreateMutex(NULL, FALSE, TEXT("Local\\CustomizeToolbarSyncMutex"));
+    g_syncMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SYNCCHANNEL), TEXT("Local\\CustomizeToolbarSync"));
+    if (g_syncMutex == NULL || g_syncMapping == NULL)
+    {
+        closeSyncChannel();
+        return;
+    }
+    
+    g_syncChannel = (SYNCCHANNEL *) MapViewOfFile(g_syncMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SYNCCHANNEL));
+    if (g_syncChannel == NULL)
+    {
+        closeSyncChannel();
+        return;
+    }
+    
+    // Create notification event for this instance
+    
+    processId = GetCurrentProcessId();
+    _stprintf_s(eventName, 100, TEXT("Local\\CustomizeToolbarSync%lu"), processId);
+    g_syncEvent = CreateEvent(NULL, FALSE, FALSE, eventName);
+    
+    WaitForSingleObject(g_syncMutex, INFINITE);
+    
+    // Channel just created (mapping is zero filled) - publish layout of this instance, otherwise take full layout from channel
+    
+    firstInstance = attachSyncChannel(g_syncChannel, &g_syncPosition, g_layoutIdentities, g_layoutCount, g_customButtonsState, g_wrapToolbarState);
+    
+    // Register this instance to be notified of changes
+    
+    for (i = 0; i < SYNCMAXINSTANCES && g_syncChannel->instances[i] != 0; i++);
+    if (i < SYNCMAXINSTANCES) g_syncChannel->instances[i] = processId;
+    
+    ReleaseMutex(g_syncMutex);
+    
+    if (!firstInstance) syncLayoutChanges();
+    
+    InterlockedExchange(&g_syncClosing, 0);
+    if (g_syncEvent != NULL) g_syncThread = CreateThread(NULL, 0, handleSyncEvents, NULL, 0, NULL);
+}
+
+void closeSyncChannel()
+{
+    DWORD processId;
+    int i;
+    
+    // Unregister this instance
+    
+    if (g_syncChannel != NULL)
+    {
+        processId = GetCurrentProcessId();
+        
+        WaitForSingleObject(g_syncMutex, INFINITE);
+        for (i = 0; i < SYNCMAXINSTANCES; i++)
+        {
+            if (g_syncChannel->instances[i] == processId) g_syncChannel->instances[i] = 0;
+        }
+        ReleaseMutex(g_syncMutex);
+        
+        UnmapViewOfFile(g_syncChannel);
+        g_syncChannel = NULL;
+    }
+    
+    // Stop synchronization thread - and wait for it to finish before its event is closed
+    
+    InterlockedExchange(&g_syncClosing, 1);
+    if (g_syncThread != NULL)
+    {
+        SetEvent(g_syncEvent);
+        WaitForSingleObject(g_syncThread, INFINITE);
+        CloseHandle(g_syncThread);
+        g_syncThread = NULL;
+    }
+    
+    if (g_syncEvent != NULL) CloseHandle(g_syncEvent);
+    g_syncEvent = NULL;
+    
+    if (g_syncMapping != NULL) CloseHandle(g_syncMapping);
+    if (g_syncMutex != NULL) CloseHandle(g_syncMutex);
+    g_syncMapping = g_syncMutex = NULL;
+}
+
+void publishLayoutChange(JOURNALDELTA deltas[], int deltaCount)
+{
+    TCHAR eventName[100];
+    HANDLE hEvent;
+    DWORD processId;
+    int i;
+    
+    if (g_syncChannel == NULL) return;
+    
+    processId = GetCurrentProcessId();
+    
+    WaitForSingleObject(g_syncMutex, INFINITE);
+    
+    // Publish deltas - or if they are not relative to latest layout (changes by other instances not yet applied) or too many,
+    // publish full layout only (so other instances cannot apply earlier deltas incrementally)
+    
+    publishSyncChange(g_syncChannel, &g_syncPosition, deltas, deltaCount, g_layoutIdentities, g_layoutCount, g_customButtonsState, g_wrapToolbarState);
+    
+    // Notify other instances (removing any that no longer exist)
+    
+    for (i = 0; i < SYNCMAXINSTANCES; i++)
+    {
+        if (g_syncChannel->instances[i] == 0 || g_syncChannel->instances[i] == processId) continue;
+        
+        _stprintf_s(eventName, 100, TEXT("Local\\CustomizeToolbarSync%lu"), g_syncChannel->instances[i]);
+        hEvent = OpenEvent(EVENT_MODIFY_STATE, FALSE, eventName);
+        if (hEvent == NULL)
+        {
+            g_syncChannel->instances[i] = 0;
+            continue;
+        }
+        SetEvent(hEvent);
+        CloseHandle(hEvent);
+    }
+    
+    ReleaseMutex(g_syncMutex);
+}
+
+void syncLayoutChanges()
+{
+    static SYNCCHANGE change;  /* Notepad++ window thread only - too large for stack */
+    JOURNALDELTA deltas[JOURNALMAXGROUP];
+    DWORD layout[300];
+    bool published, wrapChanged, applied;
+    int i, j, count, deltaCount;
+    
+    if (g_syncChannel == NULL) return;
+    
+    // Copy change under mutex - applied after mutex is released (so other instances are not held up by toolbar updates)
+    
+    WaitForSingleObject(g_syncMutex, INFINITE);
+    published = readSyncChange(g_syncChannel, &g_syncPosition, &change);
+    ReleaseMutex(g_syncMutex);
+    
+    if (!published) return;  /* nothing published since last synchronized */
+    
+    // Menu item states
+    
+    wrapChanged = ((change.wrapToolbarState != 0) != (g_wrapToolbarState != 0));
+    
+    g_customButtonsState = change.customButtonsState;
+    SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[2]._cmdID, (LPARAM) g_customButtonsState);
+    
+    g_wrapToolbarState = change.wrapToolbarState;
+    SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[3]._cmdID, (LPARAM) g_wrapToolbarState);
+    
+    // Apply deltas published since last synchronized - if still in ring
+    
+    applied = (change.deltaCount == 0);
+    if (change.deltaCount > 0) applied = applySyncDeltas(change.deltas, change.deltaCount);
+    
+    // Otherwise apply full layout (only buttons that are available in this instance)
+    
+    if (!applied)
+    {
+        count = 0;
+        for (i = 0; i < change.layoutCount; i++)
+        {
+            for (j = 0; j < g_buttonsAvailable && g_tbIdentities[j] != change.layout[i]; j++);
+            if (j < g_buttonsAvailable) layout[count++] = change.layout[i];
+        }
+        
+        deltaCount = calcLayoutDeltas(g_layoutIdentities, g_layoutCount, layout, count, deltas);
+        if (deltaCount > 0) applySyncDeltas(deltas, deltaCount);
+    }
+    
+    g_syncPosition = change.position;
+    
+    // Restore toolbar wrap state and display styles
+    
+    if (wrapChanged || change.deltaCount != 0)
+    {
+        if (g_wrapToolbarState) makeToolbarWrap();
+        else makeToolbarOverflow();
+        
+        updateToolbarState();
+        adjustIdealSize();
+    }
+}
+
+bool applySyncDeltas(JOURNALDELTA deltas[], int deltaCount)
+{
+    HWND rbWindow, tbWindow;
+    DWORD layout[300];
+    int i, pass, count;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    // First pass checks that all deltas can be applied, second pass applies them to toolbar
+    
+    for (pass = 0; pass < 2; pass++)
+    {
+        memcpy(layout, g_layoutIdentities, g_layoutCount*sizeof(DWORD));
+        count = g_layoutCount;
+        
+        if (pass == 1) SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) FALSE, (LPARAM) 0);
+        
+        for (i = 0; i < deltaCount; i++)
+        {
+            if (!applyToolbarDelta(pass == 1 ? tbWindow : NULL, layout, &count, DELTAOP(deltas[i]), deltas[i].index, DELTATOINDEX(deltas[i]), deltas[i].identity)) return false;
+        }
+    }
+    
+    SendMessage(tbWindow, WM_SETREDRAW, (WPARAM) TRUE, (LPARAM) 0);
+    
+    // Without this added buttons are not displayed !!
+    
+    SendMessage(tbWindow, TB_SETMAXTEXTROWS, (WPARAM) 0, (LPARAM) 0);
+    InvalidateRect(tbWindow, NULL, TRUE);
+    
+    // Layout changed by other instance - becomes baseline, but is not recorded as a layout change (for undo/redo)
+    
+    memcpy(g_layoutIdentities, layout, count*sizeof(DWORD));
+    g_layoutCount = count;
+    
+    return true;
+}
+
+DWORD WINAPI handleSyncEvents(LPVOID lpParam)
+{
+    // Wait for other instances to publish changes - and have them applied by Notepad++ window thread
+    
+    while (WaitForSingleObject(g_syncEvent, INFINITE) == WAIT_OBJECT_0 && InterlockedCompareExchange(&g_syncClosing, 0, 0) == 0)
+    {
+        PostMessage(nppData._nppHandle, g_syncMessage, (WPARAM) 0, (LPARAM) 0);
+    }
+    
+    return 0;
+}
+
+//
+// Export and import layout functions
+//
+
+bool getLayoutFilePath(LPTSTR filePath, bool save)
+{
+    TCHAR configPath[MAX_PATH];
+    OPENFILENAME ofn;
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(filePath, TEXT("CustomizeToolbarLayout.txt"));
+    
+    memset(&ofn, 0, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = nppData._nppHandle;
+    ofn.lpstrFilter = TEXT("Toolbar Layout (*.txt)\0*.txt\0All Files (*.*)\0*.*\0");
+    ofn.lpstrFile = filePath;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrInitialDir = configPath;
+    ofn.lpstrDefExt = TEXT("txt");
+    
+    if (save)
+    {
+        ofn.lpstrTitle = TEXT("Customize Toolbar - Export Layout");
+        ofn.Flags = OFN_OVERWRITEPROMPT | OFN_HIDEREADONLY | OFN_NOCHANGEDIR;
+        return GetSaveFileName(&ofn) != 0;
+    }
+    else
+    {
+        ofn.lpstrTitle = TEXT("Customize Toolbar - Import Layout");
+        ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST | OFN_HIDEREADONLY | OFN_NOCHANGEDIR;
+        return GetOpenFileName(&ofn) != 0;
+    }
+}
+
+void buildMenuIndex(HMENU hMenu, MENUINDEXENTRY *path)
+{
+    MENUINDEXENTRY item;
+    HMENU hSubMenu;
+    TCHAR buffer[MAXSIZE];
+    int i, k, count;
+    
+    count = GetMenuItemCount(hMenu);
+    
+    for (i = 0; i < count && g_menuIndexCount < MENUINDEXMAX; i++)
+    {
+        GetMenuString(hMenu, i, buffer, MAXSIZE, MF_BYPOSITION);
+        stripMenuString(buffer);
+        if (buffer[0] == 0) continue;  /* separator or unnamed item - cannot be in menu path */
+        
+        // Extend menu path with this menu string - hash continues from parent (as if menu strings were separated by commas)
+        
+        item = *path;
+        item.hMenu[item.depth] = hMenu;
+        item.position[item.depth] = i;
+        if (item.depth > 0) item.pathHash = ((item.pathHash << 5) - item.pathHash) + ',';
+        for (k = 0; buffer[k] != 0; k++)
+        {
+            item.pathHash = ((item.pathHash << 5) - item.pathHash) + buffer[k]; /* hash * 31 + char */
+        }
+        item.depth++;
+        
+        hSubMenu = GetSubMenu(hMenu, i);
+        if (hSubMenu == NULL)
+        {
+            item.idCommand = GetMenuItemID(hMenu, i);
+            g_menuIndex[g_menuIndexCount++] = item;
+        }
+        else if (item.depth < 4)  /* four menu strings at most (as custom buttons) */
+        {
+            buildMenuIndex(hSubMenu, &item);
+        }
+    }
+}
+
+int getMenuIndexPath(MENUINDEXENTRY *entry, LPTSTR lpString, int maxCount)
+{
+    TCHAR buffer[MAXSIZE];
+    int k, length;
+    
+    // Menu strings along menu path separated by commas
+    
+    lpString[0] = 0;
+    length = 0;
+    for (k = 0; k < entry->depth; k++)
+    {
+        GetMenuString(entry->hMenu[k], entry->position[k], buffer, MAXSIZE, MF_BYPOSITION);
+        stripMenuString(buffer);
+        if (length+lstrlen(buffer)+2 > maxCount) break;
+        if (k > 0) lpString[length++] = ',';
+        lstrcpy(&lpString[length], buffer);
+        length += lstrlen(buffer);
+    }
+    
+    return length;
+}
+
+int findMenuIndexCommand(UINT idCommand)
+{
+    int i;
+    
+    for (i = 0; i < g_menuIndexCount; i++)
+    {
+        if (g_menuIndex[i].idCommand == idCommand) return i;
+    }
+    
+    return -1;
+}
+
+int findMenuIndexPath(LPTSTR lpString)
+{
+    TCHAR buffer[MAXSIZE*4+10];
+    DWORD hash;
+    int i;
+    
+    hash = calcStringHash(lpString);
+    
+    for (i = 0; i < g_menuIndexCount; i++)
+    {
+        if (g_menuIndex[i].pathHash != hash) continue;
+        
+        getMenuIndexPath(&g_menuIndex[i], buffer, MAXSIZE*4+10);
+        if (lstrcmp(buffer, lpString) == 0) return i;  /* not just same hash */
+    }
+    
+    return -1;
+}
+
+void writeLayoutEntry(LAYOUTSTREAM *stream, TBBUTTON tbButton)
+{
+    HWND rbWindow, tbWindow;
+    TCHAR buffer[MAXSIZE*4+10];
+    int i;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    if (tbButton.idCommand == 0)  /* separator */
+    {
+        writeLayoutText(stream, TEXT("-"));
+    }
+    else if ((i = findMenuIndexCommand(tbButton.idCommand)) >= 0)  /* built-in command, plugin command or custom command (with menu item) */
+    {
+        getMenuIndexPath(&g_menuIndex[i], buffer, MAXSIZE*4+10);
+        writeLayoutText(stream, buffer);
+        
+        if (calcButtonIdentity(tbButton) == (DWORD) tbButton.idCommand)  /* built-in command - same cmdid on every machine */
+        {
+            _stprintf_s(buffer, MAXSIZE, TEXT(",#%i"), tbButton.idCommand);
+            writeLayoutText(stream, buffer);
+        }
+    }
+    else if (findButtonIdentity(tbButton) & HASHFLAG)  /* plugin command (without menu item) or custom command (menu strings not found) */
+    {
+        SendMessage(tbWindow, TB_GETSTRING, (WPARAM) MAKEWPARAM(MAXSIZE,tbButton.iString), (LPARAM) buffer);
+        writeLayoutText(stream, TEXT("@"));
+        writeLayoutText(stream, buffer);
+    }
+    else  /* built-in command (without menu item) */
+    {
+        _stprintf_s(buffer, MAXSIZE, TEXT("#%i"), tbButton.idCommand);
+        writeLayoutText(stream, buffer);
+    }
+    
+    writeLayoutText(stream, TEXT("\r\n"));
+}
+
+int resolveLayoutEntry(LPTSTR lpString)
+{
+    LPTSTR lpCmdID;
+    DWORD dword;
+    int i, j;
+    
+    // Identity of button - as written to .dat file
+    
+    if (lpString[0] == '-' && lpString[1] == 0)  /* separator */
+    {
+        dword = 0;
+    }
+    else if (lpString[0] == '@')  /* plugin command (without menu item) or custom command (menu strings not found) */
+    {
+        dword = calcStringHash(&lpString[1]) | HASHFLAG;
+    }
+    else if (lpString[0] == '#')  /* built-in command (without menu item) */
+    {
+        dword = (DWORD) _ttoi(&lpString[1]);
+    }
+    else  /* menu path (of built-in command followed by #cmdid) */
+    {
+        i = findMenuIndexPath(lpString);
+        
+        if (i < 0)
+        {
+            lpCmdID = _tcsrchr(lpString, ',');
+            if (lpCmdID == NULL || lpCmdID[1] != '#' || _ttoi(&lpCmdID[2]) <= 0) return -1;
+            
+            *lpCmdID = 0;
+            i = findMenuIndexPath(lpString);
+            *lpCmdID = ',';
+        }
+        
+        if (i >= 0)
+        {
+            for (j = 0; j < g_buttonsAvailable; j++)
+            {
+                if ((UINT) g_tbButtons[j].idCommand == g_menuIndex[i].idCommand) return j;
+            }
+            return -1;
+        }
+        
+        dword = (DWORD) _ttoi(&lpCmdID[2]);  /* menu path not found (other localization) */
+    }
+    
+    for (j = 0; j < g_buttonsAvailable; j++)
+    {
+        if (g_tbIdentities[j] == dword) return j;
+    }
+    
+    return -1;
+}
+
+void writeLayoutText(LAYOUTSTREAM *stream, LPCTSTR lpString)
+{
+    int i;
+    
+    for (i = 0; lpString[i] != 0; i++)
+    {
+        if (stream->length == LAYOUTBUFFERSIZE) flushLayoutText(stream);
+        stream->buffer[stream->length++] = lpString[i];
+    }
+}
+
+void flushLayoutText(LAYOUTSTREAM *stream)
+{
+    DWORD bytesWritten;
+    
+    if (stream->length > 0) WriteFile(stream->file, stream->buffer, stream->length*sizeof(TCHAR), &bytesWritten, NULL);
+    stream->length = 0;
+}
+
+bool readLayoutLine(LAYOUTSTREAM *stream, LPTSTR lpString, int maxCount)
+{
+    DWORD bytesRead;
+    TCHAR nextChar;
+    int length;
+    bool found;
+    
+    length = 0;
+    found = false;
+    
+    while (true)
+    {
+        // Refill buffer when empty
+        
+        if (stream->position == stream->length)
+        {
+            ReadFile(stream->file, stream->buffer, LAYOUTBUFFERSIZE*sizeof(TCHAR), &bytesRead, NULL);
+            stream->length = (int) (bytesRead/sizeof(TCHAR));
+            stream->position = 0;
+            if (stream->length == 0) break;  /* end of file */
+        }
+        
+        nextChar = stream->buffer[stream->position++];
+        found = true;
+        
+        if (nextChar == '\n') break;
+#ifdef _UNICODE
+        if (nextChar == '\r' || nextChar == 0xFEFF) continue;  /* CR or BOM */
+#else
+        if (nextChar == '\r') continue;
+#endif
+        if (length < maxCount-1) lpString[length++] = nextChar;
+    }
+    
+    lpString[length] = 0;
+    
+    return found;
+}
+
+//
+// Hash functions
+//
+
+DWORD calcButtonIdentity(TBBUTTON tbButton)
+{
+    if (tbButton.idCommand >= ID_PLUGINS_CMD && tbButton.idCommand <= g_id_plugins_cmd_limit)  /* plugin command (with menu item) */
+    {
+        return calcPluginButtonMenuHash(tbButton);
+    }
+    else if (tbButton.idCommand >= ID_PLUGINS_CMD_DYNAMIC && tbButton.idCommand <= ID_PLUGINS_CMD_DYNAMIC_LIMIT)  /* plugin command (without menu item) (from NPPM_ALLOCATECMDID) */
+    {
+        return calcButtonStringHash(tbButton);
+    }
+    else if (tbButton.idCommand >= ID_CMD_CUSTOM && tbButton.idCommand <= ID_CMD_CUSTOM_LIMIT)  /* custom command (menu strings not found) */
+    {
+        return calcButtonStringHash(tbButton);
+    }
+    else  /* built-in command or separator */
+    {
+        return tbButton.idCommand;
+    }
+}
+
+DWORD findButtonIdentity(TBBUTTON tbButton)
+{
+    int j;
+    
+    // Buttons on toolbar are copies of preserved buttons - so use preserved identity (avoids menu search for each hash)
+    
+    for (j = 0; j < g_buttonsAvailable; j++)
+    {
+        if (g_tbButtons[j].idCommand == tbButton.idCommand) return g_tbIdentities[j];
+    }
+    
+    return calcButtonIdentity(tbButton);
+}
+
+DWORD calcButtonStringHash(TBBUTTON tbButton)
+{
+    HWND rbWindow, tbWindow;
+    DWORD hash;
+    TCHAR buffer[MAXSIZE];
+    int i;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    hash = 0;
+    
+    // Hash in button string
+    
+    SendMessage(tbWindow, TB_GETSTRING, (WPARAM) MAKEWPARAM(MAXSIZE,tbButton.iString), (LPARAM) buffer);
+    for (i = 0; buffer[i] != 0; i++)
+    {
+        hash = ((hash << 5) - hash) + buffer[i]; /* hash * 31 + char */
+    }
+    
+    hash |= HASHFLAG;  /* distinguish hash value from command identifier */
+    
+    return hash;
+}
+
+DWORD calcStringHash(LPCTSTR lpString)
+{
+    DWORD hash;
+    int i;
+    
+    hash = 0;
+    
+    for (i = 0; lpString[i] != 0; i++)
+    {
+        hash = ((hash << 5) - hash) + lpString[i]; /* hash * 31 + char */
+    }
+    
+    return hash;
+}
+
+DWORD calcPluginButtonMenuHash(TBBUTTON tbButton)
+{
+    DWORD hash;
+    TCHAR buffer[MAXSIZE];
+    int i;
+    
+    hash = 0;
+    
+    // Hash in command menu string
+    
+    GetMenuString(g_hMainMenu, tbButton.idCommand, buffer, MAXSIZE, MF_BYCOMMAND);
+    stripMenuString(buffer);
+    for (i = 0; buffer[i] != 0; i++)
+    {
+        hash = ((hash << 5) - hash) + buffer[i]; /* hash * 31 + char */
+    }
+    
+    // Hash in command parent menu string
+    
+    findPluginParentMenuString(g_hMainMenu, tbButton.idCommand, buffer, MAXSIZE);
+    stripMenuString(buffer);
+    for (i = 0; buffer[i] != 0; i++)
+    {
+        hash = ((hash << 5) - hash) + buffer[i]; /* hash * 31 + char */
+    }
+    
+    hash |= HASHFLAG;  /* distinguish hash value from command identifier */
+    
+    return hash;
+}
+
+int findPluginParentMenuString(HMENU hMenu, UINT idCommand, LPTSTR lpString, int maxCount)
+{
+    HMENU hSubMenu;
+    int i, count, result;
+    
+    count = GetMenuItemCount(hMenu);
+    
+    for (i = 0; i < count; i++)
+    {
+        hSubMenu = GetSubMenu(hMenu, i);
+        if (hSubMenu == NULL)
+        {
+            if (GetMenuItemID(hMenu, i) == idCommand) return 1;  /* command identifier found at this level */
+        }
+        else
+        {
+            result = findPluginParentMenuString(hSubMenu, idCommand, lpString, maxCount);
+            if (result == 1)  /* command identifier found one level below */
+		    {
+				GetMenuString(hMenu, i, lpString, maxCount, MF_BYPOSITION);
+				return 0;  /* command identifier found */
+			}
+			if (result == 0) return result;  /* command identifier found */
+        }
+    }
+    
+    return -1;  /* command identifier not found */
+}
+
+//
+// Custom button image job functions
+//
+
+void startImageJobs()
+{
+    SYSTEM_INFO systemInfo;
+    int i, workers;
+    
+    g_imageJobNext = 0;
+    g_imageWorkers = 0;
+    
+    if (g_imageJobEvent == NULL) g_imageJobEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (g_imageJobEvent == NULL) return;  /* calling thread runs all jobs */
+    
+    // One worker for each other processor (calling thread also runs jobs while waiting)
+    
+    GetSystemInfo(&systemInfo);
+    workers = (int) systemInfo.dwNumberOfProcessors-1;
+    if (workers > IMAGEMAXWORKERS) workers = IMAGEMAXWORKERS;
+    if (workers > g_imageJobCount-1) workers = g_imageJobCount-1;
+    
+    for (i = 0; i < workers; i++)
+    {
+        InterlockedIncrement(&g_imageWorkersRunning);
+        if (QueueUserWorkItem(runImageJobs, NULL, WT_EXECUTEDEFAULT)) g_imageWorkers++;
+        else InterlockedDecrement(&g_imageWorkersRunning);
+    }
+}
+
+DWORD WINAPI runImageJobs(LPVOID lpParam)
+{
+    while (runNextImageJob());
+    
+    // Signal, then count worker finished - last access to plugin data (event may be closed once count is 0), only
+    // return remains
+    
+    SetEvent(g_imageJobEvent);
+    InterlockedDecrement(&g_imageWorkersRunning);
+    
+    return 0;
+}
+
+bool runNextImageJob()
+{
+    IMAGEJOB *job;
+    int index;
+    
+    index = (int) InterlockedIncrement(&g_imageJobNext)-1;
+    if (index >= g_imageJobCount) return false;
+    
+    job = &g_imageJobs[index];
+    job->hImage = createJobImage(job, (job->kind == IMAGEJOB_BITMAP) ? 0 : g_iconSize);
+    
+    InterlockedExchange(&job->done, 1);
+    if (g_imageJobEvent) SetEvent(g_imageJobEvent);
+    
+    return true;
+}
+
+void waitImageJob(int index)
+{
+    // Run remaining jobs on calling thread rather than wait idle (so all jobs complete even if no workers queued)
+    
+    while (!g_imageJobs[index].done)
+    {
+        if (!runNextImageJob()) WaitForSingleObject(g_imageJobEvent, INFINITE);
+    }
+}
+
+void finishImageJobs()
+{
+    // Wait for queued workers which have not yet started, or have not yet seen that no jobs remain - a worker's
+    // count is decremented just after its last signal, so that is waited for by timeout
+    
+    while (g_imageWorkersRunning > 0) WaitForSingleObject(g_imageJobEvent, 1);
+}
+
+HANDLE createJobImage(const IMAGEJOB *job, int size)
+{
+    HANDLE hImage;
+    UINT type;
+    
+    type = (job->kind == IMAGEJOB_BITMAP) ? ICONTYPE_BITMAP : ICONTYPE_ICON;
+    
+    if (job->fileName[0] == (TCHAR) '*') return createQuickCodeImage(job->fileName, type, size);  /* quick code */
+    
+    hImage = loadCustomImage(g_imageConfigPath, job->fileName, type, size);
+    
+    // Missing file image (dark icon is NULL if not found - light icon used)
+    
+    if (hImage == NULL && job->kind == IMAGEJOB_BITMAP) hImage = trackHandle(LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDB_CUSTOM_MISSINGFILE), IMAGE_BITMAP, size, size, (LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS)), HANDLEKIND_BITMAP);
+    else if (hImage == NULL && job->kind == IMAGEJOB_ICON) hImage = trackHandle(LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDI_CUSTOM_MISSINGFILE), IMAGE_ICON, size, size, (LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS)), HANDLEKIND_ICON);
+    
+    return hImage;
+}
+
+void applyImageVariants()
+{
+    HWND rbWindow, tbWindow;
+    HIMAGELIST hImageList, hHotImageList, hDisabledImageList;
+    TBBUTTON tbButton;
+    HANDLE hImage, hDisabledImage;
+    int i, index, kind, job, cx, cy;
+    
+    // Only after DPI change - otherwise Notepad++ recreates toolbar images from images made for its DPI
+    
+    if (!g_dpiChanged || g_customButtonsCount == 0 || HIWORD(g_nppVersion) < 8) return;
+    if (getWindowDpi(nppData._nppHandle) == g_imageDpi) return;
+    
+    findToolbarWindows(&rbWindow, &tbWindow);
+    
+    hImageList = (HIMAGELIST) SendMessage(tbWindow, TB_GETIMAGELIST, (WPARAM) 0, (LPARAM) 0);
+    hHotImageList = (HIMAGELIST) SendMessage(tbWindow, TB_GETHOTIMAGELIST, (WPARAM) 0, (LPARAM) 0);
+    hDisabledImageList = (HIMAGELIST) SendMessage(tbWindow, TB_GETDISABLEDIMAGELIST, (WPARAM) 0, (LPARAM) 0);
+    if (hImageList == NULL || !ImageList_GetIconSize(hImageList, &cx, &cy)) return;
+    
+    // Image shown by toolbar - standard bitmap, or fluent icon for light or dark mode
+    
+    if (SendMessage(nppData._nppHandle, NPPM_GETTOOLBARICONSETCHOICE, 0, 0) == 4) kind = IMAGEJOB_BITMAP;
+    else if (SendMessage(nppData._nppHandle, NPPM_ISDARKMODEENABLED, 0, 0)) kind = IMAGEJOB_DARKICON;
+    else kind = IMAGEJOB_ICON;
+    
+    // Replace image of each custom button (toolbar recreated, so buttons have temporary custom command identifiers)
+    
+    for (i = 0; i < g_customButtonsCount; i++)
+    {
+        index = (int) SendMessage(tbWindow, TB_COMMANDTOINDEX, (WPARAM) (ID_CMD_CUSTOM+i), (LPARAM) 0);
+        if (index == -1 || !SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) index, (LPARAM) &tbButton)) continue;
+        
+        job = i*IMAGEJOBKINDS+kind;
+        if (kind == IMAGEJOB_DARKICON && g_imageJobs[job].hImage == NULL) job = i*IMAGEJOBKINDS+IMAGEJOB_ICON;
+        
+        hImage = findImageVariant(job, cx, false);
+        if (hImage == NULL) continue;
+        
+        hDisabledImage = hDisabledImageList ? findImageVariant(job, cx, true) : NULL;
+        
+        // Normal and hot images are the same (as added by Notepad++), disabled image is greyed
+        
+        if (kind == IMAGEJOB_BITMAP)
+        {
+            ImageList_Replace(hImageList, tbButton.iBitmap, (HBITMAP) hImage, NULL);
+            if (hHotImageList) ImageList_Replace(hHotImageList, tbButton.iBitmap, (HBITMAP) hImage, NULL);
+            if (hDisabledImage) ImageList_Replace(hDisabledImageList, tbButton.iBitmap, (HBITMAP) hDisabledImage, NULL);
+        }
+        else
+        {
+            ImageList_ReplaceIcon(hImageList, tbButton.iBitmap, (HICON) hImage);
+            if (hHotImageList) ImageList_ReplaceIcon(hHotImageList, tbButton.iBitmap, (HICON) hImage);
+            if (hDisabledImage) ImageList_ReplaceIcon(hDisabledImageList, tbButton.iBitmap, (HICON) hDisabledImage);
+        }
+    }
+    
+    SendMessage(tbWindow, TB_SETIMAGELIST, (WPARAM) 0, (LPARAM) hImageList);
+    if (hHotImageList) SendMessage(tbWindow, TB_SETHOTIMAGELIST, (WPARAM) 0, (LPARAM) hHotImageList);
+    if (hDisabledImageList) SendMessage(tbWindow, TB_SETDISABLEDIMAGELIST, (WPARAM) 0, (LPARAM) hDisabledImageList);
+    
+    g_imageVariantSwaps++;
+}
+
+HANDLE findImageVariant(int job, int size, bool disabled)
+{
+    ICONIMAGE image;
+    HANDLE hImage, hNormal;
+    UINT type;
+    int i;
+    
+    // Same image (shared handle) resampled once for all buttons
+    
+    for (i = 0; i < g_imageVariantCount; i++)
+    {
+        if (g_imageJobs[g_imageVariants[i].job].hImage == g_imageJobs[job].hImage && g_imageVariants[i].size == size &&
+            g_imageVariants[i].disabled == disabled) return g_imageVariants[i].hImage;
+    }
+    
+    if (!disabled) hImage = createJobImage(&g_imageJobs[job], size);  /* sources are still in atlas, so image is resampled (not decoded again) */
+    else
+    {
+        // Disabled look made from normal image
+        
+        hImage = NULL;
+        hNormal = findImageVariant(job, size, false);
+        type = (g_imageJobs[job].kind == IMAGEJOB_BITMAP) ? ICONTYPE_BITMAP : ICONTYPE_ICON;
+        
+        if (hNormal && captureCustomImage(hNormal, type, &image))
+        {
+            makeDisabledIconImage((unsigned int *) image.pixels, image.width*image.height, type == ICONTYPE_BITMAP);
+            hImage = createSharedImage(type, &image);
+            delete[] (unsigned int *) image.pixels;
+        }
+    }
+    
+    if (hImage && g_imageVariantCount < IMAGEVARIANTMAX)
+    {
+        g_imageVariants[g_imageVariantCount].job = job;
+        g_imageVariants[g_imageVariantCount].size = size;
+        g_imageVariants[g_imageVariantCount].disabled = disabled;
+        g_imageVariants[g_imageVariantCount].hImage = hImage;
+        g_imageVariantCount++;
+    }
+    
+    return hImage;  /* kept until unloaded (image lists keep copies, but cache may be full) */
+}
+
+//
+// Custom button image atlas functions
+//
+
+void loadIconAtlas()
+{
+    TCHAR configPath[MAX_PATH];
+    TCHAR atlFilePath[MAX_PATH];
+    HANDLE atlFile;
+    DWORD fileSize;
+    
+    g_atlasCount = g_atlasUsedCount = 0;
+    g_atlasChanged = false;
+    g_atlasStamp = calcIconAtlasStamp();
+    InitializeCriticalSection(&g_atlasLock);
+    g_atlasOpen = true;
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(atlFilePath, configPath);
+    lstrcat(atlFilePath, TEXT("\\CustomizeToolbar.atlas"));
+    
+    // Map whole atlas file (images are read in place)
+    
+    atlFile = CreateFile(atlFilePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (atlFile == INVALID_HANDLE_VALUE) return;
+    
+    fileSize = GetFileSize(atlFile, NULL);
+    if (fileSize != INVALID_FILE_SIZE && fileSize > 0) g_atlasMapping = CreateFileMapping(atlFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(atlFile);  /* mapping keeps file open */
+    if (g_atlasMapping == NULL) return;
+    
+    g_atlasView = (const BYTE *) MapViewOfFile(g_atlasMapping, FILE_MAP_READ, 0, 0, 0);
+    if (g_atlasView) g_atlasCount = parseIconAtlas(g_atlasView, fileSize, g_atlasStamp, g_atlasEntries, ICONATLASMAX);
+    g_atlasSize = fileSize;
+}
+
+void saveIconAtlas()
+{
+    TCHAR configPath[MAX_PATH];
+    TCHAR atlFilePath[MAX_PATH];
+    HANDLE atlFile;
+    DWORD bytesWritten;
+    BYTE *data;
+    const unsigned int *mapped[ICONATLASMAX];
+    unsigned int *pixels;
+    size_t size;
+    int i, j, reused;
+    
+    // Encode atlas only if images were decoded or images in atlas are no longer used (entries point into mapped atlas)
+    
+    reused = 0;
+    for (i = 0; i < g_atlasUsedCount; i++) if (!g_atlasOwned[i]) reused++;
+    
+    data = NULL;
+    size = 0;
+    
+    if (g_atlasChanged || reused != g_atlasCount)
+    {
+        size = iconAtlasSize(g_atlasUsed, g_atlasUsedCount);
+        data = new BYTE[size];
+        formatIconAtlas(g_atlasUsed, g_atlasUsedCount, g_atlasStamp, data);
+    }
+    
+    if (data == NULL) return;
+    
+    // Copy reused images out of mapped atlas (still needed for DPI changes), then unmap it so that it can be replaced
+    
+    for (i = 0; i < g_atlasUsedCount; i++)
+    {
+        mapped[i] = g_atlasUsed[i].image.pixels;
+        if (g_atlasOwned[i] || g_atlasView == NULL || (const BYTE *) mapped[i] < g_atlasView || (const BYTE *) mapped[i] >= g_atlasView+g_atlasSize) continue;
+        
+        for (j = 0; j < i && mapped[j] != mapped[i]; j++);
+        if (j < i) g_atlasUsed[i].image.pixels = g_atlasUsed[j].image.pixels;  /* shares copy of same entry */
+        else
+        {
+            pixels = new unsigned int[g_atlasUsed[i].image.width*g_atlasUsed[i].image.height];
+            memcpy(pixels, mapped[i], g_atlasUsed[i].image.width*g_atlasUsed[i].image.height*4);
+            g_atlasUsed[i].image.pixels = pixels;
+            g_atlasOwned[i] = true;
+        }
+    }
+    
+    if (g_atlasView) UnmapViewOfFile(g_atlasView);
+    if (g_atlasMapping) CloseHandle(g_atlasMapping);
+    g_atlasView = NULL;
+    g_atlasMapping = NULL;
+    g_atlasCount = 0;
+    
+    // Write whole atlas file in one go
+    
+    SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, MAX_PATH, (LPARAM) configPath);
+    
+    lstrcpy(atlFilePath, configPath);
+    lstrcat(atlFilePath, TEXT("\\CustomizeToolbar.atlas"));
+    
+    atlFile = CreateFile(atlFilePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (atlFile != INVALID_HANDLE_VALUE)
+    {
+        WriteFile(atlFile, data, (DWORD) size, &bytesWritten, NULL);
+        CloseHandle(atlFile);
+    }
+    
+    delete[] data;
+}
+
+void releaseIconAtlas()
+{
+    int i;
+    
+    if (!g_atlasOpen) return;
+    
+    // Unmap atlas and free decoded images
+    
+    if (g_atlasView) UnmapViewOfFile(g_atlasView);
+    if (g_atlasMapping) CloseHandle(g_atlasMapping);
+    g_atlasView = NULL;
+    g_atlasMapping = NULL;
+    
+    for (i = 0; i < g_atlasUsedCount; i++) if (g_atlasOwned[i]) delete[] (unsigned int *) g_atlasUsed[i].image.pixels;
+    g_atlasCount = g_atlasUsedCount = 0;
+    
+    DeleteCriticalSection(&g_atlasLock);
+    g_atlasOpen = false;
+}
+
+DWORD calcIconAtlasStamp()
+{
+    int colors[4] = { COLOR_3DFACE, COLOR_3DSHADOW, COLOR_3DLIGHT, COLOR_WINDOW };  /* mapped by LR_LOADMAP3DCOLORS and LR_LOADTRANSPARENT */
+    DWORD hash;
+    int i;
+    
+    hash = 0;
+    for (i = 0; i < 4; i++) hash = ((hash << 5) - hash) + GetSysColor(colors[i]);
+    hash = ((hash << 5) - hash) + ICONSOURCEMAX;  /* icons are largest frame (not size loaded by LR_DEFAULTSIZE) */
+    hash = ((hash << 5) - hash) + 2;  /* decoder revision - 24 and 32 bit bitmaps no longer keyed */
+    
+    return hash;
+}
+
+HANDLE loadCustomImage(LPCTSTR configPath, LPCTSTR fileName, UINT type, int size)
+{
+    TCHAR filePath[MAX_PATH];
+    WIN32_FILE_ATTRIBUTE_DATA fileData;
+    ICONATLASENTRY entry;
+    const ICONIMAGE *source;
+    HANDLE hImage, hVariant;
+    BYTE *data;
+    DWORD dataSize;
+    COLORREF window;
+    unsigned int *pixels, background, shades[3];
+    int index, frameSize, width, height;
+    bool decoded, png;
+    
+    lstrcpy(filePath, configPath);
+    lstrcat(filePath, TEXT("\\"));
+    lstrcat(filePath, fileName);
+    
+    if (!GetFileAttributesEx(filePath, GetFileExInfoStandard, &fileData)) return NULL;  /* missing file */
+    
+    entry.keyHash = calcIconKeyHash(filePath);
+    entry.type = type;
+    entry.fileTime = ((unsigned long long) fileData.ftLastWriteTime.dwHighDateTime << 32) | fileData.ftLastWriteTime.dwLowDateTime;
+    entry.fileSize = ((unsigned long long) fileData.nFileSizeHigh << 32) | fileData.nFileSizeLow;
+    
+    // Image already used by another custom button, or unchanged image in atlas (images used are never changed once added)
+    
+    source = NULL;
+    
+    EnterCriticalSection(&g_atlasLock);
+    
+    index = findIconAtlasEntry(g_atlasUsed, g_atlasUsedCount, entry.keyHash, type, entry.fileTime, entry.fileSize);
+    if (index >= 0) source = &g_atlasUsed[index].image;
+    else
+    {
+        index = findIconAtlasEntry(g_atlasEntries, g_atlasCount, entry.keyHash, type, entry.fileTime, entry.fileSize);
+        if (index >= 0 && g_atlasUsedCount < ICONATLASMAX)
+        {
+            g_atlasOwned[g_atlasUsedCount] = false;
+            g_atlasUsed[g_atlasUsedCount++] = g_atlasEntries[index];
+            source = &g_atlasEntries[index].image;
+        }
+    }
+    
+    LeaveCriticalSection(&g_atlasLock);
+    
+    if (source)
+    {
+        hImage = createImageVariant(type, source, size);
+        if (hImage)
+        {
+            InterlockedIncrement(&g_atlasHits);
+            return hImage;
+        }
+    }
+    
+    // New or changed image - decode file and add image to atlas (unless already added by another image job)
+    
+    data = readImageFile(filePath, &dataSize);
+    if (data == NULL) return NULL;
+    
+    hImage = NULL;
+    decoded = false;
+    
+    // .bmp contents (also .bmp renamed to .ico) or .png contents - decoded by plugin, on window color (bitmap) or transparent (icon)
+    
+    if (type == ICONTYPE_BITMAP)
+    {
+        window = GetSysColor(COLOR_WINDOW);
+        background = 0xFF000000 | (GetRValue(window) << 16) | (GetGValue(window) << 8) | GetBValue(window);
+        
+        window = GetSysColor(COLOR_3DSHADOW);
+        shades[0] = 0xFF000000 | (GetRValue(window) << 16) | (GetGValue(window) << 8) | GetBValue(window);
+        window = GetSysColor(COLOR_3DFACE);
+        shades[1] = 0xFF000000 | (GetRValue(window) << 16) | (GetGValue(window) << 8) | GetBValue(window);
+        window = GetSysColor(COLOR_3DLIGHT);
+        shades[2] = 0xFF000000 | (GetRValue(window) << 16) | (GetGValue(window) << 8) | GetBValue(window);
+    }
+    else background = 0;
+    
+    png = false;
+    decoded = decodeBitmapImage(data, dataSize, background, (type == ICONTYPE_BITMAP) ? shades : NULL, &entry.image);
+    if (!decoded) decoded = png = decodePngImage(data, dataSize, background, &entry.image);
+    
+    if (decoded)
+    {
+        hImage = createImageVariant(type, &entry.image, size);
+        if (hImage == NULL) delete[] (unsigned int *) entry.image.pixels;
+        else InterlockedIncrement(png ? &g_pngDecodes : &g_bitmapDecodes);
+    }
+    
+    // Other formats (or .bmp not recognised) - loaded by Windows (largest frame of icon)
+    
+    else if (type == ICONTYPE_BITMAP)
+    {
+        hImage = trackHandle(LoadImage(NULL, filePath, IMAGE_BITMAP, 0, 0, (LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS | LR_LOADFROMFILE)), HANDLEKIND_BITMAP);
+    }
+    else
+    {
+        frameSize = findLargestIconFrame(data, dataSize);
+        if (frameSize > 0) hImage = trackHandle(LoadImage(NULL, filePath, IMAGE_ICON, frameSize, frameSize, (LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS | LR_LOADFROMFILE)), HANDLEKIND_ICON);
+        if (hImage == NULL) hImage = trackHandle(LoadImage(NULL, filePath, IMAGE_ICON, size, size, (LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS | LR_LOADFROMFILE)), HANDLEKIND_ICON);
+    }
+    
+    delete[] data;
+    
+    if (hImage == NULL) return NULL;
+    
+    InterlockedIncrement(&g_atlasDecodes);
+    
+    if (decoded || captureCustomImage(hImage, type, &entry.image))
+    {
+        // Reduce large icon frame to source size kept in atlas
+        
+        if (entry.image.width > ICONSOURCEMAX || entry.image.height > ICONSOURCEMAX)
+        {
+            width = (entry.image.width >= entry.image.height) ? ICONSOURCEMAX : MulDiv(entry.image.width, ICONSOURCEMAX, entry.image.height);
+            height = (entry.image.height >= entry.image.width) ? ICONSOURCEMAX : MulDiv(entry.image.height, ICONSOURCEMAX, entry.image.width);
+            pixels = new unsigned int[width*height];
+            resampleIconImage(&entry.image, width, height, pixels);
+            delete[] (unsigned int *) entry.image.pixels;
+            entry.image.width = width;
+            entry.image.height = height;
+            entry.image.pixels = pixels;
+        }
+        
+        // Shared handle (icon for DPI) instead of handle loaded by Windows (icon is frame size)
+        
+        if (!decoded)
+        {
+            hVariant = createImageVariant(type, &entry.image, (type == ICONTYPE_ICON) ? size : 0);
+            if (hVariant)
+            {
+                releaseHandle(hImage);
+                hImage = hVariant;
+            }
+        }
+        
+        EnterCriticalSection(&g_atlasLock);
+        
+        if (g_atlasUsedCount < ICONATLASMAX && findIconAtlasEntry(g_atlasUsed, g_atlasUsedCount, entry.keyHash, type, entry.fileTime, entry.fileSize) < 0)
+        {
+            // Pixels of used entry with identical contents (from another file) shared instead of kept twice
+            
+            for (index = 0; index < g_atlasUsedCount; index++)
+            {
+                source = &g_atlasUsed[index].image;
+                if (g_atlasUsed[index].type == type && source->width == entry.image.width && source->height == entry.image.height &&
+                    memcmp(source->pixels, entry.image.pixels, source->width*source->height*4) == 0) break;
+            }
+            
+            g_atlasOwned[g_atlasUsedCount] = (index == g_atlasUsedCount);
+            if (index < g_atlasUsedCount)
+            {
+                delete[] (unsigned int *) entry.image.pixels;
+                entry.image.pixels = g_atlasUsed[index].image.pixels;
+                g_sharedBuffers++;
+                g_sharedBufferBytes += entry.image.width*entry.image.height*4;
+            }
+            
+            g_atlasUsed[g_atlasUsedCount++] = entry;
+            g_atlasChanged = true;
+            entry.image.pixels = NULL;
+        }
+        
+        LeaveCriticalSection(&g_atlasLock);
+        
+        if (entry.image.pixels) delete[] (unsigned int *) entry.image.pixels;
+    }
+    
+    return hImage;
+}
+
+BYTE *readImageFile(LPCTSTR filePath, DWORD *size)
+{
+    HANDLE imageFile;
+    BYTE *data;
+    DWORD fileSize;
+    
+    // Whole file in one read (at most IMAGEFILEMAX bytes - a larger .bmp is not recognised, and is loaded by Windows)
+    
+    imageFile = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (imageFile == INVALID_HANDLE_VALUE) return NULL;
+    
+    fileSize = GetFileSize(imageFile, NULL);
+    if (fileSize == INVALID_FILE_SIZE || fileSize > IMAGEFILEMAX) fileSize = IMAGEFILEMAX;
+    
+    data = new BYTE[fileSize ? fileSize : 1];
+    
+    if (!ReadFile(imageFile, data, fileSize, size, NULL))
+    {
+        delete[] data;
+        data = NULL;
+    }
+    
+    CloseHandle(imageFile);
+    
+    return data;
+}
+
+bool captureCustomImage(HANDLE hImage, UINT type, ICONIMAGE *image)
+{
+    ICONINFO iconInfo;
+    HBITMAP hColor, hMask;
+    BITMAP bitmap;
+    BITMAPINFO bmi;
+    HDC hDC;
+    unsigned int *pixels, *mask;
+    bool alpha;
+    int i, count;
+    
+    hColor = hMask = NULL;
+    
+    if (type == ICONTYPE_BITMAP) hColor = (HBITMAP) hImage;
+    else if (GetIconInfo((HICON) hImage, &iconInfo))
+    {
+        hColor = (HBITMAP) trackHandle(iconInfo.hbmColor, HANDLEKIND_BITMAP);  /* NULL for monochrome icon (not captured) */
+        hMask = (HBITMAP) trackHandle(iconInfo.hbmMask, HANDLEKIND_BITMAP);
+    }
+    
+    pixels = NULL;
+    
+    if (hColor && GetObject(hColor, sizeof(BITMAP), &bitmap) && bitmap.bmWidth > 0 && bitmap.bmHeight > 0 && bitmap.bmWidth <= ICONMAXSIZE && bitmap.bmHeight <= ICONMAXSIZE)
+    {
+        count = bitmap.bmWidth*bitmap.bmHeight;
+        pixels = new unsigned int[count];
+        
+        ZeroMemory(&bmi, sizeof(BITMAPINFO));
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = bitmap.bmWidth;
+        bmi.bmiHeader.biHeight = -bitmap.bmHeight;  /* top row first */
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        
+        hDC = GetDC(NULL);
+        
+        if (GetDIBits(hDC, hColor, 0, bitmap.bmHeight, pixels, &bmi, DIB_RGB_COLORS) == bitmap.bmHeight)
+        {
+            // Alpha - opaque for bitmap, alpha channel of icon, or mask of icon without alpha channel
+            
+            alpha = false;
+            if (type == ICONTYPE_ICON) for (i = 0; i < count && !alpha; i++) alpha = (pixels[i] & 0xFF000000) != 0;
+            
+            if (!alpha && hMask)
+            {
+                mask = new unsigned int[count];
+                if (GetDIBits(hDC, hMask, 0, bitmap.bmHeight, mask, &bmi, DIB_RGB_COLORS) == bitmap.bmHeight)
+                {
+                    for (i = 0; i < count; i++) pixels[i] = (pixels[i] & 0x00FFFFFF) | ((mask[i] & 0x00FFFFFF) ? 0 : 0xFF000000);
+                }
+                else
+                {
+                    delete[] pixels;
+                    pixels = NULL;
+                }
+                delete[] mask;
+            }
+            else if (!alpha)
+            {
+                for (i = 0; i < count; i++) pixels[i] |= 0xFF000000;
+            }
+        }
+        else
+        {
+            delete[] pixels;
+            pixels = NULL;
+        }
+        
+        ReleaseDC(NULL, hDC);
+    }
+    
+    if (type == ICONTYPE_ICON)  /* bitmaps returned by GetIconInfo */
+    {
+        releaseHandle(hColor);
+        releaseHandle(hMask);
+    }
+    
+    if (pixels == NULL) return false;
     
-    // Create popup menu to show overflow buttons
+    image->width = bitmap.bmWidth;
+    image->height = bitmap.bmHeight;
+    image->pixels = pixels;
     
-    popupMenu = CreatePopupMenu();
+    return true;
+}
+
+HANDLE createCustomImage(UINT type, const ICONIMAGE *image)
+{
+    BITMAPINFO bmi;
+    ICONINFO iconInfo;
+    HDC hDC;
+    HBITMAP hColor, hMask;
+    HICON hIcon;
+    void *bits;
+    BYTE *maskBits;
+    int x, y, stride;
     
-    // Screen co-ordinates for Menu to be displayed - align with left of chevron (-12)
+    ZeroMemory(&bmi, sizeof(BITMAPINFO));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = image->width;
+    bmi.bmiHeader.biHeight = -image->height;  /* top row first */
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
     
-    popupPoint.x = lpNmRebarChevron->rc.left-11;
-    popupPoint.y = lpNmRebarChevron->rc.bottom;
-    ClientToScreen(tbWindow, &popupPoint);
+    hDC = GetDC(NULL);
     
-    // Get band rectangle - subtract chevron width (-16)
+    // Bitmap - device-dependent bitmap (as loaded from file)
     
-    SendMessage(rbWindow, RB_GETRECT, (WPARAM) 0, (LPARAM) (LPPOINT) &rbBandRect);
-    rbBandRect.right -= 16;
+    if (type == ICONTYPE_BITMAP)
+    {
+        hColor = (HBITMAP) trackHandle(CreateDIBitmap(hDC, &bmi.bmiHeader, CBM_INIT, image->pixels, &bmi, DIB_RGB_COLORS), HANDLEKIND_BITMAP);
+        ReleaseDC(NULL, hDC);
+        return hColor;
+    }
     
-    // Add items to popup menu
+    // Icon - color bitmap with alpha channel, and mask derived from alpha channel
     
-    itemCount = 0;
-    buttonsOnToolbar = (int) SendMessage(tbWindow, TB_BUTTONCOUNT, (WPARAM) 0, (LPARAM) 0);
+    hColor = (HBITMAP) trackHandle(CreateDIBSection(hDC, &bmi, DIB_RGB_COLORS, &bits, NULL, 0), HANDLEKIND_BITMAP);
+    ReleaseDC(NULL, hDC);
+    if (hColor == NULL) return NULL;
     
-    for (i = 0; i < buttonsOnToolbar; i++)
+    memcpy(bits, image->pixels, image->width*image->height*4);
+    
+    stride = ((image->width+15)/16)*2;  /* monochrome rows are word aligned */
+    maskBits = new BYTE[stride*image->height];
+    ZeroMemory(maskBits, stride*image->height);
+    
+    for (y = 0; y < image->height; y++)
     {
-        SendMessage(tbWindow, TB_GETBUTTON, (WPARAM) i, (LPARAM)(LPTBBUTTON) &tbButton);
-        
-        if (tbButton.fsStyle & BTNS_SEP)
-        {
-            // Add separator menu item
-            
-            if (itemCount > 0) AppendMenu(popupMenu, MF_SEPARATOR, 0, 0);
-        }
-        else
+        for (x = 0; x < image->width; x++)
         {
-            // Get button rectangle - offset by band gripper width (+12)
-            
-            SendMessage(tbWindow, TB_GETITEMRECT, (WPARAM) i, (LPARAM)(LPRECT) &tbButtonRect);
-            tbButtonRect.left += 12;
-            tbButtonRect.right += 12;
-            
-            // Check intersection of button and band rectangles
-            
-            IntersectRect(&intersectRect, &tbButtonRect, &rbBandRect);
-            
-            if (intersectRect.left != tbButtonRect.left || intersectRect.right != tbButtonRect.right ||
-                intersectRect.top != tbButtonRect.top || intersectRect.bottom != tbButtonRect.bottom)
-            {
-                menuStyle = MF_STRING;
-                menuStyle |= SendMessage(tbWindow, TB_ISBUTTONENABLED, (WPARAM) tbButton.idCommand, (LPARAM) 0) ? MF_ENABLED : MF_DISABLED|MF_GRAYED;
-                menuStyle |= SendMessage(tbWindow, TB_ISBUTTONCHECKED, (WPARAM) tbButton.idCommand, (LPARAM) 0) ? MF_CHECKED : MF_UNCHECKED;
-                
-                SendMessage(tbWindow, TB_GETSTRING, (WPARAM) MAKEWPARAM(MAXSIZE,tbButton.iString), (LPARAM) buffer);
-                
-                AppendMenu(popupMenu, menuStyle, tbButton.idCommand, buffer);
-                
-                itemCount++;
-            }
+            if ((image->pixels[y*image->width+x] & 0xFF000000) == 0) maskBits[y*stride+x/8] |= (BYTE) (0x80 >> (x%8));
         }
     }
     
-    // Display popup menu if at least one item has been added
+    hMask = (HBITMAP) trackHandle(CreateBitmap(image->width, image->height, 1, 1, maskBits), HANDLEKIND_BITMAP);
+    delete[] maskBits;
     
-    if (itemCount > 0) TrackPopupMenu(popupMenu, TPM_LEFTALIGN|TPM_TOPALIGN, popupPoint.x, popupPoint.y, 0, rbWindow, NULL);
+    iconInfo.fIcon = TRUE;
+    iconInfo.xHotspot = iconInfo.yHotspot = 0;
+    iconInfo.hbmMask = hMask;
+    iconInfo.hbmColor = hColor;
+    hIcon = (HICON) trackHandle(CreateIconIndirect(&iconInfo), HANDLEKIND_ICON);  /* copies bitmaps */
     
-    // Destroy popup menu
+    releaseHandle(hColor);
+    releaseHandle(hMask);
     
-    DestroyMenu(popupMenu);
+    return hIcon;
 }
 
-//
-// Hash functions
-//
+HANDLE createImageVariant(UINT type, const ICONIMAGE *source, int size)
+{
+    ICONIMAGE variant;
+    HANDLE hImage;
+    
+    // Source as is (bitmap, or icon of requested size), else resampled to requested size
+    
+    if (size <= 0 || (source->width == size && source->height == size)) return createSharedImage(type, source);
+    
+    variant.width = variant.height = size;
+    variant.pixels = new unsigned int[size*size];
+    resampleIconImage(source, size, size, (unsigned int *) variant.pixels);
+    InterlockedIncrement(&g_imageResamples);
+    
+    hImage = createSharedImage(type, &variant);
+    delete[] (unsigned int *) variant.pixels;
+    
+    return hImage;
+}
 
-DWORD calcButtonStringHash(TBBUTTON tbButton)
+HANDLE createSharedImage(UINT type, const ICONIMAGE *image)
 {
-    HWND rbWindow, tbWindow;
-    DWORD hash;
-    TCHAR buffer[MAXSIZE];
-    int i;
+    unsigned long long contentHash;
+    unsigned int *pixels;
+    HANDLE hImage;
+    int index;
     
-    rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
-    tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+    // Existing handle for identical image (Notepad++ copies images into its image lists, so a handle can be given for several buttons)
     
-    hash = 0;
+    contentHash = calcIconContentHash(image);
     
-    // Hash in button string
+    EnterCriticalSection(&g_sharedLock);
     
-    SendMessage(tbWindow, TB_GETSTRING, (WPARAM) MAKEWPARAM(MAXSIZE,tbButton.iString), (LPARAM) buffer);
-    for (i = 0; buffer[i] != 0; i++)
+    index = findSharedImage(contentHash, type, image);
+    if (index >= 0)
     {
-        hash = ((hash << 5) - hash) + buffer[i]; /* hash * 31 + char */
+        g_sharedImages[index].uses++;
+        g_sharedHandleUses++;
+        g_sharedHandleBytes += image->width*image->height*4;
+        hImage = g_sharedImages[index].hImage;
+        LeaveCriticalSection(&g_sharedLock);
+        return hImage;
     }
     
-    hash |= HASHFLAG;  /* distinguish hash value from command identifier */
+    LeaveCriticalSection(&g_sharedLock);
     
-    return hash;
+    // New image - created outside lock (other image jobs continue), then added unless identical image added meanwhile
+    
+    hImage = createCustomImage(type, image);
+    if (hImage == NULL) return NULL;
+    
+    EnterCriticalSection(&g_sharedLock);
+    
+    index = findSharedImage(contentHash, type, image);
+    if (index >= 0)
+    {
+        releaseHandle(hImage);
+        g_sharedImages[index].uses++;
+        g_sharedHandleUses++;
+        g_sharedHandleBytes += image->width*image->height*4;
+        hImage = g_sharedImages[index].hImage;
+    }
+    else if (g_sharedImageCount < SHAREDIMAGEMAX)
+    {
+        pixels = new unsigned int[image->width*image->height];
+        memcpy(pixels, image->pixels, image->width*image->height*4);
+        
+        g_sharedImages[g_sharedImageCount].contentHash = contentHash;
+        g_sharedImages[g_sharedImageCount].type = type;
+        g_sharedImages[g_sharedImageCount].image.width = image->width;
+        g_sharedImages[g_sharedImageCount].image.height = image->height;
+        g_sharedImages[g_sharedImageCount].image.pixels = pixels;
+        g_sharedImages[g_sharedImageCount].hImage = hImage;
+        g_sharedImages[g_sharedImageCount].uses = 1;
+        g_sharedImageCount++;
+    }
+    
+    LeaveCriticalSection(&g_sharedLock);
+    
+    return hImage;
 }
 
-DWORD calcPluginButtonMenuHash(TBBUTTON tbButton)
+int findSharedImage(unsigned long long contentHash, UINT type, const ICONIMAGE *image)
 {
-    DWORD hash;
-    TCHAR buffer[MAXSIZE];
     int i;
     
-    hash = 0;
-    
-    // Hash in command menu string
+    // Hash finds candidates, pixels decide (different images can have the same 64-bit hash)
     
-    GetMenuString(g_hMainMenu, tbButton.idCommand, buffer, MAXSIZE, MF_BYCOMMAND);
-    stripMenuString(buffer);
-    for (i = 0; buffer[i] != 0; i++)
+    for (i = 0; i < g_sharedImageCount; i++)
     {
-        hash = ((hash << 5) - hash) + buffer[i]; /* hash * 31 + char */
+        if (g_sharedImages[i].contentHash == contentHash && g_sharedImages[i].type == type && sameIconImage(&g_sharedImages[i].image, image)) return i;
     }
     
-    // Hash in command parent menu string
+    return -1;
+}
+
+int countDuplicateSlots()
+{
+    int i, j, kind, duplicates;
     
-    findPluginParentMenuString(g_hMainMenu, tbButton.idCommand, buffer, MAXSIZE);
-    stripMenuString(buffer);
-    for (i = 0; buffer[i] != 0; i++)
+    // Notepad++ adds one image list slot per button for each image, so a shared handle still fills a slot for each button
+    
+    duplicates = 0;
+    
+    for (kind = 0; kind < IMAGEJOBKINDS; kind++)
     {
-        hash = ((hash << 5) - hash) + buffer[i]; /* hash * 31 + char */
+        for (i = 1; i < g_customButtonsCount; i++)
+        {
+            if (g_imageJobs[i*IMAGEJOBKINDS+kind].hImage == NULL) continue;
+            
+            for (j = 0; j < i; j++)
+            {
+                if (g_imageJobs[j*IMAGEJOBKINDS+kind].hImage == g_imageJobs[i*IMAGEJOBKINDS+kind].hImage) break;
+            }
+            if (j < i) duplicates++;
+        }
     }
     
-    hash |= HASHFLAG;  /* distinguish hash value from command identifier */
-    
-    return hash;
+    return duplicates;
 }
 
-int findPluginParentMenuString(HMENU hMenu, UINT idCommand, LPTSTR lpString, int maxCount)
+bool loadImageStrip(int resourceName, UINT flags, int frameSize, ICONIMAGE *strip)
 {
-    HMENU hSubMenu;
-    int i, count, result;
+    HBITMAP hStrip;
+    BITMAP bitmap;
+    BITMAPINFO bmi;
+    HDC hDC;
+    unsigned int *pixels;
     
-    count = GetMenuItemCount(hMenu);
+    strip->width = strip->height = 0;
+    strip->pixels = NULL;
     
-    for (i = 0; i < count; i++)
+    hStrip = (HBITMAP) trackHandle(LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(resourceName), IMAGE_BITMAP, 0, 0, flags), HANDLEKIND_BITMAP);
+    if (hStrip == NULL) return false;
+    
+    pixels = NULL;
+    
+    if (GetObject(hStrip, sizeof(BITMAP), &bitmap) && bitmap.bmWidth == frameSize && bitmap.bmHeight >= frameSize)
     {
-        hSubMenu = GetSubMenu(hMenu, i);
-        if (hSubMenu == NULL)
-        {
-            if (GetMenuItemID(hMenu, i) == idCommand) return 1;  /* command identifier found at this level */
-        }
-        else
+        pixels = new unsigned int[bitmap.bmWidth*bitmap.bmHeight];
+        
+        ZeroMemory(&bmi, sizeof(BITMAPINFO));
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = bitmap.bmWidth;
+        bmi.bmiHeader.biHeight = -bitmap.bmHeight;  /* top row first - each frame contiguous */
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        
+        hDC = GetDC(NULL);
+        if (GetDIBits(hDC, hStrip, 0, bitmap.bmHeight, pixels, &bmi, DIB_RGB_COLORS) != bitmap.bmHeight)
         {
-            result = findPluginParentMenuString(hSubMenu, idCommand, lpString, maxCount);
-            if (result == 1)  /* command identifier found one level below */
-		    {
-				GetMenuString(hMenu, i, lpString, maxCount, MF_BYPOSITION);
-				return 0;  /* command identifier found */
-			}
-			if (result == 0) return result;  /* command identifier found */
+            delete[] pixels;
+            pixels = NULL;
         }
+        ReleaseDC(NULL, hDC);
     }
     
-    return -1;  /* command identifier not found */
+    releaseHandle(hStrip);
+    
+    if (pixels == NULL) return false;
+    
+    strip->width = bitmap.bmWidth;
+    strip->height = bitmap.bmHeight;
+    strip->pixels = pixels;
+    
+    return true;
+}
+
+HANDLE createStripFrame(UINT type, const ICONIMAGE *strip, int frame)
+{
+    ICONIMAGE image;
+    
+    if (strip->pixels == NULL || (frame+1)*strip->width > strip->height) return NULL;
+    
+    image.width = image.height = strip->width;
+    image.pixels = strip->pixels + frame*strip->width*strip->width;
+    
+    g_additionalImages++;
+    
+    return createCustomImage(type, &image);
 }
 
 //
@@ -1726,190 +4964,170 @@ int findCmdIDForMenuStrings(HMENU hMenu0, LPTSTR menuString0, LPTSTR menuString1
     return -1;
 }
 
-HBITMAP createBitmapForCustomButton(TCHAR text[])
+HANDLE createQuickCodeImage(LPCTSTR text, UINT type, int size)
 {
-    HDC hDC, hMemDC;
-    HBITMAP hBitmap1, hBitmap2;
-    HBRUSH hBrush;
-    HFONT hFont;
-    RECT rect;
-    int label, count;
-    unsigned int rh, rl, gh, gl, bh, bl;
+    QUICKCODEIMAGE *quickCode;
+    const ICONIMAGE *image;
+    unsigned int color, background, *pixels;
+    wchar_t label[QUICKCODEMAXLABEL+1];
+    COLORREF window;
+    int i;
     
-    hBitmap1 = (HBITMAP) LoadImage((HINSTANCE) g_hModule, MAKEINTRESOURCE(IDB_CUSTOM_BACKGROUND16), IMAGE_BITMAP, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
+    parseQuickCode(text, &color, label);
     
-    if (text[1] ==  0 || text[1] == (TCHAR) ':')  /* missing color code */
-    {
-        label = (text[1] == 0) ? 1 : 2;
-        
-        hBrush = CreateSolidBrush(RGB(128, 128, 128));
-    }
-    else if (text[2] ==  0 || text[2] == (TCHAR) ':')  /* letter color code */
-    {
-        label = (text[2] == 0) ? 2 : 3;
-        
-        if (text[1] == (TCHAR) 'S') hBrush = CreateSolidBrush(RGB(128, 128, 128));
-        else if (text[1] == (TCHAR) 'R') hBrush = CreateSolidBrush(RGB(176, 48, 48));
-        else if (text[1] == (TCHAR) 'G') hBrush = CreateSolidBrush(RGB(48, 144, 48));
-        else if (text[1] == (TCHAR) 'B') hBrush = CreateSolidBrush(RGB(0, 80, 192));
-        else if (text[1] == (TCHAR) 'C') hBrush = CreateSolidBrush(RGB(0, 160, 160));
-        else if (text[1] == (TCHAR) 'M') hBrush = CreateSolidBrush(RGB(160, 64, 160));
-        else if (text[1] == (TCHAR) 'Y') hBrush = CreateSolidBrush(RGB(176, 144, 0));
-        else hBrush = CreateSolidBrush(RGB(128, 128, 128));
-    }
-    else  /* hex color code */
+    // Bitmap is on window color (as if loaded with LR_LOADTRANSPARENT), icon is on transparent background - rendered at size (16 for bitmap if 0)
+    
+    if (type == ICONTYPE_BITMAP)
     {
-        for (label = 1; text[label] != 0 && text[label] != (TCHAR) ':'; label++);
-        label = (text[label] == (TCHAR) ':') ? label+1 : label;
-        
-        count = _stscanf_s(&text[1], TEXT("#%1x%1x%1x%1x%1x%1x"), &rh, &rl, &gh, &gl, &bh, &bl);
-        hBrush = (count == 6) ? CreateSolidBrush(RGB(rh*16+rl, gh*16+gl, bh*16+bl)) : CreateSolidBrush(RGB(128, 128, 128));
+        window = GetSysColor(COLOR_WINDOW);
+        background = 0xFF000000 | (GetRValue(window) << 16) | (GetGValue(window) << 8) | GetBValue(window);
     }
+    else background = 0;
     
-    text[label+2] = 0;  /* limit label to two characters */
-    
-    hFont = CreateFont(12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NONANTIALIASED_QUALITY, 0, TEXT("Lucida Console"));
-    
-    hDC = GetDC(NULL);  /* screen device context */
-    hMemDC = CreateCompatibleDC(hDC);  /* Memory device context */
+    if (size <= 0) size = 16;
+    if (size > ICONMAXSIZE) size = ICONMAXSIZE;
     
-    SetBkMode(hMemDC, TRANSPARENT);
-    SetBkColor(hMemDC, RGB(0, 0, 0));
-    SetTextColor(hMemDC, RGB(255, 255, 255));
+    // Render image unless same color, label and size already rendered
     
-    SelectObject(hMemDC, hBitmap1);
-    SelectObject(hMemDC, hFont);
+    image = NULL;
     
-    rect.left = 0;
-    rect.right = 16;
-    rect.top = 1;
-    rect.bottom = 15;
+    EnterCriticalSection(&g_quickCodeLock);
     
-    FillRect(hMemDC, &rect, hBrush);
-    
-    rect.left = (text[3] == 0) ? 1 : 0;
-    rect.right = 16;
-    rect.top = 3;
-    rect.bottom = 16;
-    
-    DrawText(hMemDC, &text[label], -1, &rect, DT_SINGLELINE | DT_CENTER | DT_NOPREFIX);
-    
-    hBitmap2 = (HBITMAP) CopyImage(hBitmap1, IMAGE_BITMAP, 0, 0, 0);
+    for (i = 0; i < g_quickCodeCount && image == NULL; i++)
+    {
+        quickCode = &g_quickCodes[i];
+        if (quickCode->color == color && quickCode->background == background && quickCode->image.width == size && lstrcmp(quickCode->label, label) == 0) image = &quickCode->image;
+    }
     
-    DeleteDC(hMemDC);
+    if (image) g_quickCodeHits++;
+    else if (g_quickCodeCount < QUICKCODEMAX)
+    {
+        pixels = new unsigned int[size*size];
+        renderQuickCode(color, label, size, background, pixels);
+        g_quickCodeRenders++;
+        
+        quickCode = &g_quickCodes[g_quickCodeCount++];
+        quickCode->color = color;
+        quickCode->background = background;
+        lstrcpy(quickCode->label, label);
+        quickCode->image.width = quickCode->image.height = size;
+        quickCode->image.pixels = pixels;
+        image = &quickCode->image;
+    }
     
-    DeleteObject(hBitmap1);
-    DeleteObject(hFont);
+    LeaveCriticalSection(&g_quickCodeLock);
     
-    ReleaseDC(NULL, hDC);
+    if (image == NULL) return NULL;  /* cache full */
     
-    return hBitmap2;
+    return createSharedImage(type, image);
 }
 
-HICON createIconForCustomButton(TCHAR text[])
+//
+// Miscellaneous functions
+//
+
+void stripMenuString(LPTSTR lpString)
 {
-    HDC hDC,hMemDC;
-    HBITMAP hBitmap1, hBitmap2;
-    HBRUSH hBrush;
-    HFONT hFont;
-    RECT rect;
-    HIMAGELIST hImageList;
-    HICON hIcon;
-    int label, count;
-    unsigned int rh, rl, gh, gl, bh, bl;
-    
-    hBitmap1 = (HBITMAP) LoadImage((HINSTANCE) g_hModule,MAKEINTRESOURCE(IDB_CUSTOM_BACKGROUND32), IMAGE_BITMAP, 0, 0, (LR_DEFAULTSIZE | LR_LOADTRANSPARENT | LR_LOADMAP3DCOLORS));
+    int i, j;
     
-    if (text[1] ==  0 || text[1] == (TCHAR) ':')  /* missing color code */
-    {
-        label = (text[1] == 0) ? 1 : 2;
-        
-        hBrush = CreateSolidBrush(RGB(128, 128, 128));
-    }
-    else if (text[2] ==  0 || text[2] == (TCHAR) ':')  /* letter color code */
-    {
-        label = (text[2] == 0) ? 2 : 3;
-        
-        if (text[1] == (TCHAR) 'S') hBrush = CreateSolidBrush(RGB(128, 128, 128));
-        else if (text[1] == (TCHAR) 'R') hBrush = CreateSolidBrush(RGB(176, 48, 48));
-        else if (text[1] == (TCHAR) 'G') hBrush = CreateSolidBrush(RGB(48, 144, 48));
-        else if (text[1] == (TCHAR) 'B') hBrush = CreateSolidBrush(RGB(0, 80, 192));
-        else if (text[1] == (TCHAR) 'C') hBrush = CreateSolidBrush(RGB(0, 160, 160));
-        else if (text[1] == (TCHAR) 'M') hBrush = CreateSolidBrush(RGB(160, 64, 160));
-        else if (text[1] == (TCHAR) 'Y') hBrush = CreateSolidBrush(RGB(176, 144, 0));
-        else hBrush = CreateSolidBrush(RGB(128, 128, 128));
-    }
-    else  /* hex color code */
+    j = 0;
+    for (i = 0; lpString[i] != 0; i++)
     {
-        for (label = 1; text[label] != 0 && text[label] != (TCHAR) ':'; label++);
-        label = (text[label] == (TCHAR) ':') ? label+1 : label;
-        
-        count = _stscanf_s(&text[1], TEXT("#%1x%1x%1x%1x%1x%1x"), &rh, &rl, &gh, &gl, &bh, &bl);
-        hBrush = (count == 6) ? CreateSolidBrush(RGB(rh*16+rl, gh*16+gl, bh*16+bl)) : CreateSolidBrush(RGB(128, 128, 128));
+        if (lpString[i] == '&');
+        else if (lpString[i] == '\t') break;
+        else lpString[j++] = lpString[i];
     }
+    lpString[j] = 0;
+}
+
+HANDLE trackHandle(HANDLE handle, int kind)
+{
+    if (handle == NULL) return NULL;
     
-    text[label+2] = 0;  /* limit label to two characters */
-    
-    hFont = CreateFont(24, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, PROOF_QUALITY, 0, TEXT("Lucida Console"));
-    
-    hDC = GetDC(NULL);  /* screen device context */
-    hMemDC = CreateCompatibleDC(hDC);  /* Memory device context */
-    
-    SetBkMode(hMemDC,TRANSPARENT);
-    SetBkColor(hMemDC, RGB(0, 0, 0));
-    SetTextColor(hMemDC, RGB(254, 254, 254));
+    EnterCriticalSection(&g_trackedLock);
+    addTrackedHandle(&g_trackedHandles, handle, kind);
+    LeaveCriticalSection(&g_trackedLock);
     
-    SelectObject(hMemDC, hBitmap1);
-    SelectObject(hMemDC, hFont);
+    return handle;
+}
+
+void releaseHandle(HANDLE handle)
+{
+    int kind;
     
-    rect.left = 0;
-    rect.right = 32;
-    rect.top = 2;
-    rect.bottom = 30;
+    if (handle == NULL) return;
     
-    FillRect(hMemDC, &rect, hBrush);
+    EnterCriticalSection(&g_trackedLock);
+    kind = removeTrackedHandle(&g_trackedHandles, handle);
+    LeaveCriticalSection(&g_trackedLock);
     
-    rect.left = (text[3] == 0) ? 1 : 0;
-    rect.right = 32;
-    rect.top = 5;
-    rect.bottom = 32;
+    if (kind == HANDLEKIND_ICON) DestroyIcon((HICON) handle);
+    else if (kind == HANDLEKIND_BITMAP) DeleteObject(handle);
+}
+
+void releaseAllHandles()
+{
+    HANDLE handle;
+    int kind;
     
-    DrawText(hMemDC, &text[label], -1, &rect, DT_SINGLELINE | DT_CENTER | DT_NOPREFIX);
+    EnterCriticalSection(&g_trackedLock);
     
-    hBitmap2 = (HBITMAP) CopyImage(hBitmap1, IMAGE_BITMAP, 0, 0, 0);
+    while ((kind = popTrackedHandle(&g_trackedHandles, &handle)) >= 0)
+    {
+        if (kind == HANDLEKIND_ICON) DestroyIcon((HICON) handle);
+        else DeleteObject(handle);
+    }
     
-    DeleteDC(hMemDC);
+    LeaveCriticalSection(&g_trackedLock);
+}
+
+void findToolbarWindows(HWND *rbWindow, HWND *tbWindow)
+{
+    // Use cached windows while they still exist with same parents - otherwise find them again
+    // (rebar is first rebar in window, toolbar is first toolbar in rebar)
     
-    DeleteObject(hBitmap1);
-    DeleteObject(hFont);
+    if (g_tbWindow == NULL || !IsWindow(g_tbWindow) || GetParent(g_tbWindow) != g_rbWindow || GetParent(g_rbWindow) != nppData._nppHandle)
+    {
+        g_rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
+        g_tbWindow = FindWindowEx(g_rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+        g_windowLookups++;
+    }
     
-    ReleaseDC(NULL, hDC);
+    *rbWindow = g_rbWindow;
+    *tbWindow = g_tbWindow;
+}
+
+double timeWindowLookups(bool cached)
+{
+    LARGE_INTEGER startTime;
+    HWND rbWindow, tbWindow;
+    int i;
     
-    hImageList = ImageList_Create(32, 32, ILC_MASK | ILC_COLOR32, 1, 0);
+    // Average microseconds per lookup - uncached is what subclassWindowProc did for every message before its fast path
     
-    ImageList_AddMasked(hImageList, hBitmap2, CLR_DEFAULT);
+    QueryPerformanceCounter(&startTime);
     
-    hIcon = ImageList_GetIcon(hImageList, 0, ILD_TRANSPARENT);
+    for (i = 0; i < LOOKUPSAMPLES; i++)
+    {
+        if (cached) findToolbarWindows(&rbWindow, &tbWindow);
+        else
+        {
+            rbWindow = FindWindowEx(nppData._nppHandle, NULL, REBARCLASSNAME, NULL);
+            tbWindow = FindWindowEx(rbWindow, NULL, TOOLBARCLASSNAME, NULL);
+        }
+    }
     
-    return hIcon;
+    return elapsedMilliseconds(startTime)*1000.0/LOOKUPSAMPLES;
 }
 
-//
-// Miscellaneous functions
-//
-
-void stripMenuString(LPTSTR lpString)
+double elapsedMilliseconds(LARGE_INTEGER startTime)
 {
-    int i, j;
+    LARGE_INTEGER endTime, frequency;
     
-    j = 0;
-    for (i = 0; lpString[i] != 0; i++)
-    {
-        if (lpString[i] == '&');
-        else if (lpString[i] == '\t') break;
-        else lpString[j++] = lpString[i];
-    }
-    lpString[j] = 0;
+    QueryPerformanceCounter(&endTime);
+    QueryPerformanceFrequency(&frequency);
+    
+    return (double) (endTime.QuadPart-startTime.QuadPart)*1000.0/(double) frequency.QuadPart;
 }
 
 int getCommCtrlMajorVersion()
@@ -1932,3 +5150,26 @@ int getCommCtrlMajorVersion()
     return (int) versionInfo.dwMajorVersion;
 }
 
+UINT getWindowDpi(HWND hwnd)
+{
+    GETDPIFORWINDOWPROC pfnGetDpiForWindow;
+    HDC hDC;
+    UINT dpi;
+    
+    // Per-monitor DPI of window (Windows 10 1607 or later), else system DPI
+    
+    pfnGetDpiForWindow = (GETDPIFORWINDOWPROC) GetProcAddress(GetModuleHandle(TEXT("user32.dll")), "GetDpiForWindow");
+    
+    dpi = 0;
+    if (pfnGetDpiForWindow && hwnd) dpi = (*pfnGetDpiForWindow)(hwnd);
+    
+    if (dpi == 0)
+    {
+        hDC = GetDC(NULL);
+        dpi = (UINT) GetDeviceCaps(hDC, LOGPIXELSX);
+        ReleaseDC(NULL, hDC);
+    }
+    
+    return dpi ? dpi : 96;
+}
+
@@ -0,0 +1,76 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#include "PluginEvents.h"
+
+bool advanceLifecycle(LIFECYCLE *lifecycle, int stage)
+{
+    if (stage == LIFECYCLE_SHUTDOWN ? lifecycle->stage == LIFECYCLE_SHUTDOWN : lifecycle->stage != stage-1)
+    {
+        lifecycle->rejected++;
+        return false;
+    }
+    
+    lifecycle->stage = stage;
+    
+    return true;
+}
+
+void newLayoutGeneration(LAYOUTPASSES *passes)
+{
+    passes->generation++;
+}
+
+void beginLayoutPass(LAYOUTPASSES *passes)
+{
+    passes->passGeneration = passes->generation;
+    passes->active = true;
+    passes->stale = false;
+    passes->started++;
+}
+
+bool layoutPassStale(LAYOUTPASSES *passes)
+{
+    // Once stale, remainder of layout pass is skipped - newer event handles latest geometry in full
+    
+    if (!passes->active) return false;
+    if (passes->passGeneration != passes->generation) passes->stale = true;
+    
+    return passes->stale;
+}
+
+bool endLayoutPass(LAYOUTPASSES *passes)
+{
+    passes->active = false;
+    if (passes->stale) passes->aborted++;
+    
+    return !passes->stale;
+}
+
+void enterStateRead(STATEREADERS *readers)
+{
+    readers->readers++;
+}
+
+bool deferStateWrite(STATEREADERS *readers, unsigned int write)
+{
+    if (readers->readers == 0) return false;
+    
+    readers->deferred |= write;
+    readers->writesDeferred++;
+    
+    return true;
+}
+
+unsigned int leaveStateRead(STATEREADERS *readers)
+{
+    unsigned int deferred;
+    
+    if (readers->readers == 0 || --readers->readers > 0) return 0;  /* unmatched, or other reader still open */
+    
+    deferred = readers->deferred;
+    readers->deferred = 0;
+    
+    return deferred;
+}
@@ -0,0 +1,674 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// PNG decoding:
+//
+//  - chunks before the first IDAT are read (IHDR, PLTE, tRNS - others ignored), then the IDAT data is inflated
+//    as one stream read straight from consecutive IDAT chunks (never copied together), into the filtered rows
+//  - filtered rows have a known size, so inflate writes into one buffer and rejects streams that would overrun it
+//  - chunk CRCs are not checked, but the zlib checksum (Adler-32) of the rows is, so damaged data is not shown
+//  - color types 0, 2, 3, 4 and 6 at every bit depth, and Adam7 interlacing (each pass unfiltered as a sub-image)
+//  - 16-bit samples are reduced to their high byte (after tRNS key is compared at full depth)
+//
+// Inflate:
+//
+//  - stored, fixed and dynamic Huffman blocks (RFC 1951)
+//  - bits are read least significant first through a 32-bit buffer, refilled a byte at a time
+//  - Huffman codes of up to 9 bits are decoded by one table lookup, longer codes from the canonical code counts
+
+#include "PngImage.h"
+#include <string.h>
+
+#define PNGFASTBITS 9  /* bits of Huffman code decoded by table lookup */
+#define PNGMAXCODES 288  /* literal/length codes (distance codes are 30, code length codes 19) */
+
+#define PNGTYPE_GREY 0
+#define PNGTYPE_RGB 2
+#define PNGTYPE_PALETTE 3
+#define PNGTYPE_GREYALPHA 4
+#define PNGTYPE_RGBA 6
+
+typedef struct
+{
+    const unsigned char *data;  /* whole file */
+    size_t size;
+    size_t next;  /* offset of chunk after current IDAT chunk */
+    const unsigned char *in;  /* remaining data of current IDAT chunk */
+    size_t left;
+    unsigned int bitBuffer;
+    int bitCount;
+    int padding;  /* zero bits added after end of stream (error if consumed) */
+    bool error;
+} PNGSTREAM;
+
+typedef struct
+{
+    short count[16];  /* number of codes of each length */
+    short symbol[PNGMAXCODES];  /* symbols in canonical code order */
+    unsigned short fast[1 << PNGFASTBITS];  /* symbol << 4 | length for codes of up to PNGFASTBITS bits (bits reversed), 0 if longer */
+} PNGHUFFMAN;
+
+// Length and distance bases and extra bits (RFC 1951 3.2.5)
+
+static const unsigned short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Adam7 passes - first column, first row, column step, row step
+
+static const unsigned char adam7[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+
+// Local functions
+
+static bool inflateRows(PNGSTREAM *stream, unsigned char *out, size_t outSize);
+static bool inflateBlock(PNGSTREAM *stream, const PNGHUFFMAN *lengths, const PNGHUFFMAN *distances, unsigned char *out, size_t outSize, size_t *written);
+static bool readDynamicCodes(PNGSTREAM *stream, PNGHUFFMAN *lengths, PNGHUFFMAN *distances);
+static bool buildHuffman(PNGHUFFMAN *huffman, const unsigned char *codeLengths, int codes);
+static int decodeSymbol(PNGSTREAM *stream, const PNGHUFFMAN *huffman);
+static unsigned int getBits(PNGSTREAM *stream, int bits);
+static void needBits(PNGSTREAM *stream, int bits);
+static void dropBits(PNGSTREAM *stream, int bits);
+static int nextByte(PNGSTREAM *stream);
+static bool unfilterRows(unsigned char *rows, int height, size_t rowBytes, int pixelBytes);
+static unsigned int readSample(const unsigned char *row, int index, int depth);
+static unsigned int scaleSample(unsigned int sample, int depth);
+static unsigned int readBigValue(const unsigned char *data);
+
+bool decodePngImage(const unsigned char *data, size_t size, unsigned int background, ICONIMAGE *image)
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    PNGSTREAM stream;
+    unsigned char *rows, *row;
+    unsigned int palette[256], *pixels, length, r, g, b, a, key[3], pixel;
+    size_t offset, rowBytes, filteredSize, passOffset;
+    int width, height, depth, colorType, interlace, channels, pixelBytes, paletteCount, pass, passes, passWidth, passHeight, x, y, i;
+    bool hasKey, ok;
+    
+    // Signature and header (IHDR must be first chunk)
+    
+    if (size < 8+25 || memcmp(data, signature, 8) != 0 || readBigValue(data+8) != 13 || memcmp(data+12, "IHDR", 4) != 0) return false;
+    
+    width = (int) readBigValue(data+16);
+    height = (int) readBigValue(data+20);
+    depth = data[24];
+    colorType = data[25];
+    interlace = data[28];
+    
+    if (width <= 0 || height <= 0 || width > ICONMAXSIZE || height > ICONMAXSIZE) return false;
+    if (data[26] != 0 || data[27] != 0 || interlace > 1) return false;  /* deflate, adaptive filtering */
+    
+    switch (colorType)
+    {
+        case PNGTYPE_GREY:
+            channels = 1;
+            ok = (depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16);
+            break;
+        case PNGTYPE_PALETTE:
+            channels = 1;
+            ok = (depth == 1 || depth == 2 || depth == 4 || depth == 8);
+            break;
+        case PNGTYPE_RGB:
+            channels = 3;
+            ok = (depth == 8 || depth == 16);
+            break;
+        case PNGTYPE_GREYALPHA:
+            channels = 2;
+            ok = (depth == 8 || depth == 16);
+            break;
+        case PNGTYPE_RGBA:
+            channels = 4;
+            ok = (depth == 8 || depth == 16);
+            break;
+        default:
+            return false;
+    }
+    if (!ok) return false;
+    
+    pixelBytes = (channels*depth+7)/8;  /* filter unit - at least one byte */
+    
+    // Chunks before image data
+    
+    for (i = 0; i < 256; i++) palette[i] = 0xFF000000;
+    paletteCount = 0;
+    hasKey = false;
+    key[0] = key[1] = key[2] = 0;
+    
+    offset = 8+25;
+    
+    while (true)
+    {
+        if (offset > size-12) return false;  /* no image data */
+        
+        length = readBigValue(data+offset);
+        if (length > size-offset-12) return false;
+        
+        if (memcmp(data+offset+4, "IDAT", 4) == 0) break;
+        if (memcmp(data+offset+4, "IEND", 4) == 0) return false;
+        
+        if (memcmp(data+offset+4, "PLTE", 4) == 0 && length % 3 == 0 && length <= 256*3)
+        {
+            paletteCount = length/3;
+            for (i = 0; i < paletteCount; i++) palette[i] = 0xFF000000 | (data[offset+8+i*3] << 16) | (data[offset+9+i*3] << 8) | data[offset+10+i*3];
+        }
+        else if (memcmp(data+offset+4, "tRNS", 4) == 0)
+        {
+            if (colorType == PNGTYPE_PALETTE) for (i = 0; i < (int) length && i < 256; i++) palette[i] = (palette[i] & 0x00FFFFFF) | (data[offset+8+i] << 24);
+            else if (colorType == PNGTYPE_GREY && length >= 2)
+            {
+                key[0] = (data[offset+8] << 8) | data[offset+9];
+                hasKey = true;
+            }
+            else if (colorType == PNGTYPE_RGB && length >= 6)
+            {
+                for (i = 0; i < 3; i++) key[i] = (data[offset+8+i*2] << 8) | data[offset+9+i*2];
+                hasKey = true;
+            }
+        }
+        
+        offset += 12+length;
+    }
+    
+    if (colorType == PNGTYPE_PALETTE && paletteCount == 0) return false;
+    
+    // Filtered rows of every pass (one filter type byte per row)
+    
+    passes = interlace ? 7 : 1;
+    filteredSize = 0;
+    
+    for (pass = 0; pass < passes; pass++)
+    {
+        passWidth = interlace ? (width-adam7[pass][0]+adam7[pass][2]-1)/adam7[pass][2] : width;
+        passHeight = interlace ? (height-adam7[pass][1]+adam7[pass][3]-1)/adam7[pass][3] : height;
+        if (passWidth > 0 && passHeight > 0) filteredSize += passHeight*(1+((size_t) passWidth*channels*depth+7)/8);
+    }
+    
+    // Inflate image data straight from IDAT chunks
+    
+    memset(&stream, 0, sizeof(PNGSTREAM));
+    stream.data = data;
+    stream.size = size;
+    stream.next = offset;
+    
+    rows = new unsigned char[filteredSize];
+    
+    if (!inflateRows(&stream, rows, filteredSize))
+    {
+        delete[] rows;
+        return false;
+    }
+    
+    // Unfilter each pass and place its pixels
+    
+    pixels = new unsigned int[width*height];
+    passOffset = 0;
+    
+    for (pass = 0; pass < passes; pass++)
+    {
+        passWidth = interlace ? (width-adam7[pass][0]+adam7[pass][2]-1)/adam7[pass][2] : width;
+        passHeight = interlace ? (height-adam7[pass][1]+adam7[pass][3]-1)/adam7[pass][3] : height;
+        if (passWidth <= 0 || passHeight <= 0) continue;
+        
+        rowBytes = ((size_t) passWidth*channels*depth+7)/8;
+        if (!unfilterRows(rows+passOffset, passHeight, rowBytes, pixelBytes))
+        {
+            delete[] rows;
+            delete[] pixels;
+            return false;
+        }
+        
+        for (y = 0; y < passHeight; y++)
+        {
+            row = rows+passOffset+y*(1+rowBytes)+1;
+            
+            for (x = 0; x < passWidth; x++)
+            {
+                switch (colorType)
+                {
+                    case PNGTYPE_GREY:
+                        g = readSample(row, x, depth);
+                        a = (hasKey && g == key[0]) ? 0 : 255;
+                        g = scaleSample(g, depth);
+                        pixel = (a << 24) | (g << 16) | (g << 8) | g;
+                        break;
+                    case PNGTYPE_RGB:
+                        r = readSample(row, x*3, depth);
+                        g = readSample(row, x*3+1, depth);
+                        b = readSample(row, x*3+2, depth);
+                        a = (hasKey && r == key[0] && g == key[1] && b == key[2]) ? 0 : 255;
+                        pixel = (a << 24) | (scaleSample(r, depth) << 16) | (scaleSample(g, depth) << 8) | scaleSample(b, depth);
+                        break;
+                    case PNGTYPE_PALETTE:
+                        pixel = palette[readSample(row, x, depth)];  /* index beyond palette is opaque black */
+                        break;
+                    case PNGTYPE_GREYALPHA:
+                        g = scaleSample(readSample(row, x*2, depth), depth);
+                        a = scaleSample(readSample(row, x*2+1, depth), depth);
+                        pixel = (a << 24) | (g << 16) | (g << 8) | g;
+                        break;
+                    default:
+                        r = scaleSample(readSample(row, x*4, depth), depth);
+                        g = scaleSample(readSample(row, x*4+1, depth), depth);
+                        b = scaleSample(readSample(row, x*4+2, depth), depth);
+                        a = scaleSample(readSample(row, x*4+3, depth), depth);
+                        pixel = (a << 24) | (r << 16) | (g << 8) | b;
+                        break;
+                }
+                
+                if (interlace) pixels[(adam7[pass][1]+y*adam7[pass][3])*width+adam7[pass][0]+x*adam7[pass][2]] = pixel;
+                else pixels[y*width+x] = pixel;
+            }
+        }
+        
+        passOffset += passHeight*(1+rowBytes);
+    }
+    
+    delete[] rows;
+    
+    // Composite on opaque background (bitmap)
+    
+    if (background & 0xFF000000)
+    {
+        for (i = 0; i < width*height; i++)
+        {
+            pixel = pixels[i];
+            a = pixel >> 24;
+            if (a == 255) continue;
+            
+            r = (((pixel >> 16) & 0xFF)*a + ((background >> 16) & 0xFF)*(255-a) + 127)/255;
+            g = (((pixel >> 8) & 0xFF)*a + ((background >> 8) & 0xFF)*(255-a) + 127)/255;
+            b = ((pixel & 0xFF)*a + (background & 0xFF)*(255-a) + 127)/255;
+            pixels[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        }
+    }
+    
+    image->width = width;
+    image->height = height;
+    image->pixels = pixels;
+    
+    return true;
+}
+
+static bool inflateRows(PNGSTREAM *stream, unsigned char *out, size_t outSize)
+{
+    PNGHUFFMAN lengths, distances;
+    unsigned char codeLengths[PNGMAXCODES];
+    unsigned int cmf, flg, last, type, length, check, s1, s2;
+    size_t written, i;
+    bool ok;
+    
+    // zlib header - deflate, no preset dictionary
+    
+    cmf = getBits(stream, 8);
+    flg = getBits(stream, 8);
+    if (stream->error || (cmf & 0x0F) != 8 || (cmf*256+flg) % 31 != 0 || (flg & 0x20)) return false;
+    
+    written = 0;
+    ok = true;
+    
+    do
+    {
+        last = getBits(stream, 1);
+        type = getBits(stream, 2);
+        
+        if (type == 0)  /* stored - byte aligned length and its complement */
+        {
+            dropBits(stream, stream->bitCount & 7);
+            length = getBits(stream, 16);
+            check = getBits(stream, 16);
+            ok = (length == (~check & 0xFFFF) && length <= outSize-written);
+            for (i = 0; ok && i < length; i++) out[written++] = (unsigned char) getBits(stream, 8);
+        }
+        else if (type == 1)  /* fixed codes (built per block - image jobs decode on several threads) */
+        {
+            for (i = 0; i < 144; i++) codeLengths[i] = 8;
+            for (; i < 256; i++) codeLengths[i] = 9;
+            for (; i < 280; i++) codeLengths[i] = 7;
+            for (; i < 288; i++) codeLengths[i] = 8;
+            buildHuffman(&lengths, codeLengths, 288);
+            for (i = 0; i < 30; i++) codeLengths[i] = 5;
+            buildHuffman(&distances, codeLengths, 30);
+            ok = inflateBlock(stream, &lengths, &distances, out, outSize, &written);
+        }
+        else if (type == 2) ok = readDynamicCodes(stream, &lengths, &distances) && inflateBlock(stream, &lengths, &distances, out, outSize, &written);
+        else ok = false;
+        
+        ok = ok && !stream->error;
+    }
+    while (ok && !last);
+    
+    if (!ok || written != outSize) return false;
+    
+    // Adler-32 of rows (byte aligned, most significant byte first)
+    
+    dropBits(stream, stream->bitCount & 7);
+    check = getBits(stream, 8) << 24;
+    check |= getBits(stream, 8) << 16;
+    check |= getBits(stream, 8) << 8;
+    check |= getBits(stream, 8);
+    if (stream->error) return false;
+    
+    s1 = 1;
+    s2 = 0;
+    for (i = 0; i < outSize; i++)
+    {
+        s1 += out[i];
+        s2 += s1;
+        if ((i & 4095) == 4095)  /* well before 32-bit overflow */
+        {
+            s1 %= 65521;
+            s2 %= 65521;
+        }
+    }
+    s1 %= 65521;
+    s2 %= 65521;
+    
+    return check == ((s2 << 16) | s1);
+}
+
+static bool inflateBlock(PNGSTREAM *stream, const PNGHUFFMAN *lengths, const PNGHUFFMAN *distances, unsigned char *out, size_t outSize, size_t *written)
+{
+    size_t position, length, distance;
+    int symbol;
+    
+    position = *written;
+    
+    while (true)
+    {
+        symbol = decodeSymbol(stream, lengths);
+        if (symbol < 0 || stream->error) return false;
+        
+        if (symbol < 256)  /* literal */
+        {
+            if (position >= outSize) return false;
+            out[position++] = (unsigned char) symbol;
+            continue;
+        }
+        
+        if (symbol == 256) break;  /* end of block */
+        
+        // Length and distance back into rows already written
+        
+        symbol -= 257;
+        if (symbol >= 29) return false;
+        length = lengthBase[symbol] + getBits(stream, lengthExtra[symbol]);
+        
+        symbol = decodeSymbol(stream, distances);
+        if (symbol < 0 || symbol >= 30) return false;
+        distance = distanceBase[symbol] + getBits(stream, distanceExtra[symbol]);
+        
+        if (stream->error || distance > position || length > outSize-position) return false;
+        
+        for (; length > 0; length--, position++) out[position] = out[position-distance];  /* may overlap */
+    }
+    
+    *written = position;
+    
+    return true;
+}
+
+static bool readDynamicCodes(PNGSTREAM *stream, PNGHUFFMAN *lengths, PNGHUFFMAN *distances)
+{
+    PNGHUFFMAN codeLengthCodes;
+    unsigned char codeLengths[PNGMAXCODES+32];
+    int lengthCodes, distanceCodes, codeLengthCount, i, symbol, repeat, value;
+    
+    lengthCodes = getBits(stream, 5) + 257;
+    distanceCodes = getBits(stream, 5) + 1;
+    codeLengthCount = getBits(stream, 4) + 4;
+    if (lengthCodes > 286 || distanceCodes > 30) return false;
+    
+    // Code length codes, then code lengths of both tables as one sequence (repeats may cross between them)
+    
+    memset(codeLengths, 0, sizeof(codeLengths));
+    for (i = 0; i < codeLengthCount; i++) codeLengths[codeLengthOrder[i]] = (unsigned char) getBits(stream, 3);
+    if (!buildHuffman(&codeLengthCodes, codeLengths, 19)) return false;
+    
+    i = 0;
+    while (i < lengthCodes+distanceCodes)
+    {
+        symbol = decodeSymbol(stream, &codeLengthCodes);
+        if (symbol < 0 || stream->error) return false;
+        
+        if (symbol < 16)
+        {
+            codeLengths[i++] = (unsigned char) symbol;
+            continue;
+        }
+        
+        if (symbol == 16)
+        {
+            if (i == 0) return false;
+            value = codeLengths[i-1];
+            repeat = 3 + getBits(stream, 2);
+        }
+        else
+        {
+            value = 0;
+            repeat = (symbol == 17) ? 3 + getBits(stream, 3) : 11 + getBits(stream, 7);
+        }
+        
+        if (i+repeat > lengthCodes+distanceCodes) return false;
+        for (; repeat > 0; repeat--) codeLengths[i++] = (unsigned char) value;
+    }
+    
+    if (codeLengths[256] == 0) return false;  /* no end of block code */
+    
+    return buildHuffman(lengths, codeLengths, lengthCodes) && buildHuffman(distances, codeLengths+lengthCodes, distanceCodes);
+}
+
+static bool buildHuffman(PNGHUFFMAN *huffman, const unsigned char *codeLengths, int codes)
+{
+    short offsets[16];
+    unsigned int code, reversed;
+    int length, left, i, j, k;
+    
+    memset(huffman, 0, sizeof(PNGHUFFMAN));
+    
+    for (i = 0; i < codes; i++) huffman->count[codeLengths[i]]++;
+    huffman->count[0] = 0;
+    
+    // Over-subscribed lengths are damaged (incomplete codes are allowed - single distance code)
+    
+    left = 1;
+    for (length = 1; length < 16; length++)
+    {
+        left = (left << 1) - huffman->count[length];
+        if (left < 0) return false;
+    }
+    
+    // Symbols in canonical order (by length, then by symbol)
+    
+    offsets[1] = 0;
+    for (length = 1; length < 15; length++) offsets[length+1] = offsets[length] + huffman->count[length];
+    for (i = 0; i < codes; i++) if (codeLengths[i]) huffman->symbol[offsets[codeLengths[i]]++] = (short) i;
+    
+    // Lookup table for short codes (stream holds code most significant bit first, so index is reversed code)
+    
+    code = 0;
+    k = 0;
+    for (length = 1; length < 16; length++)
+    {
+        for (i = 0; i < huffman->count[length]; i++, k++, code++)
+        {
+            if (length > PNGFASTBITS) continue;
+            
+            reversed = 0;
+            for (j = 0; j < length; j++) reversed |= ((code >> j) & 1) << (length-1-j);
+            for (j = (int) reversed; j < (1 << PNGFASTBITS); j += (1 << length)) huffman->fast[j] = (unsigned short) ((huffman->symbol[k] << 4) | length);
+        }
+        code <<= 1;
+    }
+    
+    return true;
+}
+
+static int decodeSymbol(PNGSTREAM *stream, const PNGHUFFMAN *huffman)
+{
+    unsigned int entry;
+    int code, first, index, count, length;
+    
+    needBits(stream, 15);
+    
+    entry = huffman->fast[stream->bitBuffer & ((1 << PNGFASTBITS)-1)];
+    if (entry)
+    {
+        dropBits(stream, entry & 15);
+        return (int) (entry >> 4);
+    }
+    
+    // Longer code - one bit at a time from canonical counts
+    
+    code = first = index = 0;
+    for (length = 1; length < 16; length++)
+    {
+        code |= (stream->bitBuffer >> (length-1)) & 1;
+        count = huffman->count[length];
+        if (code-count < first)
+        {
+            dropBits(stream, length);
+            return huffman->symbol[index+(code-first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    
+    return -1;  /* not a code */
+}
+
+static unsigned int getBits(PNGSTREAM *stream, int bits)
+{
+    unsigned int value;
+    
+    if (bits == 0) return 0;
+    
+    needBits(stream, bits);
+    value = stream->bitBuffer & ((1u << bits)-1);
+    dropBits(stream, bits);
+    
+    return value;
+}
+
+static void needBits(PNGSTREAM *stream, int bits)
+{
+    int byte;
+    
+    while (stream->bitCount < bits)
+    {
+        byte = nextByte(stream);
+        if (byte < 0)
+        {
+            byte = 0;
+            stream->padding += 8;
+        }
+        stream->bitBuffer |= (unsigned int) byte << stream->bitCount;
+        stream->bitCount += 8;
+    }
+}
+
+static void dropBits(PNGSTREAM *stream, int bits)
+{
+    stream->bitBuffer >>= bits;
+    stream->bitCount -= bits;
+    
+    if (stream->bitCount < stream->padding) stream->error = true;  /* read past end of image data */
+}
+
+static int nextByte(PNGSTREAM *stream)
+{
+    size_t length;
+    
+    // Next IDAT chunk when current one is used up (image data ends at first other chunk)
+    
+    while (stream->left == 0)
+    {
+        if (stream->next > stream->size-12) return -1;
+        
+        length = readBigValue(stream->data+stream->next);
+        if (memcmp(stream->data+stream->next+4, "IDAT", 4) != 0 || length > stream->size-stream->next-12) return -1;
+        
+        stream->in = stream->data+stream->next+8;
+        stream->left = length;
+        stream->next += 12+length;
+    }
+    
+    stream->left--;
+    
+    return *stream->in++;
+}
+
+static bool unfilterRows(unsigned char *rows, int height, size_t rowBytes, int pixelBytes)
+{
+    unsigned char *row, *prior;
+    size_t i;
+    int y, a, b, c, p, pa, pb, pc;
+    
+    prior = NULL;  /* row above first row is zeros */
+    
+    for (y = 0; y < height; y++, prior = row)
+    {
+        row = rows+y*(1+rowBytes)+1;
+        
+        switch (row[-1])
+        {
+            case 1:  /* sub */
+                for (i = pixelBytes; i < rowBytes; i++) row[i] = (unsigned char) (row[i] + row[i-pixelBytes]);
+                break;
+            case 2:  /* up */
+                if (prior) for (i = 0; i < rowBytes; i++) row[i] = (unsigned char) (row[i] + prior[i]);
+                break;
+            case 3:  /* average */
+                for (i = 0; i < rowBytes; i++)
+                {
+                    a = (i >= (size_t) pixelBytes) ? row[i-pixelBytes] : 0;
+                    b = prior ? prior[i] : 0;
+                    row[i] = (unsigned char) (row[i] + ((a+b) >> 1));
+                }
+                break;
+            case 4:  /* Paeth */
+                for (i = 0; i < rowBytes; i++)
+                {
+                    a = (i >= (size_t) pixelBytes) ? row[i-pixelBytes] : 0;
+                    b = prior ? prior[i] : 0;
+                    c = (prior && i >= (size_t) pixelBytes) ? prior[i-pixelBytes] : 0;
+                    p = a+b-c;
+                    pa = (p > a) ? p-a : a-p;
+                    pb = (p > b) ? p-b : b-p;
+                    pc = (p > c) ? p-c : c-p;
+                    row[i] = (unsigned char) (row[i] + ((pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c));
+                }
+                break;
+            default:
+                if (row[-1] != 0) return false;  /* not a filter type */
+        }
+    }
+    
+    return true;
+}
+
+static unsigned int readSample(const unsigned char *row, int index, int depth)
+{
+    if (depth == 8) return row[index];
+    if (depth == 16) return (row[index*2] << 8) | row[index*2+1];
+    
+    // 1, 2 or 4 bits - leftmost pixel in most significant bits
+    
+    return (row[(index*depth) >> 3] >> (8-depth-((index*depth) & 7))) & ((1 << depth)-1);
+}
+
+static unsigned int scaleSample(unsigned int sample, int depth)
+{
+    if (depth == 8) return sample;
+    if (depth == 16) return sample >> 8;
+    
+    return sample*255/((1 << depth)-1);
+}
+
+static unsigned int readBigValue(const unsigned char *data)
+{
+    return ((unsigned int) data[0] << 24) | ((unsigned int) data[1] << 16) | ((unsigned int) data[2] << 8) | (unsigned int) data[3];
+}
@@ -0,0 +1,141 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+#ifndef TESTCHECK_H
+#define TESTCHECK_H
+
+//
+// Checks shared by the portable module tests and benchmarks (no test framework - each test is a small program,
+// run by ctest, that prints every failed check and returns non-zero if any check failed)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#define CHECK(condition) checkCondition((condition), #condition, __FILE__, __LINE__)
+
+static int g_checks;
+static int g_failures;
+
+static void checkCondition(bool ok, const char *text, const char *file, int line)
+{
+    g_checks++;
+    if (ok) return;
+    
+    g_failures++;
+    printf("%s:%d: check failed: %s\n", file, line, text);
+}
+
+static int testResult(const char *name)
+{
+    printf("%s: %d checks, %d failed\n", name, g_checks, g_failures);
+    
+    return g_failures ? 1 : 0;
+}
+
+//
+// Whole file in buffer allocated by new[] (NULL if missing) - test data is in TESTDATA directory
+//
+static inline unsigned char *readTestFile(const char *name, size_t *size)
+{
+    char path[1024];
+    FILE *file;
+    unsigned char *data;
+    long length;
+    
+    snprintf(path, sizeof(path), "%s/%s", TESTDATA, name);
+    
+    file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    data = new unsigned char[length > 0 ? length : 1];
+    *size = fread(data, 1, (size_t) length, file);
+    fclose(file);
+    
+    return data;
+}
+
+static inline bool writeTestFile(const char *name, const void *data, size_t size)
+{
+    char path[1024];
+    FILE *file;
+    bool ok;
+    
+    snprintf(path, sizeof(path), "%s/%s", TESTDATA, name);
+    
+    file = fopen(path, "wb");
+    if (!file) return false;
+    
+    ok = (fwrite(data, 1, size, file) == size);
+    ok = (fclose(file) == 0) && ok;
+    
+    return ok;
+}
+
+//
+// Uncompressed .bmp file contents of pixels (top row first) in buffer allocated by new[] - for 8 bits per pixel, pixels are
+// indices into palette (0x00RRGGBB, colors entries), otherwise 0x00RRGGBB (24 bits) or 0xAARRGGBB (32 bits)
+//
+static inline unsigned char *makeBitmapFile(int width, int height, int bits, const unsigned int *pixels, const unsigned int *palette, int colors,
+                                            bool topDown, size_t *size)
+{
+    unsigned char *data, *row;
+    unsigned int header[13], offset;
+    int stride, x, y, i;
+    
+    if (bits != 8) colors = 0;
+    
+    stride = ((width*bits+31)/32)*4;
+    offset = 14 + 40 + colors*4;
+    *size = offset + (size_t) stride*height;
+    
+    data = new unsigned char[*size];
+    memset(data, 0, *size);
+    
+    header[0] = (unsigned int) *size;  /* BITMAPFILEHEADER from bfSize, BITMAPINFOHEADER */
+    header[1] = 0;
+    header[2] = offset;
+    header[3] = 40;
+    header[4] = (unsigned int) width;
+    header[5] = (unsigned int) (topDown ? -height : height);
+    header[6] = 1 | ((unsigned int) bits << 16);
+    header[7] = 0;  /* BI_RGB */
+    header[8] = (unsigned int) stride*height;
+    header[9] = header[10] = 2835;  /* 72 dpi */
+    header[11] = (unsigned int) colors;
+    header[12] = 0;
+    
+    data[0] = 'B';
+    data[1] = 'M';
+    for (i = 0; i < 13; i++) for (x = 0; x < 4; x++) data[2+i*4+x] = (unsigned char) (header[i] >> (x*8));
+    for (i = 0; i < colors; i++) for (x = 0; x < 4; x++) data[54+i*4+x] = (unsigned char) (palette[i] >> (x*8));
+    
+    for (y = 0; y < height; y++)
+    {
+        row = data + offset + (topDown ? y : height-1-y)*stride;
+        for (x = 0; x < width; x++)
+        {
+            if (bits == 8) row[x] = (unsigned char) pixels[y*width+x];
+            else for (i = 0; i < bits/8; i++) row[x*(bits/8)+i] = (unsigned char) (pixels[y*width+x] >> (i*8));
+        }
+    }
+    
+    return data;
+}
+
+//
+// Milliseconds since start (benchmarks)
+//
+static inline double elapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif //TESTCHECK_H
@@ -0,0 +1,123 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Bitmap decoding throughput - 8, 24 and 32 bit .bmp files at 16, 32 and 256 pixels, decoded as bitmaps (key on window
+// color, greys mapped to 3D colors) and as icons (key transparent). Files are created in memory, so only decoding is
+// measured (not file reads)
+
+#include "IconImage.h"
+#include "TestCheck.h"
+
+#define FILES 100  /* of each depth and size */
+#define ROUNDS 5
+
+static const unsigned int shades[3] = { 0xFF404040, 0xFFE0E0E0, 0xFFF8F8F8 };
+
+// Local functions
+
+static unsigned char *makeBenchBitmap(int size, int bits, int seed, size_t *fileSize);
+static double decodeFiles(unsigned char **files, const size_t *sizes, bool icon, bool *decoded);
+
+int main()
+{
+    static const int depths[] = { 8, 24, 32 };
+    static const int sizes[] = { 16, 32, 256 };
+    static unsigned char *files[FILES];
+    static size_t fileSizes[FILES];
+    double bitmap, icon, pixels;
+    int i, j, k;
+    bool decoded;
+    
+    printf("%i files of each depth and size - best of %i\n", FILES, ROUNDS);
+    printf("bits  size   bitmap (us/file)   icon (us/file)   Mpixels/s\n");
+    
+    for (i = 0; i < (int) (sizeof(depths)/sizeof(depths[0])); i++)
+    {
+        for (j = 0; j < (int) (sizeof(sizes)/sizeof(sizes[0])); j++)
+        {
+            for (k = 0; k < FILES; k++) files[k] = makeBenchBitmap(sizes[j], depths[i], k, &fileSizes[k]);
+            
+            bitmap = decodeFiles(files, fileSizes, false, &decoded);
+            CHECK(decoded);
+            icon = decodeFiles(files, fileSizes, true, &decoded);
+            CHECK(decoded);
+            
+            pixels = (double) FILES*sizes[j]*sizes[j];
+            printf("%4i  %4i   %16.2f   %14.2f   %9.1f\n", depths[i], sizes[j], bitmap*1000.0/FILES, icon*1000.0/FILES,
+                   pixels/(bitmap*1000.0));
+            
+            for (k = 0; k < FILES; k++) delete[] files[k];
+        }
+    }
+    
+    return testResult("bench_bmpimage");
+}
+
+//
+// Gradient on a magenta border (bottom-left key), with greys - palette of 256 colors for 8 bits, varying alpha for 32 bits
+//
+static unsigned char *makeBenchBitmap(int size, int bits, int seed, size_t *fileSize)
+{
+    unsigned int palette[256], *pixels, color;
+    unsigned char *data;
+    int x, y, i;
+    
+    for (i = 0; i < 256; i++) palette[i] = (unsigned int) ((i*0x010305 + seed*0x0B0D11) & 0xFFFFFF);
+    palette[0] = 0xFF00FF;
+    palette[1] = 0x808080;
+    palette[2] = 0xC0C0C0;
+    palette[3] = 0xDFDFDF;
+    
+    pixels = new unsigned int[size*size];
+    
+    for (y = 0; y < size; y++)
+    {
+        for (x = 0; x < size; x++)
+        {
+            i = (x == 0 || y == 0 || x == size-1 || y == size-1) ? 0 : 1 + (x*7 + y*13 + seed) % 255;
+            if (bits == 8) color = (unsigned int) i;
+            else if (bits == 24) color = palette[i];
+            else color = (i == 0) ? 0 : palette[i] | (unsigned int) ((128 + (x+y) % 128) << 24);
+            pixels[y*size+x] = color;
+        }
+    }
+    
+    data = makeBitmapFile(size, size, bits, pixels, palette, 256, false, fileSize);
+    delete[] pixels;
+    
+    return data;
+}
+
+//
+// Milliseconds to decode all files, best of ROUNDS
+//
+static double decodeFiles(unsigned char **files, const size_t *sizes, bool icon, bool *decoded)
+{
+    std::chrono::steady_clock::time_point start;
+    ICONIMAGE image;
+    double best, elapsed;
+    int round, i;
+    
+    *decoded = true;
+    best = 0.0;
+    for (round = 0; round < ROUNDS; round++)
+    {
+        start = std::chrono::steady_clock::now();
+        
+        for (i = 0; i < FILES; i++)
+        {
+            if (!decodeBitmapImage(files[i], sizes[i], icon ? 0 : 0xFFFFFFFF, icon ? NULL : shades, &image))
+            {
+                *decoded = false;
+                continue;
+            }
+            delete[] image.pixels;
+        }
+        
+        elapsed = elapsedMilliseconds(start);
+        if (round == 0 || elapsed < best) best = elapsed;
+    }
+    
+    return best;
+}
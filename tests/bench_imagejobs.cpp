@@ -0,0 +1,256 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Custom button image creation for the 150-icon profile (50 custom buttons, bitmap, light and dark icon each) - serial,
+// as before, compared with image jobs taken by pool workers and the calling thread (atomic job counter), each
+// button handed over in order as soon as its images are ready, as addToolbarButtons does
+//
+// Bitmaps are 16x16 .bmp files, icons are 128x128 sources (largest .ico frame) resampled for 150% DPI, and every
+// fifth button is a quick code - images are created in memory, so only decoding is measured (not file reads).
+// The pool event is stood in for by a condition variable, and the drain before the atlas is saved by joining workers
+
+#include "IconImage.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define BUTTONS 50
+#define JOBKINDS 3  /* bitmap, light icon, dark icon */
+#define JOBS (BUTTONS*JOBKINDS)
+#define ICONSOURCESIZE 128
+#define ICONSIZE 24  /* 16 at 150% DPI */
+#define MAXWORKERS 8  /* as IMAGEMAXWORKERS */
+#define ROUNDS 5
+
+typedef struct
+{
+    unsigned char *data;  /* .bmp file contents (NULL for quick code) */
+    size_t size;
+    int kind;
+    unsigned int *pixels;  /* image created */
+    std::atomic<int> done;
+} JOB;
+
+static JOB jobs[JOBS];
+static std::atomic<int> jobNext;
+static std::mutex eventMutex;
+static std::condition_variable jobEvent;
+
+// Local functions
+
+static unsigned char *makeJobBitmap(int size, int bits, int seed, size_t *fileSize);
+static void runJob(JOB *job);
+static bool runNextJob();
+static void waitJob(int index);
+static unsigned long long addButtons();
+static double createSerial(unsigned long long *checksum);
+static double createParallel(int workers, unsigned long long *checksum);
+
+int main()
+{
+    static const int workerCounts[] = { 1, 3, 7 };
+    unsigned long long serialChecksum, checksum;
+    double serial, parallel;
+    int i, workers;
+    
+    for (i = 0; i < JOBS; i++)
+    {
+        jobs[i].kind = i % JOBKINDS;
+        if ((i/JOBKINDS) % 5 == 4) jobs[i].data = NULL;  /* quick code */
+        else jobs[i].data = makeJobBitmap(jobs[i].kind == 0 ? 16 : ICONSOURCESIZE, jobs[i].kind == 0 ? 24 : 32, i, &jobs[i].size);
+    }
+    
+    // Plugin queues one worker for each other processor (at most IMAGEMAXWORKERS)
+    
+    workers = (int) std::thread::hardware_concurrency()-1;
+    if (workers < 0) workers = 0;
+    if (workers > MAXWORKERS) workers = MAXWORKERS;
+    
+    serial = createSerial(&serialChecksum);
+    printf("%i images (%i buttons), %u processors - best of %i\n", JOBS, BUTTONS, std::thread::hardware_concurrency(), ROUNDS);
+    printf("serial (before):        %8.3f ms\n", serial);
+    
+    parallel = createParallel(workers, &checksum);
+    printf("parallel (%i workers):   %8.3f ms  (x%.2f)  as plugin\n", workers, parallel, serial/parallel);
+    CHECK(checksum == serialChecksum);
+    
+    for (i = 0; i < (int) (sizeof(workerCounts)/sizeof(workerCounts[0])); i++)
+    {
+        if (workerCounts[i] == workers) continue;
+        
+        parallel = createParallel(workerCounts[i], &checksum);
+        printf("parallel (%i workers):   %8.3f ms  (x%.2f)\n", workerCounts[i], parallel, serial/parallel);
+        CHECK(checksum == serialChecksum);
+    }
+    
+    for (i = 0; i < JOBS; i++) delete[] jobs[i].data;
+    
+    return testResult("bench_imagejobs");
+}
+
+//
+// Gradient with a transparent (32 bits) or magenta (24 bits) border
+//
+static unsigned char *makeJobBitmap(int size, int bits, int seed, size_t *fileSize)
+{
+    unsigned char *data;
+    unsigned int *pixels;
+    int x, y;
+    
+    pixels = new unsigned int[size*size];
+    
+    for (y = 0; y < size; y++)
+    {
+        for (x = 0; x < size; x++)
+        {
+            if (x == 0 || y == 0 || x == size-1 || y == size-1) pixels[y*size+x] = (bits == 32) ? 0 : 0xFF00FF;
+            else pixels[y*size+x] = 0xFF000000 | (unsigned int) ((x*255/size) << 16 | (y*255/size) << 8 | ((seed*37) & 0xFF));
+        }
+    }
+    
+    data = makeBitmapFile(size, size, bits, pixels, NULL, 0, false, fileSize);
+    delete[] pixels;
+    
+    return data;
+}
+
+static void runJob(JOB *job)
+{
+    ICONIMAGE image;
+    unsigned int *pixels;
+    int size;
+    
+    size = (job->kind == 0) ? 16 : ICONSIZE;
+    
+    if (job->data == NULL)
+    {
+        job->pixels = new unsigned int[size*size];
+        renderQuickCode(0x0050C0, L"Q", size, (job->kind == 0) ? 0xFFF0F0F0 : 0, job->pixels);
+        return;
+    }
+    
+    if (!decodeBitmapImage(job->data, job->size, (job->kind == 0) ? 0xFFF0F0F0 : 0, NULL, &image)) return;
+    
+    if (image.width == size)
+    {
+        job->pixels = (unsigned int *) image.pixels;
+        return;
+    }
+    
+    pixels = new unsigned int[size*size];
+    resampleIconImage(&image, size, size, pixels);
+    delete[] image.pixels;
+    job->pixels = pixels;
+}
+
+static bool runNextJob()
+{
+    int index;
+    
+    index = jobNext.fetch_add(1);
+    if (index >= JOBS) return false;
+    
+    runJob(&jobs[index]);
+    
+    jobs[index].done.store(1);
+    std::lock_guard<std::mutex> lock(eventMutex);
+    jobEvent.notify_all();
+    
+    return true;
+}
+
+static void waitJob(int index)
+{
+    // Run remaining jobs on calling thread rather than wait idle
+    
+    while (!jobs[index].done.load())
+    {
+        if (!runNextJob())
+        {
+            std::unique_lock<std::mutex> lock(eventMutex);
+            jobEvent.wait(lock, [index]() { return jobs[index].done.load() != 0; });
+        }
+    }
+}
+
+//
+// Buttons added in order (checksum of images handed over), images released
+//
+static unsigned long long addButtons()
+{
+    unsigned long long checksum;
+    int i, j, size;
+    
+    checksum = 14695981039346656037ull;
+    
+    for (i = 0; i < JOBS; i++)
+    {
+        waitJob(i);
+        
+        size = (jobs[i].kind == 0) ? 16 : ICONSIZE;
+        if (jobs[i].pixels) for (j = 0; j < size*size; j++) checksum = (checksum ^ jobs[i].pixels[j]) * 1099511628211ull;
+        else checksum = (checksum ^ 0xFFFFFFFF) * 1099511628211ull;
+    }
+    
+    for (i = 0; i < JOBS; i++)
+    {
+        delete[] jobs[i].pixels;
+        jobs[i].pixels = NULL;
+        jobs[i].done.store(0);
+    }
+    
+    return checksum;
+}
+
+static double createSerial(unsigned long long *checksum)
+{
+    std::chrono::steady_clock::time_point start;
+    double best, elapsed;
+    int round, i;
+    
+    best = 0.0;
+    for (round = 0; round < ROUNDS; round++)
+    {
+        start = std::chrono::steady_clock::now();
+        
+        for (i = 0; i < JOBS; i++)
+        {
+            runJob(&jobs[i]);
+            jobs[i].done.store(1);
+        }
+        *checksum = addButtons();
+        
+        elapsed = elapsedMilliseconds(start);
+        if (round == 0 || elapsed < best) best = elapsed;
+    }
+    
+    return best;
+}
+
+static double createParallel(int workers, unsigned long long *checksum)
+{
+    std::chrono::steady_clock::time_point start;
+    std::thread threads[MAXWORKERS];
+    double best, elapsed;
+    int round, i;
+    
+    best = 0.0;
+    for (round = 0; round < ROUNDS; round++)
+    {
+        start = std::chrono::steady_clock::now();
+        
+        jobNext.store(0);
+        for (i = 0; i < workers; i++) threads[i] = std::thread([]() { while (runNextJob()); });
+        
+        *checksum = addButtons();
+        for (i = 0; i < workers; i++) threads[i].join();  /* drained before atlas saved */
+        
+        elapsed = elapsedMilliseconds(start);
+        if (round == 0 || elapsed < best) best = elapsed;
+    }
+    
+    return best;
+}
@@ -0,0 +1,139 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Wasted layout passes during a simulated drag-resize - resize events arrive at a fixed interval (in units of rebar
+// work) while the Notepad++ window edge is dragged, each is delayed until state settles, and each layout pass does
+// wrap/overflow then ideal size work, each ending with a checkpoint before the rebar is updated (RB_SETBANDINFO)
+//
+// Work done and rebar updates applied while the pass is for obsolete geometry are wasted - compared with and without
+// checkpoints (each obsolete rebar update also resizes the rebar again, re-entrantly)
+
+#include "PluginEvents.h"
+#include "TestCheck.h"
+
+#define DRAGTIME 2000  /* units while window edge is dragged */
+#define SETTLEDELAY 3  /* units from first event until pass (UI event delay) */
+#define POLLDELAY 1  /* units from stale pass until repeated */
+#define LAYOUTSTEPS 2
+
+static const int stepCost[LAYOUTSTEPS] = { 6, 2 };  /* wrap/overflow, ideal size */
+
+typedef struct
+{
+    int events;
+    int passes;
+    int aborted;
+    int work;
+    int wasted;  /* units of work for obsolete geometry */
+    int obsoleteUpdates;  /* rebar updates applied for obsolete geometry */
+    bool latestApplied;  /* last completed pass was for last event */
+} DRAGRESULT;
+
+// Local functions
+
+static void simulateDrag(bool checkpoints, int interval, DRAGRESULT *result);
+
+int main()
+{
+    static const int intervals[] = { 1, 2, 4, 8, 16 };
+    DRAGRESULT before, after;
+    int i;
+    
+    printf("drag-resize: %i units, settle delay %i, pass cost %i+%i\n", DRAGTIME, SETTLEDELAY, stepCost[0], stepCost[1]);
+    printf("interval  events   passes (before/after)  aborted   work units (before/after)  wasted (before/after)  obsolete updates (before/after)\n");
+    
+    for (i = 0; i < (int) (sizeof(intervals)/sizeof(intervals[0])); i++)
+    {
+        simulateDrag(false, intervals[i], &before);
+        simulateDrag(true, intervals[i], &after);
+        
+        printf("%8i  %6i   %6i / %-6i         %7i   %8i / %-8i          %6i / %-6i         %6i / %-6i\n", intervals[i], after.events,
+               before.passes, after.passes, after.aborted, before.work, after.work, before.wasted, after.wasted,
+               before.obsoleteUpdates, after.obsoleteUpdates);
+        
+        CHECK(before.latestApplied && after.latestApplied);
+        CHECK(after.wasted <= before.wasted);
+        CHECK(after.obsoleteUpdates == 0);
+    }
+    
+    return testResult("bench_layoutpasses");
+}
+
+static void simulateDrag(bool checkpoints, int interval, DRAGRESULT *result)
+{
+    LAYOUTPASSES passes;
+    unsigned int completedGeneration;
+    int t, waitUntil, step, remaining;
+    bool waiting, passing;
+    
+    memset(&passes, 0, sizeof(passes));
+    memset(result, 0, sizeof(DRAGRESULT));
+    completedGeneration = 0;
+    waiting = passing = false;
+    waitUntil = step = remaining = 0;
+    
+    for (t = 0; t < DRAGTIME || waiting || passing; t++)
+    {
+        // Resize event - coalesced while waiting, and received re-entrantly while pass in progress
+        
+        if (t < DRAGTIME && t % interval == 0)
+        {
+            newLayoutGeneration(&passes);
+            result->events++;
+            if (!waiting && !passing)
+            {
+                waiting = true;
+                waitUntil = t+SETTLEDELAY;
+            }
+        }
+        
+        // Start pass when state has settled
+        
+        if (waiting)
+        {
+            if (t < waitUntil) continue;
+            
+            waiting = false;
+            passing = true;
+            beginLayoutPass(&passes);
+            result->passes++;
+            step = 0;
+            remaining = stepCost[0];
+        }
+        
+        // One unit of rebar work
+        
+        if (remaining > 0)
+        {
+            result->work++;
+            if (passes.passGeneration != passes.generation) result->wasted++;
+            remaining--;
+        }
+        if (remaining > 0) continue;
+        
+        // Checkpoint, then rebar updated - and next step, or pass finished
+        
+        if (!(checkpoints && layoutPassStale(&passes)))
+        {
+            if (passes.passGeneration != passes.generation) result->obsoleteUpdates++;
+            
+            if (++step < LAYOUTSTEPS)
+            {
+                remaining = stepCost[step];
+                continue;
+            }
+        }
+        
+        passing = false;
+        if (!endLayoutPass(&passes) || passes.passGeneration != passes.generation)  /* stale - repeated for latest geometry */
+        {
+            waiting = true;
+            waitUntil = t+POLLDELAY;
+        }
+        if (step == LAYOUTSTEPS) completedGeneration = passes.passGeneration;
+    }
+    
+    result->aborted = passes.aborted;
+    result->latestApplied = (completedGeneration == passes.generation);
+}
@@ -0,0 +1,104 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// PNG decoding of 500 custom button icons (16, 24, 32 and 48 pixels, RGBA compressed by zlib at level 9 - see
+// data/makepng.py) as icons (straight alpha) and as bitmaps (composited on window color). Files are read once, so
+// only decoding is measured (not file reads), and the first round is compared with the expected pixels
+
+#include "PngImage.h"
+#include "TestCheck.h"
+
+#define ICONS 500
+#define ICONFILES 4
+#define ROUNDS 5
+
+static const char *iconFiles[ICONFILES][2] =
+{
+    { "png-icon16.png", "png-icon16.bgra" },
+    { "png-icon24.png", "png-icon24.bgra" },
+    { "png-icon32.png", "png-icon32.bgra" },
+    { "png-icon48.png", "png-icon48.bgra" }
+};
+
+static unsigned char *files[ICONFILES];
+static size_t fileSizes[ICONFILES];
+static unsigned char *expected[ICONFILES];
+static size_t expectedSizes[ICONFILES];
+
+// Local functions
+
+static double decodeIcons(unsigned int background, int *decoded, int *same);
+
+int main()
+{
+    double icon, bitmap;
+    size_t compressed, pixels;
+    int i, decoded, same;
+    
+    compressed = pixels = 0;
+    for (i = 0; i < ICONFILES; i++)
+    {
+        files[i] = readTestFile(iconFiles[i][0], &fileSizes[i]);
+        expected[i] = readTestFile(iconFiles[i][1], &expectedSizes[i]);
+        CHECK(files[i] != NULL && expected[i] != NULL);
+        if (!files[i] || !expected[i]) return testResult("bench_pngimage");
+        
+        compressed += fileSizes[i]*(ICONS/ICONFILES);
+        pixels += expectedSizes[i]/4*(ICONS/ICONFILES);
+    }
+    
+    printf("%i icons (%.0f KB of .png, %.2f Mpixels) - best of %i\n", ICONS, compressed/1024.0, pixels/1000000.0, ROUNDS);
+    
+    icon = decodeIcons(0, &decoded, &same);
+    printf("icons:    %8.3f ms  %6.2f us/icon  %7.1f MB/s of .png\n", icon, icon*1000.0/ICONS, compressed/(icon*1000.0));
+    CHECK(decoded == ICONS && same == ICONS);
+    
+    bitmap = decodeIcons(0xFFFFFFFF, &decoded, &same);
+    printf("bitmaps:  %8.3f ms  %6.2f us/icon  %7.1f MB/s of .png\n", bitmap, bitmap*1000.0/ICONS, compressed/(bitmap*1000.0));
+    CHECK(decoded == ICONS);
+    
+    for (i = 0; i < ICONFILES; i++)
+    {
+        delete[] files[i];
+        delete[] expected[i];
+    }
+    
+    return testResult("bench_pngimage");
+}
+
+//
+// Milliseconds to decode all icons, best of ROUNDS - icons decoded and same as expected in first round counted
+//
+static double decodeIcons(unsigned int background, int *decoded, int *same)
+{
+    std::chrono::steady_clock::time_point start;
+    ICONIMAGE image;
+    double best, elapsed;
+    int round, i, file;
+    
+    *decoded = *same = 0;
+    best = 0.0;
+    for (round = 0; round < ROUNDS; round++)
+    {
+        start = std::chrono::steady_clock::now();
+        
+        for (i = 0; i < ICONS; i++)
+        {
+            file = i % ICONFILES;
+            if (!decodePngImage(files[file], fileSizes[file], background, &image)) continue;
+            
+            if (round == 0)
+            {
+                (*decoded)++;
+                if ((size_t) image.width*image.height*4 == expectedSizes[file] && memcmp(image.pixels, expected[file], expectedSizes[file]) == 0) (*same)++;
+            }
+            delete[] image.pixels;
+        }
+        
+        elapsed = elapsedMilliseconds(start);
+        if (round == 0 || elapsed < best) best = elapsed;
+    }
+    
+    return best;
+}
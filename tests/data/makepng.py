@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+# This file is part of Customize Toolbar, a plugin for Notepad++
+# Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+# Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+# Writes the .png decoder test files (png-*.png, compressed by zlib) and the pixels expected from each (png-*.bgra,
+# BGRA top row first, as ICONIMAGE) - expected pixels are worked out here from the samples written, not by the
+# decoder under test. Run from tests/data:
+#
+#   python3 makepng.py
+
+import struct
+import zlib
+
+WIDTH, HEIGHT = 13, 11  # odd, so Adam7 passes end in part columns and rows
+
+GREY, RGB, PALETTE, GREYALPHA, RGBA = 0, 2, 3, 4, 6
+CHANNELS = {GREY: 1, RGB: 3, PALETTE: 1, GREYALPHA: 2, RGBA: 4}
+NAMES = {GREY: 'grey', RGB: 'rgb', PALETTE: 'palette', GREYALPHA: 'greyalpha', RGBA: 'rgba'}
+ADAM7 = [(0, 0, 8, 8), (4, 0, 8, 8), (0, 4, 4, 8), (2, 0, 4, 4), (0, 2, 2, 4), (1, 0, 2, 2), (0, 1, 1, 2)]
+
+
+def chunk(kind, data):
+    return struct.pack('>I', len(data)) + kind + data + struct.pack('>I', zlib.crc32(kind + data) & 0xFFFFFFFF)
+
+
+def sample(x, y, c, depth):
+    h = (x * 2654435761 + y * 40503 + c * 977 + x * y * 31) & 0xFFFFFFFF
+    return (h >> 7) % (1 << depth)
+
+
+def pack_row(samples, depth):
+    if depth == 16:
+        return b''.join(struct.pack('>H', s) for s in samples)
+    if depth == 8:
+        return bytes(samples)
+    out = bytearray()
+    per_byte = 8 // depth
+    for i in range(0, len(samples), per_byte):
+        value = 0
+        for j in range(per_byte):
+            value <<= depth
+            if i + j < len(samples):
+                value |= samples[i + j]
+        out.append(value)
+    return bytes(out)
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    return b if pb <= pc else c
+
+
+def filter_rows(rows, pixel_bytes, first_filter):
+    out = bytearray()
+    prior = bytes(len(rows[0])) if rows else b''
+    for y, row in enumerate(rows):
+        kind = (first_filter + y) % 5  # every filter type used
+        out.append(kind)
+        for i, value in enumerate(row):
+            a = row[i - pixel_bytes] if i >= pixel_bytes else 0
+            b = prior[i]
+            c = prior[i - pixel_bytes] if i >= pixel_bytes else 0
+            predictor = [0, a, b, (a + b) // 2, paeth(a, b, c)][kind]
+            out.append((value - predictor) & 0xFF)
+        prior = row
+    return bytes(out)
+
+
+def compress(data, mode):
+    if mode == 'stored':
+        return zlib.compress(data, 0)
+    if mode == 'fixed':
+        compressor = zlib.compressobj(9, zlib.DEFLATED, 15, 9, zlib.Z_FIXED)
+        return compressor.compress(data) + compressor.flush()
+    return zlib.compress(data, 9)  # dynamic codes
+
+
+def scale(value, depth):
+    if depth == 16:
+        return value >> 8
+    return value * 255 // ((1 << depth) - 1)
+
+
+def write_png(name, width, height, color_type, depth, pixels, interlace=False, mode='dynamic', palette=None,
+              transparency=None, split=0, extra=b'', filter_override=None):
+    channels = CHANNELS[color_type]
+    pixel_bytes = max(1, channels * depth // 8)
+
+    if interlace:
+        passes = [(px, py, sx, sy) for px, py, sx, sy in ADAM7]
+    else:
+        passes = [(0, 0, 1, 1)]
+
+    filtered = b''
+    for number, (px, py, sx, sy) in enumerate(passes):
+        rows = []
+        for y in range(py, height, sy):
+            samples = []
+            for x in range(px, width, sx):
+                samples.extend(pixels[y][x])
+            if samples:
+                rows.append(pack_row(samples, depth))
+        if rows:
+            filtered += filter_rows(rows, pixel_bytes, number)
+
+    if filter_override is not None:
+        filtered = bytes([filter_override]) + filtered[1:]
+
+    stream = compress(filtered, mode)
+
+    data = b'\x89PNG\r\n\x1a\n'
+    data += chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, depth, color_type, 0, 0, 1 if interlace else 0))
+    data += extra
+    if palette is not None:
+        data += chunk(b'PLTE', b''.join(struct.pack('>BBB', (p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF) for p in palette))
+    if transparency is not None:
+        data += chunk(b'tRNS', transparency)
+    if split:
+        for i in range(0, len(stream), split):
+            data += chunk(b'IDAT', stream[i:i + split])
+    else:
+        data += chunk(b'IDAT', stream)
+    data += chunk(b'IEND', b'')
+
+    with open(name, 'wb') as file:
+        file.write(data)
+
+
+def write_bgra(name, pixels):
+    with open(name, 'wb') as file:
+        for row in pixels:
+            for pixel in row:
+                file.write(struct.pack('<I', pixel))
+
+
+def make_case(color_type, depth, width, height):
+    # Samples of each pixel, and pixels expected (0xAARRGGBB) - grey and RGB keyed by tRNS at 8 and 16 bits (key
+    # compared at full depth, so a sample differing only in its low byte stays opaque), palette with fewer entries
+    # than indices (opaque black beyond) and fewer tRNS entries than colors (opaque beyond)
+
+    channels = CHANNELS[color_type]
+    samples = [[tuple(sample(x, y, c, depth) for c in range(channels)) for x in range(width)] for y in range(height)]
+    palette = transparency = None
+    key = None
+
+    if color_type in (GREY, RGB) and depth >= 8:
+        key = samples[0][0]
+        if width > 1:
+            samples[0][1] = tuple(s ^ 1 for s in key)
+        transparency = b''.join(struct.pack('>H', s) for s in key)
+
+    if color_type == PALETTE:
+        count = (1 << depth) - 1 if depth > 1 else 2
+        palette = [(i * 0x3D1F7 + 0x102030) & 0xFFFFFF for i in range(count)]
+        transparency = bytes((i * 97) & 0xFF for i in range(count // 2))
+
+    expected = []
+    for y in range(height):
+        row = []
+        for x in range(width):
+            s = samples[y][x]
+            if color_type == GREY:
+                g = scale(s[0], depth)
+                a = 0 if key is not None and s == key else 255
+                pixel = (a << 24) | (g << 16) | (g << 8) | g
+            elif color_type == RGB:
+                r, g, b = (scale(v, depth) for v in s)
+                a = 0 if key is not None and s == key else 255
+                pixel = (a << 24) | (r << 16) | (g << 8) | b
+            elif color_type == PALETTE:
+                index = s[0]
+                if index < len(palette):
+                    a = transparency[index] if index < len(transparency) else 255
+                    pixel = (a << 24) | palette[index]
+                else:
+                    pixel = 0xFF000000
+            elif color_type == GREYALPHA:
+                g, a = (scale(v, depth) for v in s)
+                pixel = (a << 24) | (g << 16) | (g << 8) | g
+            else:
+                r, g, b, a = (scale(v, depth) for v in s)
+                pixel = (a << 24) | (r << 16) | (g << 8) | b
+            row.append(pixel)
+        expected.append(row)
+
+    return samples, expected, palette, transparency
+
+
+def make_icon(size):
+    # Round icon with an antialiased edge and a highlight, as a typical toolbar icon
+
+    samples = []
+    expected = []
+    center = (size - 1) / 2
+    for y in range(size):
+        row = []
+        for x in range(size):
+            distance = ((x - center) ** 2 + (y - center) ** 2) ** 0.5
+            coverage = max(0.0, min(1.0, size * 0.45 - distance + 0.5))
+            a = int(coverage * 255 + 0.5)
+            r = min(255, 40 + x * 160 // size + (60 if distance < size * 0.2 else 0))
+            g = min(255, 100 + y * 120 // size)
+            b = 200 - (x + y) * 80 // (2 * size)
+            if a == 0:
+                r = g = b = 0
+            row.append((r, g, b, a))
+        samples.append(row)
+        expected.append([(a << 24) | (r << 16) | (g << 8) | b for r, g, b, a in row])
+    return samples, expected
+
+
+def main():
+    modes = ['dynamic', 'fixed', 'stored']
+    cases = [(GREY, 1), (GREY, 2), (GREY, 4), (GREY, 8), (GREY, 16), (RGB, 8), (RGB, 16), (PALETTE, 1), (PALETTE, 2),
+             (PALETTE, 4), (PALETTE, 8), (GREYALPHA, 8), (GREYALPHA, 16), (RGBA, 8), (RGBA, 16)]
+
+    # Every color type and bit depth, plain and interlaced - compressed with dynamic codes, fixed codes and stored
+    # blocks in turn, and image data of some split over many IDAT chunks
+
+    for number, (color_type, depth) in enumerate(cases):
+        name = 'png-%s%i' % (NAMES[color_type], depth)
+        samples, expected, palette, transparency = make_case(color_type, depth, WIDTH, HEIGHT)
+        extra = chunk(b'gAMA', struct.pack('>I', 45455)) + chunk(b'tEXt', b'Comment\x00test') if number % 2 else b''
+
+        write_png(name + '.png', WIDTH, HEIGHT, color_type, depth, samples, False, modes[number % 3], palette,
+                  transparency, 7 if number % 4 == 1 else 0, extra)
+        write_png(name + '-adam7.png', WIDTH, HEIGHT, color_type, depth, samples, True, modes[(number + 1) % 3], palette,
+                  transparency, 5 if number % 4 == 3 else 0)
+        write_bgra(name + '.bgra', expected)
+
+    # Interlaced images so small that some passes are empty
+
+    for width, height in [(1, 1), (2, 3), (5, 1)]:
+        name = 'png-rgba8-%ix%i' % (width, height)
+        samples, expected, palette, transparency = make_case(RGBA, 8, width, height)
+        write_png(name + '-adam7.png', width, height, RGBA, 8, samples, True)
+        write_bgra(name + '.bgra', expected)
+
+    # Largest image recognised, and images one pixel wider or higher than ICONMAXSIZE (256) - valid otherwise
+
+    for width, height, name in [(256, 256, 'png-max256.png'), (257, 1, 'png-wide257.png'), (1, 257, 'png-high257.png')]:
+        samples = [[(sample(x, y, 0, 1),) for x in range(width)] for y in range(height)]
+        write_png(name, width, height, GREY, 1, samples)
+
+    # Unknown filter type in first row
+
+    samples, expected, palette, transparency = make_case(RGBA, 8, WIDTH, HEIGHT)
+    write_png('png-badfilter.png', WIDTH, HEIGHT, RGBA, 8, samples, filter_override=5)
+
+    # Icons for decoding benchmark
+
+    for size in [16, 24, 32, 48]:
+        samples, expected = make_icon(size)
+        write_png('png-icon%i.png' % size, size, size, RGBA, 8, samples)
+        write_bgra('png-icon%i.bgra' % size, expected)
+
+
+if __name__ == '__main__':
+    main()
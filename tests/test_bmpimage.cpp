@@ -0,0 +1,256 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Bitmap decoding tests - key color and greys replaced only in palette images (as LoadImage with LR_LOADTRANSPARENT
+// and LR_LOADMAP3DCOLORS), 24 and 32 bit images left as they are, straight alpha kept for icons, and damaged or
+// unsupported files not recognised (plugin falls back to LoadImage)
+
+#include "IconImage.h"
+#include "TestCheck.h"
+
+#define WINDOW 0xFFFFFFFF  /* COLOR_WINDOW (bitmap background) */
+
+static const unsigned int shades[3] = { 0xFF404040, 0xFFE0E0E0, 0xFFF8F8F8 };  /* COLOR_3DSHADOW, COLOR_3DFACE, COLOR_3DLIGHT */
+
+// Local functions
+
+static bool decodeSame(const unsigned char *data, size_t size, unsigned int background, const unsigned int *shades, const unsigned int *expected,
+                       int width, int height);
+static void testPalette();
+static void testTrueColor();
+static void testAlpha();
+static void testBitfields();
+static void testRejected();
+static void testDisabled();
+
+int main()
+{
+    testPalette();
+    testTrueColor();
+    testAlpha();
+    testBitfields();
+    testRejected();
+    testDisabled();
+    
+    return testResult("test_bmpimage");
+}
+
+static bool decodeSame(const unsigned char *data, size_t size, unsigned int background, const unsigned int *shades, const unsigned int *expected,
+                       int width, int height)
+{
+    ICONIMAGE image;
+    bool same;
+    
+    if (!decodeBitmapImage(data, size, background, shades, &image)) return false;
+    
+    same = image.width == width && image.height == height && memcmp(image.pixels, expected, (size_t) width*height*4) == 0;
+    delete[] image.pixels;
+    
+    return same;
+}
+
+static void testPalette()
+{
+    static const unsigned int palette[6] = { 0x00FF00FF, 0x00808080, 0x00C0C0C0, 0x00DFDFDF, 0x00123456, 0x00FFFFFF };
+    static const unsigned int indices[3*5] =
+    {
+        4, 1, 2, 3, 5,
+        1, 4, 4, 4, 6,  /* index 6 beyond colors used - black */
+        0, 0, 4, 2, 0   /* bottom-left is key (magenta) */
+    };
+    static const unsigned int bitmap[3*5] =
+    {
+        0xFF123456, 0xFF404040, 0xFFE0E0E0, 0xFFF8F8F8, 0xFFFFFFFF,
+        0xFF404040, 0xFF123456, 0xFF123456, 0xFF123456, 0xFF000000,
+        WINDOW,     WINDOW,     0xFF123456, 0xFFE0E0E0, WINDOW
+    };
+    static const unsigned int icon[3*5] =
+    {
+        0xFF123456, 0xFF808080, 0xFFC0C0C0, 0xFFDFDFDF, 0xFFFFFFFF,
+        0xFF808080, 0xFF123456, 0xFF123456, 0xFF123456, 0xFF000000,
+        0,          0,          0xFF123456, 0xFFC0C0C0, 0
+    };
+    static const unsigned int keyGrey[3*5] =
+    {
+        4, 1, 2, 3, 5,
+        1, 4, 4, 4, 0,
+        2, 0, 4, 2, 0   /* bottom-left is key (0xC0C0C0) */
+    };
+    static const unsigned int keyGreyBitmap[3*5] =
+    {
+        0xFF123456, 0xFF404040, WINDOW,     0xFFF8F8F8, 0xFFFFFFFF,
+        0xFF404040, 0xFF123456, 0xFF123456, 0xFF123456, 0xFFFF00FF,
+        WINDOW,     0xFFFF00FF, 0xFF123456, WINDOW,     0xFFFF00FF
+    };
+    unsigned char *data;
+    size_t size;
+    
+    // Bitmap (key on window color, greys mapped to 3D colors) and icon (key transparent, greys kept), bottom-up and
+    // top-down, width 5 (rows padded)
+    
+    data = makeBitmapFile(5, 3, 8, indices, palette, 6, false, &size);
+    CHECK(decodeSame(data, size, WINDOW, shades, bitmap, 5, 3));
+    CHECK(decodeSame(data, size, 0, NULL, icon, 5, 3));
+    delete[] data;
+    
+    data = makeBitmapFile(5, 3, 8, indices, palette, 6, true, &size);
+    CHECK(decodeSame(data, size, WINDOW, shades, bitmap, 5, 3));
+    delete[] data;
+    
+    // Key that is also a grey - key wins
+    
+    data = makeBitmapFile(5, 3, 8, keyGrey, palette, 6, false, &size);
+    CHECK(decodeSame(data, size, WINDOW, shades, keyGreyBitmap, 5, 3));
+    delete[] data;
+}
+
+static void testTrueColor()
+{
+    static const unsigned int pixels[2*5] =
+    {
+        0x808080, 0xC0C0C0, 0xDFDFDF, 0x123456, 0xFF00FF,
+        0xFF00FF, 0xC0C0C0, 0x808080, 0x123456, 0x000000   /* bottom-left magenta */
+    };
+    unsigned int expected[2*5];
+    unsigned char *data;
+    size_t size;
+    int i;
+    
+    // 24 and 32 bits without alpha - opaque, with no color replaced (LoadImage only changes color table)
+    
+    for (i = 0; i < 2*5; i++) expected[i] = 0xFF000000 | pixels[i];
+    
+    data = makeBitmapFile(5, 2, 24, pixels, NULL, 0, false, &size);
+    CHECK(decodeSame(data, size, WINDOW, shades, expected, 5, 2));
+    CHECK(decodeSame(data, size, 0, NULL, expected, 5, 2));
+    delete[] data;
+    
+    data = makeBitmapFile(5, 2, 32, pixels, NULL, 0, true, &size);
+    CHECK(decodeSame(data, size, WINDOW, shades, expected, 5, 2));
+    CHECK(decodeSame(data, size, 0, NULL, expected, 5, 2));
+    delete[] data;
+}
+
+static void testAlpha()
+{
+    static const unsigned int pixels[4] = { 0x80FF0000, 0x00000000, 0xFF00FF00, 0x40102030 };
+    static const unsigned int opaque[4] = { 0xFFFF0000, 0xFF000000, 0xFF00FF00, 0xFF102030 };
+    unsigned char *data;
+    size_t size;
+    
+    // Straight alpha kept for icon (not premultiplied - 0x80FF0000 stays, not 0x807F0000), opaque for bitmap
+    
+    data = makeBitmapFile(2, 2, 32, pixels, NULL, 0, false, &size);
+    CHECK(decodeSame(data, size, 0, NULL, pixels, 2, 2));
+    CHECK(decodeSame(data, size, WINDOW, shades, opaque, 2, 2));
+    delete[] data;
+}
+
+static void testBitfields()
+{
+    static const unsigned int pixels[4] = { 0x80FF0000, 0x00000000, 0xFF00FF00, 0x40102030 };
+    static const unsigned int masks[3] = { 0x00FF0000, 0x0000FF00, 0x000000FF };
+    unsigned char *plain, *data;
+    size_t plainSize, size;
+    int i, j;
+    
+    // BI_BITFIELDS with standard masks (after BITMAPINFOHEADER) decoded as BI_RGB, other masks not recognised
+    
+    plain = makeBitmapFile(2, 2, 32, pixels, NULL, 0, false, &plainSize);
+    size = plainSize+12;
+    data = new unsigned char[size];
+    memcpy(data, plain, 54);
+    for (i = 0; i < 3; i++) for (j = 0; j < 4; j++) data[54+i*4+j] = (unsigned char) (masks[i] >> (j*8));
+    memcpy(data+66, plain+54, plainSize-54);
+    data[2] = (unsigned char) size;
+    data[10] = 66;  /* pixels offset */
+    data[30] = 3;  /* BI_BITFIELDS */
+    
+    CHECK(decodeSame(data, size, 0, NULL, pixels, 2, 2));
+    
+    data[54] = 0xFF;  /* red mask 0x00FF00FF */
+    CHECK(!decodeSame(data, size, 0, NULL, pixels, 2, 2));
+    
+    delete[] data;
+    delete[] plain;
+}
+
+static void testRejected()
+{
+    static const unsigned int palette[2] = { 0x000000, 0xFFFFFF };
+    static unsigned int pixels[(ICONMAXSIZE+1)*2];
+    ICONIMAGE image;
+    unsigned char *data, *copy;
+    size_t size, length;
+    int rejected;
+    
+    // Truncated at every length - never recognised (so never read past end)
+    
+    data = makeBitmapFile(7, 3, 24, pixels, NULL, 0, false, &size);
+    copy = new unsigned char[size];
+    rejected = 0;
+    for (length = 0; length < size; length++)
+    {
+        memcpy(copy, data, length);
+        if (!decodeBitmapImage(copy, length, 0, NULL, &image)) rejected++;
+        else delete[] image.pixels;
+    }
+    CHECK(rejected == (int) size);
+    
+    // Not a bitmap, zero or INT_MIN height, and unsupported bits per pixel and compression
+    
+    memcpy(copy, data, size);
+    copy[0] = 'b';
+    CHECK(!decodeBitmapImage(copy, size, 0, NULL, &image));
+    
+    memcpy(copy, data, size);
+    memset(copy+22, 0, 4);
+    CHECK(!decodeBitmapImage(copy, size, 0, NULL, &image));
+    
+    memcpy(copy, data, size);
+    memset(copy+22, 0, 3);
+    copy[25] = 0x80;  /* height INT_MIN */
+    CHECK(!decodeBitmapImage(copy, size, 0, NULL, &image));
+    
+    memcpy(copy, data, size);
+    copy[28] = 16;
+    CHECK(!decodeBitmapImage(copy, size, 0, NULL, &image));
+    
+    memcpy(copy, data, size);
+    copy[30] = 1;  /* BI_RLE8 */
+    CHECK(!decodeBitmapImage(copy, size, 0, NULL, &image));
+    
+    delete[] copy;
+    delete[] data;
+    
+    // Palette extends past end of file
+    
+    data = makeBitmapFile(2, 2, 8, pixels, palette, 2, false, &size);
+    data[46] = 200;  /* colors used */
+    CHECK(!decodeBitmapImage(data, size, 0, NULL, &image));
+    delete[] data;
+    
+    // Wider than ICONMAXSIZE
+    
+    data = makeBitmapFile(ICONMAXSIZE+1, 2, 24, pixels, NULL, 0, false, &size);
+    CHECK(!decodeBitmapImage(data, size, 0, NULL, &image));
+    delete[] data;
+}
+
+static void testDisabled()
+{
+    unsigned int pixels[3];
+    
+    // Greyed by luma, alpha halved for icons (straight alpha, so color is not scaled with it)
+    
+    pixels[0] = 0xFFFFFFFF;
+    pixels[1] = 0xFF000000;
+    pixels[2] = 0x80FF0000;
+    makeDisabledIconImage(pixels, 3, false);
+    CHECK(pixels[0] == 0x7FFFFFFF && pixels[1] == 0x7F000000 && pixels[2] == 0x404C4C4C);
+    
+    pixels[0] = 0xFF00FF00;
+    makeDisabledIconImage(pixels, 1, true);
+    CHECK(pixels[0] == 0xFF959595);
+}
@@ -0,0 +1,111 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// .dat file tests - format detection of each historical format, round trip of current format, and rejection
+// of damaged or oversized files (read as the plugin and DatTool read them, with one byte extra)
+
+#include "DatFile.h"
+#include "TestCheck.h"
+
+// Local functions
+
+static size_t makeDat(unsigned char *data, const unsigned int *values, int count);
+static void testFormats();
+static void testRoundTrip();
+static void testRejected();
+
+int main()
+{
+    testFormats();
+    testRoundTrip();
+    testRejected();
+    
+    return testResult("test_datfile");
+}
+
+static size_t makeDat(unsigned char *data, const unsigned int *values, int count)
+{
+    int i;
+    
+    for (i = 0; i < count; i++)
+    {
+        data[i*4] = (unsigned char) values[i];
+        data[i*4+1] = (unsigned char) (values[i] >> 8);
+        data[i*4+2] = (unsigned char) (values[i] >> 16);
+        data[i*4+3] = (unsigned char) (values[i] >> 24);
+    }
+    
+    return (size_t) count*4;
+}
+
+static void testFormats()
+{
+    static const unsigned int v12[] = { 2, 1, 41001, 41002, 41003 };
+    static const unsigned int v20[] = { 2, 1, 41001, 41002, 41003, 1 };
+    static const unsigned int v30[] = { 1, 0, 1, 2, 41001, 41002, 0x89ABCDEF };
+    static const unsigned int v310[] = { 1, 0xFFFFFFFF, 1, 1, 41001, 41002, 1, 0, 1 };
+    unsigned char data[DATMAXSIZE+1];
+    DATLAYOUT layout;
+    
+    CHECK(parseDatLayout(data, makeDat(data, v12, 5), &layout) == DATFORMAT_V12);
+    CHECK(layout.buttonsOnToolbar == 2 && layout.buttonsAvailable == 1 && layout.toolbar[1] == 41002 && layout.available[0] == 41003);
+    
+    CHECK(parseDatLayout(data, makeDat(data, v20, 6), &layout) == DATFORMAT_V20);
+    CHECK(layout.wrapToolbarState == 1);
+    
+    CHECK(parseDatLayout(data, makeDat(data, v30, 7), &layout) == DATFORMAT_V30);
+    CHECK(layout.customButtonsState == 1 && layout.available[1] == 0x89ABCDEF);
+    
+    CHECK(parseDatLayout(data, makeDat(data, v310, 9), &layout) == DATFORMAT_V310);
+    CHECK(layout.wrapToolbarState == -1 && layout.marginStates[0] == 1 && layout.marginStates[2] == 1);
+}
+
+static void testRoundTrip()
+{
+    unsigned char data[DATMAXSIZE+1];
+    DATLAYOUT layout, parsed;
+    size_t size;
+    int i;
+    
+    // Largest layout fits exactly
+    
+    memset(&layout, 0, sizeof(layout));
+    layout.customButtonsState = 1;
+    layout.buttonsOnToolbar = DATMAXBUTTONS;
+    layout.buttonsAvailable = DATMAXBUTTONS;
+    for (i = 0; i < DATMAXBUTTONS; i++)
+    {
+        layout.toolbar[i] = 40000 + i;
+        layout.available[i] = 0x80000000u + i;
+    }
+    
+    size = formatDatLayout(&layout, data);
+    CHECK(size <= DATMAXSIZE);
+    CHECK(parseDatLayout(data, size, &parsed) == DATFORMAT_V30);
+    CHECK(memcmp(parsed.toolbar, layout.toolbar, sizeof(layout.toolbar)) == 0);
+    CHECK(memcmp(parsed.available, layout.available, sizeof(layout.available)) == 0);
+}
+
+static void testRejected()
+{
+    static const unsigned int badCount[] = { 1, 0, 3, 0, 41001, 41002 };
+    static const unsigned int badState[] = { 1, 0, 1, 0, 41001, 7, 0, 0 };
+    unsigned char data[DATMAXSIZE+4] = {0};
+    DATLAYOUT layout;
+    size_t size;
+    
+    CHECK(parseDatLayout(data, 0, &layout) == DATFORMAT_UNKNOWN);
+    CHECK(parseDatLayout(data, makeDat(data, badCount, 6), &layout) == DATFORMAT_UNKNOWN);
+    CHECK(parseDatLayout(data, makeDat(data, badState, 8), &layout) == DATFORMAT_UNKNOWN);
+    CHECK(layout.buttonsOnToolbar == 0 && layout.buttonsAvailable == 0);
+    
+    size = makeDat(data, badCount, 6);
+    CHECK(parseDatLayout(data, size-1, &layout) == DATFORMAT_UNKNOWN);  /* truncated */
+    
+    // Oversized - a valid layout followed by more data than any .dat file holds is not taken as its prefix
+    
+    memset(data, 0, sizeof(data));
+    CHECK(parseDatLayout(data, DATMAXSIZE+1, &layout) == DATFORMAT_UNKNOWN);
+    CHECK(parseDatLayout(data, DATMAXSIZE+4, &layout) == DATFORMAT_UNKNOWN);
+}
@@ -0,0 +1,136 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Handle table tests - handles are stood in for by distinct addresses. A long session of icon set switches (each
+// creating images for the new set and releasing those of the old one) must not leave any handle live
+
+#include "HandleTable.h"
+#include "TestCheck.h"
+
+static HANDLETABLE table;
+static char handles[2*TRACKEDMAX];  /* address of each element is a distinct handle */
+
+// Local functions
+
+static void reset();
+static void testAddRemove();
+static void testFull();
+static void testIconSetSwitches();
+
+int main()
+{
+    testAddRemove();
+    testFull();
+    testIconSetSwitches();
+    
+    return testResult("test_handletable");
+}
+
+static void reset()
+{
+    memset(&table, 0, sizeof(table));
+}
+
+static void testAddRemove()
+{
+    void *handle;
+    int live;
+    
+    reset();
+    
+    CHECK(addTrackedHandle(&table, &handles[0], HANDLEKIND_BITMAP));
+    CHECK(addTrackedHandle(&table, &handles[1], HANDLEKIND_ICON));
+    CHECK(addTrackedHandle(&table, &handles[2], HANDLEKIND_BITMAP));
+    CHECK(table.live[HANDLEKIND_BITMAP] == 2 && table.live[HANDLEKIND_ICON] == 1 && table.created == 3);
+    
+    // Removed with kind it was added as (so caller frees it correctly) - not freed twice, and unknown handles
+    // (not owned by plugin) are left alone
+    
+    CHECK(removeTrackedHandle(&table, &handles[1]) == HANDLEKIND_ICON);
+    CHECK(removeTrackedHandle(&table, &handles[1]) == -1);
+    CHECK(removeTrackedHandle(&table, &handles[9]) == -1);
+    CHECK(table.count == 2 && table.live[HANDLEKIND_ICON] == 0 && table.freed == 1);
+    
+    // Peak kept after handles freed
+    
+    CHECK(removeTrackedHandle(&table, &handles[0]) == HANDLEKIND_BITMAP);
+    CHECK(table.live[HANDLEKIND_BITMAP] == 1 && table.peak[HANDLEKIND_BITMAP] == 2 && table.peak[HANDLEKIND_ICON] == 1);
+    
+    // Remaining handles released at unload
+    
+    CHECK(addTrackedHandle(&table, &handles[3], HANDLEKIND_ICON));
+    CHECK(popTrackedHandle(&table, &handle) == HANDLEKIND_ICON && handle == &handles[3]);
+    CHECK(popTrackedHandle(&table, &handle) == HANDLEKIND_BITMAP && handle == &handles[2]);
+    CHECK(popTrackedHandle(&table, &handle) == -1);
+    
+    live = table.live[HANDLEKIND_BITMAP] + table.live[HANDLEKIND_ICON];
+    CHECK(live == 0 && table.created == table.freed);
+}
+
+static void testFull()
+{
+    void *handle;
+    int i, added;
+    
+    reset();
+    
+    // Handles beyond table are counted as untracked (not freed by plugin), table is unchanged
+    
+    added = 0;
+    for (i = 0; i < TRACKEDMAX+5; i++) if (addTrackedHandle(&table, &handles[i], i % HANDLEKINDS)) added++;
+    
+    CHECK(added == TRACKEDMAX && table.count == TRACKEDMAX && table.untracked == 5);
+    CHECK(removeTrackedHandle(&table, &handles[TRACKEDMAX]) == -1);
+    
+    // Room made for another
+    
+    CHECK(removeTrackedHandle(&table, &handles[0]) == HANDLEKIND_BITMAP);
+    CHECK(addTrackedHandle(&table, &handles[TRACKEDMAX], HANDLEKIND_BITMAP));
+    
+    while (popTrackedHandle(&table, &handle) >= 0);
+    CHECK(table.count == 0 && table.live[HANDLEKIND_BITMAP] == 0 && table.live[HANDLEKIND_ICON] == 0);
+}
+
+static void testIconSetSwitches()
+{
+    int switches, i, set, first, peak;
+    bool removed;
+    
+    reset();
+    
+    // 27 additional buttons and 100 custom buttons, each icon set switch creating a bitmap, icon and dark icon
+    // for each, and a temporary bitmap released as soon as each icon is created
+    
+    for (switches = 0; switches < 1000; switches++)
+    {
+        set = switches % 2;
+        first = set*(TRACKEDMAX/2);
+        
+        for (i = 0; i < 127*3; i++)
+        {
+            addTrackedHandle(&table, &handles[first+i], (i % 3 == 0) ? HANDLEKIND_BITMAP : HANDLEKIND_ICON);
+            if (i % 3 != 0)
+            {
+                addTrackedHandle(&table, &handles[first+TRACKEDMAX/2-1], HANDLEKIND_BITMAP);
+                removeTrackedHandle(&table, &handles[first+TRACKEDMAX/2-1]);
+            }
+        }
+        
+        // Images of previous set released once new set shown
+        
+        if (switches > 0)
+        {
+            removed = true;
+            first = (1-set)*(TRACKEDMAX/2);
+            for (i = 0; i < 127*3; i++) if (removeTrackedHandle(&table, &handles[first+i]) < 0) removed = false;
+            CHECK(removed);
+        }
+    }
+    
+    peak = table.peak[HANDLEKIND_BITMAP] + table.peak[HANDLEKIND_ICON];
+    printf("1000 icon set switches: %i handles live, %i peak, %i created, %i untracked\n", table.count, peak, table.created, table.untracked);
+    
+    CHECK(table.count == 127*3 && table.live[HANDLEKIND_BITMAP] == 127 && table.live[HANDLEKIND_ICON] == 2*127);
+    CHECK(peak <= 2*127*3+1 && table.untracked == 0);
+}
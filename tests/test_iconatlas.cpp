@@ -0,0 +1,228 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Icon atlas tests - entries written and read back, and atlas files which must not be recognised (other stamp,
+// truncated, corrupt entry headers) - a warm startup of 100 custom buttons (3 images each) is timed. Also the
+// content hash and comparison by which images share one handle
+
+#include "IconImage.h"
+#include "TestCheck.h"
+#include <wchar.h>
+
+#define STAMP 0x12345678
+
+// Local functions
+
+static int makeEntries(ICONATLASENTRY *entries, int count, unsigned int *pixels);
+static void testRoundTrip();
+static void testRejected();
+static void testFind();
+static void testSameImage();
+
+int main()
+{
+    testRoundTrip();
+    testRejected();
+    testFind();
+    testSameImage();
+    
+    return testResult("test_iconatlas");
+}
+
+//
+// Entries of 16x16 bitmaps and 32x32 icons with distinct pixels - returns pixels used
+//
+static int makeEntries(ICONATLASENTRY *entries, int count, unsigned int *pixels)
+{
+    wchar_t fileName[64];
+    int i, j, size, used;
+    
+    used = 0;
+    for (i = 0; i < count; i++)
+    {
+        size = (i % 3 == 0) ? 16 : 32;
+        swprintf(fileName, 64, L"C:\\Icons\\Button%i%ls", i/3, (i % 3 == 0) ? L".bmp" : (i % 3 == 1) ? L".ico" : L"_dark.ico");
+        
+        entries[i].keyHash = calcIconKeyHash(fileName);
+        entries[i].type = (i % 3 == 0) ? ICONTYPE_BITMAP : ICONTYPE_ICON;
+        entries[i].fileTime = 0x01D9000000000000ull + (unsigned long long) i*10000000;
+        entries[i].fileSize = 822 + (unsigned long long) i;
+        entries[i].image.width = size;
+        entries[i].image.height = size;
+        entries[i].image.pixels = pixels+used;
+        
+        for (j = 0; j < size*size; j++) pixels[used+j] = 0xFF000000u | (unsigned int) (i*7919 + j);
+        used += size*size;
+    }
+    
+    return used;
+}
+
+static void testRoundTrip()
+{
+    static ICONATLASENTRY entries[ICONATLASMAX], parsed[ICONATLASMAX];
+    static unsigned int pixels[ICONATLASMAX*32*32];
+    std::chrono::steady_clock::time_point start;
+    unsigned char *data;
+    size_t size;
+    int i, count, found;
+    bool same;
+    
+    makeEntries(entries, ICONATLASMAX, pixels);
+    
+    size = iconAtlasSize(entries, ICONATLASMAX);
+    data = new unsigned char[size];
+    CHECK(formatIconAtlas(entries, ICONATLASMAX, STAMP, data) == size);
+    
+    // Warm startup - atlas parsed, and each image found by file name, time and size
+    
+    start = std::chrono::steady_clock::now();
+    count = parseIconAtlas(data, size, STAMP, parsed, ICONATLASMAX);
+    found = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (findIconAtlasEntry(parsed, count, entries[i].keyHash, entries[i].type, entries[i].fileTime, entries[i].fileSize) == i) found++;
+    }
+    printf("warm startup: %i images (%.0f KB atlas) found in %.3f ms\n", found, size/1024.0, elapsedMilliseconds(start));
+    
+    CHECK(count == ICONATLASMAX && found == ICONATLASMAX);
+    
+    same = true;
+    for (i = 0; i < count; i++)
+    {
+        if (parsed[i].keyHash != entries[i].keyHash || parsed[i].type != entries[i].type || parsed[i].fileTime != entries[i].fileTime ||
+            parsed[i].fileSize != entries[i].fileSize || parsed[i].image.width != entries[i].image.width || parsed[i].image.height != entries[i].image.height ||
+            memcmp(parsed[i].image.pixels, entries[i].image.pixels, (size_t) entries[i].image.width*entries[i].image.height*4) != 0) same = false;
+        if (((size_t) parsed[i].image.pixels & 3) != 0) same = false;  /* pixels aligned within atlas */
+    }
+    CHECK(same);
+    
+    // Empty atlas
+    
+    size = iconAtlasSize(entries, 0);
+    CHECK(formatIconAtlas(entries, 0, STAMP, data) == size);
+    CHECK(parseIconAtlas(data, size, STAMP, parsed, ICONATLASMAX) == 0);
+    
+    delete[] data;
+}
+
+static void testRejected()
+{
+    static ICONATLASENTRY entries[6], parsed[6];
+    static unsigned int pixels[6*32*32];
+    unsigned char *data, *copy;
+    size_t size, length;
+    int rejected;
+    
+    makeEntries(entries, 6, pixels);
+    
+    size = iconAtlasSize(entries, 6);
+    data = new unsigned char[size];
+    copy = new unsigned char[size];
+    formatIconAtlas(entries, 6, STAMP, data);
+    
+    CHECK(parseIconAtlas(data, size, STAMP, parsed, 6) == 6);
+    
+    // System colors or icon size changed since atlas written
+    
+    CHECK(parseIconAtlas(data, size, STAMP+1, parsed, 6) == 0);
+    
+    // More entries than caller holds
+    
+    CHECK(parseIconAtlas(data, size, STAMP, parsed, 5) == 0);
+    
+    // Truncated at every length - never recognised (so never read past end)
+    
+    rejected = 0;
+    for (length = 0; length < size; length++)
+    {
+        memcpy(copy, data, length);
+        if (parseIconAtlas(copy, length, STAMP, parsed, 6) == 0) rejected++;
+    }
+    CHECK(rejected == (int) size);
+    
+    // Corrupt signature, and entry dimensions zero or over ICONMAXSIZE
+    
+    memcpy(copy, data, size);
+    copy[0] ^= 1;
+    CHECK(parseIconAtlas(copy, size, STAMP, parsed, 6) == 0);
+    
+    memcpy(copy, data, size);
+    memset(copy+16+24, 0, 4);  /* width of first entry */
+    CHECK(parseIconAtlas(copy, size, STAMP, parsed, 6) == 0);
+    
+    memcpy(copy, data, size);
+    copy[16+28] = (unsigned char) ((ICONMAXSIZE+1) & 0xFF);  /* height of first entry */
+    copy[16+29] = (unsigned char) ((ICONMAXSIZE+1) >> 8);
+    CHECK(parseIconAtlas(copy, size, STAMP, parsed, 6) == 0);
+    
+    memcpy(copy, data, size);
+    copy[16+24] = 0xFF;  /* width of first entry - pixels beyond end of file */
+    copy[16+25] = 0xFF;
+    copy[16+26] = 0xFF;
+    copy[16+27] = 0x7F;
+    CHECK(parseIconAtlas(copy, size, STAMP, parsed, 6) == 0);
+    
+    delete[] copy;
+    delete[] data;
+}
+
+static void testFind()
+{
+    static ICONATLASENTRY entries[6];
+    static unsigned int pixels[6*32*32];
+    
+    makeEntries(entries, 6, pixels);
+    
+    // File name matches in any case
+    
+    CHECK(calcIconKeyHash(L"C:\\Icons\\Button1.ico") == calcIconKeyHash(L"c:\\icons\\BUTTON1.ICO"));
+    CHECK(calcIconKeyHash(L"C:\\Icons\\Button1.ico") != calcIconKeyHash(L"C:\\Icons\\Button2.ico"));
+    
+    // Image decoded again if file changed since (time or size), or other type of image from same file
+    
+    CHECK(findIconAtlasEntry(entries, 6, entries[4].keyHash, entries[4].type, entries[4].fileTime, entries[4].fileSize) == 4);
+    CHECK(findIconAtlasEntry(entries, 6, entries[4].keyHash, entries[4].type, entries[4].fileTime+1, entries[4].fileSize) == -1);
+    CHECK(findIconAtlasEntry(entries, 6, entries[4].keyHash, entries[4].type, entries[4].fileTime, entries[4].fileSize+1) == -1);
+    CHECK(findIconAtlasEntry(entries, 6, entries[4].keyHash, ICONTYPE_BITMAP, entries[4].fileTime, entries[4].fileSize) == -1);
+    CHECK(findIconAtlasEntry(entries, 0, entries[0].keyHash, entries[0].type, entries[0].fileTime, entries[0].fileSize) == -1);
+}
+
+static void testSameImage()
+{
+    static const unsigned int pixels[16] = { 0xFF102030, 0xFF405060, 0x80708090, 0, 0xFF102030, 0xFF405060, 0x80708090, 0,
+                                             0xFF102030, 0xFF405060, 0x80708090, 0, 0xFF102030, 0xFF405060, 0x80708090, 0 };
+    static const unsigned int collision[2][2] = { { 0x1F6811C6, 0xFF000000 }, { 0xA06811C7, 0x6A0002CF } };  /* same FNV-1a hash */
+    unsigned int changed[16];
+    ICONIMAGE image, other;
+    
+    image.width = image.height = 4;
+    image.pixels = pixels;
+    
+    // Identical contents (other buffer)
+    
+    memcpy(changed, pixels, sizeof(changed));
+    other = image;
+    other.pixels = changed;
+    CHECK(sameIconImage(&image, &other) && calcIconContentHash(&image) == calcIconContentHash(&other));
+    
+    // One pixel changed, and same pixels at other size
+    
+    changed[9] ^= 0x01000000;
+    CHECK(!sameIconImage(&image, &other) && calcIconContentHash(&image) != calcIconContentHash(&other));
+    
+    other.width = 2;
+    other.height = 8;
+    other.pixels = pixels;
+    CHECK(!sameIconImage(&image, &other) && calcIconContentHash(&image) != calcIconContentHash(&other));
+    
+    // Different images with same hash - not shared
+    
+    image.width = other.width = 2;
+    image.height = other.height = 1;
+    image.pixels = collision[0];
+    other.pixels = collision[1];
+    CHECK(calcIconContentHash(&image) == calcIconContentHash(&other));
+    CHECK(!sameIconImage(&image, &other));
+}
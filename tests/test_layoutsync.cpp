@@ -0,0 +1,289 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Layout delta and shared channel tests - instances of Notepad++ are stood in for by threads, the shared memory by
+// an ordinary SYNCCHANNEL, and the named mutex by std::mutex (each instance copies changes under the mutex and
+// applies them after releasing it, as the plugin does)
+
+#include "LayoutSync.h"
+#include "TestCheck.h"
+#include <mutex>
+#include <random>
+#include <thread>
+
+typedef struct
+{
+    LAYOUTID layout[LAYOUTMAXBUTTONS];
+    int count;
+    SYNCPOSITION position;
+} INSTANCE;
+
+static SYNCCHANNEL channel;
+static std::mutex channelMutex;
+
+// Local functions
+
+static int makeLayout(std::mt19937 &random, LAYOUTID layout[]);
+static bool applyDeltas(LAYOUTID layout[], int *count, const JOURNALDELTA deltas[], int deltaCount);
+static void attachInstance(INSTANCE *instance, std::mt19937 &random);
+static void editInstance(INSTANCE *instance, const LAYOUTID layout[], int count);
+static int syncInstance(INSTANCE *instance);
+static bool sameLayout(const INSTANCE *instance, const LAYOUTID layout[], int count);
+static void testDeltas();
+static void testIncremental();
+static void testConflict();
+static void testConcurrent();
+
+int main()
+{
+    testDeltas();
+    testIncremental();
+    testConflict();
+    testConcurrent();
+    
+    return testResult("test_layoutsync");
+}
+
+//
+// Random layout of distinct buttons (and separators, identity 0, which can occur many times)
+//
+static int makeLayout(std::mt19937 &random, LAYOUTID layout[])
+{
+    bool used[80] = { false };
+    LAYOUTID identity;
+    int i, count;
+    
+    count = (int) (random() % 60);
+    for (i = 0; i < count; i++)
+    {
+        do identity = random() % 80; while (identity != 0 && used[identity]);
+        used[identity] = true;
+        
+        if (identity == 0) layout[i] = 0;  /* separator */
+        else if (identity < 60) layout[i] = 41000 + identity;  /* built-in command */
+        else layout[i] = 0x80000000u | identity;  /* plugin command (menuhash) */
+    }
+    
+    return count;
+}
+
+static bool applyDeltas(LAYOUTID layout[], int *count, const JOURNALDELTA deltas[], int deltaCount)
+{
+    int i;
+    
+    for (i = 0; i < deltaCount; i++)
+    {
+        if (!applyLayoutDelta(layout, count, DELTAOP(deltas[i]), deltas[i].index, DELTATOINDEX(deltas[i]), deltas[i].identity)) return false;
+    }
+    
+    return true;
+}
+
+static void attachInstance(INSTANCE *instance, std::mt19937 &random)
+{
+    std::lock_guard<std::mutex> lock(channelMutex);
+    
+    instance->count = makeLayout(random, instance->layout);
+    attachSyncChannel(&channel, &instance->position, instance->layout, instance->count, 0, 0);
+}
+
+static void editInstance(INSTANCE *instance, const LAYOUTID layout[], int count)
+{
+    JOURNALDELTA deltas[2*LAYOUTMAXBUTTONS];
+    int deltaCount;
+    
+    deltaCount = calcLayoutDeltas(instance->layout, instance->count, layout, count, deltas);
+    
+    memcpy(instance->layout, layout, count*sizeof(LAYOUTID));
+    instance->count = count;
+    
+    std::lock_guard<std::mutex> lock(channelMutex);
+    publishSyncChange(&channel, &instance->position, deltas, deltaCount, instance->layout, instance->count, 0, 0);
+}
+
+//
+// Returns deltas applied, or -1 if full layout was applied
+//
+static int syncInstance(INSTANCE *instance)
+{
+    static thread_local SYNCCHANGE change;
+    LAYOUTID layout[LAYOUTMAXBUTTONS];
+    int count;
+    bool published;
+    
+    channelMutex.lock();
+    published = readSyncChange(&channel, &instance->position, &change);
+    channelMutex.unlock();
+    
+    if (!published) return 0;
+    
+    instance->position = change.position;
+    
+    memcpy(layout, instance->layout, instance->count*sizeof(LAYOUTID));
+    count = instance->count;
+    
+    if (change.deltaCount >= 0 && applyDeltas(layout, &count, change.deltas, change.deltaCount))
+    {
+        memcpy(instance->layout, layout, count*sizeof(LAYOUTID));
+        instance->count = count;
+        return change.deltaCount;
+    }
+    
+    memcpy(instance->layout, change.layout, change.layoutCount*sizeof(LAYOUTID));
+    instance->count = change.layoutCount;
+    return -1;
+}
+
+static bool sameLayout(const INSTANCE *instance, const LAYOUTID layout[], int count)
+{
+    return instance->count == count && memcmp(instance->layout, layout, count*sizeof(LAYOUTID)) == 0;
+}
+
+static void testDeltas()
+{
+    std::mt19937 random(1);
+    LAYOUTID oldLayout[LAYOUTMAXBUTTONS], newLayout[LAYOUTMAXBUTTONS], layout[LAYOUTMAXBUTTONS];
+    JOURNALDELTA deltas[2*LAYOUTMAXBUTTONS];
+    int i, oldCount, newCount, count, deltaCount, failed;
+    
+    // Deltas change any layout into any other layout
+    
+    failed = 0;
+    for (i = 0; i < 2000; i++)
+    {
+        oldCount = makeLayout(random, oldLayout);
+        newCount = makeLayout(random, newLayout);
+        
+        deltaCount = calcLayoutDeltas(oldLayout, oldCount, newLayout, newCount, deltas);
+        
+        memcpy(layout, oldLayout, oldCount*sizeof(LAYOUTID));
+        count = oldCount;
+        if (deltaCount > oldCount+newCount || !applyDeltas(layout, &count, deltas, deltaCount) ||
+            count != newCount || memcmp(layout, newLayout, count*sizeof(LAYOUTID)) != 0) failed++;
+        if (deltaCount > 0 && !DELTAGROUPEND(deltas[deltaCount-1])) failed++;
+    }
+    CHECK(failed == 0);
+    
+    // Delta that does not fit layout is rejected (layout unchanged)
+    
+    layout[0] = 41001;
+    layout[1] = 41002;
+    count = 2;
+    CHECK(!applyLayoutDelta(layout, &count, JOURNALOP_DELETE, 0, 0, 41002));
+    CHECK(!applyLayoutDelta(layout, &count, JOURNALOP_MOVE, 1, 2, 41002));
+    CHECK(!applyLayoutDelta(layout, &count, JOURNALOP_INSERT, 3, 0, 41003));
+    CHECK(count == 2 && layout[0] == 41001 && layout[1] == 41002);
+    
+    CHECK(applyLayoutDelta(layout, &count, JOURNALOP_MOVE, 1, 0, 41002));
+    CHECK(count == 2 && layout[0] == 41002 && layout[1] == 41001);
+}
+
+static void testIncremental()
+{
+    std::mt19937 random(2);
+    INSTANCE a, b;
+    LAYOUTID layout[LAYOUTMAXBUTTONS];
+    JOURNALDELTA deltas[2*LAYOUTMAXBUTTONS];
+    int i, count, deltaCount;
+    
+    memset(&channel, 0, sizeof(channel));
+    attachInstance(&a, random);
+    attachInstance(&b, random);
+    
+    // Later instance takes full layout of channel
+    
+    CHECK(syncInstance(&b) == -1);
+    CHECK(sameLayout(&b, a.layout, a.count));
+    CHECK(syncInstance(&a) == 0);
+    
+    // Few changes - applied as deltas
+    
+    for (i = 0; i < 3; i++)
+    {
+        count = makeLayout(random, layout);
+        editInstance(&a, layout, count);
+    }
+    CHECK(syncInstance(&b) > 0);
+    CHECK(sameLayout(&b, a.layout, a.count));
+    CHECK(syncInstance(&a) == 0);  /* own changes not read back */
+    
+    // More deltas than ring holds - full layout applied
+    
+    for (deltaCount = 0; deltaCount <= SYNCMAXDELTAS; )
+    {
+        count = makeLayout(random, layout);
+        deltaCount += calcLayoutDeltas(a.layout, a.count, layout, count, deltas);
+        editInstance(&a, layout, count);
+    }
+    CHECK(syncInstance(&b) == -1);
+    CHECK(sameLayout(&b, a.layout, a.count));
+}
+
+static void testConflict()
+{
+    std::mt19937 random(3);
+    INSTANCE a, b;
+    LAYOUTID layout[LAYOUTMAXBUTTONS];
+    int count;
+    
+    memset(&channel, 0, sizeof(channel));
+    attachInstance(&a, random);
+    attachInstance(&b, random);
+    syncInstance(&b);
+    
+    // Both change layout before reading other's change - last change published wins, and no instance applies
+    // deltas of the other across it
+    
+    count = makeLayout(random, layout);
+    editInstance(&a, layout, count);
+    
+    count = makeLayout(random, layout);
+    editInstance(&b, layout, count);
+    
+    CHECK(syncInstance(&a) == -1);
+    CHECK(sameLayout(&a, layout, count));
+    CHECK(syncInstance(&b) == 0);
+    CHECK(sameLayout(&b, layout, count));
+}
+
+static void testConcurrent()
+{
+    INSTANCE instances[4];
+    std::thread threads[4];
+    int i;
+    
+    memset(&channel, 0, sizeof(channel));
+    
+    // Each instance changes its layout and reads changes of others, concurrently - when all have stopped and read
+    // last changes, every instance has layout of channel
+    
+    for (i = 0; i < 4; i++)
+    {
+        threads[i] = std::thread([&instances, i]()
+        {
+            std::mt19937 random(10+i);
+            LAYOUTID layout[LAYOUTMAXBUTTONS];
+            int round, count;
+            
+            attachInstance(&instances[i], random);
+            for (round = 0; round < 300; round++)
+            {
+                syncInstance(&instances[i]);
+                if (random() % 3 == 0)
+                {
+                    count = makeLayout(random, layout);
+                    editInstance(&instances[i], layout, count);
+                }
+            }
+        });
+    }
+    
+    for (i = 0; i < 4; i++) threads[i].join();
+    
+    for (i = 0; i < 4; i++)
+    {
+        syncInstance(&instances[i]);
+        CHECK(sameLayout(&instances[i], channel.layout, channel.layoutCount));
+    }
+}
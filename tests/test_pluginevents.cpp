@@ -0,0 +1,202 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Plugin event sequencing tests - Notepad++ notifications are simulated in various orders, and handlers that stand in
+// for those of the plugin (see sequence of events in CustomizeToolbar.cpp) record each pass they run
+//
+// State readers are simulated as customize dialog box and overflow menu modal loops, dispatching UI events and
+// layout changes of other instances while open
+
+#include "PluginEvents.h"
+#include "TestCheck.h"
+#include <string>
+
+static LIFECYCLE lifecycle;
+static std::string passes;  /* passes run, in order */
+static int uiEventsHandled, uiEventsCovered;
+
+// Local functions
+
+static void reset();
+static void setInfo();
+static void toolbarModification();
+static void nppReady();
+static void startupReady();
+static void uiEvent();
+static void nppShutdown();
+static void testStartup();
+static void testRepeated();
+static void testOutOfOrder();
+static void testEarlyShutdown();
+static void testStateReaders();
+
+int main()
+{
+    testStartup();
+    testRepeated();
+    testOutOfOrder();
+    testEarlyShutdown();
+    testStateReaders();
+    
+    return testResult("test_pluginevents");
+}
+
+static void reset()
+{
+    lifecycle.stage = LIFECYCLE_LOADED;
+    lifecycle.rejected = 0;
+    passes.clear();
+    uiEventsHandled = uiEventsCovered = 0;
+}
+
+static void setInfo()
+{
+    if (!advanceLifecycle(&lifecycle, LIFECYCLE_MENUS)) return;
+    passes += "menus ";
+}
+
+static void toolbarModification()
+{
+    if (!advanceLifecycle(&lifecycle, LIFECYCLE_TOOLBAR)) return;
+    passes += "buttons ";
+}
+
+static void nppReady()
+{
+    if (!advanceLifecycle(&lifecycle, LIFECYCLE_READY)) return;
+    passes += "subclass ";
+}
+
+static void startupReady()
+{
+    if (lifecycle.stage != LIFECYCLE_READY) return;  /* readiness timer only runs while ready */
+    
+    passes += "preserve restore states wrap ";
+    advanceLifecycle(&lifecycle, LIFECYCLE_STARTED);
+}
+
+static void uiEvent()
+{
+    // Events before startup completed are covered by startup pass
+    
+    if (lifecycle.stage != LIFECYCLE_STARTED) uiEventsCovered++;
+    else uiEventsHandled++;
+}
+
+static void nppShutdown()
+{
+    bool started;
+    
+    started = (lifecycle.stage == LIFECYCLE_STARTED);
+    if (!advanceLifecycle(&lifecycle, LIFECYCLE_SHUTDOWN)) return;
+    
+    passes += started ? "save " : "nosave ";
+}
+
+static void testStartup()
+{
+    reset();
+    
+    setInfo();
+    toolbarModification();
+    uiEvent();  /* toolbar resized while buttons added */
+    nppReady();
+    uiEvent();
+    startupReady();
+    uiEvent();
+    nppShutdown();
+    
+    CHECK(passes == "menus buttons subclass preserve restore states wrap save ");
+    CHECK(lifecycle.stage == LIFECYCLE_SHUTDOWN && lifecycle.rejected == 0);
+    CHECK(uiEventsCovered == 2 && uiEventsHandled == 1);
+}
+
+static void testRepeated()
+{
+    reset();
+    
+    // Toolbar reset sends NPPN_TBMODIFICATION again - buttons are added once only, and startup pass runs once
+    
+    setInfo();
+    toolbarModification();
+    toolbarModification();
+    nppReady();
+    startupReady();
+    toolbarModification();
+    nppReady();
+    startupReady();
+    nppShutdown();
+    nppShutdown();
+    
+    CHECK(passes == "menus buttons subclass preserve restore states wrap save ");
+    CHECK(lifecycle.rejected == 4);
+}
+
+static void testOutOfOrder()
+{
+    reset();
+    
+    // NPPN_READY before NPPN_TBMODIFICATION is ignored (window would be subclassed before buttons exist)
+    
+    setInfo();
+    nppReady();
+    startupReady();
+    toolbarModification();
+    nppReady();
+    startupReady();
+    
+    CHECK(passes == "menus buttons subclass preserve restore states wrap ");
+    CHECK(lifecycle.stage == LIFECYCLE_STARTED && lifecycle.rejected == 1);
+}
+
+static void testEarlyShutdown()
+{
+    reset();
+    
+    // Closed before startup completed - layout not saved (toolbar not restored), and nothing runs after shutdown
+    
+    setInfo();
+    toolbarModification();
+    nppReady();
+    nppShutdown();
+    startupReady();
+    uiEvent();
+    nppReady();
+    
+    CHECK(passes == "menus buttons subclass nosave ");
+    CHECK(lifecycle.stage == LIFECYCLE_SHUTDOWN && lifecycle.rejected == 1);
+    CHECK(uiEventsHandled == 0);
+}
+
+static void testStateReaders()
+{
+    STATEREADERS readers;
+    
+    memset(&readers, 0, sizeof(readers));
+    
+    // No reader - writes made immediately, and unmatched leave ignored
+    
+    CHECK(!deferStateWrite(&readers, 1));
+    CHECK(leaveStateRead(&readers) == 0 && readers.readers == 0);
+    
+    // Customize dialog box open - changed icons (twice) and layout change of other instance deferred, then overflow
+    // menu opened and closed from within it - writes made once, when dialog box closes
+    
+    enterStateRead(&readers);
+    CHECK(deferStateWrite(&readers, 2));
+    CHECK(deferStateWrite(&readers, 2));
+    enterStateRead(&readers);
+    CHECK(deferStateWrite(&readers, 32));
+    CHECK(leaveStateRead(&readers) == 0);
+    CHECK(deferStateWrite(&readers, 16));
+    CHECK(leaveStateRead(&readers) == (2|16|32));
+    CHECK(readers.writesDeferred == 4);
+    
+    // Writes after last reader finished not deferred, and not returned again
+    
+    CHECK(!deferStateWrite(&readers, 2));
+    enterStateRead(&readers);
+    CHECK(leaveStateRead(&readers) == 0);
+    CHECK(readers.readers == 0 && readers.deferred == 0);
+}
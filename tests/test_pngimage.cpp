@@ -0,0 +1,393 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// PNG decoding tests - every color type and bit depth, plain and interlaced, compared with the pixels expected
+// (data/png-*.bgra), and images that must not be recognised (over ICONMAXSIZE, truncated, corrupt headers or
+// image data). The .png files and expected pixels are written by data/makepng.py (zlib, not this decoder)
+
+#include "PngImage.h"
+#include "TestCheck.h"
+
+typedef struct
+{
+    const char *name;  /* .png file */
+    const char *expected;  /* .bgra file */
+    int width;
+    int height;
+} PNGCASE;
+
+static const PNGCASE cases[] =
+{
+    { "png-grey1.png", "png-grey1.bgra", 13, 11 },
+    { "png-grey1-adam7.png", "png-grey1.bgra", 13, 11 },
+    { "png-grey2.png", "png-grey2.bgra", 13, 11 },
+    { "png-grey2-adam7.png", "png-grey2.bgra", 13, 11 },
+    { "png-grey4.png", "png-grey4.bgra", 13, 11 },
+    { "png-grey4-adam7.png", "png-grey4.bgra", 13, 11 },
+    { "png-grey8.png", "png-grey8.bgra", 13, 11 },  /* tRNS key */
+    { "png-grey8-adam7.png", "png-grey8.bgra", 13, 11 },
+    { "png-grey16.png", "png-grey16.bgra", 13, 11 },  /* tRNS key compared at 16 bits */
+    { "png-grey16-adam7.png", "png-grey16.bgra", 13, 11 },
+    { "png-rgb8.png", "png-rgb8.bgra", 13, 11 },
+    { "png-rgb8-adam7.png", "png-rgb8.bgra", 13, 11 },
+    { "png-rgb16.png", "png-rgb16.bgra", 13, 11 },
+    { "png-rgb16-adam7.png", "png-rgb16.bgra", 13, 11 },
+    { "png-palette1.png", "png-palette1.bgra", 13, 11 },
+    { "png-palette1-adam7.png", "png-palette1.bgra", 13, 11 },
+    { "png-palette2.png", "png-palette2.bgra", 13, 11 },  /* index beyond palette */
+    { "png-palette2-adam7.png", "png-palette2.bgra", 13, 11 },
+    { "png-palette4.png", "png-palette4.bgra", 13, 11 },
+    { "png-palette4-adam7.png", "png-palette4.bgra", 13, 11 },
+    { "png-palette8.png", "png-palette8.bgra", 13, 11 },
+    { "png-palette8-adam7.png", "png-palette8.bgra", 13, 11 },
+    { "png-greyalpha8.png", "png-greyalpha8.bgra", 13, 11 },
+    { "png-greyalpha8-adam7.png", "png-greyalpha8.bgra", 13, 11 },
+    { "png-greyalpha16.png", "png-greyalpha16.bgra", 13, 11 },
+    { "png-greyalpha16-adam7.png", "png-greyalpha16.bgra", 13, 11 },
+    { "png-rgba8.png", "png-rgba8.bgra", 13, 11 },
+    { "png-rgba8-adam7.png", "png-rgba8.bgra", 13, 11 },
+    { "png-rgba16.png", "png-rgba16.bgra", 13, 11 },
+    { "png-rgba16-adam7.png", "png-rgba16.bgra", 13, 11 },
+    { "png-rgba8-1x1-adam7.png", "png-rgba8-1x1.bgra", 1, 1 },  /* interlaced with passes empty */
+    { "png-rgba8-2x3-adam7.png", "png-rgba8-2x3.bgra", 2, 3 },
+    { "png-rgba8-5x1-adam7.png", "png-rgba8-5x1.bgra", 5, 1 }
+};
+
+// Local functions
+
+static bool decodeTestFile(const char *name, unsigned int background, ICONIMAGE *image);
+static size_t findChunk(const unsigned char *data, size_t size, const char *type, size_t *length);
+static void testDecode();
+static void testComposite();
+static void testDimensions();
+static void testTruncated();
+static void testCorruptData();
+static void testCorruptHeaders();
+
+int main()
+{
+    testDecode();
+    testComposite();
+    testDimensions();
+    testTruncated();
+    testCorruptData();
+    testCorruptHeaders();
+    
+    return testResult("test_pngimage");
+}
+
+static bool decodeTestFile(const char *name, unsigned int background, ICONIMAGE *image)
+{
+    unsigned char *data;
+    size_t size;
+    bool ok;
+    
+    data = readTestFile(name, &size);
+    if (!data) return false;
+    
+    ok = decodePngImage(data, size, background, image);
+    delete[] data;
+    
+    return ok;
+}
+
+//
+// Offset of data of first chunk of type (0 if none)
+//
+static size_t findChunk(const unsigned char *data, size_t size, const char *type, size_t *length)
+{
+    size_t offset;
+    
+    *length = 0;
+    
+    for (offset = 8; offset+12 <= size; offset += 12+*length)
+    {
+        *length = ((size_t) data[offset] << 24) | ((size_t) data[offset+1] << 16) | ((size_t) data[offset+2] << 8) | data[offset+3];
+        if (memcmp(data+offset+4, type, 4) == 0) return offset+8;
+    }
+    
+    return 0;
+}
+
+static void testDecode()
+{
+    ICONIMAGE image;
+    unsigned char *expected;
+    size_t expectedSize;
+    int i;
+    bool decoded;
+    
+    for (i = 0; i < (int) (sizeof(cases)/sizeof(cases[0])); i++)
+    {
+        expected = readTestFile(cases[i].expected, &expectedSize);
+        CHECK(expected != NULL && expectedSize == (size_t) cases[i].width*cases[i].height*4);
+        
+        decoded = decodeTestFile(cases[i].name, 0, &image);
+        CHECK(decoded);
+        
+        if (decoded && expected)
+        {
+            if (image.width != cases[i].width || image.height != cases[i].height || memcmp(image.pixels, expected, expectedSize) != 0)
+            {
+                printf("%s: decoded image differs from %s\n", cases[i].name, cases[i].expected);
+                CHECK(false);
+            }
+        }
+        
+        if (decoded) delete[] image.pixels;
+        delete[] expected;
+    }
+}
+
+static void testComposite()
+{
+    ICONIMAGE image;
+    unsigned int *expected, pixel, a, r, g, b, background;
+    size_t size;
+    int i;
+    bool same;
+    
+    // Straight alpha composited on opaque background (bitmap), rounded to nearest
+    
+    background = 0xFF336699;
+    expected = (unsigned int *) readTestFile("png-rgba8.bgra", &size);
+    CHECK(expected != NULL);
+    if (!expected) return;
+    
+    if (!decodeTestFile("png-rgba8-adam7.png", background, &image))
+    {
+        CHECK(false);
+        delete[] (unsigned char *) expected;
+        return;
+    }
+    
+    same = (image.width == 13 && image.height == 11);
+    for (i = 0; same && i < 13*11; i++)
+    {
+        pixel = expected[i];
+        a = pixel >> 24;
+        r = (((pixel >> 16) & 0xFF)*a + 0x33*(255-a) + 127)/255;
+        g = (((pixel >> 8) & 0xFF)*a + 0x66*(255-a) + 127)/255;
+        b = ((pixel & 0xFF)*a + 0x99*(255-a) + 127)/255;
+        if (image.pixels[i] != (0xFF000000 | (r << 16) | (g << 8) | b)) same = false;
+    }
+    CHECK(same);
+    
+    delete[] image.pixels;
+    delete[] (unsigned char *) expected;
+}
+
+static void testDimensions()
+{
+    ICONIMAGE image;
+    
+    // ICONMAXSIZE wide and high recognised, one pixel more in either direction not
+    
+    if (decodeTestFile("png-max256.png", 0, &image))
+    {
+        CHECK(image.width == ICONMAXSIZE && image.height == ICONMAXSIZE);
+        delete[] image.pixels;
+    }
+    else CHECK(false);
+    
+    CHECK(!decodeTestFile("png-wide257.png", 0, &image));
+    CHECK(!decodeTestFile("png-high257.png", 0, &image));
+}
+
+static void testTruncated()
+{
+    static const char *names[] = { "png-grey1.png", "png-grey16.png", "png-grey4.png", "png-rgba8-adam7.png" };  /* dynamic, fixed, stored codes, interlaced */
+    ICONIMAGE image;
+    unsigned char *data, *copy;
+    size_t size, length;
+    int i, rejected;
+    
+    // Truncated at every length - never recognised (copy is exactly length bytes, so reads past end show under a
+    // sanitizer)
+    
+    for (i = 0; i < (int) (sizeof(names)/sizeof(names[0])); i++)
+    {
+        data = readTestFile(names[i], &size);
+        CHECK(data != NULL);
+        if (!data) continue;
+        
+        rejected = 0;
+        for (length = 0; length < size-12; length++)  /* IEND not needed */
+        {
+            copy = new unsigned char[length > 0 ? length : 1];
+            memcpy(copy, data, length);
+            if (!decodePngImage(copy, length, 0, &image)) rejected++;
+            else delete[] image.pixels;
+            delete[] copy;
+        }
+        
+        if (rejected != (int) (size-12)) printf("%s: %i of %i truncated files recognised\n", names[i], (int) (size-12)-rejected, (int) (size-12));
+        CHECK(rejected == (int) (size-12));
+        
+        delete[] data;
+    }
+}
+
+static void testCorruptData()
+{
+    static const char *names[] = { "png-grey1.png", "png-grey16.png", "png-grey4.png" };  /* dynamic, fixed, stored codes */
+    ICONIMAGE image;
+    unsigned char *data;
+    size_t size, offset, length, i;
+    int j, recognised;
+    
+    for (j = 0; j < (int) (sizeof(names)/sizeof(names[0])); j++)
+    {
+        data = readTestFile(names[j], &size);
+        CHECK(data != NULL);
+        if (!data) continue;
+        
+        offset = findChunk(data, size, "IDAT", &length);
+        CHECK(offset > 0 && length > 6);
+        if (offset == 0 || length <= 6)
+        {
+            delete[] data;
+            continue;
+        }
+        
+        // Lowest bit of each byte of image data changed (zlib header, deflate codes, Adler-32) - never recognised. Deflate
+        // reads bits lowest first, so high bits of a stored block header byte or the last byte can be unused padding
+        
+        recognised = 0;
+        for (i = offset; i < offset+length; i++)
+        {
+            data[i] ^= 0x01;
+            if (decodePngImage(data, size, 0, &image))
+            {
+                recognised++;
+                delete[] image.pixels;
+            }
+            data[i] ^= 0x01;
+        }
+        if (recognised) printf("%s: %i of %i corrupt streams recognised\n", names[j], recognised, (int) length);
+        CHECK(recognised == 0);
+        
+        // Unknown compression method, preset dictionary (header check kept valid), and reserved block type
+        
+        data[offset] = 0x77;
+        data[offset+1] = 0x01;
+        data[offset+1] += (unsigned char) (31 - (data[offset]*256+data[offset+1]) % 31);
+        CHECK(!decodePngImage(data, size, 0, &image));
+        
+        data[offset] = 0x78;
+        data[offset+1] = 0x20;
+        data[offset+1] += (unsigned char) (31 - (data[offset]*256+data[offset+1]) % 31);
+        CHECK(!decodePngImage(data, size, 0, &image));
+        
+        data[offset+1] = 0x01;  /* 0x7801 - no dictionary */
+        data[offset+2] |= 0x06;
+        CHECK(!decodePngImage(data, size, 0, &image));
+        
+        delete[] data;
+    }
+    
+    // Unknown filter type
+    
+    CHECK(!decodeTestFile("png-badfilter.png", 0, &image));
+}
+
+static void testCorruptHeaders()
+{
+    static const unsigned char badFormats[][2] =  /* bit depth, color type */
+    {
+        { 3, 0 }, { 32, 0 }, { 4, 2 }, { 16, 3 }, { 1, 4 }, { 4, 6 }, { 8, 1 }, { 8, 5 }, { 8, 7 }
+    };
+    ICONIMAGE image;
+    unsigned char *data, *copy;
+    size_t size, offset, length;
+    int i;
+    
+    data = readTestFile("png-grey8.png", &size);
+    CHECK(data != NULL);
+    if (!data) return;
+    
+    copy = new unsigned char[size];
+    
+    // Signature and IHDR (chunk CRCs are not checked, so fields are changed alone)
+    
+    memcpy(copy, data, size);
+    copy[1] = 'p';
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    memcpy(copy, data, size);
+    copy[11] = 14;  /* IHDR length */
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    for (i = 0; i < (int) (sizeof(badFormats)/sizeof(badFormats[0])); i++)
+    {
+        memcpy(copy, data, size);
+        copy[24] = badFormats[i][0];
+        copy[25] = badFormats[i][1];
+        CHECK(!decodePngImage(copy, size, 0, &image));
+    }
+    
+    memcpy(copy, data, size);
+    copy[26] = 1;  /* compression method */
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    memcpy(copy, data, size);
+    copy[27] = 1;  /* filter method */
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    memcpy(copy, data, size);
+    copy[28] = 2;  /* interlace method */
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    memcpy(copy, data, size);
+    memset(copy+16, 0, 4);  /* width */
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    memcpy(copy, data, size);
+    copy[16] = 0x80;  /* width negative as int */
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    // Image data for fewer or more rows than header has - inflate would overrun rows, or stops short of them
+    
+    memcpy(copy, data, size);
+    copy[23] = 10;
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    memcpy(copy, data, size);
+    copy[23] = 12;
+    CHECK(!decodePngImage(copy, size, 0, &image));
+    
+    // No image data (IDAT renamed), and chunk length past end of file
+    
+    offset = findChunk(data, size, "IDAT", &length);
+    CHECK(offset > 0);
+    if (offset > 0)
+    {
+        memcpy(copy, data, size);
+        copy[offset-4] = 'i';
+        CHECK(!decodePngImage(copy, size, 0, &image));
+        
+        memcpy(copy, data, size);
+        copy[offset-8] = 0x7F;
+        CHECK(!decodePngImage(copy, size, 0, &image));
+    }
+    
+    delete[] copy;
+    delete[] data;
+    
+    // Palette image without palette (PLTE renamed)
+    
+    data = readTestFile("png-palette4.png", &size);
+    CHECK(data != NULL);
+    if (!data) return;
+    
+    offset = findChunk(data, size, "PLTE", &length);
+    CHECK(offset > 0);
+    if (offset > 0)
+    {
+        data[offset-4] = 'p';
+        CHECK(!decodePngImage(data, size, 0, &image));
+    }
+    
+    delete[] data;
+}
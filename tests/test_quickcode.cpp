@@ -0,0 +1,103 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Quick code tests - parsing, and rendering compared with golden images (data/quickcode-*.bgra, BGRA pixels
+// top row first, as ICONIMAGE). After an intended change to the renderer, rewrite the golden images with:
+//
+//   test_quickcode --update
+
+#include "IconImage.h"
+#include "TestCheck.h"
+#include <wchar.h>
+
+typedef struct
+{
+    const char *name;  /* golden image file */
+    const wchar_t *text;  /* quick code */
+    int size;
+    unsigned int background;
+} QUICKCODECASE;
+
+static const QUICKCODECASE cases[] =
+{
+    { "quickcode-bitmap16.bgra", L"*R:LA", 16, 0xFFFFFFFF },  /* bitmap on window color */
+    { "quickcode-icon32.bgra", L"*#4488CC:AB", 32, 0 },  /* icon on transparent background */
+    { "quickcode-icon48.bgra", L"*G:x", 48, 0 },  /* font scaled x3 */
+    { "quickcode-empty16.bgra", L"*S:", 16, 0 },  /* tile only */
+    { "quickcode-unknown24.bgra", L"*#12345:\x00E9~", 24, 0xFF202020 },  /* bad hex color (grey), non-ASCII label ('?') */
+    { "quickcode-icon64.bgra", L"*Y:WWW", 64, 0 }  /* label cut to two characters */
+};
+
+// Local functions
+
+static void testParse();
+static void testRender(bool update);
+
+int main(int argc, char *argv[])
+{
+    testParse();
+    testRender(argc > 1 && strcmp(argv[1], "--update") == 0);
+    
+    return testResult("test_quickcode");
+}
+
+static void testParse()
+{
+    unsigned int color;
+    wchar_t label[QUICKCODEMAXLABEL+1];
+    
+    parseQuickCode(L"*R:LA", &color, label);
+    CHECK(color == 0xB03030 && wcscmp(label, L"LA") == 0);
+    
+    parseQuickCode(L"*#4488cc:A", &color, label);
+    CHECK(color == 0x4488CC && wcscmp(label, L"A") == 0);
+    
+    parseQuickCode(L"*#4488C:AB", &color, label);  /* five digits - not recognised */
+    CHECK(color == 0x808080 && wcscmp(label, L"AB") == 0);
+    
+    parseQuickCode(L"*Q:XYZ", &color, label);  /* unknown letter, label cut */
+    CHECK(color == 0x808080 && wcscmp(label, L"XY") == 0);
+    
+    parseQuickCode(L"*:", &color, label);
+    CHECK(color == 0x808080 && label[0] == 0);
+    
+    parseQuickCode(L"*B", &color, label);  /* no colon - no label */
+    CHECK(color == 0x0050C0 && label[0] == 0);
+}
+
+static void testRender(bool update)
+{
+    unsigned int color, *pixels;
+    unsigned char *golden;
+    wchar_t label[QUICKCODEMAXLABEL+1];
+    size_t goldenSize, size;
+    int i;
+    
+    for (i = 0; i < (int) (sizeof(cases)/sizeof(cases[0])); i++)
+    {
+        size = (size_t) cases[i].size*cases[i].size*4;
+        pixels = new unsigned int[cases[i].size*cases[i].size];
+        
+        parseQuickCode(cases[i].text, &color, label);
+        renderQuickCode(color, label, cases[i].size, cases[i].background, pixels);
+        
+        if (update)
+        {
+            CHECK(writeTestFile(cases[i].name, pixels, size));
+            delete[] pixels;
+            continue;
+        }
+        
+        golden = readTestFile(cases[i].name, &goldenSize);
+        CHECK(golden != NULL && goldenSize == size);
+        if (golden && goldenSize == size && memcmp(golden, pixels, size) != 0)
+        {
+            printf("%s: rendered image differs from golden image\n", cases[i].name);
+            CHECK(false);
+        }
+        
+        delete[] golden;
+        delete[] pixels;
+    }
+}
@@ -0,0 +1,272 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// Resampling tests - constant colors kept, same size exact, no color from transparent pixels, SSE2 passes the same
+// as scalar passes (IconImage.cpp compiled again below with IMAGENOSSE2, in its own namespace) - and largest frame
+// found in .ico directories
+
+#include "IconImage.h"
+#include "TestCheck.h"
+
+#define IMAGENOSSE2
+namespace scalar
+{
+#include "../src/IconImage.cpp"
+}
+
+typedef struct
+{
+    int sourceWidth, sourceHeight;
+    int width, height;
+} RESAMPLECASE;
+
+static const RESAMPLECASE cases[] =
+{
+    { 16, 16, 16, 16 },  /* same size */
+    { 16, 16, 32, 32 },  /* enlarged x2 */
+    { 16, 16, 40, 24 },  /* enlarged by fractions, unequal */
+    { 48, 48, 32, 32 },  /* reduced by fraction */
+    { 128, 128, 24, 24 },  /* reduced by 5.33 */
+    { 256, 256, 16, 16 },  /* largest reduced to bitmap size */
+    { 7, 13, 20, 5 }  /* one axis enlarged, other reduced */
+};
+
+#define CASES (int) (sizeof(cases)/sizeof(cases[0]))
+
+// Local functions
+
+static void testConstant();
+static void testSameSize();
+static void testTransparent();
+static void testScalar();
+static void testLargestFrame();
+static void fillRandom(unsigned int *pixels, int count, unsigned int seed);
+static bool closePixels(unsigned int pixel, unsigned int other);
+static unsigned char *makeDirectory(const int *widths, int count, unsigned int listed, size_t *size);
+
+int main()
+{
+    testConstant();
+    testSameSize();
+    testTransparent();
+    testScalar();
+    testLargestFrame();
+    
+    return testResult("test_resample");
+}
+
+static void testConstant()
+{
+    static const unsigned int colors[] = { 0xFF4080C0, 0x80FF0010, 0x01FFFFFF, 0 };
+    unsigned int *source, *pixels;
+    ICONIMAGE image;
+    int i, j, k, count;
+    bool same;
+    
+    for (i = 0; i < CASES; i++)
+    {
+        for (j = 0; j < (int) (sizeof(colors)/sizeof(colors[0])); j++)
+        {
+            count = cases[i].sourceWidth*cases[i].sourceHeight;
+            source = new unsigned int[count];
+            for (k = 0; k < count; k++) source[k] = colors[j];
+            
+            image.width = cases[i].sourceWidth;
+            image.height = cases[i].sourceHeight;
+            image.pixels = source;
+            
+            pixels = new unsigned int[cases[i].width*cases[i].height];
+            resampleIconImage(&image, cases[i].width, cases[i].height, pixels);
+            
+            same = true;
+            for (k = 0; k < cases[i].width*cases[i].height; k++) if (pixels[k] != colors[j]) same = false;
+            CHECK(same);
+            
+            delete[] source;
+            delete[] pixels;
+        }
+    }
+}
+
+static void testSameSize()
+{
+    unsigned int source[24*24], pixels[24*24];
+    ICONIMAGE image;
+    int i;
+    bool same;
+    
+    fillRandom(source, 24*24, 1);
+    
+    image.width = image.height = 24;
+    image.pixels = source;
+    resampleIconImage(&image, 24, 24, pixels);
+    
+    same = true;
+    for (i = 0; i < 24*24; i++)
+    {
+        if (pixels[i] != ((source[i] >> 24) ? source[i] : 0)) same = false;  /* fully transparent pixels are 0 */
+    }
+    CHECK(same);
+}
+
+static void testTransparent()
+{
+    unsigned int *source, *pixels, color;
+    ICONIMAGE image;
+    int i, k, x, y, count;
+    bool red, partial;
+    
+    // Opaque red on left of each row and transparent green on right - output is red wherever not transparent, and
+    // partly transparent along edge
+    
+    for (i = 0; i < CASES; i++)
+    {
+        count = cases[i].sourceWidth*cases[i].sourceHeight;
+        source = new unsigned int[count];
+        for (y = 0; y < cases[i].sourceHeight; y++)
+        {
+            for (x = 0; x < cases[i].sourceWidth; x++)
+            {
+                source[y*cases[i].sourceWidth + x] = (x < cases[i].sourceWidth/2) ? 0xFFFF0000 : 0x0000FF00;
+            }
+        }
+        
+        image.width = cases[i].sourceWidth;
+        image.height = cases[i].sourceHeight;
+        image.pixels = source;
+        
+        pixels = new unsigned int[cases[i].width*cases[i].height];
+        resampleIconImage(&image, cases[i].width, cases[i].height, pixels);
+        
+        red = true;
+        partial = false;
+        for (k = 0; k < cases[i].width*cases[i].height; k++)
+        {
+            color = pixels[k];
+            if (color != 0 && (color & 0xFFFFFF) != 0xFF0000) red = false;
+            if ((color >> 24) != 0 && (color >> 24) != 0xFF) partial = true;
+        }
+        CHECK(red);
+        CHECK(partial || cases[i].width == cases[i].sourceWidth);
+        
+        delete[] source;
+        delete[] pixels;
+    }
+}
+
+static void testScalar()
+{
+    unsigned int *source, *pixels, *scalarPixels;
+    ICONIMAGE image;
+    int i, k;
+    bool same;
+    
+    // Same to within one per channel - the scalar sums may be compiled to fused multiply-adds
+    
+    for (i = 0; i < CASES; i++)
+    {
+        source = new unsigned int[cases[i].sourceWidth*cases[i].sourceHeight];
+        fillRandom(source, cases[i].sourceWidth*cases[i].sourceHeight, 2 + i);
+        
+        image.width = cases[i].sourceWidth;
+        image.height = cases[i].sourceHeight;
+        image.pixels = source;
+        
+        pixels = new unsigned int[cases[i].width*cases[i].height];
+        scalarPixels = new unsigned int[cases[i].width*cases[i].height];
+        resampleIconImage(&image, cases[i].width, cases[i].height, pixels);
+        scalar::resampleIconImage(&image, cases[i].width, cases[i].height, scalarPixels);
+        
+        same = true;
+        for (k = 0; k < cases[i].width*cases[i].height; k++) if (!closePixels(pixels[k], scalarPixels[k])) same = false;
+        CHECK(same);
+        
+        delete[] source;
+        delete[] pixels;
+        delete[] scalarPixels;
+    }
+}
+
+static void testLargestFrame()
+{
+    static const int icon[] = { 16, 32, 0, 48 };
+    static const int small[] = { 24, 16 };
+    unsigned char *data;
+    size_t size;
+    
+    data = makeDirectory(icon, 4, 4, &size);
+    CHECK(findLargestIconFrame(data, size) == 256);  /* width 0 is 256 */
+    CHECK(findLargestIconFrame(data, 6 + 3*16 - 1) == 32);  /* only complete entries */
+    CHECK(findLargestIconFrame(data, 5) == 0);
+    data[2] = 2;  /* cursor */
+    CHECK(findLargestIconFrame(data, size) == 0);
+    data[2] = 1;
+    data[1] = 1;  /* reserved */
+    CHECK(findLargestIconFrame(data, size) == 0);
+    delete[] data;
+    
+    data = makeDirectory(small, 2, 2, &size);
+    CHECK(findLargestIconFrame(data, size) == 24);
+    delete[] data;
+    
+    data = makeDirectory(icon, 4, 2, &size);  /* fewer entries listed than present */
+    CHECK(findLargestIconFrame(data, size) == 32);
+    delete[] data;
+    
+    data = makeDirectory(small, 2, 0, &size);
+    CHECK(findLargestIconFrame(data, size) == 0);
+    delete[] data;
+}
+
+//
+// Random pixels (alpha 0 to 255, one in eight fully transparent with random color)
+//
+static void fillRandom(unsigned int *pixels, int count, unsigned int seed)
+{
+    int i;
+    
+    for (i = 0; i < count; i++)
+    {
+        seed = seed*1664525 + 1013904223;
+        pixels[i] = (seed >> 29 == 0) ? seed & 0xFFFFFF : seed ^ (seed << 13);
+    }
+}
+
+static bool closePixels(unsigned int pixel, unsigned int other)
+{
+    int c, difference;
+    
+    for (c = 0; c < 32; c += 8)
+    {
+        difference = (int) ((pixel >> c) & 0xFF) - (int) ((other >> c) & 0xFF);
+        if (difference < -1 || difference > 1) return false;
+    }
+    
+    return true;
+}
+
+//
+// Icon directory (header and 16-byte entries, no images) - count listed in header may differ from entries written
+//
+static unsigned char *makeDirectory(const int *widths, int count, unsigned int listed, size_t *size)
+{
+    unsigned char *data;
+    int i;
+    
+    *size = 6 + count*16;
+    data = new unsigned char[*size];
+    memset(data, 0, *size);
+    
+    data[2] = 1;
+    data[4] = (unsigned char) listed;
+    data[5] = (unsigned char) (listed >> 8);
+    
+    for (i = 0; i < count; i++)
+    {
+        data[6+i*16] = (unsigned char) widths[i];
+        data[6+i*16+1] = (unsigned char) widths[i];
+    }
+    
+    return data;
+}
@@ -0,0 +1,168 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// DatTool - offline inspection and migration of CustomizeToolbar.dat files
+//
+// Usage:
+//   DatTool inspect <file.dat> ...                  show detected version, menu item states and buttons
+//   DatTool convert <file.dat> ... [-o <dir>]       rewrite files in current format (in place, or into directory)
+//
+// Build (any platform, no Windows dependencies):
+//   cl /O2 /EHsc /Iinc tools\DatTool.cpp src\DatFile.cpp
+//   g++ -O2 -Iinc tools/DatTool.cpp src/DatFile.cpp -o DatTool
+//
+// Each file is read whole, decoded once and (for convert) written with a single write,
+// so that a whole directory of backed-up .dat files can be migrated in one run
+
+#include "DatFile.h"
+#include <stdio.h>
+#include <string.h>
+
+#define HASHFLAG 0x80000000
+
+// Local functions
+
+static bool readDatFile(const char *path, DATLAYOUT *layout);
+static bool writeDatFile(const char *path, const DATLAYOUT *layout);
+static void inspectLayout(const char *path, const DATLAYOUT *layout);
+static void printButtons(const char *title, const unsigned int *buttons, int count);
+static const char *baseName(const char *path);
+
+int main(int argc, char *argv[])
+{
+    static DATLAYOUT layout;
+    char outPath[1024];
+    const char *outDir;
+    bool convert;
+    int i, failed, converted;
+    
+    if (argc < 3 || (strcmp(argv[1], "inspect") != 0 && strcmp(argv[1], "convert") != 0))
+    {
+        fprintf(stderr, "Usage: DatTool inspect <file.dat> ...\n");
+        fprintf(stderr, "       DatTool convert <file.dat> ... [-o <dir>]\n");
+        return 2;
+    }
+    
+    convert = (strcmp(argv[1], "convert") == 0);
+    
+    // Output directory (convert only)
+    
+    outDir = NULL;
+    if (convert && argc >= 5 && strcmp(argv[argc-2], "-o") == 0)
+    {
+        outDir = argv[argc-1];
+        argc -= 2;
+    }
+    
+    failed = converted = 0;
+    
+    for (i = 2; i < argc; i++)
+    {
+        if (!readDatFile(argv[i], &layout))
+        {
+            fprintf(stderr, "%s: not a recognised CustomizeToolbar.dat file\n", argv[i]);
+            failed++;
+            continue;
+        }
+        
+        if (!convert)
+        {
+            inspectLayout(argv[i], &layout);
+            continue;
+        }
+        
+        if (outDir) snprintf(outPath, sizeof(outPath), "%s/%s", outDir, baseName(argv[i]));
+        else snprintf(outPath, sizeof(outPath), "%s", argv[i]);
+        
+        if (!writeDatFile(outPath, &layout))
+        {
+            fprintf(stderr, "%s: cannot write file\n", outPath);
+            failed++;
+            continue;
+        }
+        
+        printf("%s: %s -> %s\n", outPath, datFormatName(layout.format), datFormatName(DATFORMAT_V30));
+        converted++;
+    }
+    
+    if (convert) printf("%d converted, %d failed\n", converted, failed);
+    
+    return failed ? 1 : 0;
+}
+
+static bool readDatFile(const char *path, DATLAYOUT *layout)
+{
+    FILE *file;
+    unsigned char data[DATMAXSIZE+1];
+    size_t size;
+    
+    file = fopen(path, "rb");
+    if (!file) return false;
+    
+    size = fread(data, 1, sizeof(data), file);  /* one byte extra to detect oversized files */
+    fclose(file);
+    
+    return parseDatLayout(data, size, layout) != DATFORMAT_UNKNOWN;
+}
+
+static bool writeDatFile(const char *path, const DATLAYOUT *layout)
+{
+    FILE *file;
+    unsigned char data[DATMAXSIZE];
+    size_t size;
+    bool ok;
+    
+    size = formatDatLayout(layout, data);
+    
+    file = fopen(path, "wb");
+    if (!file) return false;
+    
+    ok = (fwrite(data, 1, size, file) == size);
+    ok = (fclose(file) == 0) && ok;
+    
+    return ok;
+}
+
+static void inspectLayout(const char *path, const DATLAYOUT *layout)
+{
+    printf("%s\n", path);
+    printf("  version:          %s\n", datFormatName(layout->format));
+    
+    if (layout->format != DATFORMAT_V12 && layout->format != DATFORMAT_V20)
+        printf("  custom buttons:   %s\n", layout->customButtonsState ? "on" : "off");
+    if (layout->format != DATFORMAT_V12)
+        printf("  wrap toolbar:     %s\n", layout->wrapToolbarState ? "on" : "off");
+    if (layout->format == DATFORMAT_V310)
+        printf("  margin buttons:   %d %d %d (not used by current version)\n", layout->marginStates[0] != 0, layout->marginStates[1] != 0, layout->marginStates[2] != 0);
+    
+    printButtons("on toolbar", layout->toolbar, layout->buttonsOnToolbar);
+    printButtons("available", layout->available, layout->buttonsAvailable);
+}
+
+static void printButtons(const char *title, const unsigned int *buttons, int count)
+{
+    int i;
+    
+    printf("  %s: %d\n", title, count);
+    
+    for (i = 0; i < count; i++)
+    {
+        if (buttons[i] == 0) printf("    %3d  separator\n", i);
+        else if (buttons[i] & HASHFLAG) printf("    %3d  menuhash %08X\n", i, buttons[i]);
+        else printf("    %3d  cmdid    %u\n", i, buttons[i]);
+    }
+}
+
+static const char *baseName(const char *path)
+{
+    const char *name;
+    
+    name = path;
+    for (; *path; path++)
+    {
+        if (*path == '/' || *path == '\\') name = path + 1;
+    }
+    
+    return name;
+}
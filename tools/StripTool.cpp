@@ -0,0 +1,348 @@
+// This file is part of Customize Toolbar, a plugin for Notepad++
+// Copyright (C) 2011-2021 DW-dev (dw-dev@gmx.com)
+// Copyright (C) 2024+     QGtKMlLz    E-mail: 3m33dkojb@mozmail.com
+
+// StripTool - packs additional button images into one strip per icon style
+//
+// Usage:
+//   StripTool <list.txt> <bitmaps.bmp> <icons.bmp>
+//
+//   StripTool res\additional_buttons.txt res\additional_buttons.bmp res\additional_icons.bmp
+//
+// Build (any platform, no Windows dependencies):
+//   cl /O2 /EHsc tools\StripTool.cpp
+//   g++ -O2 tools/StripTool.cpp -o StripTool
+//
+// The list file names one button per line (a semi-colon starts a comment), and each name.bmp and name.ico
+// is read from the directory of the list file. Frames are stacked vertically, first button at top, so that
+// each frame is contiguous when the strip is read top row first.
+//
+// Standard strip - 8-bit bitmap with palette merged from all bitmaps, so LoadImage still maps the transparent
+// colour (first pixel) and 3D colours. Every bitmap must have the same transparent colour (bottom left pixel).
+// Fluent strip - 32-bit bitmap (RGB+alpha) of the 32x32 frame of each icon
+//
+// Run again after changing any additional button image or the list, and rebuild the plugin
+
+#include <stdio.h>
+#include <string.h>
+
+#define STRIPMAXFRAMES 64
+#define STRIPMAXFILE 65536
+#define BITMAPSIZE 16
+#define ICONSIZE 32
+
+typedef struct
+{
+    unsigned char index[BITMAPSIZE*BITMAPSIZE];  /* merged palette indexes, top row first */
+    unsigned int key;  /* transparent colour (bottom left pixel) */
+} STRIPBITMAP;
+
+// Local functions
+
+static int readList(const char *path, char names[][256], int maxNames);
+static size_t readFile(const char *path, unsigned char *data, size_t maxSize);
+static bool readBitmap(const char *path, STRIPBITMAP *frame, unsigned int *palette, int *paletteCount);
+static bool readIcon(const char *path, unsigned int *pixels);
+static bool writeStrip(const char *path, int width, int height, int bitCount, const unsigned int *palette, int paletteCount, const unsigned char *bits);
+static unsigned int readValue(const unsigned char *data, int size);
+static void writeValue(unsigned char *data, unsigned int value, int size);
+
+int main(int argc, char *argv[])
+{
+    static char names[STRIPMAXFRAMES][256];
+    static STRIPBITMAP bitmaps[STRIPMAXFRAMES];
+    static unsigned int icons[STRIPMAXFRAMES][ICONSIZE*ICONSIZE];
+    static unsigned char bitmapBits[STRIPMAXFRAMES*BITMAPSIZE*BITMAPSIZE];
+    static unsigned char iconBits[STRIPMAXFRAMES*ICONSIZE*ICONSIZE*4];
+    unsigned int palette[256];
+    char dir[1024], path[1536];
+    const char *slash;
+    int i, y, count, paletteCount, height;
+    
+    if (argc != 4)
+    {
+        fprintf(stderr, "Usage: StripTool <list.txt> <bitmaps.bmp> <icons.bmp>\n");
+        return 2;
+    }
+    
+    count = readList(argv[1], names, STRIPMAXFRAMES);
+    if (count <= 0)
+    {
+        fprintf(stderr, "%s: cannot read list (or list is empty)\n", argv[1]);
+        return 1;
+    }
+    
+    // Directory of list file
+    
+    slash = NULL;
+    for (i = 0; argv[1][i]; i++)
+    {
+        if (argv[1][i] == '/' || argv[1][i] == '\\') slash = argv[1] + i;
+    }
+    if (slash) snprintf(dir, sizeof(dir), "%.*s", (int) (slash - argv[1] + 1), argv[1]);
+    else dir[0] = 0;
+    
+    // Decode every frame
+    
+    paletteCount = 0;
+    
+    for (i = 0; i < count; i++)
+    {
+        snprintf(path, sizeof(path), "%s%.255s.bmp", dir, names[i]);
+        if (!readBitmap(path, &bitmaps[i], palette, &paletteCount))
+        {
+            fprintf(stderr, "%s: not a %dx%d 8-bit bitmap (or merged palette exceeds 256 colours)\n", path, BITMAPSIZE, BITMAPSIZE);
+            return 1;
+        }
+        if (bitmaps[i].key != bitmaps[0].key)
+        {
+            fprintf(stderr, "%s: transparent colour %06X differs from first bitmap (%06X)\n", path, bitmaps[i].key, bitmaps[0].key);
+            return 1;
+        }
+        
+        snprintf(path, sizeof(path), "%s%.255s.ico", dir, names[i]);
+        if (!readIcon(path, icons[i]))
+        {
+            fprintf(stderr, "%s: no %dx%d 32-bit image in icon\n", path, ICONSIZE, ICONSIZE);
+            return 1;
+        }
+    }
+    
+    // Stack frames, first frame at top (strips are written bottom row first)
+    
+    height = count*BITMAPSIZE;
+    for (i = 0; i < count; i++)
+    {
+        for (y = 0; y < BITMAPSIZE; y++)
+            memcpy(&bitmapBits[(height-1-(i*BITMAPSIZE+y))*BITMAPSIZE], &bitmaps[i].index[y*BITMAPSIZE], BITMAPSIZE);
+    }
+    
+    height = count*ICONSIZE;
+    for (i = 0; i < count; i++)
+    {
+        for (y = 0; y < ICONSIZE*ICONSIZE; y++)
+            writeValue(&iconBits[((height-1-(i*ICONSIZE+y/ICONSIZE))*ICONSIZE+y%ICONSIZE)*4], icons[i][y], 4);
+    }
+    
+    if (!writeStrip(argv[2], BITMAPSIZE, count*BITMAPSIZE, 8, palette, paletteCount, bitmapBits))
+    {
+        fprintf(stderr, "%s: cannot write file\n", argv[2]);
+        return 1;
+    }
+    if (!writeStrip(argv[3], ICONSIZE, count*ICONSIZE, 32, NULL, 0, iconBits))
+    {
+        fprintf(stderr, "%s: cannot write file\n", argv[3]);
+        return 1;
+    }
+    
+    printf("%d frames, %d colours: %s, %s\n", count, paletteCount, argv[2], argv[3]);
+    
+    return 0;
+}
+
+static int readList(const char *path, char names[][256], int maxNames)
+{
+    FILE *file;
+    char line[256];
+    int count, length;
+    
+    file = fopen(path, "r");
+    if (!file) return -1;
+    
+    count = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        length = (int) strlen(line);
+        while (length > 0 && (line[length-1] == '\n' || line[length-1] == '\r' || line[length-1] == ' ')) line[--length] = 0;
+        if (length == 0 || line[0] == ';') continue;
+        
+        if (count == maxNames)
+        {
+            count = -1;
+            break;
+        }
+        strcpy(names[count++], line);
+    }
+    
+    fclose(file);
+    
+    return count;
+}
+
+static size_t readFile(const char *path, unsigned char *data, size_t maxSize)
+{
+    FILE *file;
+    size_t size;
+    
+    file = fopen(path, "rb");
+    if (!file) return 0;
+    
+    size = fread(data, 1, maxSize, file);
+    fclose(file);
+    
+    return size;
+}
+
+static bool readBitmap(const char *path, STRIPBITMAP *frame, unsigned int *palette, int *paletteCount)
+{
+    static unsigned char data[STRIPMAXFILE];
+    unsigned int colors[256], color;
+    size_t size, offset, headerSize;
+    int x, y, i, used;
+    
+    size = readFile(path, data, sizeof(data));
+    if (size < 54 || data[0] != 'B' || data[1] != 'M') return false;
+    
+    offset = readValue(&data[10], 4);
+    headerSize = readValue(&data[14], 4);
+    if ((int) readValue(&data[18], 4) != BITMAPSIZE || (int) readValue(&data[22], 4) != BITMAPSIZE) return false;  /* bottom-up only */
+    if (readValue(&data[28], 2) != 8 || readValue(&data[30], 4) != 0) return false;  /* 8-bit, uncompressed */
+    if (offset + BITMAPSIZE*BITMAPSIZE > size) return false;
+    
+    used = (int) readValue(&data[46], 4);
+    if (used == 0 || used > 256) used = 256;
+    if (14 + headerSize + used*4 > offset) return false;
+    
+    for (i = 0; i < used; i++) colors[i] = readValue(&data[14+headerSize+i*4], 4) & 0x00FFFFFF;
+    
+    frame->key = colors[data[offset]];  /* first pixel (bottom left) */
+    
+    // Merge palette - transparent colour is first entry
+    
+    if (*paletteCount == 0) palette[(*paletteCount)++] = frame->key;
+    
+    for (y = 0; y < BITMAPSIZE; y++)
+    {
+        for (x = 0; x < BITMAPSIZE; x++)
+        {
+            color = colors[data[offset+(BITMAPSIZE-1-y)*BITMAPSIZE+x]];  /* rows are 16 bytes (already aligned) */
+            
+            for (i = 0; i < *paletteCount; i++)
+            {
+                if (palette[i] == color) break;
+            }
+            if (i == *paletteCount)
+            {
+                if (*paletteCount == 256) return false;
+                palette[(*paletteCount)++] = color;
+            }
+            
+            frame->index[y*BITMAPSIZE+x] = (unsigned char) i;
+        }
+    }
+    
+    return true;
+}
+
+static bool readIcon(const char *path, unsigned int *pixels)
+{
+    static unsigned char data[STRIPMAXFILE];
+    size_t size, offset;
+    int i, x, y, count, width, height, stride;
+    bool alpha;
+    
+    size = readFile(path, data, sizeof(data));
+    if (size < 6 || readValue(&data[0], 2) != 0 || readValue(&data[2], 2) != 1) return false;
+    
+    count = (int) readValue(&data[4], 2);
+    
+    for (i = 0; i < count && 6 + i*16 + 16 <= (int) size; i++)
+    {
+        offset = readValue(&data[6+i*16+12], 4);
+        if (offset + 40 > size || readValue(&data[offset], 4) != 40) continue;  /* PNG frames not packed */
+        
+        width = (int) readValue(&data[offset+4], 4);
+        height = (int) readValue(&data[offset+8], 4)/2;  /* colour and mask */
+        if (width != ICONSIZE || height != ICONSIZE || readValue(&data[offset+14], 2) != 32) continue;
+        
+        offset += 40;
+        stride = ((ICONSIZE+31)/32)*4;
+        if (offset + ICONSIZE*ICONSIZE*4 + ICONSIZE*stride > size) return false;
+        
+        alpha = false;
+        for (y = 0; y < ICONSIZE; y++)
+        {
+            for (x = 0; x < ICONSIZE; x++)
+            {
+                pixels[y*ICONSIZE+x] = readValue(&data[offset+((ICONSIZE-1-y)*ICONSIZE+x)*4], 4);
+                if (pixels[y*ICONSIZE+x] & 0xFF000000) alpha = true;
+            }
+        }
+        
+        // Icon without alpha channel - opaque where mask is clear
+        
+        if (!alpha)
+        {
+            offset += ICONSIZE*ICONSIZE*4;
+            for (y = 0; y < ICONSIZE; y++)
+            {
+                for (x = 0; x < ICONSIZE; x++)
+                {
+                    if ((data[offset+(ICONSIZE-1-y)*stride+x/8] & (0x80 >> (x%8))) == 0) pixels[y*ICONSIZE+x] |= 0xFF000000;
+                }
+            }
+        }
+        
+        return true;
+    }
+    
+    return false;
+}
+
+static bool writeStrip(const char *path, int width, int height, int bitCount, const unsigned int *palette, int paletteCount, const unsigned char *bits)
+{
+    FILE *file;
+    unsigned char header[54+256*4];
+    size_t headerSize, bitsSize;
+    int i;
+    bool ok;
+    
+    headerSize = 54 + paletteCount*4;
+    bitsSize = (size_t) width*height*bitCount/8;  /* 16 and 32 pixel rows are already aligned */
+    
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    writeValue(&header[2], (unsigned int) (headerSize + bitsSize), 4);
+    writeValue(&header[10], (unsigned int) headerSize, 4);
+    writeValue(&header[14], 40, 4);
+    writeValue(&header[18], width, 4);
+    writeValue(&header[22], height, 4);  /* bottom-up */
+    writeValue(&header[26], 1, 2);
+    writeValue(&header[28], bitCount, 2);
+    writeValue(&header[34], (unsigned int) bitsSize, 4);
+    writeValue(&header[46], paletteCount, 4);
+    writeValue(&header[50], paletteCount, 4);
+    for (i = 0; i < paletteCount; i++) writeValue(&header[54+i*4], palette[i], 4);
+    
+    file = fopen(path, "wb");
+    if (!file) return false;
+    
+    ok = (fwrite(header, 1, headerSize, file) == headerSize);
+    ok = (fwrite(bits, 1, bitsSize, file) == bitsSize) && ok;
+    ok = (fclose(file) == 0) && ok;
+    
+    return ok;
+}
+
+static unsigned int readValue(const unsigned char *data, int size)
+{
+    unsigned int value;
+    int i;
+    
+    value = 0;
+    for (i = size-1; i >= 0; i--) value = (value << 8) | data[i];
+    
+    return value;
+}
+
+static void writeValue(unsigned char *data, unsigned int value, int size)
+{
+    int i;
+    
+    for (i = 0; i < size; i++)
+    {
+        data[i] = (unsigned char) (value & 0xFF);
+        value >>= 8;
+    }
+}